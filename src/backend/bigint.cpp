@@ -0,0 +1,362 @@
+#include "backend/bigint.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <span>
+
+namespace TwoPy::Backend {
+    namespace {
+        using Limb = BigInt::Limb;
+        using Limbs = BigInt::Limbs;
+        using Wide = std::uint64_t;
+
+        constexpr unsigned limb_bits = 32;
+        constexpr Limb decimal_base = 1'000'000'000;     // largest power of 10 in a limb
+        constexpr unsigned decimal_digits = 9;
+
+        void trim(Limbs& limbs) noexcept {
+            while (!limbs.empty() && limbs.back() == 0) {
+                limbs.pop_back();
+            }
+        }
+
+        int compare_magnitude(std::span<const Limb> lhs, std::span<const Limb> rhs) noexcept {
+            if (lhs.size() != rhs.size()) {
+                return lhs.size() < rhs.size() ? -1 : 1;
+            }
+            for (std::size_t i = lhs.size(); i-- > 0;) {
+                if (lhs[i] != rhs[i]) {
+                    return lhs[i] < rhs[i] ? -1 : 1;
+                }
+            }
+            return 0;
+        }
+
+        /* target += value * base^shift, `target` grows as needed */
+        void add_into(Limbs& target, std::span<const Limb> value, std::size_t shift) {
+            if (target.size() < value.size() + shift) {
+                target.resize(value.size() + shift, 0);
+            }
+
+            Wide carry = 0;
+            std::size_t i = 0;
+            for (; i < value.size(); i++) {
+                Wide sum = Wide {target[shift + i]} + value[i] + carry;
+                target[shift + i] = static_cast<Limb>(sum);
+                carry = sum >> limb_bits;
+            }
+            for (std::size_t j = shift + i; carry != 0; j++) {
+                if (j == target.size()) {
+                    target.push_back(0);
+                }
+                Wide sum = Wide {target[j]} + carry;
+                target[j] = static_cast<Limb>(sum);
+                carry = sum >> limb_bits;
+            }
+        }
+
+        /* target -= value, |target| >= |value| */
+        void subtract_from(Limbs& target, std::span<const Limb> value) noexcept {
+            Limb borrow = 0;
+            for (std::size_t i = 0; i < target.size(); i++) {
+                Wide sub = Wide {i < value.size() ? value[i] : 0} + borrow;
+                borrow = Wide {target[i]} < sub ? 1 : 0;
+                target[i] = static_cast<Limb>(Wide {target[i]} - sub);
+                if (i >= value.size() && borrow == 0) {
+                    break;
+                }
+            }
+            trim(target);
+        }
+
+        Limbs add_magnitude(std::span<const Limb> lhs, std::span<const Limb> rhs) {
+            Limbs result(lhs.begin(), lhs.end());
+            add_into(result, rhs, 0);
+            return result;
+        }
+
+        Limbs multiply_schoolbook(std::span<const Limb> lhs, std::span<const Limb> rhs) {
+            if (lhs.empty() || rhs.empty()) {
+                return {};
+            }
+
+            Limbs result(lhs.size() + rhs.size(), 0);
+            for (std::size_t i = 0; i < lhs.size(); i++) {
+                Wide carry = 0;
+                for (std::size_t j = 0; j < rhs.size(); j++) {
+                    Wide prod = Wide {lhs[i]} * rhs[j] + result[i + j] + carry;
+                    result[i + j] = static_cast<Limb>(prod);
+                    carry = prod >> limb_bits;
+                }
+                result[i + rhs.size()] = static_cast<Limb>(carry);
+            }
+            trim(result);
+            return result;
+        }
+
+        std::span<const Limb> trimmed(std::span<const Limb> limbs) noexcept {
+            while (!limbs.empty() && limbs.back() == 0) {
+                limbs = limbs.first(limbs.size() - 1);
+            }
+            return limbs;
+        }
+
+        Limbs multiply(std::span<const Limb> lhs, std::span<const Limb> rhs) {
+            lhs = trimmed(lhs);
+            rhs = trimmed(rhs);
+            if (lhs.size() < rhs.size()) {
+                std::swap(lhs, rhs);
+            }
+            if (rhs.size() < BigInt::karatsuba_threshold) {
+                return multiply_schoolbook(lhs, rhs);
+            }
+
+            std::size_t half = lhs.size() / 2;
+            auto lhs_low = lhs.first(half);
+            auto lhs_high = lhs.subspan(half);
+
+            // Lopsided operands: split only the long one, rhs times each half
+            if (rhs.size() <= half) {
+                Limbs result = multiply(lhs_low, rhs);
+                add_into(result, multiply(lhs_high, rhs), half);
+                trim(result);
+                return result;
+            }
+
+            auto rhs_low = rhs.first(half);
+            auto rhs_high = rhs.subspan(half);
+
+            // (a1 B + a0)(b1 B + b0) = z2 B^2 + ((a1 + a0)(b1 + b0) - z2 - z0) B + z0
+            Limbs z0 = multiply(lhs_low, rhs_low);
+            Limbs z2 = multiply(lhs_high, rhs_high);
+            Limbs z1 = multiply(add_magnitude(lhs_low, lhs_high), add_magnitude(rhs_low, rhs_high));
+            subtract_from(z1, z0);
+            subtract_from(z1, z2);
+
+            Limbs result = std::move(z0);
+            add_into(result, z1, half);
+            add_into(result, z2, 2 * half);
+            trim(result);
+            return result;
+        }
+
+        /* limbs = limbs * factor + addend */
+        void multiply_add_small(Limbs& limbs, Limb factor, Limb addend) {
+            Wide carry = addend;
+            for (Limb& limb : limbs) {
+                Wide prod = Wide {limb} * factor + carry;
+                limb = static_cast<Limb>(prod);
+                carry = prod >> limb_bits;
+            }
+            if (carry != 0) {
+                limbs.push_back(static_cast<Limb>(carry));
+            }
+        }
+
+        /* limbs /= divisor, returns the remainder */
+        Limb divide_small(Limbs& limbs, Limb divisor) noexcept {
+            Wide rem = 0;
+            for (std::size_t i = limbs.size(); i-- > 0;) {
+                Wide cur = (rem << limb_bits) | limbs[i];
+                limbs[i] = static_cast<Limb>(cur / divisor);
+                rem = cur % divisor;
+            }
+            trim(limbs);
+            return static_cast<Limb>(rem);
+        }
+
+        /* limbs = limbs * 2 + bit */
+        void shift_left_one(Limbs& limbs, Limb bit) {
+            Limb carry = bit;
+            for (Limb& limb : limbs) {
+                Limb high = limb >> (limb_bits - 1);
+                limb = (limb << 1) | carry;
+                carry = high;
+            }
+            if (carry != 0) {
+                limbs.push_back(carry);
+            }
+        }
+
+        /* Quotient and remainder of the magnitudes, `rhs` isn't zero. Long division a bit at a time
+           unless the divisor is a single limb */
+        std::pair<Limbs, Limbs> divide_magnitude(std::span<const Limb> lhs, std::span<const Limb> rhs) {
+            Limbs quotient(lhs.begin(), lhs.end());
+            if (rhs.size() == 1) {
+                Limb rem = divide_small(quotient, rhs[0]);
+                return {std::move(quotient), rem != 0 ? Limbs {rem} : Limbs {}};
+            }
+
+            std::ranges::fill(quotient, 0);
+            Limbs remainder {};
+            for (std::size_t bit = lhs.size() * limb_bits; bit-- > 0;) {
+                shift_left_one(remainder, (lhs[bit / limb_bits] >> (bit % limb_bits)) & 1);
+                if (compare_magnitude(remainder, rhs) >= 0) {
+                    subtract_from(remainder, rhs);
+                    quotient[bit / limb_bits] |= Limb {1} << (bit % limb_bits);
+                }
+            }
+            trim(quotient);
+            return {std::move(quotient), std::move(remainder)};
+        }
+    }
+
+    BigInt::BigInt(Limbs limbs, bool negative)
+        : m_limbs(std::move(limbs)) {
+        trim(m_limbs);
+        m_negative = negative && !m_limbs.empty();
+    }
+
+    BigInt::BigInt(long value)
+        : m_negative(value < 0) {
+        // Through unsigned so LONG_MIN doesn't overflow on negation
+        auto magnitude = static_cast<unsigned long>(value);
+        if (m_negative) {
+            magnitude = 0 - magnitude;
+        }
+        while (magnitude != 0) {
+            m_limbs.push_back(static_cast<Limb>(magnitude));
+            magnitude >>= limb_bits;
+        }
+    }
+
+    std::optional<BigInt> BigInt::from_string(std::string_view text) {
+        bool negative = false;
+        if (!text.empty() && (text.front() == '-' || text.front() == '+')) {
+            negative = text.front() == '-';
+            text.remove_prefix(1);
+        }
+        if (text.empty()) {
+            return std::nullopt;
+        }
+
+        // Nine digits at a time, the first chunk takes the leftover so the rest are all full
+        Limbs limbs {};
+        std::size_t chunk = text.size() % decimal_digits;
+        if (chunk == 0) {
+            chunk = decimal_digits;
+        }
+        for (std::size_t pos = 0; pos < text.size(); pos += chunk, chunk = decimal_digits) {
+            Limb value = 0;
+            Limb scale = 1;
+            for (char c : text.substr(pos, chunk)) {
+                if (c < '0' || c > '9') {
+                    return std::nullopt;
+                }
+                value = value * 10 + static_cast<Limb>(c - '0');
+                scale *= 10;
+            }
+            multiply_add_small(limbs, scale, value);
+        }
+        return BigInt(std::move(limbs), negative);
+    }
+
+    std::optional<long> BigInt::to_long(long min, long max) const noexcept {
+        if (m_limbs.size() > 2) {
+            return std::nullopt;
+        }
+
+        Wide magnitude = 0;
+        for (std::size_t i = m_limbs.size(); i-- > 0;) {
+            magnitude = (magnitude << limb_bits) | m_limbs[i];
+        }
+
+        if (m_negative) {
+            if (magnitude > static_cast<Wide>(0) - static_cast<Wide>(min)) {
+                return std::nullopt;
+            }
+            return static_cast<long>(0 - magnitude);
+        }
+        if (magnitude > static_cast<Wide>(max)) {
+            return std::nullopt;
+        }
+        return static_cast<long>(magnitude);
+    }
+
+    double BigInt::to_double() const noexcept {
+        double result = 0.0;
+        for (std::size_t i = m_limbs.size(); i-- > 0;) {
+            result = std::ldexp(result, limb_bits) + m_limbs[i];
+        }
+        return m_negative ? -result : result;
+    }
+
+    std::string BigInt::to_string() const {
+        if (m_limbs.empty()) {
+            return "0";
+        }
+
+        // Peel off nine decimal digits per division, least significant chunk first
+        Limbs rest = m_limbs;
+        std::vector<Limb> chunks {};
+        while (!rest.empty()) {
+            chunks.push_back(divide_small(rest, decimal_base));
+        }
+
+        std::string result = m_negative ? "-" : "";
+        result += std::to_string(chunks.back());
+        for (std::size_t i = chunks.size() - 1; i-- > 0;) {
+            std::string digits = std::to_string(chunks[i]);
+            result.append(decimal_digits - digits.size(), '0');
+            result += digits;
+        }
+        return result;
+    }
+
+    BigInt BigInt::operator-() const {
+        return BigInt(m_limbs, !m_negative);
+    }
+
+    BigInt BigInt::abs() const {
+        return BigInt(m_limbs, false);
+    }
+
+    BigInt operator+(const BigInt& lhs, const BigInt& rhs) {
+        if (lhs.m_negative == rhs.m_negative) {
+            return BigInt(add_magnitude(lhs.m_limbs, rhs.m_limbs), lhs.m_negative);
+        }
+
+        // Opposite signs: the bigger magnitude wins and keeps its sign
+        if (compare_magnitude(lhs.m_limbs, rhs.m_limbs) >= 0) {
+            Limbs result = lhs.m_limbs;
+            subtract_from(result, rhs.m_limbs);
+            return BigInt(std::move(result), lhs.m_negative);
+        }
+        Limbs result = rhs.m_limbs;
+        subtract_from(result, lhs.m_limbs);
+        return BigInt(std::move(result), rhs.m_negative);
+    }
+
+    BigInt operator-(const BigInt& lhs, const BigInt& rhs) {
+        return lhs + -rhs;
+    }
+
+    BigInt operator*(const BigInt& lhs, const BigInt& rhs) {
+        return BigInt(multiply(lhs.m_limbs, rhs.m_limbs), lhs.m_negative != rhs.m_negative);
+    }
+
+    std::pair<BigInt, BigInt> BigInt::floor_divmod(const BigInt& lhs, const BigInt& rhs) {
+        auto [quotient, remainder] = divide_magnitude(lhs.m_limbs, rhs.m_limbs);
+        BigInt floor_quotient(std::move(quotient), lhs.m_negative != rhs.m_negative);
+        BigInt modulo(std::move(remainder), lhs.m_negative);
+
+        // That division truncated, a remainder whose sign isn't the divisor's moves over by one divisor
+        if (!modulo.is_zero() && lhs.m_negative != rhs.m_negative) {
+            floor_quotient = floor_quotient - BigInt(1L);
+            modulo = modulo + rhs;
+        }
+        return {std::move(floor_quotient), std::move(modulo)};
+    }
+
+    std::strong_ordering operator<=>(const BigInt& lhs, const BigInt& rhs) noexcept {
+        if (lhs.m_negative != rhs.m_negative) {
+            return lhs.m_negative ? std::strong_ordering::less : std::strong_ordering::greater;
+        }
+
+        int cmp = compare_magnitude(lhs.m_limbs, rhs.m_limbs);
+        if (lhs.m_negative) {
+            cmp = -cmp;
+        }
+        return cmp <=> 0;
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef TWOPY_BIGINT_HPP
+#define TWOPY_BIGINT_HPP
+
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "backend/objects.hpp"
+
+/*
+Arbitrary-precision ints. Only the slow path: an int lives in the Value as a machine word for as
+long as it fits, arithmetic checks for overflow and only then moves over to a BigInt. Results
+that fit in a word again go back to being immediates (see make_int() in operations.hpp), so a
+BigIntPyObject is always outside the immediate range.
+
+Sign and magnitude, the magnitude in base 2^32 limbs, least significant first, no leading zero
+limbs (zero is no limbs at all). Multiplication is schoolbook below karatsuba_threshold limbs and
+Karatsuba above it. Division is long division, a bit at a time.
+*/
+namespace TwoPy::Backend {
+    class BigInt {
+        public:
+            using Limb = std::uint32_t;
+            using Limbs = std::vector<Limb>;
+
+            static constexpr std::size_t karatsuba_threshold = 32;
+
+        private:
+            Limbs m_limbs {};
+            bool m_negative {};
+
+            BigInt(Limbs limbs, bool negative);
+
+        public:
+            BigInt() = default;
+            explicit BigInt(long value);
+
+            /* Decimal digits with an optional sign, nullopt if there's anything else in `text` */
+            [[nodiscard]] static std::optional<BigInt> from_string(std::string_view text);
+
+            [[nodiscard]] bool is_zero() const noexcept {
+                return m_limbs.empty();
+            }
+
+            [[nodiscard]] bool is_negative() const noexcept {
+                return m_negative;
+            }
+
+            [[nodiscard]] std::size_t limb_count() const noexcept {
+                return m_limbs.size();
+            }
+
+            /* The value as a long if it lies within [min, max] */
+            [[nodiscard]] std::optional<long> to_long(long min, long max) const noexcept;
+
+            [[nodiscard]] double to_double() const noexcept;
+            [[nodiscard]] std::string to_string() const;
+
+            [[nodiscard]] BigInt operator-() const;
+            [[nodiscard]] BigInt abs() const;
+
+            friend BigInt operator+(const BigInt& lhs, const BigInt& rhs);
+            friend BigInt operator-(const BigInt& lhs, const BigInt& rhs);
+            friend BigInt operator*(const BigInt& lhs, const BigInt& rhs);
+
+            /* Python's // and % at once: the quotient rounds toward negative infinity, the remainder
+               takes the divisor's sign. `rhs` isn't zero */
+            [[nodiscard]] static std::pair<BigInt, BigInt> floor_divmod(const BigInt& lhs, const BigInt& rhs);
+
+            friend std::strong_ordering operator<=>(const BigInt& lhs, const BigInt& rhs) noexcept;
+            friend bool operator==(const BigInt& lhs, const BigInt& rhs) noexcept = default;
+    };
+
+    class BigIntPyObject : public ObjectBase {
+        private:
+            BigInt m_value;
+
+        public:
+            explicit BigIntPyObject(BigInt value)
+                : ObjectBase(ObjectTag::BIGINT), m_value(std::move(value)) {}
+
+            [[nodiscard]] const BigInt& value() const noexcept {
+                return m_value;
+            }
+
+            std::string stringify() override {
+                return m_value.to_string();
+            }
+
+            // Never zero, zero always fits in an immediate
+            bool is_truthy() const noexcept override {
+                return true;
+            }
+    };
+}
+
+#endif
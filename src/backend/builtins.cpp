@@ -0,0 +1,404 @@
+#include "backend/builtins.hpp"
+#include "backend/operations.hpp"
+
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+#include <fmt/core.h>
+
+namespace TwoPy::Backend {
+    namespace {
+        void expect_args(std::string_view name, std::span<const Value> args, std::size_t min, std::size_t max) {
+            if (args.size() < min || args.size() > max) {
+                throw std::runtime_error(fmt::format("TypeError: {}() got {} arguments", name, args.size()));
+            }
+        }
+
+        Value builtin_print(NativeContext& ctx, std::span<const Value> args) {
+            for (std::size_t i = 0; i < args.size(); i++) {
+                if (i > 0) ctx.out.write(" ");
+
+                // Numbers format straight into the buffer, no temporary string per argument
+                const Value& arg = args[i];
+                if (arg.is_int()) {
+                    ctx.out.format("{}", arg.as_int());
+                } else if (arg.is_float()) {
+                    ctx.out.format("{:f}", arg.as_float());
+                } else if (auto str = as_string(arg)) {
+                    ctx.out.write(str->view());
+                } else {
+                    ctx.out.write(arg.to_string());
+                }
+            }
+            ctx.out.end_line();
+            return Value {};
+        }
+
+        Value builtin_len(NativeContext&, std::span<const Value> args) {
+            expect_args("len", args, 1, 1);
+
+            if (auto str = as_string(args[0])) {
+                return Value(static_cast<long>(str->length()));
+            }
+            if (auto range = as_range(args[0])) {
+                return Value(range->length());
+            }
+            if (auto list = as_list(args[0])) {
+                return Value(static_cast<long>(list->size()));
+            }
+            if (auto dict = as_dict(args[0])) {
+                return Value(static_cast<long>(dict->size()));
+            }
+            throw std::runtime_error("TypeError: object has no len()");
+        }
+
+        Value builtin_range(NativeContext&, std::span<const Value> args) {
+            expect_args("range", args, 1, 3);
+
+            for (const auto& arg : args) {
+                if (!arg.is_int() && !arg.is_bool()) {
+                    throw std::runtime_error("TypeError: range() arguments must be integers");
+                }
+            }
+
+            long start = args.size() == 1 ? 0L : args[0].to_long();
+            long stop = args.size() == 1 ? args[0].to_long() : args[1].to_long();
+            long step = args.size() == 3 ? args[2].to_long() : 1L;
+            if (step == 0) {
+                throw std::runtime_error("ValueError: range() arg 3 must not be zero");
+            }
+
+            return Value(make_object<RangePyObject>(start, stop, step));
+        }
+
+        Value builtin_int(NativeContext&, std::span<const Value> args) {
+            expect_args("int", args, 0, 1);
+            if (args.empty()) {
+                return Value(0L);
+            }
+
+            if (auto str = as_string(args[0])) {
+                std::string_view text = str->view();
+                if (auto result = parse_int(text)) {
+                    return *result;
+                }
+                throw std::runtime_error(fmt::format("ValueError: invalid literal for int(): '{}'", text));
+            }
+            if (as_bigint(args[0]) != nullptr) {
+                return args[0];
+            }
+            if (is_number(args[0])) {
+                return make_int(args[0].to_long());
+            }
+            throw std::runtime_error("TypeError: int() argument must be a string or a number");
+        }
+
+        Value builtin_float(NativeContext&, std::span<const Value> args) {
+            expect_args("float", args, 0, 1);
+            if (args.empty()) {
+                return Value(0.0);
+            }
+
+            if (auto str = as_string(args[0])) {
+                std::string_view text = str->view();
+                double result {};
+                auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), result);
+                if (ec != std::errc {} || end != text.data() + text.size()) {
+                    throw std::runtime_error(fmt::format("ValueError: could not convert string to float: '{}'", text));
+                }
+                return Value(double {result});
+            }
+            if (is_number(args[0])) {
+                return Value(to_double(args[0]));
+            }
+            throw std::runtime_error("TypeError: float() argument must be a string or a number");
+        }
+
+        Value builtin_str(NativeContext&, std::span<const Value> args) {
+            expect_args("str", args, 0, 1);
+            // Strings are immutable, str() of one is the same object
+            if (!args.empty() && is_string(args[0])) {
+                return args[0];
+            }
+            return Value(StringPyObject::make(args.empty() ? std::string {} : args[0].to_string()));
+        }
+
+        Value builtin_list(NativeContext& ctx, std::span<const Value> args) {
+            expect_args("list", args, 0, 1);
+
+            if (args.empty()) {
+                return Value(ctx.heap.make<ListPyObject>());
+            }
+
+            std::vector<Value> items {};
+            if (auto list = as_list(args[0])) {
+                items.assign(list->items().begin(), list->items().end());
+            } else if (auto range = as_range(args[0])) {
+                items.reserve(static_cast<std::size_t>(range->length()));
+                for (long i = 0, count = range->length(); i < count; i++) {
+                    items.emplace_back(long {range->start() + i * range->step()});
+                }
+            } else {
+                throw std::runtime_error(fmt::format("TypeError: '{}' object is not iterable", type_name(args[0])));
+            }
+            return Value(ctx.heap.make<ListPyObject>(std::move(items)));
+        }
+
+        Value builtin_dict(NativeContext& ctx, std::span<const Value> args) {
+            expect_args("dict", args, 0, 1);
+
+            auto result = ctx.heap.make<DictPyObject>();
+            if (args.empty()) {
+                return Value(std::move(result));
+            }
+
+            auto source = as_dict(args[0]);
+            if (source == nullptr) {
+                throw std::runtime_error(fmt::format("TypeError: '{}' object is not iterable", type_name(args[0])));
+            }
+            for (const auto& entry : source->entries()) {
+                if (entry.live()) {
+                    result->store(ctx.heap, entry.key, entry.value);
+                }
+            }
+            return Value(std::move(result));
+        }
+
+        Value builtin_abs(NativeContext&, std::span<const Value> args) {
+            expect_args("abs", args, 1, 1);
+
+            if (args[0].is_float()) {
+                return Value(std::fabs(args[0].as_float()));
+            }
+            if (auto big = as_bigint(args[0])) {
+                return make_int(big->value().abs());
+            }
+            if (args[0].is_int() || args[0].is_bool()) {
+                long val = args[0].to_long();
+                if (long negated {}; val < 0) {
+                    return small_sub(0, val, negated) ? Value(long {negated}) : make_int(-BigInt(val));
+                }
+                return Value(long {val});
+            }
+            throw std::runtime_error("TypeError: bad operand type for abs()");
+        }
+
+        /* min() and max() take either several values or one range */
+        Value pick_extreme(std::string_view name, std::span<const Value> args, CompareOp better) {
+            if (args.empty()) {
+                throw std::runtime_error(fmt::format("TypeError: {}() expected at least 1 argument, got 0", name));
+            }
+
+            if (auto list = args.size() == 1 ? as_list(args[0]) : nullptr) {
+                if (list->size() == 0) {
+                    throw std::runtime_error(fmt::format("ValueError: {}() arg is an empty sequence", name));
+                }
+                return pick_extreme(name, list->items(), better);
+            }
+
+            if (args.size() == 1) {
+                auto range = as_range(args[0]);
+                if (range == nullptr) {
+                    throw std::runtime_error(fmt::format("TypeError: {}() argument is not iterable", name));
+                }
+                if (range->length() == 0) {
+                    throw std::runtime_error(fmt::format("ValueError: {}() arg is an empty sequence", name));
+                }
+
+                bool ascending = range->step() > 0;
+                bool want_first = (better == CompareOp::LT) == ascending;
+                return Value(want_first ? range->start() : range->last());
+            }
+
+            const Value* best = &args[0];
+            for (const auto& arg : args.subspan(1)) {
+                auto result = compare_values(better, arg, *best);
+                if (!result) {
+                    throw std::runtime_error(fmt::format("TypeError: '{}' not supported between these types", name));
+                }
+                if (*result) {
+                    best = &arg;
+                }
+            }
+            return *best;
+        }
+
+        Value builtin_min(NativeContext&, std::span<const Value> args) {
+            return pick_extreme("min", args, CompareOp::LT);
+        }
+
+        Value builtin_max(NativeContext&, std::span<const Value> args) {
+            return pick_extreme("max", args, CompareOp::GT);
+        }
+
+        Value builtin_sum(NativeContext&, std::span<const Value> args) {
+            expect_args("sum", args, 1, 2);
+
+            if (auto list = as_list(args[0])) {
+                Value total = args.size() == 2 ? args[1] : Value(0L);
+                for (const auto& item : list->items()) {
+                    if (!is_number(item) || !is_number(total)) {
+                        throw std::runtime_error(fmt::format("TypeError: unsupported operand type(s) for +: '{}' and '{}'", type_name(total), type_name(item)));
+                    }
+                    total = binary_add(total, item);
+                }
+                return total;
+            }
+
+            auto range = as_range(args[0]);
+            if (range == nullptr) {
+                throw std::runtime_error("TypeError: sum() argument is not iterable");
+            }
+
+            Value start = args.size() == 2 ? args[1] : Value(0L);
+            long count = range->length();
+            if (count == 0) {
+                return start;
+            }
+
+            // Arithmetic series, no need to walk the range. Halving before multiplying keeps it exact
+            Value first(range->start());
+            Value last(range->last());
+            Value series = count % 2 == 0
+                ? binary_mul(make_int(count / 2), binary_add(first, last))
+                : binary_mul(make_int(count), Value(range->start() + (count / 2) * range->step()));
+            return binary_add(start, series);
+        }
+
+        /* Methods get self as their first argument */
+        Value list_append(NativeContext& ctx, std::span<const Value> args) {
+            expect_args("append", args, 2, 2);
+            as_list(args[0])->append(ctx.heap, args[1]);
+            return Value {};
+        }
+
+        Value list_pop(NativeContext&, std::span<const Value> args) {
+            expect_args("pop", args, 1, 2);
+
+            ListPyObject* list = as_list(args[0]);
+            if (list->size() == 0) {
+                throw std::runtime_error("IndexError: pop from empty list");
+            }
+            if (args.size() == 1) {
+                return list->pop_back();
+            }
+
+            auto pos = list->position(subscript_index(args[1]));
+            if (!pos) {
+                throw std::runtime_error("IndexError: pop index out of range");
+            }
+            return list->erase(*pos);
+        }
+
+        Value dict_get(NativeContext&, std::span<const Value> args) {
+            expect_args("get", args, 2, 3);
+
+            if (const Value* found = as_dict(args[0])->find(args[1])) {
+                return *found;
+            }
+            return args.size() == 3 ? args[2] : Value {};
+        }
+
+        Value dict_pop(NativeContext&, std::span<const Value> args) {
+            expect_args("pop", args, 2, 3);
+
+            if (auto removed = as_dict(args[0])->remove(args[1])) {
+                return std::move(*removed);
+            }
+            if (args.size() == 3) {
+                return args[2];
+            }
+            throw std::runtime_error(fmt::format("KeyError: {}", repr(args[1])));
+        }
+
+        struct BuiltinEntry {
+            std::string_view name;
+            NativeFn fn;
+        };
+
+        struct MethodEntry {
+            ObjectTag owner;
+            std::string_view name;
+            NativeFn fn;
+        };
+
+        constexpr std::array<MethodEntry, 4> method_entries {{
+            {ObjectTag::LIST, "append", list_append},
+            {ObjectTag::LIST, "pop", list_pop},
+            {ObjectTag::DICT, "get", dict_get},
+            {ObjectTag::DICT, "pop", dict_pop},
+        }};
+
+        struct MethodSlot {
+            ObjectTag owner;
+            ObjectRef<StringPyObject> name;     // interned, like the names the compiler emits
+            Value fn;
+        };
+
+        const std::array<MethodSlot, method_entries.size()>& method_table() {
+            static const auto table = [] {
+                std::array<MethodSlot, method_entries.size()> slots {};
+                for (std::size_t i = 0; i < method_entries.size(); i++) {
+                    const auto& entry = method_entries[i];
+                    slots[i] = {entry.owner, StringPyObject::intern(entry.name), Value(make_object<NativeFunctionPyObject>(entry.name, entry.fn))};
+                }
+                return slots;
+            }();
+            return table;
+        }
+
+        constexpr std::array<BuiltinEntry, 12> builtin_entries {{
+            {"print", builtin_print},
+            {"len", builtin_len},
+            {"range", builtin_range},
+            {"int", builtin_int},
+            {"float", builtin_float},
+            {"str", builtin_str},
+            {"list", builtin_list},
+            {"dict", builtin_dict},
+            {"abs", builtin_abs},
+            {"min", builtin_min},
+            {"max", builtin_max},
+            {"sum", builtin_sum},
+        }};
+
+        const std::array<Value, builtin_entries.size()>& builtin_table() {
+            static const auto table = [] {
+                std::array<Value, builtin_entries.size()> values {};
+                for (std::size_t i = 0; i < builtin_entries.size(); i++) {
+                    values[i] = Value(make_object<NativeFunctionPyObject>(builtin_entries[i].name, builtin_entries[i].fn));
+                }
+                return values;
+            }();
+            return table;
+        }
+    }
+
+    std::optional<std::uint8_t> find_builtin(std::string_view name) noexcept {
+        for (std::size_t i = 0; i < builtin_entries.size(); i++) {
+            if (builtin_entries[i].name == name) {
+                return static_cast<std::uint8_t>(i);
+            }
+        }
+        return std::nullopt;
+    }
+
+    const Value& builtin(std::uint8_t index) {
+        return builtin_table()[index];
+    }
+
+    std::string_view builtin_name(std::uint8_t index) {
+        return builtin_entries[index].name;
+    }
+
+    const Value* find_method(ObjectTag owner, const StringPyObject& name) noexcept {
+        for (const auto& slot : method_table()) {
+            if (slot.owner == owner && *slot.name == name) {
+                return &slot.fn;
+            }
+        }
+        return nullptr;
+    }
+}
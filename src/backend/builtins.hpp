@@ -0,0 +1,69 @@
+#ifndef TWOPY_BUILTINS_HPP
+#define TWOPY_BUILTINS_HPP
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "backend/gc.hpp"
+#include "backend/objects.hpp"
+#include "backend/output_buffer.hpp"
+#include "backend/value.hpp"
+
+/*
+The builtins module. Every builtin is created once, up front, and called through a plain
+function pointer. Python-level errors (TypeError, ValueError...) are thrown as std::runtime_error
+and the VM turns them into a RUNTIME_ERROR.
+*/
+namespace TwoPy::Backend {
+    /* The parts of the calling VM a builtin can reach */
+    struct NativeContext {
+        OutputBuffer& out;
+        Heap& heap;     // containers a builtin creates are tracked here
+    };
+
+    using NativeFn = Value (*)(NativeContext& ctx, std::span<const Value> args);
+
+    class NativeFunctionPyObject : public ObjectBase {
+        private:
+            std::string_view m_name;
+            NativeFn m_fn;
+
+        public:
+            NativeFunctionPyObject(std::string_view name, NativeFn fn)
+                : ObjectBase(ObjectTag::NATIVE_FUNCTION), m_name(name), m_fn(fn) {}
+
+            [[nodiscard]] std::string_view name() const noexcept {
+                return m_name;
+            }
+
+            [[nodiscard]] Value call(NativeContext& ctx, std::span<const Value> args) const {
+                return m_fn(ctx, args);
+            }
+
+            std::string stringify() override {
+                return fmt::format("<built-in function {}>", m_name);
+            }
+
+            bool is_truthy() const noexcept override {
+                return true;
+            }
+    };
+
+    /* Index into the builtins table, what LOAD_BUILTIN carries */
+    [[nodiscard]] std::optional<std::uint8_t> find_builtin(std::string_view name) noexcept;
+
+    [[nodiscard]] const Value& builtin(std::uint8_t index);
+
+    [[nodiscard]] std::string_view builtin_name(std::uint8_t index);
+
+    class StringPyObject;
+
+    /* The native behind `name` on objects tagged `owner`, what LOAD_METHOD looks up. Natives are
+       called with self as their first argument */
+    [[nodiscard]] const Value* find_method(ObjectTag owner, const StringPyObject& name) noexcept;
+}
+
+#endif
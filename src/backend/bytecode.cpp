@@ -1,6 +1,12 @@
 #include "backend/bytecode.hpp"
+#include "backend/builtins.hpp"
+#include "backend/operations.hpp"
 
+#include <algorithm>
+#include <bit>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
 #include <fmt/core.h>
 
 /*
@@ -9,10 +15,11 @@ One would be to use std::hold_alternative which you'll have to manually check
 or use std::visit which allows for more cleaner code in the future.
 */
 namespace TwoPy::Backend {
-    compiler::compiler(const TwoPy::Frontend::Program& program)
-        : m_program(program), m_scope_depth(0) {
+    compiler::compiler(const TwoPy::Frontend::Program& program, bool inline_calls)
+        : m_program(program), m_scope_depth(0), m_inline_calls(inline_calls) {
         m_bytecode_program.name = "<module>";
         auto module_chunk = std::make_shared<Chunk>();
+        module_chunk->name = "<module>";
         m_bytecode_program.chunks.push_back(module_chunk);
         m_curr_chunk = module_chunk;
     }
@@ -23,6 +30,12 @@ namespace TwoPy::Backend {
         }
 
         emit_return_none();
+        resolve_jumps();
+        resolve_builtins();
+
+        for (auto& chunk : m_bytecode_program.chunks) {
+            chunk->max_stack = max_stack_depth(*chunk);
+        }
         return m_bytecode_program;
     }
 
@@ -41,6 +54,13 @@ namespace TwoPy::Backend {
             } else {
                 throw std::runtime_error("Something went wrong");
             }
+
+            // Assignments consume their value, anything else leaves one behind (mirrors CPython's POP_TOP)
+            auto* ops = std::get_if<TwoPy::Frontend::OperatorsType>(&expr_stmt->expression->node);
+            if (ops == nullptr || !std::holds_alternative<TwoPy::Frontend::AssignmentOp>(*ops)) {
+                m_curr_chunk->code.push_back({OpCode::POP});
+                m_curr_chunk->byte_offset += 2;
+            }
         }
 
         if (auto* func_def = std::get_if<TwoPy::Frontend::FunctionDef>(&stmt.node)) {
@@ -51,9 +71,31 @@ namespace TwoPy::Backend {
              disassemble_if_stmt(*if_stmt);
         }
 
+        if (auto* for_stmt = std::get_if<TwoPy::Frontend::ForStmt>(&stmt.node)) {
+            disassemble_for_stmt(*for_stmt);
+        }
+
+        if (auto* while_stmt = std::get_if<TwoPy::Frontend::WhileStmt>(&stmt.node)) {
+            disassemble_while_stmt(*while_stmt);
+        }
+
+        if (std::holds_alternative<TwoPy::Frontend::BreakStmt>(stmt.node)) {
+            disassemble_break_stmt();
+        }
+
+        if (std::holds_alternative<TwoPy::Frontend::ContinueStmt>(stmt.node)) {
+            disassemble_continue_stmt();
+        }
+
         if (auto* return_stmt = std::get_if<TwoPy::Frontend::ReturnStmt>(&stmt.node)) {
             if (return_stmt->value) {
                 disassemble_expr(*return_stmt->value);
+
+                // `return f(...)` in a function: nothing of the frame is needed after the call, the callee can have it
+                bool is_call = std::holds_alternative<TwoPy::Frontend::CallExpr>(return_stmt->value->node);
+                if (is_call && m_curr_chunk != m_bytecode_program.chunks.front() && m_curr_chunk->code.back().opcode == OpCode::CALL_FUNCTION) {
+                    m_curr_chunk->code.back().opcode = OpCode::TAIL_CALL;
+                }
             } else {
                 emit_return_none();
                 return;
@@ -67,61 +109,208 @@ namespace TwoPy::Backend {
     void compiler::disassemble_body_stmt(const TwoPy::Frontend::Block& blk) {
         for (const auto& s : blk.statements) {
             disassemble_instruction(s);
-            m_curr_chunk->code.push_back({OpCode::POP});
-            m_curr_chunk->byte_offset += 2;
         }
+    }
 
-        emit_return_none();
+    void compiler::disassemble_condition(const TwoPy::Frontend::ExprNode& condition, bool jump_if, std::vector<std::size_t>& jumps) {
+        if (auto* ops = std::get_if<TwoPy::Frontend::OperatorsType>(&condition.node)) {
+            auto* p_and = std::get_if<TwoPy::Frontend::AndOp>(ops);
+            auto* p_or = std::get_if<TwoPy::Frontend::OrOp>(ops);
+            if (p_and != nullptr || p_or != nullptr) {
+                const auto& left = p_and != nullptr ? *p_and->left : *p_or->left;
+                const auto& right = p_and != nullptr ? *p_and->right : *p_or->right;
+
+                // `a and b` is false as soon as a is, `a or b` true as soon as a is: then both sides jump alike
+                if (jump_if == (p_or != nullptr)) {
+                    disassemble_condition(left, jump_if, jumps);
+                    disassemble_condition(right, jump_if, jumps);
+                    return;
+                }
+
+                // Otherwise a settling it the other way skips b and falls through
+                std::vector<std::size_t> skips {};
+                disassemble_condition(left, !jump_if, skips);
+                disassemble_condition(right, jump_if, jumps);
+                for (auto skip : skips) {
+                    patch_jump(skip);
+                }
+                return;
+            }
+        }
+
+        disassemble_expr(condition);
+        jumps.push_back(emit_jump(jump_if ? OpCode::POP_JUMP_IF_TRUE : OpCode::POP_JUMP_IF_FALSE));
+    }
+
+    std::optional<std::size_t> compiler::disassemble_branch(const TwoPy::Frontend::ExprNode& condition, const TwoPy::Frontend::Block& body, bool needs_end_jump) {
+        std::vector<std::size_t> false_jumps {};
+        disassemble_condition(condition, false, false_jumps);
+
+        disassemble_body_stmt(body);
+
+        std::optional<std::size_t> end_jump {};
+        if (needs_end_jump) {
+            end_jump = emit_jump(OpCode::JUMP_FORWARD);
+        }
+
+        for (auto fj : false_jumps) {
+            patch_jump(fj);
+        }
+
+        return end_jump;
     }
 
     void compiler::disassemble_if_stmt(const TwoPy::Frontend::IfStmt& stmt) {
-        disassemble_expr(*stmt.condition);
+        const bool has_else = stmt.else_branch != nullptr;
+        std::vector<std::size_t> end_jumps {};
+
+        if (auto end_jump = disassemble_branch(*stmt.condition, stmt.body, !stmt.elifs.empty() || has_else)) {
+            end_jumps.push_back(*end_jump);
+        }
 
-        auto jmp = emit_jump(OpCode::POP_JUMP_IF_FALSE);
+        for (std::size_t i = 0; i < stmt.elifs.size(); i++) {
+            if (auto end_jump = disassemble_elif_stmt(stmt.elifs[i], i + 1 < stmt.elifs.size() || has_else)) {
+                end_jumps.push_back(*end_jump);
+            }
+        }
 
-        for (auto tj : truthy_jumps) {
-            patch_jump(tj);
+        if (has_else) {
+            disassemble_body_stmt(stmt.else_branch->body);
         }
-        truthy_jumps.clear();
 
+        for (auto ej : end_jumps) {
+            patch_jump(ej);
+        }
+    }
+
+    void compiler::disassemble_for_stmt(const TwoPy::Frontend::ForStmt& stmt) {
+        if (!stmt.iterable || !*stmt.iterable) {
+            throw std::runtime_error("for loop without an iterable");
+        }
+
+        disassemble_expr(**stmt.iterable);
+        m_curr_chunk->code.push_back({OpCode::GET_ITER});
+        m_curr_chunk->byte_offset += 2;
+
+        // FOR_ITER is the loop head, the back-edge returns to it and it jumps out once the iterable runs dry
+        std::size_t loop_start = m_curr_chunk->byte_offset;
+        std::size_t exit_jump = emit_jump(OpCode::FOR_ITER);
+        disassemble_identifier_assignment_expr(stmt.variable);
+
+        m_loops.push_back({.start = loop_start, .breaks = {}, .is_for = true});
         disassemble_body_stmt(stmt.body);
 
-        patch_jump(jmp);
+        emit_loop(loop_start);
+        patch_jump(exit_jump);
+        end_loop();
+    }
+
+    void compiler::disassemble_while_stmt(const TwoPy::Frontend::WhileStmt& stmt) {
+        // The condition is the loop header, every pass runs it again
+        std::size_t loop_start = m_curr_chunk->byte_offset;
+        std::vector<std::size_t> exit_jumps {};
+        disassemble_condition(*stmt.condition, false, exit_jumps);
 
-        for (auto pj : pending_jumps) {
-            patch_jump(pj);
+        m_loops.push_back({.start = loop_start, .breaks = {}, .is_for = false});
+        disassemble_body_stmt(stmt.body);
+
+        emit_loop(loop_start);
+        for (auto ej : exit_jumps) {
+            patch_jump(ej);
         }
-        pending_jumps.clear();
+        end_loop();
+    }
 
-        if (stmt.else_branch != nullptr) {
-            disassemble_body_stmt(stmt.else_branch->body);
+    void compiler::disassemble_break_stmt() {
+        if (m_loops.empty()) {
+            throw std::runtime_error("'break' outside loop");
         }
 
-        for (const auto& stmt : stmt.elifs) {
-            disassemble_elif_stmt(stmt);
+        // A for loop's exit edge drops the iterable and its position, a break has to do the same on its way out
+        if (m_loops.back().is_for) {
+            for (int i = 0; i < 2; i++) {
+                m_curr_chunk->code.push_back({OpCode::POP});
+                m_curr_chunk->byte_offset += 2;
+            }
         }
+        m_loops.back().breaks.push_back(emit_jump(OpCode::JUMP_FORWARD));
     }
 
-    void compiler::disassemble_elif_stmt(const TwoPy::Frontend::ElifStmt& stmt) {
-        disassemble_expr(*stmt.condition);
+    void compiler::disassemble_continue_stmt() {
+        if (m_loops.empty()) {
+            throw std::runtime_error("'continue' not properly in loop");
+        }
+        emit_loop(m_loops.back().start);
+    }
 
-        auto jmp = emit_jump(OpCode::POP_JUMP_IF_FALSE);
+    void compiler::end_loop() {
+        for (auto brk : m_loops.back().breaks) {
+            patch_jump(brk);
+        }
+        m_loops.pop_back();
+    }
 
-        for (auto tj : truthy_jumps) {
-            patch_jump(tj);
+    void compiler::resolve_jumps() {
+        resolve_jump_targets(*m_curr_chunk, m_jumps);
+        m_jumps.clear();
+    }
+
+    void resolve_jump_targets(Chunk& chunk, const std::vector<JumpSite>& jumps) {
+        auto& code = chunk.code;
+
+        std::vector<std::optional<std::size_t>> targets(code.size());
+        for (const auto& jump : jumps) {
+            targets[jump.index] = jump.target / 2;
         }
-        truthy_jumps.clear();
 
-        disassemble_body_stmt(stmt.body);
+        /* Each EXTENDED_ARG moves everything after it up by one, which can push other targets past
+           one byte, so this goes round until no new prefix is needed. A jump to a prefixed
+           instruction lands on its prefix. */
+        std::vector<bool> extended(code.size());
+        std::vector<std::size_t> moved(code.size() + 1);
+        for (bool changed = true; changed;) {
+            changed = false;
+
+            std::size_t shift = 0;
+            for (std::size_t i = 0; i < moved.size(); i++) {
+                moved[i] = i + shift;
+                if (i < code.size() && extended[i]) {
+                    shift++;
+                }
+            }
 
-        patch_jump(jmp);
+            for (std::size_t i = 0; i < code.size(); i++) {
+                if (targets[i] && !extended[i] && moved[*targets[i]] * 2 > UINT8_MAX) {
+                    extended[i] = true;
+                    changed = true;
+                }
+            }
+        }
 
-        for (auto pj : pending_jumps) {
-            patch_jump(pj);
+        std::vector<Instruction> resolved;
+        resolved.reserve(moved.back());
+        for (std::size_t i = 0; i < code.size(); i++) {
+            Instruction instr = code[i];
+            if (targets[i]) {
+                std::size_t offset = moved[*targets[i]] * 2;
+                if (offset > UINT16_MAX) {
+                    throw std::runtime_error("Jump target out of range");
+                }
+                if (extended[i]) {
+                    resolved.push_back({.opcode = OpCode::EXTENDED_ARG, .argument = static_cast<std::uint8_t>(offset >> 8)});
+                }
+                instr.argument = static_cast<std::uint8_t>(offset & 0xFF);
+            }
+            resolved.push_back(instr);
         }
-        pending_jumps.clear();
+
+        code = std::move(resolved);
+        chunk.byte_offset = code.size() * 2;
     }
 
+    std::optional<std::size_t> compiler::disassemble_elif_stmt(const TwoPy::Frontend::ElifStmt& stmt, bool needs_end_jump) {
+        return disassemble_branch(*stmt.condition, stmt.body, needs_end_jump);
+    }
 
     void compiler::disassemble_expr(const TwoPy::Frontend::ExprNode& expr) {
         if (auto* callee = std::get_if<TwoPy::Frontend::CallExpr>(&expr.node)) {
@@ -141,80 +330,78 @@ namespace TwoPy::Backend {
         if (auto* ident = std::get_if<TwoPy::Frontend::Identifier>(&expr.node)) {
             disassemble_identifier_expr(*ident);
         }
+
+        if (auto* list = std::get_if<TwoPy::Frontend::ListExpr>(&expr.node)) {
+            disassemble_list_expr(*list);
+        }
+
+        if (auto* dict = std::get_if<TwoPy::Frontend::DictExpr>(&expr.node)) {
+            disassemble_dict_expr(*dict);
+        }
+
+        if (auto* subscript = std::get_if<TwoPy::Frontend::ListIndexExpr>(&expr.node)) {
+            disassemble_subscript_operands(*subscript);
+            m_curr_chunk->code.push_back({OpCode::BINARY_SUBSCR});
+            m_curr_chunk->byte_offset += 2;
+        }
+
+        if (std::holds_alternative<TwoPy::Frontend::AttributeExpr>(expr.node)) {
+            throw std::runtime_error("Attributes can only be called as methods");
+        }
     }
 
     void compiler::disassemble_identifier_expr(const TwoPy::Frontend::Identifier& iden) {
-        std::uint8_t var_index;
-
-        // if local 
-        if (m_scope_depth > 0){
-            if (!local_vars.contains(iden.token.value)) {
-                m_curr_chunk->names_pool.push_back(iden.token.value);
-                var_index = static_cast<std::uint8_t>(m_curr_chunk->names_pool.size() - 1);
-                local_vars.insert({iden.token.value, var_index});
+        if (m_inline_params != nullptr) {
+            auto param = m_inline_params->find(iden.token.value);
+            if (param != m_inline_params->end()) {
+                m_curr_chunk->code.push_back({OpCode::LOAD_FAST, param->second});
             } else {
-                var_index = local_vars.at(iden.token.value);
+                m_curr_chunk->code.push_back({OpCode::LOAD_NAME, global_slot(iden.token.value)});
             }
-
-            m_curr_chunk->code.push_back({OpCode::LOAD_FAST, var_index});
             m_curr_chunk->byte_offset += 2;
-        } else {
-            if (!global_vars.contains(iden.token.value)) {
-                m_curr_chunk->names_pool.push_back(iden.token.value);
-                var_index = static_cast<std::uint8_t>(m_curr_chunk->names_pool.size() - 1);
-                global_vars.insert({iden.token.value, var_index});
-            } else {
-                /// NOTE: .at() throws if it doesn't find the data
-                var_index = global_vars.at(iden.token.value);
-            }
+            return;
+        }
 
-            m_curr_chunk->code.push_back({OpCode::LOAD_NAME, var_index});
-            m_curr_chunk->byte_offset += 2;
-        }    
+        // Inside a function only its parameters and assigned names are fast locals, anything else is a global or builtin
+        if (m_scope_depth > 0 && local_vars.contains(iden.token.value)) {
+            m_curr_chunk->code.push_back({OpCode::LOAD_FAST, local_vars.at(iden.token.value)});
+        } else {
+            m_curr_chunk->code.push_back({OpCode::LOAD_NAME, global_slot(iden.token.value)});
+        }
+        m_curr_chunk->byte_offset += 2;
     }
 
     void compiler::disassemble_identifier_assignment_expr(const TwoPy::Frontend::Identifier& iden) {
-        std::uint8_t var_index;
-
         // Locals
         if (m_scope_depth > 0) {
-            if (!local_vars.contains(iden.token.value)) {
-                m_curr_chunk->names_pool.push_back(iden.token.value);
-                var_index = static_cast<std::uint8_t>(m_curr_chunk->names_pool.size() - 1);
-                local_vars.insert({iden.token.value, var_index});
-            } else {
-                /// NOTE: .at() throws if it doesn't find the data
-                var_index = local_vars.at(iden.token.value);
-            }
-            
-            m_curr_chunk->code.push_back({OpCode::STORE_FAST, var_index});
-            m_curr_chunk->byte_offset += 2;  
+            m_curr_chunk->code.push_back({OpCode::STORE_FAST, local_slot(iden.token.value)});
         } else { // Globals
-            if (!global_vars.contains(iden.token.value)) {
-                m_curr_chunk->names_pool.push_back(iden.token.value);
-                var_index = static_cast<std::uint8_t>(m_curr_chunk->names_pool.size() - 1);
-                global_vars.insert({iden.token.value, var_index});
-            } else {
-                /// NOTE: .at() throws if it doesn't find the data
-                var_index = global_vars.at(iden.token.value);
-            }
-            
-            m_curr_chunk->code.push_back({OpCode::STORE_NAME, var_index});
-            m_curr_chunk->byte_offset += 2;  
+            m_curr_chunk->code.push_back({OpCode::STORE_NAME, global_slot(iden.token.value)});
         }
+        m_curr_chunk->byte_offset += 2;
     }
 
     void compiler::disassemble_operators(const TwoPy::Frontend::OperatorsType& ops) {
         if (auto* assign = std::get_if<TwoPy::Frontend::AssignmentOp>(&ops)) {
+            // Checked before the value is emitted so a rejected statement leaves nothing behind
+            auto* ident = assign->target ? std::get_if<TwoPy::Frontend::Identifier>(&assign->target->node) : nullptr;
+            auto* subscript = assign->target ? std::get_if<TwoPy::Frontend::ListIndexExpr>(&assign->target->node) : nullptr;
+            if (assign->target && ident == nullptr && subscript == nullptr) {
+                throw std::runtime_error("Cannot assign to this target");
+            }
+
             if (assign->value) {
                 disassemble_expr(*assign->value);
             }
 
-            if (assign->target) {
-                if (auto* ident = std::get_if<TwoPy::Frontend::Identifier>(&assign->target->node)) {
-                    disassemble_identifier_assignment_expr(*ident);
-                }
+            if (ident != nullptr) {
+                disassemble_identifier_assignment_expr(*ident);
+            } else if (subscript != nullptr) {
+                disassemble_subscript_operands(*subscript);
+                m_curr_chunk->code.push_back({OpCode::STORE_SUBSCR});
+                m_curr_chunk->byte_offset += 2;
             }
+            return;
         }
 
         if (auto* term = std::get_if<TwoPy::Frontend::TermOp>(&ops)) {
@@ -255,28 +442,45 @@ namespace TwoPy::Backend {
         }
 
         if (auto* compare = std::get_if<TwoPy::Frontend::EqualityOp>(&ops)) {
-            disassemble_expr(*compare->left);
-            disassemble_expr(*compare->right);
-
-            m_curr_chunk->code.push_back({OpCode::COMPARE_OP});
-            m_curr_chunk->byte_offset += 2;
+            CompareOp op = compare->op.value == "==" ? CompareOp::EQ : CompareOp::NE;
+            disassemble_compare_expr(op, *compare->left, *compare->right);
 
             return;
         } 
+
+        if (auto* compare = std::get_if<TwoPy::Frontend::ComparisonOp>(&ops)) {
+            const std::string& op = compare->op.value;
+            CompareOp cmp = CompareOp::LT;
+            if (op == "<=") {
+                cmp = CompareOp::LE;
+            } else if (op == ">") {
+                cmp = CompareOp::GT;
+            } else if (op == ">=") {
+                cmp = CompareOp::GE;
+            }
+
+            disassemble_compare_expr(cmp, *compare->left, *compare->right);
+
+            return;
+        }
  
         if (auto* _and = std::get_if<TwoPy::Frontend::AndOp>(&ops)) {
             disassemble_and_expr(*_and);
+            return;
         }
 
         if (auto* _or = std::get_if<TwoPy::Frontend::OrOp>(&ops)) {
             disassemble_or_expr(*_or);
-        } 
+            return;
+        }
+
+        // +=, ** and the bitwise operators parse but have no opcodes yet, emitting nothing would unbalance the stack
+        throw std::runtime_error("Operator not supported by the compiler");
     }
 
     void compiler::disassemble_literals(const TwoPy::Frontend::Literals& lits) {
         if (auto* int_lit = std::get_if<TwoPy::Frontend::IntegerLiteral>(&lits)) {
-            m_curr_chunk->consts_pool.emplace_back(std::stol(int_lit->token.value));
-            std::uint8_t const_index = static_cast<std::uint8_t>(m_curr_chunk->consts_pool.size() - 1);
+            std::uint8_t const_index = intern_constant(m_curr_chunk->consts_pool, int_literal(int_lit->token.value));
 
             m_curr_chunk->code.push_back({OpCode::LOAD_CONSTANT, const_index});
             m_curr_chunk->byte_offset += 2;
@@ -284,8 +488,7 @@ namespace TwoPy::Backend {
         }
 
         if (auto* float_lit = std::get_if<TwoPy::Frontend::FloatLiteral>(&lits)) {
-            m_curr_chunk->consts_pool.emplace_back(std::stod(float_lit->token.value));
-            std::uint8_t const_index = static_cast<std::uint8_t>(m_curr_chunk->consts_pool.size() - 1);
+            std::uint8_t const_index = intern_constant(m_curr_chunk->consts_pool, Value(std::stod(float_lit->token.value)));
 
             m_curr_chunk->code.push_back({OpCode::LOAD_CONSTANT, const_index});
             m_curr_chunk->byte_offset += 2;
@@ -293,11 +496,9 @@ namespace TwoPy::Backend {
         }
 
         if (auto* string_lit = std::get_if<TwoPy::Frontend::StringLiteral>(&lits)) {
-            auto str_obj = std::make_shared<StringPyObject>(string_lit->token.value);
-
-            m_curr_chunk->consts_pool.emplace_back(str_obj);
+            auto str_obj = StringPyObject::literal(string_lit->token.value);
 
-            std::uint8_t const_index = static_cast<std::uint8_t>(m_curr_chunk->consts_pool.size() - 1);
+            std::uint8_t const_index = intern_constant(m_curr_chunk->consts_pool, Value(std::move(str_obj)));
 
             m_curr_chunk->code.push_back({OpCode::LOAD_CONSTANT, const_index});
             m_curr_chunk->byte_offset += 2;
@@ -305,8 +506,7 @@ namespace TwoPy::Backend {
         }
 
         if (auto* bool_lit = std::get_if<TwoPy::Frontend::BoolLiteral>(&lits)) {
-            m_curr_chunk->consts_pool.emplace_back(bool_lit->token.value == "True");
-            std::uint8_t const_index = static_cast<std::uint8_t>(m_curr_chunk->consts_pool.size() - 1);
+            std::uint8_t const_index = intern_constant(m_curr_chunk->consts_pool, Value(bool {bool_lit->token.value == "True"}));
 
             m_curr_chunk->code.push_back({OpCode::LOAD_CONSTANT, const_index});
             m_curr_chunk->byte_offset += 2;
@@ -315,6 +515,54 @@ namespace TwoPy::Backend {
         }
     }
 
+    namespace {
+        constexpr std::size_t max_inlined_nodes = 16;
+
+        /* Arithmetic, compares, subscripts, names and literals, nothing that calls out or needs a scope of its own */
+        bool inlinable_expr(const TwoPy::Frontend::ExprNode& expr, std::size_t& budget) {
+            if (budget == 0) {
+                return false;
+            }
+            budget--;
+
+            if (std::holds_alternative<TwoPy::Frontend::Literals>(expr.node) || std::holds_alternative<TwoPy::Frontend::Identifier>(expr.node)) {
+                return true;
+            }
+            if (auto* subscript = std::get_if<TwoPy::Frontend::ListIndexExpr>(&expr.node)) {
+                return inlinable_expr(*subscript->list_name, budget) && inlinable_expr(*subscript->index, budget);
+            }
+
+            auto* ops = std::get_if<TwoPy::Frontend::OperatorsType>(&expr.node);
+            if (ops == nullptr) {
+                return false;
+            }
+            return std::visit([&](const auto& op) {
+                using Op = std::decay_t<decltype(op)>;
+                if constexpr (std::is_same_v<Op, TwoPy::Frontend::TermOp> || std::is_same_v<Op, TwoPy::Frontend::FactorOp>) {
+                    return inlinable_expr(*op.left, budget) && inlinable_expr(*op.right, budget);
+                } else if constexpr (std::is_same_v<Op, TwoPy::Frontend::EqualityOp> || std::is_same_v<Op, TwoPy::Frontend::ComparisonOp>) {
+                    return inlinable_expr(*op.left, budget) && inlinable_expr(*op.right, budget);
+                } else {
+                    return false;
+                }
+            }, *ops);
+        }
+
+        /* The body's single `return` value when the function can be inlined, without calls in it there's no recursion either */
+        const TwoPy::Frontend::ExprNode* inlinable_body(const TwoPy::Frontend::FunctionDef& function) {
+            const auto& statements = function.body.statements;
+            if (statements.size() != 1 || statements[0] == nullptr) {
+                return nullptr;
+            }
+            auto* return_stmt = std::get_if<TwoPy::Frontend::ReturnStmt>(&statements[0]->node);
+            if (return_stmt == nullptr || return_stmt->value == nullptr) {
+                return nullptr;
+            }
+            std::size_t budget = max_inlined_nodes;
+            return inlinable_expr(*return_stmt->value, budget) ? return_stmt->value.get() : nullptr;
+        }
+    }
+
     /// TODO: Since I'm Lazy, I forgot to add STORE/LOAD_FAST for local vars 
     void compiler::disassemble_function_object(const TwoPy::Frontend::FunctionDef& function) {
         auto func_chunk = std::make_shared<Chunk>();
@@ -328,11 +576,29 @@ namespace TwoPy::Backend {
         saved_chunk = std::move(m_curr_chunk);
         m_curr_chunk = std::move(func_chunk);
 
+        m_curr_chunk->name = function.token.value;
+
+        // Arguments arrive in the first slots, in parameter order
+        auto saved_locals = std::exchange(local_vars, {});
+        // break/continue can't reach the loops around the def, and the caller's jumps stay pending until its chunk is done
+        auto saved_loops = std::exchange(m_loops, {});
+        auto saved_jumps = std::exchange(m_jumps, {});
+        for (const auto& param : function.params.params) {
+            (void)local_slot(param.token.value);
+        }
+
         init_scope();
         for (const auto& stmt : function.body.statements) {
             disassemble_instruction(stmt);
         }
 
+        // Falling off the end returns None
+        emit_return_none();
+        resolve_jumps();
+
+        local_vars = std::move(saved_locals);
+        m_loops = std::move(saved_loops);
+        m_jumps = std::move(saved_jumps);
         m_curr_chunk = std::move(saved_chunk);
 
         std::vector<std::string> param_names;
@@ -340,45 +606,53 @@ namespace TwoPy::Backend {
             param_names.push_back(param.token.value);
         }
 
-        auto func_obj = std::make_shared<FunctionPyObject>(
+        Value func_obj(make_object<FunctionPyObject>(
             function.token.value, std::move(param_names), func_chunk_index
-        );
+        ));
         end_scope();
 
-        std::uint8_t code_index = static_cast<std::uint8_t>(m_curr_chunk->consts_pool.size());
-        m_curr_chunk->consts_pool.emplace_back(func_obj);
+        // A def inside a function binds a new object on every call, no call site could know which one it'll see
+        const TwoPy::Frontend::ExprNode* body = m_scope_depth == 0 ? inlinable_body(function) : nullptr;
+        if (body != nullptr) {
+            m_inlinable.insert_or_assign(function.token.value, InlineCandidate{.def = &function, .body = body, .function = func_obj});
+        } else {
+            m_inlinable.erase(function.token.value);
+        }
+
+        std::uint8_t code_index = intern_constant(m_curr_chunk->consts_pool, std::move(func_obj));
 
         m_curr_chunk->code.push_back({OpCode::LOAD_CONSTANT, code_index});
         m_curr_chunk->byte_offset += 2;
 
-        auto name_obj = std::make_shared<StringPyObject>(function.token.value);
-        std::uint8_t name_index = static_cast<std::uint8_t>(m_curr_chunk->consts_pool.size());
+        auto name_obj = StringPyObject::intern(function.token.value);
+        std::uint8_t qualname_index = intern_constant(m_curr_chunk->consts_pool, Value(std::move(name_obj)));
 
-        m_curr_chunk->consts_pool.emplace_back(name_obj);
-        m_curr_chunk->code.push_back({OpCode::LOAD_CONSTANT, name_index});
+        m_curr_chunk->code.push_back({OpCode::LOAD_CONSTANT, qualname_index});
         m_curr_chunk->byte_offset += 2;
 
         m_curr_chunk->code.push_back({OpCode::MAKE_FUNCTION, 0});
         m_curr_chunk->byte_offset += 2;
 
-        std::uint8_t var_index;
-        if (!global_vars.contains(function.token.value)) {
-            m_curr_chunk->names_pool.push_back(function.token.value);
-            var_index = static_cast<std::uint8_t>(m_curr_chunk->names_pool.size() - 1);
-            global_vars.insert({function.token.value, var_index});
-        } else {
-            var_index = global_vars.at(function.token.value);
-        }
-        
-        m_curr_chunk->code.push_back({OpCode::STORE_NAME, var_index});
+        m_curr_chunk->code.push_back({OpCode::STORE_NAME, global_slot(function.token.value)});
         m_curr_chunk->byte_offset += 2;
-
-        m_curr_chunk->consts_pool.emplace_back(name_obj);
     }
 
     void compiler::disassemble_callexpr_object(const TwoPy::Frontend::CallExpr& callee) {
+        if (auto* method = std::get_if<TwoPy::Frontend::AttributeExpr>(&callee.callee->node)) {
+            disassemble_method_call(*method, callee);
+            return;
+        }
+
+        // Anything else that evaluates to a callable, lst[0](x) or f(x)(y), is called as it is
         auto* ident = std::get_if<TwoPy::Frontend::Identifier>(&callee.callee->node);
-        disassemble_identifier_expr(*ident);
+        disassemble_expr(*callee.callee);
+
+        // Only defs compiled before this call are known, the guard catches the name being rebound since
+        auto it = ident != nullptr ? m_inlinable.find(ident->token.value) : m_inlinable.end();
+        if (m_inline_calls && it != m_inlinable.end() && it->second.def->params.params.size() == callee.arguments.size()) {
+            disassemble_inlined_call(it->first, it->second, callee);
+            return;
+        }
 
         for (const auto& arg : callee.arguments) {
             disassemble_expr(*arg);
@@ -389,19 +663,295 @@ namespace TwoPy::Backend {
         m_curr_chunk->byte_offset += 2;
     }
 
+    /*
+    The callee and the arguments are evaluated as for the real call, then the arguments go into
+    fresh slots, one per parameter and named after the function so no variable can clash with
+    them. Reusing them at every site of the same function is fine, an argument that's itself
+    an inlined call is done with the slots before the outer call stores into them.
+
+        LOAD_NAME f, <arguments>, STORE_FAST...     the callee stays on the stack
+        LOAD_CONSTANT <f>, JUMP_IF_INLINED body
+        LOAD_FAST..., CALL_FUNCTION, JUMP_FORWARD end
+      body:
+        <the return value, parameters read from their slots>
+      end:
+    */
+    void compiler::disassemble_inlined_call(const std::string& name, const InlineCandidate& inlined, const TwoPy::Frontend::CallExpr& call) {
+        for (const auto& arg : call.arguments) {
+            disassemble_expr(*arg);
+        }
+
+        std::map<std::string, std::uint8_t> params;
+        std::vector<std::uint8_t> slots;
+        for (const auto& param : inlined.def->params.params) {
+            slots.push_back(local_slot(name + "." + param.token.value));
+            params.insert({param.token.value, slots.back()});
+        }
+        for (std::size_t i = slots.size(); i-- > 0;) {
+            m_curr_chunk->code.push_back({OpCode::STORE_FAST, slots[i]});
+            m_curr_chunk->byte_offset += 2;
+        }
+
+        m_curr_chunk->code.push_back({OpCode::LOAD_CONSTANT, intern_constant(m_curr_chunk->consts_pool, inlined.function)});
+        m_curr_chunk->byte_offset += 2;
+        std::size_t inlined_jump = emit_jump(OpCode::JUMP_IF_INLINED);
+
+        // The name was rebound since: the real call, on the arguments as they were evaluated
+        for (std::uint8_t slot : slots) {
+            m_curr_chunk->code.push_back({OpCode::LOAD_FAST, slot});
+            m_curr_chunk->byte_offset += 2;
+        }
+        m_curr_chunk->code.push_back({OpCode::CALL_FUNCTION, static_cast<std::uint8_t>(slots.size())});
+        m_curr_chunk->byte_offset += 2;
+        std::size_t end_jump = emit_jump(OpCode::JUMP_FORWARD);
+
+        patch_jump(inlined_jump);
+        const auto* saved_params = std::exchange(m_inline_params, &params);
+        disassemble_expr(*inlined.body);
+        m_inline_params = saved_params;
+        patch_jump(end_jump);
+
+        m_bytecode_program.inlined_calls[name]++;
+    }
+
+    void compiler::disassemble_method_call(const TwoPy::Frontend::AttributeExpr& method, const TwoPy::Frontend::CallExpr& callee) {
+        disassemble_identifier_expr(method.constructor);
+
+        // Interned, so the VM's method lookup compares names by pointer
+        auto name_obj = StringPyObject::intern(method.attribute.token.value);
+        std::uint8_t name_index = intern_constant(m_curr_chunk->consts_pool, Value(std::move(name_obj)));
+        m_curr_chunk->code.push_back({OpCode::LOAD_METHOD, name_index});
+        m_curr_chunk->byte_offset += 2;
+
+        for (const auto& arg : callee.arguments) {
+            disassemble_expr(*arg);
+        }
+
+        std::uint8_t arg_count = static_cast<std::uint8_t>(callee.arguments.size());
+        m_curr_chunk->code.push_back({OpCode::CALL_METHOD, arg_count});
+        m_curr_chunk->byte_offset += 2;
+    }
+
+    void compiler::disassemble_list_expr(const TwoPy::Frontend::ListExpr& list) {
+        if (list.elements.size() > UINT8_MAX) {
+            throw std::runtime_error("Too many items in one list display");
+        }
+
+        for (const auto& element : list.elements) {
+            disassemble_expr(*element);
+        }
+
+        m_curr_chunk->code.push_back({OpCode::BUILD_LIST, static_cast<std::uint8_t>(list.elements.size())});
+        m_curr_chunk->byte_offset += 2;
+    }
+
+    void compiler::disassemble_dict_expr(const TwoPy::Frontend::DictExpr& dict) {
+        if (dict.entries.size() > UINT8_MAX) {
+            throw std::runtime_error("Too many entries in one dict display");
+        }
+
+        for (const auto& [key, value] : dict.entries) {
+            disassemble_expr(*key);
+            disassemble_expr(*value);
+        }
+
+        m_curr_chunk->code.push_back({OpCode::BUILD_MAP, static_cast<std::uint8_t>(dict.entries.size())});
+        m_curr_chunk->byte_offset += 2;
+    }
+
+    void compiler::disassemble_subscript_operands(const TwoPy::Frontend::ListIndexExpr& subscript) {
+        disassemble_expr(*subscript.list_name);
+        disassemble_expr(*subscript.index);
+    }
+
+    void compiler::disassemble_compare_expr(CompareOp op, const TwoPy::Frontend::ExprNode& left, const TwoPy::Frontend::ExprNode& right) {
+        disassemble_expr(left);
+        disassemble_expr(right);
+
+        m_curr_chunk->code.push_back({OpCode::COMPARE_OP, static_cast<std::uint8_t>(op)});
+        m_curr_chunk->byte_offset += 2;
+    }
+
     void compiler::disassemble_and_expr(const TwoPy::Frontend::AndOp& p_and) {
         disassemble_expr(*p_and.left);
-        std::size_t and_jump = emit_jump(OpCode::POP_JUMP_IF_FALSE);
-        pending_jumps.emplace_back(and_jump);
+        std::size_t and_jump = emit_jump(OpCode::JUMP_IF_FALSE_OR_POP);
 
         disassemble_expr(*p_and.right);
+        patch_jump(and_jump);
     }
 
     void compiler::disassemble_or_expr(const TwoPy::Frontend::OrOp& p_or) {
         disassemble_expr(*p_or.left);
-        std::size_t truthy_jump = emit_jump(OpCode::POP_JUMP_IF_TRUE);
-        truthy_jumps.emplace_back(truthy_jump);
+        std::size_t or_jump = emit_jump(OpCode::JUMP_IF_TRUE_OR_POP);
 
         disassemble_expr(*p_or.right);
-    } 
+        patch_jump(or_jump);
+    }
+
+    void compiler::resolve_builtins() {
+        std::vector<bool> stored(m_bytecode_program.global_names.size());
+        for (const auto& chunk : m_bytecode_program.chunks) {
+            for (const auto& instr : chunk->code) {
+                if (instr.opcode == OpCode::STORE_NAME) {
+                    stored[instr.argument] = true;
+                }
+            }
+        }
+
+        // Nothing can ever bind these globals, so the lookup can skip straight to the builtin
+        for (const auto& chunk : m_bytecode_program.chunks) {
+            for (auto& instr : chunk->code) {
+                if (instr.opcode != OpCode::LOAD_NAME || stored[instr.argument]) {
+                    continue;
+                }
+
+                if (auto index = find_builtin(m_bytecode_program.global_names[instr.argument])) {
+                    instr = {.opcode = OpCode::LOAD_BUILTIN, .argument = *index};
+                }
+            }
+        }
+    }
+
+    namespace {
+        /* Net change to the operand stack. A fused opcode only replaces the first instruction of its
+           sequence and the rest still follow it, so it counts as that first instruction. */
+        int stack_effect(const Instruction& instr) {
+            switch (instr.opcode) {
+                case OpCode::PUSH:
+                case OpCode::PUSH_NULL:
+                case OpCode::LOAD_FAST:
+                case OpCode::LOAD_NAME:
+                case OpCode::LOAD_CONSTANT:
+                case OpCode::LOAD_BUILTIN:
+                case OpCode::LOAD_NAME__LOAD_NAME:
+                case OpCode::LOAD_NAME__LOAD_CONSTANT:
+                case OpCode::LOAD_NAME__LOAD_CONSTANT__ADD:
+                case OpCode::LOAD_CONSTANT__STORE_NAME:
+                    return 1;
+                case OpCode::JUMP_FORWARD:
+                case OpCode::JUMP_BACKWARD:
+                case OpCode::EXTENDED_ARG:
+                    return 0;
+                case OpCode::GET_ITER:
+                case OpCode::FOR_ITER:
+                case OpCode::FOR_ITER_RANGE:
+                    // The position goes next to the iterable, then each pass pushes an item (the exit edge pops both instead)
+                    return 1;
+                case OpCode::CALL_FUNCTION:
+                case OpCode::TAIL_CALL:
+                    return -static_cast<int>(instr.argument);
+                case OpCode::JUMP_IF_INLINED:
+                    // Only the function when it falls through to the real call, the callee goes too on the jump
+                    return -1;
+                case OpCode::BUILD_LIST:
+                    return 1 - static_cast<int>(instr.argument);
+                case OpCode::BUILD_MAP:
+                    return 1 - 2 * static_cast<int>(instr.argument);
+                case OpCode::LOAD_METHOD:
+                    return 1;
+                case OpCode::CALL_METHOD:
+                    return -static_cast<int>(instr.argument) - 1;
+                case OpCode::STORE_SUBSCR:
+                    return -3;
+                default:
+                    // Binary ops, compares, stores, POP, conditional jumps, RETURN and MAKE_FUNCTION all take one more than they leave
+                    return -1;
+            }
+        }
+    }
+
+    namespace {
+        /* Same immediate down to the bits (0.0 and -0.0 stay apart, True and 1 stay apart), or the same object */
+        bool same_constant(const Value& lhs, const Value& rhs) noexcept {
+            if (lhs.tag() != rhs.tag()) {
+                return false;
+            }
+
+            switch (lhs.tag()) {
+                case ValueTag::NONE: return true;
+                case ValueTag::BOOL: return lhs.as_bool() == rhs.as_bool();
+                case ValueTag::INT: return lhs.as_int() == rhs.as_int();
+                case ValueTag::FLOAT: return std::bit_cast<std::uint64_t>(lhs.as_float()) == std::bit_cast<std::uint64_t>(rhs.as_float());
+                case ValueTag::OBJ: return lhs.as_object() == rhs.as_object();
+                default: return false;
+            }
+        }
+    }
+
+    std::uint8_t intern_constant(std::vector<Value>& pool, Value val) {
+        auto it = std::ranges::find_if(pool, [&](const Value& existing) { return same_constant(existing, val); });
+        if (it != pool.end()) {
+            return static_cast<std::uint8_t>(std::distance(pool.begin(), it));
+        }
+
+        if (pool.size() > UINT8_MAX) {
+            throw std::runtime_error("Too many constants in one chunk");
+        }
+        pool.push_back(std::move(val));
+        return static_cast<std::uint8_t>(pool.size() - 1);
+    }
+
+    Value int_literal(std::string_view digits) {
+        if (auto val = parse_int(digits)) {
+            return *val;
+        }
+        throw std::runtime_error(fmt::format("Invalid int literal '{}'", digits));
+    }
+
+    std::size_t max_stack_depth(const Chunk& chunk) {
+        std::vector<int> depth_at(chunk.code.size(), -1);
+        std::vector<std::size_t> worklist {};
+        int max_depth = 0;
+
+        auto visit = [&](std::size_t index, int depth) {
+            if (index < depth_at.size() && depth_at[index] < 0) {
+                depth_at[index] = depth;
+                worklist.push_back(index);
+            }
+        };
+
+        visit(0, 0);
+        while (!worklist.empty()) {
+            std::size_t index = worklist.back();
+            worklist.pop_back();
+
+            const Instruction& instr = chunk.code[index];
+            int depth = std::max(depth_at[index] + stack_effect(instr), 0);
+            max_depth = std::max(max_depth, depth);
+
+            switch (instr.opcode) {
+                case OpCode::RETURN:
+                    break;
+                case OpCode::JUMP_FORWARD:
+                case OpCode::JUMP_BACKWARD:
+                    visit(jump_target(chunk.code.data(), index), depth);
+                    break;
+                case OpCode::FOR_ITER:
+                case OpCode::FOR_ITER_RANGE:
+                    visit(jump_target(chunk.code.data(), index), depth_at[index] - 2);
+                    visit(index + 1, depth);
+                    break;
+                case OpCode::POP_JUMP_IF_FALSE:
+                case OpCode::POP_JUMP_IF_TRUE:
+                    visit(jump_target(chunk.code.data(), index), depth);
+                    visit(index + 1, depth);
+                    break;
+                case OpCode::JUMP_IF_FALSE_OR_POP:
+                case OpCode::JUMP_IF_TRUE_OR_POP:
+                    // The value only goes when the jump isn't taken
+                    visit(jump_target(chunk.code.data(), index), depth_at[index]);
+                    visit(index + 1, depth);
+                    break;
+                case OpCode::JUMP_IF_INLINED:
+                    visit(jump_target(chunk.code.data(), index), depth - 1);
+                    visit(index + 1, depth);
+                    break;
+                default:
+                    visit(index + 1, depth);
+                    break;
+            }
+        }
+
+        return static_cast<std::size_t>(max_depth);
+    }
 }
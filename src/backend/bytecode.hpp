@@ -4,7 +4,9 @@
 #include <cstddef>
 #include <memory>
 #include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include <algorithm>
@@ -37,14 +39,62 @@ namespace TwoPy::Backend {
         STORE_FAST, // Local vars
         STORE_NAME, // Stuff like Classes, Functions, Dicts, Lists, etc etc
 
-        COMPARE_OP, // != ==
+        COMPARE_OP, // argument is a CompareOp
 
         POP_JUMP_IF_FALSE, // AND stops if the first value is true
         POP_JUMP_IF_TRUE, // OR stops if the first value is true
+        JUMP_IF_FALSE_OR_POP,   // `and` as a value: a falsy TOS is the result and stays, otherwise it's dropped for the right side
+        JUMP_IF_TRUE_OR_POP,    // `or` as a value, the same for a truthy TOS
+        JUMP_FORWARD, // Skips the remaining elif/else arms
+        JUMP_BACKWARD,  // Loop back-edge, the VM counts how often each loop header gets taken
+        EXTENDED_ARG,   // High byte of the next instruction's jump target, only emitted past byte offset 255
+        GET_ITER,       // Leaves the iterable and its start position, see iteration_start()
+        FOR_ITER,       // Pushes the next item, or drops the iterable and position and jumps once exhausted
 
         LOAD_FAST,  // Local vars
         LOAD_NAME,  // Module-level (mirrors STORE_NAME)
         LOAD_CONSTANT,
+        LOAD_BUILTIN,   // builtins table index, for names no global can shadow
+
+        BUILD_LIST,     // argument is the item count, the items are on the stack first to last
+        BUILD_MAP,      // argument is the pair count, each key sits right under its value
+        BINARY_SUBSCR,  // TOS1[TOS]
+        STORE_SUBSCR,   // TOS1[TOS] = TOS2
+        LOAD_METHOD,    // argument is the method name's constant, leaves the method and then self
+        CALL_METHOD,    // argument is the count of arguments after self
+        TAIL_CALL,      // CALL_FUNCTION right before a RETURN, a Python callee takes over the running frame
+        JUMP_IF_INLINED,    // the callee under TOS is still the function TOS inlined here, see disassemble_inlined_call()
+
+        /* Superinstructions, only produced by fuse_superinstructions().
+           The fused opcode replaces the first instruction of the sequence and the
+           following instructions keep their opcodes, so they still hold their arguments
+           and stay valid jump targets. */
+        LOAD_NAME__LOAD_NAME,
+        LOAD_NAME__LOAD_CONSTANT,
+        LOAD_CONSTANT__STORE_NAME,
+        COMPARE_OP__POP_JUMP_IF_FALSE,
+        LOAD_NAME__LOAD_CONSTANT__ADD,
+
+        /* Specialized forms written over ADD/SUB/MUL/FOR_ITER by the VM at runtime (quickening).
+           Each one guards its operand types and falls back to the generic opcode on a miss. */
+        ADD_INT,
+        ADD_FLOAT,
+        ADD_STR,
+        SUB_INT,
+        SUB_FLOAT,
+        MUL_INT,
+        MUL_FLOAT,
+        FOR_ITER_RANGE,
+    };
+
+    /* Same ordering as CPython's COMPARE_OP argument */
+    enum class CompareOp : std::uint8_t {
+        LT,
+        LE,
+        EQ,
+        NE,
+        GT,
+        GE,
     };
 
     /* Inside Python's bytecode 3.6 documentation. Use 2 bytes for each instruction. Previously the number of bytes varied by instruction.*/
@@ -54,27 +104,83 @@ namespace TwoPy::Backend {
     };
 
     struct Chunk {
+        std::string name;                       // the function's, "<module>" for the top level
         std::vector<Instruction> code;
         std::vector<Value> consts_pool;
-        std::vector<std::string> names_pool;
+        std::vector<std::string> local_names;   // fast slots of a function chunk, parameters first
         std::size_t byte_offset; // instructions lists
+        std::size_t max_stack {};               // deepest the operand stack gets, the VM checks it once at frame entry
     };
 
     struct ByteCodeProgram {
         std::string name;
         std::vector<std::shared_ptr<Chunk>> chunks;
+        std::vector<std::string> global_names;  // LOAD_NAME/STORE_NAME argument -> name, shared by every chunk
+        std::map<std::string, std::size_t> inlined_calls {};    // function -> how many call sites got its body
+    };
+
+    /*
+    Index of `val` in `pool`, appended if it isn't there yet. Immediates (None, bools, ints, floats)
+    are shared, so every `1` or `None` in a chunk is one constant slot. Objects share a slot only
+    with themselves, which covers interned strings.
+    */
+    [[nodiscard]] std::uint8_t intern_constant(std::vector<Value>& pool, Value val);
+
+    /*
+    Instruction index the jump at `index` goes to. Jump arguments are absolute byte offsets, one
+    byte each, and an EXTENDED_ARG right before the jump supplies the high byte.
+    */
+    [[nodiscard]] inline std::size_t jump_target(const Instruction* code, std::size_t index) noexcept {
+        std::size_t offset = code[index].argument;
+        if (index > 0 && code[index - 1].opcode == OpCode::EXTENDED_ARG) {
+            offset |= static_cast<std::size_t>(code[index - 1].argument) << 8;
+        }
+        return offset / 2;
+    }
+
+    struct JumpSite {
+        std::size_t index;      // of the jump instruction
+        std::size_t target;     // byte offset, as if no EXTENDED_ARG had been inserted
     };
 
+    /* Writes every jump's target into `chunk`, inserting the EXTENDED_ARGs the ones past byte offset 255 need */
+    void resolve_jump_targets(Chunk& chunk, const std::vector<JumpSite>& jumps);
+
+    /* The int an integer literal stands for, a bigint when it doesn't fit in an immediate */
+    [[nodiscard]] Value int_literal(std::string_view digits);
+
     class compiler {
     private:
         const TwoPy::Frontend::Program& m_program;
         std::size_t m_scope_depth {};
 
-        std::map<std::string, std::uint8_t> global_vars {};
+        // name -> fast slot of the function being compiled
         std::map<std::string, std::uint8_t> local_vars {};
 
-        std::vector<std::size_t> pending_jumps {};
-        std::vector<std::size_t> truthy_jumps {};
+        /* Where every jump in the chunk being compiled goes. Targets are only written into the
+           code by resolve_jumps(), once it's known which of them need an EXTENDED_ARG. */
+        std::vector<JumpSite> m_jumps {};
+
+        /* The loops around the statement being compiled, innermost last */
+        struct LoopContext {
+            std::size_t start;                  // byte offset of the header, continue jumps back to it
+            std::vector<std::size_t> breaks;    // JUMP_FORWARDs patched to the loop exit
+            bool is_for;                        // the iterable and its position sit on the stack
+        };
+        std::vector<LoopContext> m_loops {};
+
+        /* A module-level def whose body is one small `return` of arithmetic on its parameters, with
+           no calls in it. Calls to its name after the def get the body in place of the call */
+        struct InlineCandidate {
+            const TwoPy::Frontend::FunctionDef* def;
+            const TwoPy::Frontend::ExprNode* body;
+            Value function;     // the guard checks the callee is still this object
+        };
+        std::map<std::string, InlineCandidate> m_inlinable {};
+        bool m_inline_calls {true};
+
+        // While an inlined body compiles: its parameters -> the fresh slots they got, every other name is a global
+        const std::map<std::string, std::uint8_t>* m_inline_params {};
 
         std::shared_ptr<Chunk> m_curr_chunk {};
 
@@ -89,22 +195,21 @@ namespace TwoPy::Backend {
 
         void patch_jump(std::size_t offset) {
             std::size_t jump_instr_index = (offset - 2) / 2; 
-            m_curr_chunk->code[jump_instr_index].argument =
-                static_cast<std::uint8_t>(m_curr_chunk->byte_offset);
+            m_jumps.push_back({.index=jump_instr_index, .target=m_curr_chunk->byte_offset});
         }      
 
+        /* Jumps back to `loop_start`, a byte offset recorded before the loop's first instruction */
+        void emit_loop(std::size_t loop_start) {
+            m_jumps.push_back({.index=m_curr_chunk->code.size(), .target=loop_start});
+            m_curr_chunk->code.push_back({.opcode=OpCode::JUMP_BACKWARD, .argument=0});
+            m_curr_chunk->byte_offset += 2;
+        }
+
+        /* Writes the recorded jump targets into the finished chunk, prefixing EXTENDED_ARG where one byte isn't enough */
+        void resolve_jumps();
+
         void emit_return_none() {
-            auto it = std::ranges::find_if(m_curr_chunk->consts_pool, [](const Value& v) {
-                return std::get_if<std::monostate>(&v.data()) != nullptr;
-            });
-
-            std::uint8_t none_index;
-            if (it != m_curr_chunk->consts_pool.end()) {
-                none_index = static_cast<std::uint8_t>(std::distance(m_curr_chunk->consts_pool.begin(), it));
-            } else {
-                none_index = static_cast<std::uint8_t>(m_curr_chunk->consts_pool.size());
-                m_curr_chunk->consts_pool.emplace_back();
-            }
+            std::uint8_t none_index = intern_constant(m_curr_chunk->consts_pool, Value {});
 
             m_curr_chunk->code.push_back({.opcode=OpCode::LOAD_CONSTANT, .argument=none_index});
             m_curr_chunk->byte_offset += 2;
@@ -113,6 +218,32 @@ namespace TwoPy::Backend {
             m_curr_chunk->byte_offset += 2;
         }
 
+        /* Globals are numbered once for the whole program, the VM keeps them in a table indexed by this slot */
+        [[nodiscard]] std::uint8_t global_slot(const std::string& name) {
+            auto& names = m_bytecode_program.global_names;
+            auto it = std::ranges::find(names, name);
+            if (it != names.end()) {
+                return static_cast<std::uint8_t>(std::distance(names.begin(), it));
+            }
+
+            if (names.size() > UINT8_MAX) {
+                throw std::runtime_error("Too many global names");
+            }
+            names.push_back(name);
+            return static_cast<std::uint8_t>(names.size() - 1);
+        }
+
+        [[nodiscard]] std::uint8_t local_slot(const std::string& name) {
+            if (auto it = local_vars.find(name); it != local_vars.end()) {
+                return it->second;
+            }
+
+            auto slot = static_cast<std::uint8_t>(m_curr_chunk->local_names.size());
+            m_curr_chunk->local_names.push_back(name);
+            local_vars.insert({name, slot});
+            return slot;
+        }
+
          /// TODO: I'll need to add detection for nested functions scoping
         void init_scope() {
             m_scope_depth++;
@@ -132,23 +263,56 @@ namespace TwoPy::Backend {
 
         void disassemble_function_object(const TwoPy::Frontend::FunctionDef& function);
         void disassemble_callexpr_object(const TwoPy::Frontend::CallExpr& callee);
-        void disassemble_elif_stmt(const TwoPy::Frontend::ElifStmt& stmt);
+        // The callee, then the arguments into fresh slots, a guard, the real call for when it fails and the body
+        void disassemble_inlined_call(const std::string& name, const InlineCandidate& inlined, const TwoPy::Frontend::CallExpr& call);
+        // obj.name(args): LOAD_METHOD/CALL_METHOD, no bound method object gets built
+        void disassemble_method_call(const TwoPy::Frontend::AttributeExpr& method, const TwoPy::Frontend::CallExpr& callee);
+        void disassemble_list_expr(const TwoPy::Frontend::ListExpr& list);
+        void disassemble_dict_expr(const TwoPy::Frontend::DictExpr& dict);
+        // container then index, the subscript opcodes find them in that order
+        void disassemble_subscript_operands(const TwoPy::Frontend::ListIndexExpr& subscript);
+        /* An if/while condition, compiled as jumps instead of a value: the ones it leaves in `jumps` are
+           taken when the condition's truth is `jump_if`, and/or short-circuit straight into them */
+        void disassemble_condition(const TwoPy::Frontend::ExprNode& condition, bool jump_if, std::vector<std::size_t>& jumps);
+        // Returns the JUMP_FORWARD that skips the remaining arms, if one was needed
+        std::optional<std::size_t> disassemble_branch(const TwoPy::Frontend::ExprNode& condition, const TwoPy::Frontend::Block& body, bool needs_end_jump);
+        std::optional<std::size_t> disassemble_elif_stmt(const TwoPy::Frontend::ElifStmt& stmt, bool needs_end_jump);
         void disassemble_if_stmt(const TwoPy::Frontend::IfStmt& stmt);
+        // GET_ITER once, then FOR_ITER at the top of every pass until the iterable runs out
+        void disassemble_for_stmt(const TwoPy::Frontend::ForStmt& stmt);
+        void disassemble_while_stmt(const TwoPy::Frontend::WhileStmt& stmt);
+        void disassemble_break_stmt();
+        void disassemble_continue_stmt();
+        // Patches the breaks of the innermost loop to the current offset and leaves it
+        void end_loop();
         void disassemble_body_stmt(const TwoPy::Frontend::Block& blk);
         // pushing data to the stack
         void disassemble_identifier_expr(const TwoPy::Frontend::Identifier& iden);
         // popping data to the stack
         void disassemble_identifier_assignment_expr(const TwoPy::Frontend::Identifier& iden); 
+        // and/or as a value: the operand that decides it is the result, see JUMP_IF_FALSE_OR_POP
         void disassemble_and_expr(const TwoPy::Frontend::AndOp& p_and);
         void disassemble_or_expr(const TwoPy::Frontend::OrOp& p_or);  
+        void disassemble_compare_expr(CompareOp op, const TwoPy::Frontend::ExprNode& left, const TwoPy::Frontend::ExprNode& right);
+        // After the whole program is compiled, since a later def or assignment can still shadow a builtin
+        void resolve_builtins();
         
     public:
-        compiler(const TwoPy::Frontend::Program& program);
+        explicit compiler(const TwoPy::Frontend::Program& program, bool inline_calls = true);
 
         ByteCodeProgram disassemble_program();
         
         [[nodiscard]] std::optional<ByteCodeProgram> operator()();
     };
+
+    /* Walks every path through the chunk and returns the highest operand stack depth reached */
+    [[nodiscard]] std::size_t max_stack_depth(const Chunk& chunk);
+
+    /* Peephole pass that rewrites hot opcode sequences (picked from `-p` dispatch profiles) into superinstructions */
+    void fuse_superinstructions(ByteCodeProgram& program);
+
+    /* The opcode a superinstruction took the place of, for code that takes the instructions one at a time. Anything else comes back unchanged */
+    [[nodiscard]] OpCode unfused_opcode(OpCode op) noexcept;
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,279 @@
+#include "backend/dict_object.hpp"
+#include "backend/operations.hpp"
+
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+namespace TwoPy::Backend {
+    namespace {
+        std::size_t hash_long(long val) noexcept {
+            return std::hash<long> {}(val);
+        }
+
+        /* Bytes per index slot for a table of `capacity` slots, entry positions stay below capacity */
+        std::uint8_t index_width(std::size_t capacity) noexcept {
+            if (capacity <= 1UL << 7) {
+                return 1;
+            }
+            if (capacity <= 1UL << 15) {
+                return 2;
+            }
+            if (capacity <= 1UL << 31) {
+                return 4;
+            }
+            return 8;
+        }
+
+        template <typename Int>
+        std::int64_t read_slot(const std::byte* index, std::size_t slot) noexcept {
+            Int val {};
+            std::memcpy(&val, index + slot * sizeof(Int), sizeof(Int));
+            return val;
+        }
+
+        template <typename Int>
+        void write_slot(std::byte* index, std::size_t slot, std::int64_t val) noexcept {
+            auto narrowed = static_cast<Int>(val);
+            std::memcpy(index + slot * sizeof(Int), &narrowed, sizeof(Int));
+        }
+
+        /* CPython's probe order: every slot gets visited, and the high hash bits get a say early */
+        struct Probe {
+            std::size_t mask;
+            std::size_t perturb;
+            std::size_t slot;
+
+            Probe(std::size_t hash, std::size_t mask) noexcept
+                : mask(mask), perturb(hash), slot(hash & mask) {}
+
+            void next() noexcept {
+                perturb >>= 5;
+                slot = (slot * 5 + perturb + 1) & mask;
+            }
+        };
+    }
+
+    std::size_t hash_key(const Value& key) {
+        if (key.is_int() || key.is_bool()) {
+            return hash_long(key.to_long());
+        }
+        if (auto str = as_string(key)) {
+            return str->hash();
+        }
+        if (key.is_float()) {
+            // An integral float has to land on the same hash as the int it equals
+            double val = key.as_float();
+            if (std::trunc(val) == val && val >= static_cast<double>(LONG_MIN) && val < -static_cast<double>(LONG_MIN)) {
+                return hash_long(static_cast<long>(val));
+            }
+            return std::hash<double> {}(val);
+        }
+        if (auto big = as_bigint(key)) {
+            // Same rule from the other side: past a long, ints hash as the float they'd compare equal to
+            if (auto small = big->value().to_long(LONG_MIN, LONG_MAX)) {
+                return hash_long(*small);
+            }
+            return std::hash<double> {}(big->value().to_double());
+        }
+        if (key.is_none()) {
+            return DictPyObject::none_hash;
+        }
+        if (as_list(key) != nullptr || as_dict(key) != nullptr) {
+            throw std::runtime_error(fmt::format("TypeError: unhashable type: '{}'", type_name(key)));
+        }
+        // Everything else compares by identity
+        return std::hash<const void*> {}(key.as_object());
+    }
+
+    bool keys_equal(const Value& lhs, const Value& rhs) {
+        if (lhs.is_obj() && lhs.as_object() == rhs.as_object()) {
+            return true;
+        }
+        if (both_strings(lhs, rhs)) {
+            return *as_string(lhs) == *as_string(rhs);
+        }
+        auto result = compare_values(CompareOp::EQ, lhs, rhs);
+        return result && *result;
+    }
+
+    std::int64_t DictPyObject::index_at(std::size_t slot) const noexcept {
+        switch (m_index_width) {
+            case 1: return read_slot<std::int8_t>(m_index.data(), slot);
+            case 2: return read_slot<std::int16_t>(m_index.data(), slot);
+            case 4: return read_slot<std::int32_t>(m_index.data(), slot);
+            default: return read_slot<std::int64_t>(m_index.data(), slot);
+        }
+    }
+
+    void DictPyObject::set_index(std::size_t slot, std::int64_t entry) noexcept {
+        switch (m_index_width) {
+            case 1: write_slot<std::int8_t>(m_index.data(), slot, entry); break;
+            case 2: write_slot<std::int16_t>(m_index.data(), slot, entry); break;
+            case 4: write_slot<std::int32_t>(m_index.data(), slot, entry); break;
+            default: write_slot<std::int64_t>(m_index.data(), slot, entry); break;
+        }
+    }
+
+    template <typename Matches>
+    std::optional<DictPyObject::Found> DictPyObject::probe(std::size_t hash, Matches&& matches) const {
+        if (m_index.empty()) {
+            return std::nullopt;
+        }
+
+        for (Probe probe(hash, m_mask);; probe.next()) {
+            std::int64_t ix = index_at(probe.slot);
+            if (ix == empty_slot) {
+                return std::nullopt;
+            }
+            if (ix >= 0) {
+                const Entry& entry = m_entries[static_cast<std::size_t>(ix)];
+                if (entry.hash == hash && matches(entry.key)) {
+                    return Found {.slot = probe.slot, .entry = static_cast<std::size_t>(ix)};
+                }
+            }
+        }
+    }
+
+    std::optional<DictPyObject::Found> DictPyObject::lookup(const Value& key, std::size_t hash) const {
+        if (key.is_int()) {
+            // int keys are the common non-str case, two ints compare without going through compare_values
+            return probe(hash, [&](const Value& other) {
+                return other.is_int() ? other.as_int() == key.as_int() : keys_equal(other, key);
+            });
+        }
+        return probe(hash, [&](const Value& other) { return keys_equal(other, key); });
+    }
+
+    std::optional<DictPyObject::Found> DictPyObject::lookup_string(const StringPyObject& key) const noexcept {
+        // Only a str can equal a str. Interned keys (names, identifier-like literals) match on the pointer alone
+        return probe(key.hash(), [&](const Value& other) {
+            const StringPyObject* str = as_string(other);
+            return str != nullptr && *str == key;
+        });
+    }
+
+    std::size_t DictPyObject::free_slot(std::size_t hash) const noexcept {
+        Probe probe(hash, m_mask);
+        while (index_at(probe.slot) >= 0) {
+            probe.next();
+        }
+        return probe.slot;
+    }
+
+    void DictPyObject::resize(std::size_t min_used) {
+        std::size_t capacity = min_capacity;
+        while (usable(capacity) < min_used) {
+            capacity *= 2;
+        }
+
+        // Live entries slide down over the deleted ones, in order
+        std::erase_if(m_entries, [](const Entry& entry) { return !entry.live(); });
+        m_entries.reserve(usable(capacity));
+
+        m_index_width = index_width(capacity);
+        m_index.assign(capacity * m_index_width, std::byte {0xFF});     // all bits set is -1 at every width
+        m_mask = capacity - 1;
+
+        for (std::size_t i = 0; i < m_entries.size(); i++) {
+            set_index(free_slot(m_entries[i].hash), static_cast<std::int64_t>(i));
+        }
+    }
+
+    const Value* DictPyObject::find(const Value& key) const {
+        if (auto str = as_string(key)) {
+            return find_string(*str);
+        }
+
+        std::size_t hash = hash_key(key);     // still a TypeError for an unhashable key
+        if (m_string_keys) {
+            // A str-only dict can't hold anything else
+            return nullptr;
+        }
+        auto found = lookup(key, hash);
+        return found ? &m_entries[found->entry].value : nullptr;
+    }
+
+    const Value* DictPyObject::find_string(const StringPyObject& key) const noexcept {
+        auto found = lookup_string(key);
+        return found ? &m_entries[found->entry].value : nullptr;
+    }
+
+    void DictPyObject::store(Heap& heap, Value key, Value value) {
+        const StringPyObject* str = as_string(key);
+        std::size_t hash = str != nullptr ? str->hash() : hash_key(key);
+
+        auto found = str != nullptr ? lookup_string(*str) : m_string_keys ? std::nullopt : lookup(key, hash);
+        if (found) {
+            heap.write_barrier(this, value);
+            m_entries[found->entry].value = std::move(value);
+            return;
+        }
+
+        if (m_entries.size() >= usable(capacity())) {
+            resize(m_used * 3);
+        }
+
+        heap.write_barrier(this, key);
+        heap.write_barrier(this, value);
+        m_string_keys = m_string_keys && str != nullptr;
+        set_index(free_slot(hash), static_cast<std::int64_t>(m_entries.size()));
+        m_entries.push_back({.hash = hash, .key = std::move(key), .value = std::move(value)});
+        m_used++;
+    }
+
+    std::optional<Value> DictPyObject::remove(const Value& key) {
+        const StringPyObject* str = as_string(key);
+        auto found = str != nullptr ? lookup_string(*str) : lookup(key, hash_key(key));
+        if (!found) {
+            return std::nullopt;
+        }
+
+        set_index(found->slot, dummy_slot);
+        m_used--;
+
+        // The caller may be holding the only other reference to the key, so the entry is taken apart here
+        Entry& entry = m_entries[found->entry];
+        Value removed = std::move(entry.value);
+        entry.key = Value {};
+        entry.value = Value {};
+        entry.hash = ~none_hash;
+        return removed;
+    }
+
+    void DictPyObject::trace(GcVisitor& visitor) const {
+        for (const Entry& entry : m_entries) {
+            visitor.visit(entry.key);
+            visitor.visit(entry.value);
+        }
+    }
+
+    std::string DictPyObject::stringify() {
+        if (m_printing) {
+            return "{...}";
+        }
+        m_printing = true;
+
+        std::string result = "{";
+        bool first = true;
+        for (const Entry& entry : m_entries) {
+            if (!entry.live()) {
+                continue;
+            }
+            if (!first) {
+                result += ", ";
+            }
+            first = false;
+
+            result += repr(entry.key);
+            result += ": ";
+            result += repr(entry.value);
+        }
+        result += '}';
+
+        m_printing = false;
+        return result;
+    }
+}
@@ -0,0 +1,129 @@
+#ifndef TWOPY_DICT_OBJECT_HPP
+#define TWOPY_DICT_OBJECT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "backend/gc.hpp"
+#include "backend/value.hpp"
+
+/*
+dict, laid out like CPython's since 3.6: the entries sit in a dense array in insertion order, and
+a separate open-addressed table of small ints maps hash slots to entry positions. The table is
+int8 while the dict is small and widens to int16/int32/int64 as it grows, so a lookup touches a
+few bytes of index and one entry. Deleting leaves a hole in the entries that the next resize
+squeezes out.
+*/
+namespace TwoPy::Backend {
+    class StringPyObject;
+
+    /* hash(key), throws TypeError for unhashable keys. Equal keys hash the same, 1, 1.0 and True included */
+    [[nodiscard]] std::size_t hash_key(const Value& key);
+
+    /* key == key the way a dict sees it */
+    [[nodiscard]] bool keys_equal(const Value& lhs, const Value& rhs);
+
+    class DictPyObject final : public GcObject {
+        public:
+            static constexpr std::size_t min_capacity = 8;
+            static constexpr std::size_t none_hash = 0x5f3759df;   // hash(None)
+
+            struct Entry {
+                std::size_t hash;
+                Value key;
+                Value value;
+
+                /* A deleted entry keeps its place until the next resize, as a None key with a hash None can't have */
+                [[nodiscard]] bool live() const noexcept {
+                    return !key.is_none() || hash == none_hash;
+                }
+            };
+
+        private:
+            static constexpr std::int64_t empty_slot = -1;
+            static constexpr std::int64_t dummy_slot = -2;     // was used, probing carries on past it
+
+            std::vector<Entry> m_entries;
+            std::vector<std::byte> m_index;
+            std::size_t m_mask {};          // index capacity - 1, capacity is a power of two
+            std::size_t m_used {};          // live entries
+            std::uint8_t m_index_width {};  // bytes per index slot
+            bool m_string_keys {true};      // every key so far is a str, lookups can skip the generic compare
+            bool m_printing {};
+
+            [[nodiscard]] std::int64_t index_at(std::size_t slot) const noexcept;
+            void set_index(std::size_t slot, std::int64_t entry) noexcept;
+
+            struct Found {
+                std::size_t slot;   // in the index
+                std::size_t entry;
+            };
+
+            /* Walks the probe path for `hash` until `matches` accepts an entry or an empty slot ends it */
+            template <typename Matches>
+            [[nodiscard]] std::optional<Found> probe(std::size_t hash, Matches&& matches) const;
+
+            [[nodiscard]] std::optional<Found> lookup(const Value& key, std::size_t hash) const;
+            [[nodiscard]] std::optional<Found> lookup_string(const StringPyObject& key) const noexcept;
+            /* First slot on the probe path that isn't holding an entry */
+            [[nodiscard]] std::size_t free_slot(std::size_t hash) const noexcept;
+
+            [[nodiscard]] std::size_t capacity() const noexcept {
+                return m_index.empty() ? 0 : m_mask + 1;
+            }
+
+            /* Two thirds full at most, past that the probe chains get long */
+            [[nodiscard]] static constexpr std::size_t usable(std::size_t capacity) noexcept {
+                return capacity * 2 / 3;
+            }
+
+            /* Rebuilds the index for room for `min_used` entries and drops the deleted ones */
+            void resize(std::size_t min_used);
+
+        public:
+            DictPyObject() noexcept
+                : GcObject(ObjectTag::DICT) {}
+
+            [[nodiscard]] std::size_t size() const noexcept {
+                return m_used;
+            }
+
+            /* In insertion order, skip the ones that aren't live */
+            [[nodiscard]] std::span<const Entry> entries() const noexcept {
+                return m_entries;
+            }
+
+            [[nodiscard]] const Value* find(const Value& key) const;
+
+            /* str keys, no hashing past the string's cached hash and no generic compare */
+            [[nodiscard]] const Value* find_string(const StringPyObject& key) const noexcept;
+
+            void store(Heap& heap, Value key, Value value);
+
+            /* Takes `key` out, nullopt when it wasn't there */
+            [[nodiscard]] std::optional<Value> remove(const Value& key);
+
+            void trace(GcVisitor& visitor) const override;
+
+            void clear_references() override {
+                // Moved out first, destroying the entries may reach back into this dict
+                std::vector<Entry> entries = std::exchange(m_entries, {});
+                m_index.clear();
+                m_mask = 0;
+                m_used = 0;
+            }
+
+            std::string stringify() override;
+
+            bool is_truthy() const noexcept override {
+                return m_used != 0;
+            }
+    };
+}
+
+#endif
@@ -0,0 +1,134 @@
+#include "backend/gc.hpp"
+
+#include <algorithm>
+
+namespace TwoPy::Backend {
+    GcObject::~GcObject() {
+        if (m_heap != nullptr) {
+            m_heap->untrack(this);
+        }
+    }
+
+    Heap::~Heap() {
+        // The VM's stack and globals are already gone, whatever is still tracked is only kept alive by cycles
+        collect(Generation::OLD, [](GcVisitor&) {});
+
+        for (GcObject* head : m_generations) {
+            for (GcObject* obj = head; obj != nullptr; obj = obj->m_gc_next) {
+                obj->m_heap = nullptr;
+            }
+        }
+    }
+
+    void Heap::link(GcObject* obj, Generation gen) noexcept {
+        auto& head = m_generations[static_cast<std::size_t>(gen)];
+        obj->m_generation = gen;
+        obj->m_gc_prev = nullptr;
+        obj->m_gc_next = head;
+        if (head != nullptr) {
+            head->m_gc_prev = obj;
+        }
+        head = obj;
+        m_stats.tracked[static_cast<std::size_t>(gen)]++;
+    }
+
+    void Heap::unlink(GcObject* obj) noexcept {
+        auto gen = static_cast<std::size_t>(obj->m_generation);
+        if (obj->m_gc_prev != nullptr) {
+            obj->m_gc_prev->m_gc_next = obj->m_gc_next;
+        } else {
+            m_generations[gen] = obj->m_gc_next;
+        }
+        if (obj->m_gc_next != nullptr) {
+            obj->m_gc_next->m_gc_prev = obj->m_gc_prev;
+        }
+        obj->m_gc_prev = obj->m_gc_next = nullptr;
+        m_stats.tracked[gen]--;
+    }
+
+    void Heap::track(GcObject* obj) noexcept {
+        obj->m_heap = this;
+        link(obj, Generation::YOUNG);
+        m_young_allocations++;
+        m_stats.allocated++;
+    }
+
+    void Heap::untrack(GcObject* obj) noexcept {
+        if (obj->m_remembered) {
+            std::erase(m_remembered, obj);
+        }
+        unlink(obj);
+        obj->m_heap = nullptr;
+    }
+
+    void Heap::collect(const RootScanner& roots) {
+        if (++m_young_since_full >= full_every) {
+            collect(Generation::OLD, roots);
+        } else {
+            collect(Generation::YOUNG, roots);
+        }
+    }
+
+    void Heap::collect(Generation gen, const RootScanner& roots) {
+        auto start = std::chrono::steady_clock::now();
+
+        GcVisitor visitor(gen);
+        roots(visitor);
+        if (gen == Generation::YOUNG) {
+            // Old objects written to since the last collection may be the only path to a young one
+            for (GcObject* owner : m_remembered) {
+                owner->trace(visitor);
+            }
+        }
+        visitor.drain();
+
+        // Everything unmarked in the collected generations is unreachable
+        std::vector<GcObject*> garbage {};
+        std::vector<GcObject*> survivors {};     // young ones, to promote
+        for (std::size_t g = 0; g <= static_cast<std::size_t>(gen); g++) {
+            for (GcObject* obj = m_generations[g]; obj != nullptr; obj = obj->m_gc_next) {
+                if (obj->m_marked) {
+                    obj->m_marked = false;
+                    if (obj->m_generation == Generation::YOUNG) {
+                        survivors.push_back(obj);
+                    }
+                } else {
+                    garbage.push_back(obj);
+                }
+            }
+        }
+
+        // Pinned first: clearing one object may drop the last reference to the next one on the list
+        for (GcObject* obj : garbage) {
+            obj->incref();
+        }
+        for (GcObject* obj : garbage) {
+            obj->clear_references();
+        }
+        for (GcObject* obj : garbage) {
+            obj->decref();
+        }
+
+        for (GcObject* obj : survivors) {
+            unlink(obj);
+            link(obj, Generation::OLD);
+        }
+        m_stats.promoted += survivors.size();
+        if (gen == Generation::OLD) {
+            m_young_since_full = 0;
+        }
+
+        // Every young object that survived is old now, so there are no old -> young edges left to remember
+        for (GcObject* owner : m_remembered) {
+            owner->m_remembered = false;
+        }
+        m_remembered.clear();
+        m_young_allocations = 0;
+
+        auto pause = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        m_stats.collections[static_cast<std::size_t>(gen)]++;
+        m_stats.collected += garbage.size();
+        m_stats.total_pause += pause;
+        m_stats.max_pause = std::max(m_stats.max_pause, pause);
+    }
+}
@@ -0,0 +1,194 @@
+#ifndef TWOPY_GC_HPP
+#define TWOPY_GC_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "backend/objects.hpp"
+#include "backend/value.hpp"
+
+/*
+Cycle collector on top of the refcount. Refcounting frees everything acyclic the moment it dies,
+the tracing collector only has to find groups of container objects that keep each other alive.
+
+Only containers take part (GcObject): strings, functions and ranges can't point back at anything.
+A collection marks from the VM's roots (stack, frames, globals, constant pools). Every tracked
+object it can't reach is garbage: each one drops its references and the refcount frees the lot.
+
+Two generations. New containers go into the young one and survivors of a young collection are
+promoted to the old one. A young collection doesn't look inside old objects, so storing a young
+object into an old one has to go through write_barrier(), which remembers the old object as an
+extra root until the next collection.
+*/
+namespace TwoPy::Backend {
+    class Heap;
+    class GcVisitor;
+
+    enum class Generation : std::uint8_t {
+        YOUNG,
+        OLD,
+    };
+
+    /* Base for objects that can hold references to other objects */
+    class GcObject : public ObjectBase {
+        private:
+            friend class Heap;
+            friend class GcVisitor;
+
+            Heap* m_heap {};
+            GcObject* m_gc_prev {};
+            GcObject* m_gc_next {};
+            Generation m_generation {Generation::YOUNG};
+            bool m_marked {};
+            bool m_remembered {};
+
+        protected:
+            explicit GcObject(ObjectTag tag) noexcept
+                : ObjectBase(tag) {}
+
+        public:
+            ~GcObject() override;
+
+            GcObject* gc_object() noexcept override {
+                return this;
+            }
+
+            [[nodiscard]] Generation generation() const noexcept {
+                return m_generation;
+            }
+
+            /* Hands every object this one references to the visitor */
+            virtual void trace(GcVisitor& visitor) const = 0;
+
+            /* Drops every reference this object holds, how the collector breaks a cycle */
+            virtual void clear_references() = 0;
+    };
+
+    /* Marking worklist. Roots and traced children both come through visit(). */
+    class GcVisitor {
+        private:
+            Generation m_collecting;
+            std::vector<GcObject*> m_worklist {};
+
+        public:
+            explicit GcVisitor(Generation collecting) noexcept
+                : m_collecting(collecting) {}
+
+            void visit(ObjectBase* obj) {
+                GcObject* gc_obj = obj != nullptr ? obj->gc_object() : nullptr;
+                if (gc_obj == nullptr || gc_obj->m_marked) {
+                    return;
+                }
+                // A young collection treats every old object as alive without walking it
+                if (m_collecting == Generation::YOUNG && gc_obj->m_generation == Generation::OLD) {
+                    return;
+                }
+
+                gc_obj->m_marked = true;
+                m_worklist.push_back(gc_obj);
+            }
+
+            void visit(const Value& val) {
+                visit(val.as_object());
+            }
+
+            void visit(std::span<const Value> values) {
+                for (const auto& val : values) {
+                    visit(val.as_object());
+                }
+            }
+
+            /* Walks everything reachable from what was visited so far */
+            void drain() {
+                while (!m_worklist.empty()) {
+                    GcObject* obj = m_worklist.back();
+                    m_worklist.pop_back();
+                    obj->trace(*this);
+                }
+            }
+    };
+
+    struct GcStats {
+        std::array<std::size_t, 2> collections {};      // indexed by Generation
+        std::array<std::size_t, 2> tracked {};          // live containers per generation
+        std::size_t allocated {};
+        std::size_t collected {};
+        std::size_t promoted {};
+        std::chrono::nanoseconds total_pause {};
+        std::chrono::nanoseconds max_pause {};
+    };
+
+    class Heap {
+        public:
+            /* Enumerates the roots for a collection, the VM hands its stack, globals and constants to the visitor */
+            using RootScanner = std::function<void(GcVisitor&)>;
+
+            static constexpr std::size_t young_threshold = 700;    // allocations between young collections
+            static constexpr std::size_t full_every = 10;          // young collections between full ones
+
+        private:
+            // Intrusive doubly linked list per generation, untracking on free is O(1)
+            std::array<GcObject*, 2> m_generations {};
+            std::vector<GcObject*> m_remembered {};
+
+            std::size_t m_young_allocations {};
+            std::size_t m_young_since_full {};
+            GcStats m_stats {};
+
+            void link(GcObject* obj, Generation gen) noexcept;
+            void unlink(GcObject* obj) noexcept;
+
+        public:
+            Heap() = default;
+            ~Heap();
+
+            Heap(const Heap&) = delete;
+            Heap& operator=(const Heap&) = delete;
+
+            /* Creates a container and starts tracking it in the young generation */
+            template <typename T, typename... Args>
+            [[nodiscard]] ObjectRef<T> make(Args&&... args) {
+                ObjectRef<T> obj = make_object<T>(std::forward<Args>(args)...);
+                track(obj.get());
+                return obj;
+            }
+
+            void track(GcObject* obj) noexcept;
+            void untrack(GcObject* obj) noexcept;
+
+            /* Call after storing `stored` into `owner` */
+            void write_barrier(GcObject* owner, const Value& stored) {
+                if (owner->m_generation != Generation::OLD || owner->m_remembered) {
+                    return;
+                }
+
+                GcObject* target = stored.is_obj() ? stored.as_object()->gc_object() : nullptr;
+                if (target != nullptr && target->m_generation == Generation::YOUNG) {
+                    owner->m_remembered = true;
+                    m_remembered.push_back(owner);
+                }
+            }
+
+            /* The VM polls this at its safe points, where every live Value is somewhere the roots can see */
+            [[nodiscard]] bool collect_pending() const noexcept {
+                return m_young_allocations >= young_threshold;
+            }
+
+            /* Young collection, or a full one every `full_every` young collections */
+            void collect(const RootScanner& roots);
+
+            void collect(Generation gen, const RootScanner& roots);
+
+            [[nodiscard]] const GcStats& stats() const noexcept {
+                return m_stats;
+            }
+    };
+}
+
+#endif
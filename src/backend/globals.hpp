@@ -0,0 +1,94 @@
+#ifndef TWOPY_GLOBALS_HPP
+#define TWOPY_GLOBALS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <flat_map>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "backend/value.hpp"
+
+namespace TwoPy::Backend {
+    /*
+    Module globals. The compiler numbers every global name it sees (ByteCodeProgram::global_names)
+    and LOAD_NAME/STORE_NAME carry that number, so the VM indexes straight into a slot.
+    The name -> slot map is only a view for lookups by string.
+
+    version() changes whenever the set of bound names changes, not when a bound value is
+    overwritten. That is what the VM's LOAD_NAME inline caches key on.
+    */
+    class GlobalTable {
+    private:
+        std::vector<Value> m_values {};
+        std::vector<std::uint8_t> m_bound {};
+        std::vector<std::string> m_names {};
+        std::flat_map<std::string, std::size_t> m_index {};
+        std::uint32_t m_version {};
+
+    public:
+        explicit GlobalTable(const std::vector<std::string>& names)
+        : m_values(names.size()), m_bound(names.size()), m_names(names) {
+            for (std::size_t slot = 0; slot < names.size(); slot++) {
+                m_index.insert({names[slot], slot});
+            }
+        }
+
+        [[nodiscard]] std::uint32_t version() const noexcept {
+            return m_version;
+        }
+
+        [[nodiscard]] bool is_bound(std::size_t slot) const noexcept {
+            return m_bound[slot] != 0;
+        }
+
+        [[nodiscard]] const Value& operator[](std::size_t slot) const noexcept {
+            return m_values[slot];
+        }
+
+        /* Unbound slots hold None */
+        [[nodiscard]] std::span<const Value> values() const noexcept {
+            return m_values;
+        }
+
+        [[nodiscard]] const std::string& name(std::size_t slot) const noexcept {
+            return m_names[slot];
+        }
+
+        void store(std::size_t slot, Value val) {
+            if (m_bound[slot] == 0) {
+                m_bound[slot] = 1;
+                m_version++;
+            }
+            m_values[slot] = std::move(val);
+        }
+
+        /* Dictionary view */
+        [[nodiscard]] const Value* find(std::string_view name) const {
+            auto it = m_index.find(std::string(name));
+            if (it == m_index.end() || !is_bound(it->second)) {
+                return nullptr;
+            }
+            return &m_values[it->second];
+        }
+
+        /* Slot for a name the compiler never saw. Growing the table moves every slot, so it counts as a new version. */
+        std::size_t bind(const std::string& name, Value val) {
+            if (auto it = m_index.find(name); it != m_index.end()) {
+                store(it->second, std::move(val));
+                return it->second;
+            }
+
+            m_values.push_back(std::move(val));
+            m_bound.push_back(1);
+            m_names.push_back(name);
+            m_index.insert({name, m_names.size() - 1});
+            m_version++;
+            return m_names.size() - 1;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,855 @@
+#include "backend/jit.hpp"
+#include "backend/vm.hpp"
+#include "backend/operations.hpp"
+#include "backend/builtins.hpp"
+#include "backend/trace.hpp"
+
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <exception>
+#include <optional>
+
+#if TWOPY_USE_JIT
+    #include <sys/mman.h>
+    #include <unistd.h>
+
+    #include "backend/jit_stencil.hpp"
+    #include "jit_stencils.hpp"     // generated from jit_stencils.cpp by extract_stencils
+#endif
+
+namespace TwoPy::Backend {
+#if TWOPY_USE_JIT
+    std::unique_ptr<JitCode> JitCode::map(std::size_t size, std::vector<std::uint32_t> entries) {
+        auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        std::size_t mapped = (size + page - 1) / page * page;
+
+        void* memory = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            return nullptr;
+        }
+        return std::unique_ptr<JitCode>(new JitCode(memory, mapped, size, std::move(entries)));
+    }
+
+    bool JitCode::seal() noexcept {
+        return mprotect(m_memory, m_mapped, PROT_READ | PROT_EXEC) == 0;
+    }
+
+    JitCode::~JitCode() {
+        munmap(m_memory, m_mapped);
+    }
+
+    JitExit JitCode::run(VM& vm, std::size_t ip) const {
+        // Every stencil is a function of the running frame's state, the one for `ip` is where it starts
+        using Entry = std::uint32_t (*)(VM*, Value**, Value*);
+        auto entry = reinterpret_cast<Entry>(data() + m_entries[ip]);
+        return static_cast<JitExit>(entry(&vm, vm.vm_stack.sp_address(), vm.m_slots));
+    }
+
+    /* Copies the first `size` bytes of a stencil to `at` and fills in its holes, `value` gives what goes in each kind */
+    template <typename HoleValue>
+    void paste(std::uint8_t* at, const Stencil& stencil, std::size_t size, HoleValue value) {
+        std::memcpy(at, stencil.code.data(), size);
+        for (const Hole& hole : stencil.holes) {
+            // The final jump when it was left out
+            if (hole.offset >= size) {
+                continue;
+            }
+            std::uint64_t filled = value(hole.kind) + static_cast<std::uint64_t>(hole.addend);
+            if (hole.relative) {
+                filled -= reinterpret_cast<std::uintptr_t>(at + hole.offset);
+            }
+            std::memcpy(at + hole.offset, &filled, hole.width);
+        }
+    }
+
+    /*
+    Pastes a chunk together from stencils. Each instruction gets one piece, a stencil and what
+    goes in its holes, and an inline stencil also gets a second, generic piece after the last
+    instruction to be its slow path. Laying the pieces out first gives every one its address,
+    then they're copied into the mapping and patched there.
+
+    Helpers are called as helper(vm, argument, instruction index) and return a JitExit, anything
+    but CONTINUE leaves compiled code with it. Branch helpers return 1 to take the jump instead.
+    */
+    class StencilJit {
+        public:
+            [[nodiscard]] static std::unique_ptr<JitCode> compile(VM& vm, std::size_t chunk_index) {
+                return StencilJit(vm, chunk_index).emit();
+            }
+
+        private:
+            using Helper = std::uint32_t (*)(VM&, std::uint32_t, std::uint32_t) noexcept;
+
+            static constexpr auto proceed = static_cast<std::uint32_t>(JitExit::CONTINUE);
+            static constexpr auto resume = static_cast<std::uint32_t>(JitExit::RESUME);
+            static constexpr auto error = static_cast<std::uint32_t>(JitExit::ERROR);
+            static constexpr auto done = static_cast<std::uint32_t>(JitExit::DONE);
+
+            struct Piece {
+                const Stencil* stencil {};      // nullptr for an instruction with no code, it falls through to the next
+                Helper helper {};
+                std::uint32_t arg {};
+                std::uint32_t site {};
+                std::uint64_t operand {};
+                std::size_t next {};            // pieces are numbered like instructions, slow paths after them
+                std::size_t target {};
+                std::size_t slow {};
+                std::size_t offset {};
+                std::size_t size {};
+            };
+
+            VM& m_vm;
+            std::size_t m_chunk_index;
+            std::span<const Instruction> m_code;
+            std::vector<Piece> m_pieces {};
+            std::vector<Piece> m_slow_paths {};
+            bool m_unsupported {};
+
+            StencilJit(VM& vm, std::size_t chunk_index)
+                : m_vm(vm), m_chunk_index(chunk_index), m_code(vm.m_chunk_code[chunk_index]) {}
+
+            /* Helpers that can throw hand the exception to VM::run_compiled(), it mustn't unwind through machine code */
+            template <std::uint32_t (*Op)(VM&, std::uint32_t, std::uint32_t)>
+            static std::uint32_t guarded(VM& vm, std::uint32_t arg, std::uint32_t site) noexcept {
+                try {
+                    return Op(vm, arg, site);
+                } catch (...) {
+                    vm.m_jit_exception = std::current_exception();
+                    return error;
+                }
+            }
+
+            static std::uint32_t op_return(VM& vm, std::uint32_t, std::uint32_t) noexcept {
+                return vm.pop_frame() ? resume : done;
+            }
+
+            static std::uint32_t load_constant(VM& vm, std::uint32_t arg, std::uint32_t) noexcept {
+                vm.vm_stack.push(vm.m_bp->consts_pool[arg]);
+                return proceed;
+            }
+
+            /* Also the slow path of the quickened forms, they only ever were a shortcut to the same result */
+            template <Value (*Op)(const Value&, const Value&)>
+            static std::uint32_t binary(VM& vm, std::uint32_t, std::uint32_t) {
+                Value& lhs = vm.vm_stack.peek(1);
+                lhs = Op(lhs, vm.vm_stack.top());
+                vm.vm_stack.drop();
+                return proceed;
+            }
+
+            static std::uint32_t compare(VM& vm, std::uint32_t op, std::uint32_t) {
+                auto result = compare_values(static_cast<CompareOp>(op), vm.vm_stack.peek(1), vm.vm_stack.top());
+                if (!result) {
+                    return error;
+                }
+                vm.vm_stack.peek(1) = Value(bool {*result});
+                vm.vm_stack.drop();
+                return proceed;
+            }
+
+            static std::uint32_t pop(VM& vm, std::uint32_t, std::uint32_t) noexcept {
+                vm.vm_stack.drop();
+                return proceed;
+            }
+
+            static std::uint32_t store_name(VM& vm, std::uint32_t slot, std::uint32_t) noexcept {
+                vm.m_globals.store(slot, vm.vm_stack.pop());
+                return proceed;
+            }
+
+            static std::uint32_t load_name(VM& vm, std::uint32_t slot, std::uint32_t site) {
+                return vm.load_name(site, static_cast<std::uint8_t>(slot)) ? proceed : error;
+            }
+
+            static std::uint32_t load_builtin(VM& vm, std::uint32_t index, std::uint32_t) noexcept {
+                vm.vm_stack.push(builtin(index));
+                return proceed;
+            }
+
+            static std::uint32_t load_fast(VM& vm, std::uint32_t slot, std::uint32_t) noexcept {
+                vm.vm_stack.push(vm.m_slots[slot]);
+                return proceed;
+            }
+
+            static std::uint32_t store_fast(VM& vm, std::uint32_t slot, std::uint32_t) noexcept {
+                vm.m_slots[slot] = vm.vm_stack.pop();
+                return proceed;
+            }
+
+            static std::uint32_t pop_jump_if_false(VM& vm, std::uint32_t, std::uint32_t) noexcept {
+                bool truthy = vm.vm_stack.top().is_truthy();
+                vm.vm_stack.drop();
+                return truthy ? 0 : 1;
+            }
+
+            static std::uint32_t pop_jump_if_true(VM& vm, std::uint32_t, std::uint32_t) noexcept {
+                bool truthy = vm.vm_stack.top().is_truthy();
+                vm.vm_stack.drop();
+                return truthy ? 1 : 0;
+            }
+
+            /* and/or as a value, 1 keeps TOS as the result and jumps */
+            static std::uint32_t jump_if_false_or_pop(VM& vm, std::uint32_t, std::uint32_t) noexcept {
+                if (vm.vm_stack.top().is_truthy()) {
+                    vm.vm_stack.drop();
+                    return 0;
+                }
+                return 1;
+            }
+
+            static std::uint32_t jump_if_true_or_pop(VM& vm, std::uint32_t, std::uint32_t) noexcept {
+                if (vm.vm_stack.top().is_truthy()) {
+                    return 1;
+                }
+                vm.vm_stack.drop();
+                return 0;
+            }
+
+            /* The caller's ip has to be saved before its frame is left */
+            static std::uint32_t call_function(VM& vm, std::uint32_t arg_count, std::uint32_t site) {
+                vm.m_ip = site + 1;
+                switch (vm.call_function(static_cast<std::uint8_t>(arg_count))) {
+                    case VM::CallResult::RETURNED: return proceed;
+                    case VM::CallResult::ENTERED: return resume;
+                    default: return error;
+                }
+            }
+
+            static std::uint32_t tail_call(VM& vm, std::uint32_t arg_count, std::uint32_t site) {
+                vm.m_ip = site + 1;
+                switch (vm.tail_call(static_cast<std::uint8_t>(arg_count))) {
+                    case VM::CallResult::RETURNED: return proceed;
+                    case VM::CallResult::ENTERED: return resume;
+                    default: return error;
+                }
+            }
+
+            /* A function calling itself in tail position stays in its code, 1 jumps back to the start of the chunk */
+            static std::uint32_t self_tail_call(VM& vm, std::uint32_t arg_count, std::uint32_t) noexcept {
+                ObjectBase* callee = vm.vm_stack.peek(arg_count).as_object();
+                if (callee == nullptr || callee->tag() != ObjectTag::FUNCTION) {
+                    return 0;
+                }
+                const auto& func = *static_cast<FunctionPyObject*>(callee);
+                if (func.get_chunk_index() != vm.m_frames.back().chunk_index || func.get_params().size() != arg_count) {
+                    return 0;
+                }
+                return vm.replace_frame(func, static_cast<std::uint8_t>(arg_count)) ? 1 : 0;
+            }
+
+            /* The back-edge of a loop with a trace. Once that's left, the frame carries on from its exit */
+            static std::uint32_t enter_trace(VM& vm, std::uint32_t header, std::uint32_t) noexcept {
+                vm.m_loop_counts[header]++;
+                vm.m_ip = header;
+                return vm.enter_trace(header) ? resume : proceed;
+            }
+
+            static std::uint32_t jump_if_inlined(VM& vm, std::uint32_t, std::uint32_t) noexcept {
+                return vm.still_inlined() ? 1 : 0;
+            }
+
+            static std::uint32_t get_iter(VM& vm, std::uint32_t, std::uint32_t) {
+                return vm.get_iter() ? proceed : error;
+            }
+
+            static std::uint32_t for_iter(VM& vm, std::uint32_t, std::uint32_t) noexcept {
+                return vm.for_iter_step() ? 0 : 1;
+            }
+
+            /* A FOR_ITER_RANGE site whose iterable stopped being a range takes the generic step, without a rewrite */
+            static std::optional<Value> range_next(VM& vm) noexcept {
+                if (const RangePyObject* range = as_range(vm.vm_stack.peek(1))) {
+                    if (std::optional<long> current = range_step(*range, vm.vm_stack.top())) {
+                        return Value(long {*current});
+                    }
+                    vm.vm_stack.truncate(vm.vm_stack.sp() - 2);
+                    return std::nullopt;
+                }
+                if (!vm.for_iter_step()) {
+                    return std::nullopt;
+                }
+                return vm.vm_stack.pop();
+            }
+
+            static std::uint32_t for_iter_range(VM& vm, std::uint32_t, std::uint32_t) noexcept {
+                std::optional<Value> item = range_next(vm);
+                if (!item) {
+                    return 1;
+                }
+                vm.vm_stack.push(std::move(*item));
+                return 0;
+            }
+
+            /* FOR_ITER_RANGE with the store after it folded in, as the interpreter does it */
+            static std::uint32_t for_iter_range_store_fast(VM& vm, std::uint32_t slot, std::uint32_t) noexcept {
+                std::optional<Value> item = range_next(vm);
+                if (!item) {
+                    return 1;
+                }
+                vm.m_slots[slot] = std::move(*item);
+                return 0;
+            }
+
+            static std::uint32_t for_iter_range_store_name(VM& vm, std::uint32_t slot, std::uint32_t) noexcept {
+                std::optional<Value> item = range_next(vm);
+                if (!item) {
+                    return 1;
+                }
+                vm.m_globals.store(slot, std::move(*item));
+                return 0;
+            }
+
+            static std::uint32_t build_list(VM& vm, std::uint32_t count, std::uint32_t) {
+                vm.build_list(static_cast<std::uint8_t>(count));
+                return proceed;
+            }
+
+            static std::uint32_t build_map(VM& vm, std::uint32_t count, std::uint32_t) {
+                return vm.build_map(static_cast<std::uint8_t>(count)) ? proceed : error;
+            }
+
+            static std::uint32_t binary_subscr(VM& vm, std::uint32_t, std::uint32_t) {
+                return vm.binary_subscr() ? proceed : error;
+            }
+
+            static std::uint32_t store_subscr(VM& vm, std::uint32_t, std::uint32_t) {
+                return vm.store_subscr() ? proceed : error;
+            }
+
+            static std::uint32_t load_method(VM& vm, std::uint32_t name_const, std::uint32_t) {
+                return vm.load_method(static_cast<std::uint8_t>(name_const)) ? proceed : error;
+            }
+
+            static std::uint32_t call_method(VM& vm, std::uint32_t arg_count, std::uint32_t) {
+                return vm.call_method(static_cast<std::uint8_t>(arg_count)) ? proceed : error;
+            }
+
+
+            [[nodiscard]] static Piece piece(std::size_t index, const Stencil& stencil, Helper helper = nullptr, std::uint32_t arg = 0) noexcept {
+                return {.stencil = &stencil, .helper = helper, .arg = arg, .site = static_cast<std::uint32_t>(index), .next = index + 1};
+            }
+
+            [[nodiscard]] Piece branch(std::size_t index, const Stencil& stencil, Helper helper = nullptr, std::uint32_t arg = 0) const noexcept {
+                Piece jump = piece(index, stencil, helper, arg);
+                jump.target = jump_target(m_code.data(), index);
+                return jump;
+            }
+
+            /* Gives an inline stencil its slow path, the same instruction through `generic` and `helper` */
+            [[nodiscard]] Piece with_slow_path(Piece fast, const Stencil& generic, Helper helper) {
+                Piece slow = fast;
+                slow.stencil = &generic;
+                slow.helper = helper;
+                fast.slow = m_code.size() + m_slow_paths.size();
+                m_slow_paths.push_back(slow);
+                return fast;
+            }
+
+            /*
+            Whether the call is to the running function is only known when it happens, the global it
+            loads can be rebound. So the piece tries that first and jumps to the chunk's first piece,
+            anything else goes on to a generic tail call placed with the slow paths
+            */
+            [[nodiscard]] Piece tail_call_piece(std::size_t index, std::uint32_t arg_count) {
+                Piece self_call = piece(index, Stencils::branch, &self_tail_call, arg_count);
+                self_call.target = 0;
+                self_call.next = m_code.size() + m_slow_paths.size();
+                m_slow_paths.push_back(piece(index, Stencils::call, &guarded<&tail_call>, arg_count));
+                return self_call;
+            }
+
+#ifdef TWOPY_NAN_BOXING
+            /* An immediate constant is baked into the code */
+            [[nodiscard]] Piece load_constant_piece(std::size_t index, std::uint32_t arg) const {
+                const Value& constant = m_vm.m_prgm.chunks[m_chunk_index]->consts_pool[arg];
+                if (constant.is_obj()) {
+                    return piece(index, Stencils::call, &load_constant, arg);
+                }
+                Piece immediate = piece(index, Stencils::load_immediate);
+                immediate.operand = constant.bits();
+                return immediate;
+            }
+
+            [[nodiscard]] Piece int_binary_piece(std::size_t index, OpCode op, Helper generic) {
+                const Stencil& fast = op == OpCode::ADD_INT ? Stencils::add_int : op == OpCode::SUB_INT ? Stencils::sub_int : Stencils::mul_int;
+                return with_slow_path(piece(index, fast), Stencils::call, generic);
+            }
+
+            [[nodiscard]] Piece compare_piece(std::size_t index, std::uint32_t op) {
+                static constexpr std::array<const Stencil*, 6> compares {
+                    &Stencils::compare_lt, &Stencils::compare_le, &Stencils::compare_eq, &Stencils::compare_ne, &Stencils::compare_gt, &Stencils::compare_ge,
+                };
+                return with_slow_path(piece(index, *compares[op], nullptr, op), Stencils::call, &guarded<&compare>);
+            }
+
+            [[nodiscard]] Piece pop_piece(std::size_t index) {
+                return with_slow_path(piece(index, Stencils::pop), Stencils::call, &pop);
+            }
+
+            [[nodiscard]] Piece load_fast_piece(std::size_t index, std::uint32_t slot) {
+                return with_slow_path(piece(index, Stencils::load_fast, nullptr, slot), Stencils::call, &load_fast);
+            }
+
+            [[nodiscard]] Piece store_fast_piece(std::size_t index, std::uint32_t slot) {
+                return with_slow_path(piece(index, Stencils::store_fast, nullptr, slot), Stencils::call, &store_fast);
+            }
+
+            [[nodiscard]] Piece pop_jump_piece(std::size_t index, bool jump_if) {
+                const Stencil& fast = jump_if ? Stencils::pop_jump_if_true : Stencils::pop_jump_if_false;
+                return with_slow_path(branch(index, fast), Stencils::branch, jump_if ? &pop_jump_if_true : &pop_jump_if_false);
+            }
+#else
+            // The variant Value's layout is the standard library's business, every instruction calls its helper
+            [[nodiscard]] Piece load_constant_piece(std::size_t index, std::uint32_t arg) const { return piece(index, Stencils::call, &load_constant, arg); }
+            [[nodiscard]] Piece int_binary_piece(std::size_t index, OpCode, Helper generic) const { return piece(index, Stencils::call, generic); }
+            [[nodiscard]] Piece compare_piece(std::size_t index, std::uint32_t op) const { return piece(index, Stencils::call, &guarded<&compare>, op); }
+            [[nodiscard]] Piece pop_piece(std::size_t index) const { return piece(index, Stencils::call, &pop); }
+            [[nodiscard]] Piece load_fast_piece(std::size_t index, std::uint32_t slot) const { return piece(index, Stencils::call, &load_fast, slot); }
+            [[nodiscard]] Piece store_fast_piece(std::size_t index, std::uint32_t slot) const { return piece(index, Stencils::call, &store_fast, slot); }
+
+            [[nodiscard]] Piece pop_jump_piece(std::size_t index, bool jump_if) const {
+                return branch(index, Stencils::branch, jump_if ? &pop_jump_if_true : &pop_jump_if_false);
+            }
+#endif
+
+            [[nodiscard]] Piece instruction_piece(std::size_t index) {
+                const Instruction& instr = m_code[index];
+                std::uint32_t arg = instr.argument;
+
+                // A superinstruction compiles as the first instruction it replaced, the others follow with their own pieces
+                switch (unfused_opcode(instr.opcode)) {
+                    case OpCode::RETURN: return piece(index, Stencils::exit, &op_return);
+                    case OpCode::LOAD_CONSTANT: return load_constant_piece(index, arg);
+
+                    case OpCode::ADD:
+                    case OpCode::ADD_FLOAT:
+                    case OpCode::ADD_STR: return piece(index, Stencils::call, &guarded<&binary<&binary_add>>);
+                    case OpCode::SUB:
+                    case OpCode::SUB_FLOAT: return piece(index, Stencils::call, &guarded<&binary<&binary_sub>>);
+                    case OpCode::MUL:
+                    case OpCode::MUL_FLOAT: return piece(index, Stencils::call, &guarded<&binary<&binary_mul>>);
+                    case OpCode::DIV: return piece(index, Stencils::call, &guarded<&binary<&binary_div>>);
+                    case OpCode::BINARY_MODULO: return piece(index, Stencils::call, &guarded<&binary<&binary_mod>>);
+                    case OpCode::BINARY_FLOOR_DIVIDE: return piece(index, Stencils::call, &guarded<&binary<&binary_floor_div>>);
+
+                    case OpCode::ADD_INT: return int_binary_piece(index, OpCode::ADD_INT, &guarded<&binary<&binary_add>>);
+                    case OpCode::SUB_INT: return int_binary_piece(index, OpCode::SUB_INT, &guarded<&binary<&binary_sub>>);
+                    case OpCode::MUL_INT: return int_binary_piece(index, OpCode::MUL_INT, &guarded<&binary<&binary_mul>>);
+
+                    case OpCode::POP:
+                    case OpCode::MAKE_FUNCTION: return pop_piece(index);
+                    case OpCode::STORE_NAME: return piece(index, Stencils::call, &store_name, arg);
+                    case OpCode::LOAD_NAME: return piece(index, Stencils::call, &guarded<&load_name>, arg);
+                    case OpCode::LOAD_BUILTIN: return piece(index, Stencils::call, &load_builtin, arg);
+                    case OpCode::LOAD_FAST: return load_fast_piece(index, arg);
+                    case OpCode::STORE_FAST: return store_fast_piece(index, arg);
+                    case OpCode::COMPARE_OP: return compare_piece(index, arg);
+
+                    case OpCode::POP_JUMP_IF_FALSE: return pop_jump_piece(index, false);
+                    case OpCode::POP_JUMP_IF_TRUE: return pop_jump_piece(index, true);
+                    case OpCode::JUMP_IF_FALSE_OR_POP: return branch(index, Stencils::branch, &jump_if_false_or_pop);
+                    case OpCode::JUMP_IF_TRUE_OR_POP: return branch(index, Stencils::branch, &jump_if_true_or_pop);
+                    case OpCode::JUMP_FORWARD: return branch(index, Stencils::jump);
+                    case OpCode::JUMP_IF_INLINED: return branch(index, Stencils::branch, &jump_if_inlined);
+
+                    // Counted here too, so --loop-stats doesn't lose what runs compiled. A loop with a trace goes there instead
+                    case OpCode::JUMP_BACKWARD: {
+                        Piece jump = branch(index, Stencils::jump_backward);
+                        if (m_vm.m_chunk_traces[m_chunk_index][jump.target] != nullptr) {
+                            Piece enter = piece(index, Stencils::call, &enter_trace, static_cast<std::uint32_t>(jump.target));
+                            enter.next = jump.target;
+                            return enter;
+                        }
+                        jump.operand = reinterpret_cast<std::uintptr_t>(&m_vm.m_chunk_loop_counts[m_chunk_index][jump.target]);
+                        return jump;
+                    }
+
+                    case OpCode::GET_ITER: return piece(index, Stencils::call, &guarded<&get_iter>);
+                    case OpCode::FOR_ITER: return branch(index, Stencils::branch, &for_iter);
+
+                    // FOR_ITER_RANGE with the store after it folded in, as the interpreter does it
+                    case OpCode::FOR_ITER_RANGE: {
+                        const Instruction& store = m_code[index + 1];
+                        if (store.opcode != OpCode::STORE_FAST && store.opcode != OpCode::STORE_NAME) {
+                            return branch(index, Stencils::branch, &for_iter_range);
+                        }
+                        Piece fused = branch(index, Stencils::branch, store.opcode == OpCode::STORE_FAST ? &for_iter_range_store_fast : &for_iter_range_store_name, store.argument);
+                        fused.next = index + 2;
+                        return fused;
+                    }
+
+                    case OpCode::CALL_FUNCTION: return piece(index, Stencils::call, &guarded<&call_function>, arg);
+                    case OpCode::TAIL_CALL: return tail_call_piece(index, arg);
+                    case OpCode::BUILD_LIST: return piece(index, Stencils::call, &guarded<&build_list>, arg);
+                    case OpCode::BUILD_MAP: return piece(index, Stencils::call, &guarded<&build_map>, arg);
+                    case OpCode::BINARY_SUBSCR: return piece(index, Stencils::call, &guarded<&binary_subscr>);
+                    case OpCode::STORE_SUBSCR: return piece(index, Stencils::call, &guarded<&store_subscr>);
+                    case OpCode::LOAD_METHOD: return piece(index, Stencils::call, &guarded<&load_method>, arg);
+                    case OpCode::CALL_METHOD: return piece(index, Stencils::call, &guarded<&call_method>, arg);
+
+                    // Folded into its jump
+                    case OpCode::EXTENDED_ARG: return {.next = index + 1};
+
+                    // The interpreter has no handler either, the chunk stays with it so it can report the opcode
+                    default:
+                        m_unsupported = true;
+                        return {.next = index + 1};
+                }
+            }
+
+            [[nodiscard]] std::uint64_t hole_value(const Piece& piece, HoleKind kind, const std::uint8_t* base) const noexcept {
+                auto address = [&](std::size_t index) { return reinterpret_cast<std::uintptr_t>(base + m_pieces[index].offset); };
+                switch (kind) {
+                    case HoleKind::CONTINUE: return address(piece.next);
+                    case HoleKind::JUMP_TARGET: return address(piece.target);
+                    case HoleKind::SLOW: return address(piece.slow);
+                    case HoleKind::HELPER: return reinterpret_cast<std::uintptr_t>(piece.helper);
+                    case HoleKind::OPARG: return piece.arg;
+                    case HoleKind::SITE: return piece.site;
+                    case HoleKind::OPERAND: return piece.operand;
+                    case HoleKind::VM: return reinterpret_cast<std::uintptr_t>(&m_vm);
+                    case HoleKind::SP_ADDRESS: return reinterpret_cast<std::uintptr_t>(m_vm.vm_stack.sp_address());
+                    case HoleKind::SLOTS_ADDRESS: return reinterpret_cast<std::uintptr_t>(&m_vm.m_slots);
+                    // Only in trace stencils
+                    case HoleKind::RESULT:
+                    case HoleKind::LEFT:
+                    case HoleKind::RIGHT: break;
+                }
+                return 0;
+            }
+
+            [[nodiscard]] std::unique_ptr<JitCode> emit() {
+                for (std::size_t i = 0; i < m_code.size(); i++) {
+                    m_pieces.push_back(instruction_piece(i));
+                }
+                if (m_unsupported) {
+                    return nullptr;
+                }
+                m_pieces.insert(m_pieces.end(), m_slow_paths.begin(), m_slow_paths.end());
+
+                // A piece whose continuation is pasted right after it loses its final jump and falls through.
+                // Every chunk ends in RETURN, whose stencil always leaves, so nothing falls into the slow paths
+                assert(m_code.back().opcode == OpCode::RETURN);
+                std::size_t size = 0;
+                std::vector<std::uint32_t> entries;
+                entries.reserve(m_code.size());
+                for (std::size_t i = 0; i < m_pieces.size(); i++) {
+                    Piece& piece = m_pieces[i];
+                    piece.offset = size;
+                    if (i < m_code.size()) {
+                        entries.push_back(static_cast<std::uint32_t>(size));
+                    }
+                    if (piece.stencil != nullptr) {
+                        piece.size = piece.next == i + 1 && i < m_code.size() ? piece.stencil->fallthrough_size : piece.stencil->code.size();
+                    }
+                    size += piece.size;
+                }
+
+                std::unique_ptr<JitCode> code = JitCode::map(size, std::move(entries));
+                if (!code) {
+                    return nullptr;
+                }
+
+                std::uint8_t* base = code->data();
+                for (const Piece& piece : m_pieces) {
+                    if (piece.stencil != nullptr) {
+                        paste(base + piece.offset, *piece.stencil, piece.size, [&](HoleKind kind) { return hole_value(piece, kind, base); });
+                    }
+                }
+
+                return code->seal() ? std::move(code) : nullptr;
+            }
+    };
+
+    std::uint32_t JitCode::run_trace(std::uint64_t* registers) const {
+        using Entry = std::uint32_t (*)(std::uint64_t*);
+        auto entry = reinterpret_cast<Entry>(data() + m_entries[0]);
+        return entry(registers);
+    }
+
+    /*
+    Pastes an optimized trace together: the code before LOOP once, the body, the PHIs' moves and a
+    jump back to the body's start, then one stub per exit that returns its number. Loads have no
+    code, VM::run_trace() fills their registers. A compare whose only use is the guard right after
+    it is folded into that guard.
+    */
+    class TraceJit {
+        public:
+            [[nodiscard]] static bool compile(VM& vm, Trace& trace) {
+                return TraceJit(vm, trace).emit();
+            }
+
+        private:
+            struct Piece {
+                const Stencil* stencil {};
+                std::uint32_t result {};    // registers
+                std::uint32_t left {};
+                std::uint32_t right {};
+                std::uint32_t arg {};
+                std::uint64_t operand {};
+                std::size_t next {};
+                std::size_t target {};
+                std::size_t slow {};
+                std::size_t offset {};
+                std::size_t size {};
+            };
+
+            using CompareStencils = std::array<const Stencil*, 6>;     // indexed by CompareOp
+
+            static constexpr CompareStencils int_compares {
+                &Stencils::trace_compare_lt_int, &Stencils::trace_compare_le_int, &Stencils::trace_compare_eq_int,
+                &Stencils::trace_compare_ne_int, &Stencils::trace_compare_gt_int, &Stencils::trace_compare_ge_int,
+            };
+            static constexpr CompareStencils float_compares {
+                &Stencils::trace_compare_lt_float, &Stencils::trace_compare_le_float, &Stencils::trace_compare_eq_float,
+                &Stencils::trace_compare_ne_float, &Stencils::trace_compare_gt_float, &Stencils::trace_compare_ge_float,
+            };
+            static constexpr CompareStencils int_guards {
+                &Stencils::trace_guard_lt_int, &Stencils::trace_guard_le_int, &Stencils::trace_guard_eq_int,
+                &Stencils::trace_guard_ne_int, &Stencils::trace_guard_gt_int, &Stencils::trace_guard_ge_int,
+            };
+            static constexpr CompareStencils int_negated_guards {
+                &Stencils::trace_guard_not_lt_int, &Stencils::trace_guard_not_le_int, &Stencils::trace_guard_not_eq_int,
+                &Stencils::trace_guard_not_ne_int, &Stencils::trace_guard_not_gt_int, &Stencils::trace_guard_not_ge_int,
+            };
+            static constexpr CompareStencils float_guards {
+                &Stencils::trace_guard_lt_float, &Stencils::trace_guard_le_float, &Stencils::trace_guard_eq_float,
+                &Stencils::trace_guard_ne_float, &Stencils::trace_guard_gt_float, &Stencils::trace_guard_ge_float,
+            };
+            static constexpr CompareStencils float_negated_guards {
+                &Stencils::trace_guard_not_lt_float, &Stencils::trace_guard_not_le_float, &Stencils::trace_guard_not_eq_float,
+                &Stencils::trace_guard_not_ne_float, &Stencils::trace_guard_not_gt_float, &Stencils::trace_guard_not_ge_float,
+            };
+
+            VM& m_vm;
+            Trace& m_trace;
+            std::vector<Piece> m_pieces {};
+            std::vector<std::size_t> m_uses {};
+            std::size_t m_register_count;
+
+            TraceJit(VM& vm, Trace& trace)
+                : m_vm(vm), m_trace(trace), m_register_count(trace.register_count) {}
+
+            [[nodiscard]] std::uint32_t reg(std::uint32_t value) const noexcept {
+                return m_trace.registers[value];
+            }
+
+            void add(const Stencil& stencil, std::uint32_t result, std::uint32_t left = 0, std::uint32_t right = 0) {
+                m_pieces.push_back({.stencil = &stencil, .result = result, .left = left, .right = right, .next = m_pieces.size() + 1});
+            }
+
+            /* Operands, PHIs and exits all keep a value alive */
+            void count_uses() {
+                m_uses.assign(m_trace.code.size(), 0);
+                for (const TraceInstr& instr : m_trace.code) {
+                    switch (instr.op) {
+                        case TraceOp::CONSTANT:
+                        case TraceOp::LOAD_FAST:
+                        case TraceOp::LOAD_NAME:
+                        case TraceOp::LOOP: break;
+                        case TraceOp::INT_TO_FLOAT:
+                        case TraceOp::GUARD_TRUE:
+                        case TraceOp::GUARD_FALSE: m_uses[instr.left]++; break;
+                        default: m_uses[instr.left]++; m_uses[instr.right]++; break;
+                    }
+                }
+                for (const TraceExit& exit : m_trace.exits) {
+                    for (std::uint32_t value : exit.stack) {
+                        m_uses[value]++;
+                    }
+                    for (const auto& [variable, value] : exit.variables) {
+                        m_uses[value]++;
+                    }
+                }
+            }
+
+            [[nodiscard]] bool fused_into_guard(std::uint32_t value) const noexcept {
+                const std::vector<TraceInstr>& code = m_trace.code;
+                return code[value].op == TraceOp::COMPARE && m_uses[value] == 1 && value + 1 < code.size()
+                    && (code[value + 1].op == TraceOp::GUARD_TRUE || code[value + 1].op == TraceOp::GUARD_FALSE) && code[value + 1].left == value;
+            }
+
+            [[nodiscard]] static const Stencil& arithmetic_stencil(const TraceInstr& instr) noexcept {
+                if (instr.type == TraceType::FLOAT) {
+                    switch (instr.op) {
+                        case TraceOp::ADD: return Stencils::trace_add_float;
+                        case TraceOp::SUB: return Stencils::trace_sub_float;
+                        case TraceOp::MUL: return Stencils::trace_mul_float;
+                        default: return instr.checked ? Stencils::trace_div_float_checked : Stencils::trace_div_float;
+                    }
+                }
+                switch (instr.op) {
+                    case TraceOp::ADD: return instr.checked ? Stencils::trace_add_int : Stencils::trace_add_int_unchecked;
+                    case TraceOp::SUB: return instr.checked ? Stencils::trace_sub_int : Stencils::trace_sub_int_unchecked;
+                    case TraceOp::MOD: return Stencils::trace_mod_int;
+                    case TraceOp::FLOOR_DIV: return Stencils::trace_floor_div_int;
+                    default: return Stencils::trace_mul_int;
+                }
+            }
+
+            void add_guard(std::uint32_t value) {
+                const TraceInstr& guard = m_trace.code[value];
+                bool holds = guard.op == TraceOp::GUARD_TRUE;
+                if (fused_into_guard(guard.left)) {
+                    const TraceInstr& compare = m_trace.code[guard.left];
+                    bool ints = m_trace.code[compare.left].type == TraceType::INT;
+                    const CompareStencils& stencils = ints ? (holds ? int_guards : int_negated_guards) : (holds ? float_guards : float_negated_guards);
+                    add(*stencils[compare.arg], 0, reg(compare.left), reg(compare.right));
+                } else {
+                    add(holds ? Stencils::trace_guard_true : Stencils::trace_guard_false, 0, reg(guard.left));
+                }
+                m_pieces.back().slow = guard.exit;
+            }
+
+            /* The PHIs all take their values at once, a move reading what another one writes reads a copy made first */
+            void add_phi_moves() {
+                std::vector<std::pair<std::uint32_t, std::uint32_t>> moves;
+                for (std::uint32_t value = 0; value < m_trace.code.size(); value++) {
+                    const TraceInstr& phi = m_trace.code[value];
+                    if (phi.op == TraceOp::PHI && reg(phi.left) != reg(phi.right)) {
+                        moves.emplace_back(reg(phi.left), reg(phi.right));
+                    }
+                }
+                for (auto& [destination, source] : moves) {
+                    if (std::ranges::find(moves, source, &std::pair<std::uint32_t, std::uint32_t>::first) != moves.end()) {
+                        auto copy = static_cast<std::uint32_t>(m_register_count++);
+                        add(Stencils::trace_move, copy, source);
+                        source = copy;
+                    }
+                }
+                for (const auto& [destination, source] : moves) {
+                    add(Stencils::trace_move, destination, source);
+                }
+            }
+
+            [[nodiscard]] std::uint64_t hole_value(const Piece& piece, HoleKind kind, const std::uint8_t* base) const noexcept {
+                auto address = [&](std::size_t index) { return reinterpret_cast<std::uintptr_t>(base + m_pieces[index].offset); };
+                switch (kind) {
+                    case HoleKind::CONTINUE: return address(piece.next);
+                    case HoleKind::JUMP_TARGET: return address(piece.target);
+                    case HoleKind::SLOW: return address(piece.slow);
+                    case HoleKind::OPARG: return piece.arg;
+                    case HoleKind::OPERAND: return piece.operand;
+                    case HoleKind::RESULT: return piece.result * sizeof(std::uint64_t);
+                    case HoleKind::LEFT: return piece.left * sizeof(std::uint64_t);
+                    case HoleKind::RIGHT: return piece.right * sizeof(std::uint64_t);
+                    default: return 0;
+                }
+            }
+
+            [[nodiscard]] bool emit() {
+                const std::vector<TraceInstr>& code = m_trace.code;
+                std::size_t body = 0;
+                std::vector<std::size_t> guards;
+                count_uses();
+
+                for (std::uint32_t value = 0; value < code.size(); value++) {
+                    const TraceInstr& instr = code[value];
+                    switch (instr.op) {
+                        case TraceOp::LOAD_FAST:
+                        case TraceOp::LOAD_NAME:
+                        case TraceOp::PHI: break;
+                        case TraceOp::LOOP: body = m_pieces.size(); break;
+                        case TraceOp::CONSTANT:
+                            add(Stencils::trace_constant, reg(value));
+                            m_pieces.back().operand = instr.arg;
+                            break;
+                        case TraceOp::INT_TO_FLOAT: add(Stencils::trace_int_to_float, reg(value), reg(instr.left)); break;
+                        case TraceOp::COMPARE:
+                            if (!fused_into_guard(value)) {
+                                bool ints = code[instr.left].type == TraceType::INT;
+                                add(*(ints ? int_compares : float_compares)[instr.arg], reg(value), reg(instr.left), reg(instr.right));
+                            }
+                            break;
+                        case TraceOp::GUARD_TRUE:
+                        case TraceOp::GUARD_FALSE:
+                            add_guard(value);
+                            guards.push_back(m_pieces.size() - 1);
+                            break;
+                        default:
+                            add(arithmetic_stencil(instr), reg(value), reg(instr.left), reg(instr.right));
+                            if (instr.checked) {
+                                m_pieces.back().slow = instr.exit;
+                                guards.push_back(m_pieces.size() - 1);
+                            }
+                            break;
+                    }
+                }
+                add_phi_moves();
+
+                Piece jump {.stencil = &Stencils::trace_jump_backward, .target = body};
+                jump.operand = reinterpret_cast<std::uintptr_t>(&m_vm.m_chunk_loop_counts[m_trace.chunk_index][m_trace.header]);
+                jump.next = m_pieces.size();
+                m_pieces.push_back(jump);
+
+                // Every guard's `slow` so far is its exit's number, the stubs go after the jump
+                std::size_t exits = m_pieces.size();
+                for (std::size_t guard : guards) {
+                    m_pieces[guard].slow += exits;
+                }
+                for (std::size_t exit = 0; exit < m_trace.exits.size(); exit++) {
+                    m_pieces.push_back({.stencil = &Stencils::trace_exit, .arg = static_cast<std::uint32_t>(exit), .next = m_pieces.size() + 1});
+                }
+
+                std::size_t size = 0;
+                for (std::size_t i = 0; i < m_pieces.size(); i++) {
+                    Piece& piece = m_pieces[i];
+                    piece.offset = size;
+                    piece.size = piece.next == i + 1 ? piece.stencil->fallthrough_size : piece.stencil->code.size();
+                    size += piece.size;
+                }
+
+                std::unique_ptr<JitCode> machine_code = JitCode::map(size, {0});
+                if (!machine_code) {
+                    return false;
+                }
+                std::uint8_t* base = machine_code->data();
+                for (const Piece& piece : m_pieces) {
+                    paste(base + piece.offset, *piece.stencil, piece.size, [&](HoleKind kind) { return hole_value(piece, kind, base); });
+                }
+                if (!machine_code->seal()) {
+                    return false;
+                }
+
+                m_trace.machine_code = std::move(machine_code);
+                m_trace.register_file.assign(m_register_count, 0);
+                return true;
+            }
+    };
+#else
+    std::unique_ptr<JitCode> JitCode::map(std::size_t, std::vector<std::uint32_t>) {
+        return nullptr;
+    }
+
+    bool JitCode::seal() noexcept {
+        return false;
+    }
+
+    JitCode::~JitCode() = default;
+
+    JitExit JitCode::run(VM&, std::size_t) const {
+        return JitExit::RESUME;
+    }
+
+    std::uint32_t JitCode::run_trace(std::uint64_t*) const {
+        return 0;
+    }
+#endif
+
+    std::unique_ptr<JitCode> jit_compile([[maybe_unused]] VM& vm, [[maybe_unused]] std::size_t chunk_index) {
+#if TWOPY_USE_JIT
+        return StencilJit::compile(vm, chunk_index);
+#else
+        return nullptr;
+#endif
+    }
+
+    bool jit_compile_trace([[maybe_unused]] VM& vm, [[maybe_unused]] Trace& trace) {
+#if TWOPY_USE_JIT
+        return TraceJit::compile(vm, trace);
+#else
+        return false;
+#endif
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef TWOPY_JIT_HPP
+#define TWOPY_JIT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#if defined(TWOPY_JIT) && defined(__x86_64__) && defined(__linux__)
+    #define TWOPY_USE_JIT 1
+#else
+    #define TWOPY_USE_JIT 0
+#endif
+
+/*
+Copy-and-patch JIT for x86-64 Linux. A hot chunk becomes machine code by pasting one stencil per
+instruction, in order, and filling in the stencil's holes with the instruction's operands, the
+helper it calls and the addresses of the templates it jumps to. Stencils are compiled from C++
+(jit_stencils.cpp) when twopy is built, extract_stencils turns the object file into the byte arrays
+jit.cpp pastes from. Most stencils call a C++ helper that does what the interpreter's handler does,
+on the same stack and frames. Under NaN-boxing the int arithmetic, int compares, bool branches and
+fast-local moves are done inline, and their helper is only the slow path.
+
+Compiled code runs until the frame changes (a call into Python code, a return) and then hands
+back to VM::run_compiled(), which carries on natively if the new frame's chunk is compiled too.
+A hot loop that only does arithmetic on numbers gets a trace of its own first (trace.hpp), pasted
+from the same kind of stencils. Elsewhere, or without `-DTWOPY_JIT=ON`, jit_compile() and
+jit_compile_trace() give nothing and everything stays interpreted.
+*/
+namespace TwoPy::Backend {
+    class VM;
+
+    /* How compiled code hands control back */
+    enum class JitExit : std::uint32_t {
+        CONTINUE,   // only passed between templates and helpers, never returned
+        RESUME,     // the running frame changed, carry on from its m_ip
+        ERROR,      // already reported, or left in VM::m_jit_exception to rethrow
+        DONE,       // the module frame returned
+    };
+
+    /* Filled in whenever the JIT runs, printed by `-p` */
+    struct JitStats {
+        std::size_t compiled {};        // chunks
+        std::size_t code_bytes {};
+        std::size_t entries {};         // times the VM handed a frame to compiled code
+        std::size_t traces {};          // loops recorded and compiled, see trace.hpp
+        std::size_t trace_aborts {};    // recordings given up on
+        std::size_t traces_discarded {};
+        std::size_t trace_entries {};
+        std::size_t trace_iterations {};
+    };
+
+    /* A compiled chunk in its own executable mapping, one template per instruction and then the out-of-line slow paths */
+    class JitCode {
+        private:
+            void* m_memory {};
+            std::size_t m_mapped {};
+            std::size_t m_size {};
+            std::vector<std::uint32_t> m_entries;   // instruction index -> offset of its template
+
+            JitCode(void* memory, std::size_t mapped, std::size_t size, std::vector<std::uint32_t> entries) noexcept
+                : m_memory(memory), m_mapped(mapped), m_size(size), m_entries(std::move(entries)) {}
+
+        public:
+            /* Fresh writable pages for `size` bytes of code, nullptr if the OS says no. Nothing runs before seal() */
+            [[nodiscard]] static std::unique_ptr<JitCode> map(std::size_t size, std::vector<std::uint32_t> entries);
+
+            /* The code is patched in place, holes need the addresses it ends up at */
+            [[nodiscard]] std::uint8_t* data() const noexcept {
+                return static_cast<std::uint8_t*>(m_memory);
+            }
+
+            /* Flips the pages to read+execute, they're never writable and executable at once */
+            [[nodiscard]] bool seal() noexcept;
+
+            JitCode(const JitCode&) = delete;
+            JitCode& operator=(const JitCode&) = delete;
+            ~JitCode();
+
+            [[nodiscard]] std::size_t size() const noexcept {
+                return m_size;
+            }
+
+            /* Runs the running frame from instruction `ip` until it stops being the running frame, an error or the end of the program */
+            [[nodiscard]] JitExit run(VM& vm, std::size_t ip) const;
+
+            /* Runs a compiled trace on its register file until a guard fails, returns the number of the exit it took */
+            [[nodiscard]] std::uint32_t run_trace(std::uint64_t* registers) const;
+    };
+
+    /* Compiles the chunk from the VM's (quickened) copy of its code. nullptr where the JIT isn't built in */
+    [[nodiscard]] std::unique_ptr<JitCode> jit_compile(VM& vm, std::size_t chunk_index);
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef TWOPY_JIT_STENCIL_HPP
+#define TWOPY_JIT_STENCIL_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+/*
+What extract_stencils leaves for the JIT: a stencil is the machine code the compiler made for one
+function in jit_stencils.cpp, plus the places in it that referred to one of the `_JIT_*` symbols.
+Those holes are filled in per instruction once the code has its final address.
+*/
+namespace TwoPy::Backend {
+    enum class HoleKind : std::uint8_t {
+        CONTINUE,       // the next template to run
+        JUMP_TARGET,    // the template of the instruction's jump target
+        SLOW,           // the out-of-line generic copy of this instruction, or a trace guard's exit
+        HELPER,         // the C++ helper it calls
+        OPARG,          // the instruction's argument
+        SITE,           // the instruction's index in its chunk
+        OPERAND,        // anything else the template needs baked in, a constant's bits or a counter's address
+        VM,             // the VM the code was compiled for
+        SP_ADDRESS,     // where that VM keeps its value stack's pointer
+        SLOTS_ADDRESS,  // where it keeps the running frame's slots
+        RESULT,         // trace stencils: byte offsets into the register file, of the value computed
+        LEFT,           // and of the operands
+        RIGHT,
+    };
+
+    /* The symbol each kind of hole is written as in jit_stencils.cpp, in HoleKind's order */
+    inline constexpr std::array<std::string_view, 13> hole_symbols {
+        "_JIT_CONTINUE", "_JIT_JUMP_TARGET", "_JIT_SLOW", "_JIT_HELPER", "_JIT_OPARG", "_JIT_SITE", "_JIT_OPERAND",
+        "_JIT_VM", "_JIT_SP_ADDRESS", "_JIT_SLOTS_ADDRESS", "_JIT_RESULT", "_JIT_LEFT", "_JIT_RIGHT",
+    };
+
+    struct Hole {
+        std::uint32_t offset;       // from the start of the stencil
+        HoleKind kind;
+        std::uint8_t width;         // 8, or 4 for a jump's displacement or where the compiler only wanted the low half
+        bool relative;              // a jump's displacement, the value minus the hole's own address
+        std::int64_t addend;
+    };
+
+    struct Stencil {
+        std::span<const std::uint8_t> code;
+        std::span<const Hole> holes;
+        // The code without a final `jmp _JIT_CONTINUE`, everything when it doesn't end in one.
+        // A template pasted right before its continuation is copied only this far and falls through
+        std::size_t fallthrough_size;
+    };
+}
+
+#endif
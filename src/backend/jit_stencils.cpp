@@ -0,0 +1,409 @@
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <type_traits>
+
+#include "backend/value.hpp"
+
+/*
+The JIT's templates, written as C++ and never linked into twopy. The build compiles this file on
+its own to an object file and extract_stencils copies each `twopy_stencil_*` function's machine
+code out of it, noting where it refers to a `_JIT_*` symbol. jit.cpp pastes one stencil per
+instruction and writes the real operands, helpers and jump targets into those holes.
+
+That only works if a stencil is self-contained, so the rules are:
+- no calls and no data other than through the `_JIT_*` symbols below. With the medium code model
+  the data ones become 64-bit immediates, and the templates a stencil moves on to are reached by
+  jumps with a 32-bit displacement, they're all in the same mapping
+- moving on to another template is always a tail call, compiled code never grows the stack
+- a hole's value is never compared, the compiler is allowed to assume an address isn't 0
+
+Every stencil has the same signature, so moving on is a plain jump and the three arguments stay
+in registers from one template to the next. `sp` is the value stack's own pointer, helpers move it
+too. The return value is a JitExit and goes straight back to JitCode::run().
+
+The trace stencils at the end are the exception, see trace.hpp: they only ever see the trace's
+register file, and return the number of the exit they left through to JitCode::run_trace().
+*/
+namespace TwoPy::Backend {
+    class VM;
+}
+
+using TwoPy::Backend::VM;
+using TwoPy::Backend::Value;
+
+/* The stack's slots are only ever looked at as 8-byte NaN-boxes, with the variant Value every template calls its helper */
+using Boxed = std::uint64_t;
+
+extern "C" {
+    extern const char _JIT_OPARG[];
+    extern const char _JIT_SITE[];
+    extern const char _JIT_OPERAND[];
+    extern const char _JIT_HELPER[];
+    extern const char _JIT_VM[];
+    extern const char _JIT_SP_ADDRESS[];
+    extern const char _JIT_SLOTS_ADDRESS[];
+
+    // Sized so the compiler takes them for small data and folds the offset into the addressing mode
+    extern const char _JIT_RESULT[1];
+    extern const char _JIT_LEFT[1];
+    extern const char _JIT_RIGHT[1];
+
+    std::uint32_t _JIT_CONTINUE(VM* vm, Boxed** sp, Boxed* slots) noexcept;
+    std::uint32_t _JIT_JUMP_TARGET(VM* vm, Boxed** sp, Boxed* slots) noexcept;
+    std::uint32_t _JIT_SLOW(VM* vm, Boxed** sp, Boxed* slots) noexcept;
+}
+
+#define STENCIL(name) extern "C" std::uint32_t twopy_stencil_##name(VM* vm, Boxed** sp, Boxed* slots) noexcept
+
+namespace {
+    /* The helper lives in twopy and the code in an mmap, too far apart for a direct call, so it's called through its address */
+    [[gnu::always_inline]] inline std::uint32_t helper(VM* vm, std::uint32_t arg, std::uint32_t site) noexcept {
+        using Helper = std::uint32_t (*)(VM*, std::uint32_t, std::uint32_t) noexcept;
+        auto address = reinterpret_cast<std::uintptr_t>(_JIT_HELPER);
+        asm("" : "+r"(address));    // otherwise the compiler sees through the cast and calls the symbol directly
+        return reinterpret_cast<Helper>(address)(vm, arg, site);
+    }
+
+    [[gnu::always_inline]] inline std::uint32_t oparg() noexcept {
+        return static_cast<std::uint32_t>(reinterpret_cast<std::uintptr_t>(_JIT_OPARG));
+    }
+
+    [[gnu::always_inline]] inline std::uint32_t site() noexcept {
+        return static_cast<std::uint32_t>(reinterpret_cast<std::uintptr_t>(_JIT_SITE));
+    }
+
+    [[gnu::always_inline]] inline std::uint64_t operand() noexcept {
+        return reinterpret_cast<std::uintptr_t>(_JIT_OPERAND);
+    }
+
+    /*
+    Moves on after a helper call. The arguments are all baked in (the VM, where it keeps the
+    stack's pointer and the running frame's slots) so nothing has to be kept in callee-saved
+    registers across the call, which would cost every template a push and a pop each
+    */
+    template <std::uint32_t (*Next)(VM*, Boxed**, Boxed*) noexcept>
+    [[gnu::always_inline]] inline std::uint32_t after_call() noexcept {
+        auto* vm = reinterpret_cast<VM*>(const_cast<char*>(_JIT_VM));
+        auto** sp = reinterpret_cast<Boxed**>(const_cast<char*>(_JIT_SP_ADDRESS));
+        Boxed* slots = *reinterpret_cast<Boxed* const*>(_JIT_SLOTS_ADDRESS);
+        return Next(vm, sp, slots);
+    }
+}
+
+/* Calls the helper and carries on unless it says to leave. Also the slow path of every inline template below */
+STENCIL(call) {
+    if (std::uint32_t exit = helper(vm, oparg(), site())) {
+        return exit;
+    }
+    return after_call<_JIT_CONTINUE>();
+}
+
+/* Always leaves with what the helper says */
+STENCIL(exit) {
+    return helper(vm, oparg(), site());
+}
+
+/* The helper returns nonzero to take the jump, which for loops is the way out */
+STENCIL(branch) {
+    if (helper(vm, oparg(), site()) != 0) [[unlikely]] {
+        return after_call<_JIT_JUMP_TARGET>();
+    }
+    return after_call<_JIT_CONTINUE>();
+}
+
+STENCIL(jump) {
+    return _JIT_JUMP_TARGET(vm, sp, slots);
+}
+
+/* A loop's back-edge, counted so --loop-stats doesn't lose what runs compiled */
+STENCIL(jump_backward) {
+    ++*reinterpret_cast<std::size_t*>(operand());
+    return _JIT_JUMP_TARGET(vm, sp, slots);
+}
+
+#ifdef TWOPY_NAN_BOXING
+namespace {
+    constexpr int tag_shift = 48;
+
+    [[gnu::always_inline]] inline constexpr std::uint64_t tag(std::uint64_t bits) noexcept {
+        return bits >> tag_shift;
+    }
+
+    constexpr std::uint64_t int_tag = tag(Value::int_bits(0));
+    constexpr std::uint64_t bool_tag = tag(Value::bool_bits(false));
+    constexpr std::uint64_t obj_tag = tag(Value::obj_bits());
+
+    [[gnu::always_inline]] inline long as_int(Boxed value) noexcept {
+        return static_cast<long>(value << (64 - tag_shift)) >> (64 - tag_shift);
+    }
+
+    /* 48-bit int arithmetic, anything else or a result that leaves the range takes the generic path */
+    template <typename Op>
+    [[gnu::always_inline]] inline std::uint32_t int_binary(VM* vm, Boxed** sp, Boxed* slots, Op op) noexcept {
+        Boxed* top = *sp;
+        if (tag(top[-2]) != int_tag || tag(top[-1]) != int_tag) [[unlikely]] {
+            return _JIT_SLOW(vm, sp, slots);
+        }
+        long result {};
+        if (op(as_int(top[-2]), as_int(top[-1]), &result) || result < Value::int_min || result > Value::int_max) [[unlikely]] {
+            return _JIT_SLOW(vm, sp, slots);
+        }
+        top[-2] = Value::int_bits(result);
+        *sp = top - 1;
+        return _JIT_CONTINUE(vm, sp, slots);
+    }
+
+    template <typename Compare>
+    [[gnu::always_inline]] inline std::uint32_t int_compare(VM* vm, Boxed** sp, Boxed* slots, Compare compare) noexcept {
+        Boxed* top = *sp;
+        if (tag(top[-2]) != int_tag || tag(top[-1]) != int_tag) [[unlikely]] {
+            return _JIT_SLOW(vm, sp, slots);
+        }
+        top[-2] = Value::bool_bits(compare(as_int(top[-2]), as_int(top[-1])));
+        *sp = top - 1;
+        return _JIT_CONTINUE(vm, sp, slots);
+    }
+
+    /* A bool decides inline, anything else asks the helper about its truthiness */
+    template <bool JumpIf>
+    [[gnu::always_inline]] inline std::uint32_t pop_jump(VM* vm, Boxed** sp, Boxed* slots) noexcept {
+        Boxed* top = *sp;
+        if (tag(top[-1]) != bool_tag) [[unlikely]] {
+            return _JIT_SLOW(vm, sp, slots);
+        }
+        *sp = top - 1;
+        if (((top[-1] & 1) != 0) == JumpIf) {
+            return _JIT_JUMP_TARGET(vm, sp, slots);
+        }
+        return _JIT_CONTINUE(vm, sp, slots);
+    }
+}
+
+/* Objects need a refcount touched, only immediates are copied inline */
+STENCIL(load_fast) {
+    Boxed value = slots[oparg()];
+    if (tag(value) == obj_tag) [[unlikely]] {
+        return _JIT_SLOW(vm, sp, slots);
+    }
+    *(*sp)++ = value;
+    return _JIT_CONTINUE(vm, sp, slots);
+}
+
+/* The stored value moves, only an object being overwritten needs the helper to release it */
+STENCIL(store_fast) {
+    Boxed& slot = slots[oparg()];
+    if (tag(slot) == obj_tag) [[unlikely]] {
+        return _JIT_SLOW(vm, sp, slots);
+    }
+    slot = *--*sp;
+    return _JIT_CONTINUE(vm, sp, slots);
+}
+
+STENCIL(pop) {
+    if (tag((*sp)[-1]) == obj_tag) [[unlikely]] {
+        return _JIT_SLOW(vm, sp, slots);
+    }
+    --*sp;
+    return _JIT_CONTINUE(vm, sp, slots);
+}
+
+/* A constant that isn't an object, its bits are the operand */
+STENCIL(load_immediate) {
+    *(*sp)++ = operand();
+    return _JIT_CONTINUE(vm, sp, slots);
+}
+
+STENCIL(add_int) {
+    return int_binary(vm, sp, slots, [](long lhs, long rhs, long* result) { return __builtin_add_overflow(lhs, rhs, result); });
+}
+
+STENCIL(sub_int) {
+    return int_binary(vm, sp, slots, [](long lhs, long rhs, long* result) { return __builtin_sub_overflow(lhs, rhs, result); });
+}
+
+STENCIL(mul_int) {
+    return int_binary(vm, sp, slots, [](long lhs, long rhs, long* result) { return __builtin_mul_overflow(lhs, rhs, result); });
+}
+
+// One per CompareOp, the operator is part of the code rather than an operand
+STENCIL(compare_lt) { return int_compare(vm, sp, slots, std::less<long> {}); }
+STENCIL(compare_le) { return int_compare(vm, sp, slots, std::less_equal<long> {}); }
+STENCIL(compare_eq) { return int_compare(vm, sp, slots, std::equal_to<long> {}); }
+STENCIL(compare_ne) { return int_compare(vm, sp, slots, std::not_equal_to<long> {}); }
+STENCIL(compare_gt) { return int_compare(vm, sp, slots, std::greater<long> {}); }
+STENCIL(compare_ge) { return int_compare(vm, sp, slots, std::greater_equal<long> {}); }
+
+STENCIL(pop_jump_if_false) { return pop_jump<false>(vm, sp, slots); }
+STENCIL(pop_jump_if_true) { return pop_jump<true>(vm, sp, slots); }
+#endif
+
+/*
+Trace stencils. A trace keeps its values unboxed, one 8-byte register each in a file the C++ side
+fills on entry: an int as a long, a float as the double's bits, a bool as 0 or 1. RESULT, LEFT and
+RIGHT are byte offsets into it. A guard that fails jumps to _JIT_SLOW, the exit stub for its snapshot.
+
+Their continuations take a different signature, so they are declared again under their own names
+*/
+namespace trace {
+    extern "C" std::uint32_t next(std::uint64_t* registers) noexcept asm("_JIT_CONTINUE");
+    extern "C" std::uint32_t loop(std::uint64_t* registers) noexcept asm("_JIT_JUMP_TARGET");
+    extern "C" std::uint32_t leave(std::uint64_t* registers) noexcept asm("_JIT_SLOW");
+}
+
+#define TRACE_STENCIL(name) extern "C" std::uint32_t twopy_stencil_trace_##name(std::uint64_t* registers) noexcept
+
+namespace {
+    [[gnu::always_inline]] inline std::uint64_t& reg(std::uint64_t* registers, const char* offset) noexcept {
+        return *reinterpret_cast<std::uint64_t*>(reinterpret_cast<char*>(registers) + reinterpret_cast<std::uintptr_t>(offset));
+    }
+
+    [[gnu::always_inline]] inline long int_reg(std::uint64_t* registers, const char* offset) noexcept {
+        return static_cast<long>(reg(registers, offset));
+    }
+
+    [[gnu::always_inline]] inline double float_reg(std::uint64_t* registers, const char* offset) noexcept {
+        return std::bit_cast<double>(reg(registers, offset));
+    }
+
+    /* Leaves when the result wouldn't be a small int any more, the interpreter makes the bigint */
+    template <bool Checked, typename Op>
+    [[gnu::always_inline]] inline std::uint32_t int_arithmetic(std::uint64_t* registers, Op op) noexcept {
+        long result {};
+        bool overflow = op(int_reg(registers, _JIT_LEFT), int_reg(registers, _JIT_RIGHT), &result);
+        if (Checked && (overflow || result < Value::int_min || result > Value::int_max)) [[unlikely]] {
+            return trace::leave(registers);
+        }
+        reg(registers, _JIT_RESULT) = static_cast<std::uint64_t>(result);
+        return trace::next(registers);
+    }
+
+    /* Python's floor division on longs as int_arithmetic() takes it, "overflow" for a zero divisor too */
+    template <bool Modulo>
+    [[gnu::always_inline]] inline bool floor_divide(long lhs, long rhs, long* result) noexcept {
+        if (rhs == 0 || (rhs == -1 && lhs == std::numeric_limits<long>::min())) {
+            return true;
+        }
+        long quotient = lhs / rhs;
+        long remainder = lhs % rhs;
+        if (remainder != 0 && (remainder < 0) != (rhs < 0)) {
+            quotient--;
+            remainder += rhs;
+        }
+        *result = Modulo ? remainder : quotient;
+        return false;
+    }
+
+    template <typename Op>
+    [[gnu::always_inline]] inline std::uint32_t float_arithmetic(std::uint64_t* registers, Op op) noexcept {
+        reg(registers, _JIT_RESULT) = std::bit_cast<std::uint64_t>(op(float_reg(registers, _JIT_LEFT), float_reg(registers, _JIT_RIGHT)));
+        return trace::next(registers);
+    }
+
+    template <typename T>
+    [[gnu::always_inline]] inline T typed_reg(std::uint64_t* registers, const char* offset) noexcept {
+        if constexpr (std::is_same_v<T, double>) {
+            return float_reg(registers, offset);
+        } else {
+            return int_reg(registers, offset);
+        }
+    }
+
+    template <typename T, typename Compare>
+    [[gnu::always_inline]] inline std::uint32_t compare(std::uint64_t* registers, Compare compare) noexcept {
+        reg(registers, _JIT_RESULT) = compare(typed_reg<T>(registers, _JIT_LEFT), typed_reg<T>(registers, _JIT_RIGHT)) ? 1 : 0;
+        return trace::next(registers);
+    }
+
+    /* A compare only a guard looks at is never materialized, the guard branches on it directly */
+    template <typename T, bool Expected, typename Compare>
+    [[gnu::always_inline]] inline std::uint32_t guard(std::uint64_t* registers, Compare compare) noexcept {
+        if (compare(typed_reg<T>(registers, _JIT_LEFT), typed_reg<T>(registers, _JIT_RIGHT)) != Expected) [[unlikely]] {
+            return trace::leave(registers);
+        }
+        return trace::next(registers);
+    }
+}
+
+TRACE_STENCIL(constant) {
+    reg(registers, _JIT_RESULT) = operand();
+    return trace::next(registers);
+}
+
+/* A phi that couldn't share its register with the value it takes on */
+TRACE_STENCIL(move) {
+    reg(registers, _JIT_RESULT) = reg(registers, _JIT_LEFT);
+    return trace::next(registers);
+}
+
+TRACE_STENCIL(int_to_float) {
+    reg(registers, _JIT_RESULT) = std::bit_cast<std::uint64_t>(static_cast<double>(int_reg(registers, _JIT_LEFT)));
+    return trace::next(registers);
+}
+
+TRACE_STENCIL(add_int) { return int_arithmetic<true>(registers, [](long lhs, long rhs, long* result) { return __builtin_add_overflow(lhs, rhs, result); }); }
+TRACE_STENCIL(sub_int) { return int_arithmetic<true>(registers, [](long lhs, long rhs, long* result) { return __builtin_sub_overflow(lhs, rhs, result); }); }
+TRACE_STENCIL(mul_int) { return int_arithmetic<true>(registers, [](long lhs, long rhs, long* result) { return __builtin_mul_overflow(lhs, rhs, result); }); }
+TRACE_STENCIL(mod_int) { return int_arithmetic<true>(registers, [](long lhs, long rhs, long* result) { return floor_divide<true>(lhs, rhs, result); }); }
+TRACE_STENCIL(floor_div_int) { return int_arithmetic<true>(registers, [](long lhs, long rhs, long* result) { return floor_divide<false>(lhs, rhs, result); }); }
+
+// Where a guard already bounds the operand, see eliminate_overflow_guards() in trace.cpp
+TRACE_STENCIL(add_int_unchecked) { return int_arithmetic<false>(registers, [](long lhs, long rhs, long* result) { return __builtin_add_overflow(lhs, rhs, result); }); }
+TRACE_STENCIL(sub_int_unchecked) { return int_arithmetic<false>(registers, [](long lhs, long rhs, long* result) { return __builtin_sub_overflow(lhs, rhs, result); }); }
+
+TRACE_STENCIL(add_float) { return float_arithmetic(registers, std::plus<double> {}); }
+TRACE_STENCIL(sub_float) { return float_arithmetic(registers, std::minus<double> {}); }
+TRACE_STENCIL(mul_float) { return float_arithmetic(registers, std::multiplies<double> {}); }
+TRACE_STENCIL(div_float) { return float_arithmetic(registers, std::divides<double> {}); }
+
+// A divisor that may be zero leaves before dividing, the interpreter raises the ZeroDivisionError
+TRACE_STENCIL(div_float_checked) {
+    if (float_reg(registers, _JIT_RIGHT) == 0.0) [[unlikely]] {
+        return trace::leave(registers);
+    }
+    return float_arithmetic(registers, std::divides<double> {});
+}
+
+TRACE_STENCIL(guard_true) {
+    if (reg(registers, _JIT_LEFT) == 0) [[unlikely]] {
+        return trace::leave(registers);
+    }
+    return trace::next(registers);
+}
+
+TRACE_STENCIL(guard_false) {
+    if (reg(registers, _JIT_LEFT) != 0) [[unlikely]] {
+        return trace::leave(registers);
+    }
+    return trace::next(registers);
+}
+
+// Per CompareOp and operand type: the compare, the guard that it holds and the guard that it doesn't
+#define TRACE_COMPARE_STENCILS(op, Compare)                                                                          \
+    TRACE_STENCIL(compare_##op##_int) { return compare<long>(registers, Compare<long> {}); }                          \
+    TRACE_STENCIL(compare_##op##_float) { return compare<double>(registers, Compare<double> {}); }                    \
+    TRACE_STENCIL(guard_##op##_int) { return guard<long, true>(registers, Compare<long> {}); }                        \
+    TRACE_STENCIL(guard_not_##op##_int) { return guard<long, false>(registers, Compare<long> {}); }                   \
+    TRACE_STENCIL(guard_##op##_float) { return guard<double, true>(registers, Compare<double> {}); }                  \
+    TRACE_STENCIL(guard_not_##op##_float) { return guard<double, false>(registers, Compare<double> {}); }
+
+TRACE_COMPARE_STENCILS(lt, std::less)
+TRACE_COMPARE_STENCILS(le, std::less_equal)
+TRACE_COMPARE_STENCILS(eq, std::equal_to)
+TRACE_COMPARE_STENCILS(ne, std::not_equal_to)
+TRACE_COMPARE_STENCILS(gt, std::greater)
+TRACE_COMPARE_STENCILS(ge, std::greater_equal)
+
+#undef TRACE_COMPARE_STENCILS
+
+/* The end of an iteration, counted like the loop's back-edge in the interpreter */
+TRACE_STENCIL(jump_backward) {
+    ++*reinterpret_cast<std::uint64_t*>(operand());
+    return trace::loop(registers);
+}
+
+/* An exit's stub, the C++ side restores the interpreter's state from the snapshot */
+TRACE_STENCIL(exit) {
+    return oparg();
+}
@@ -0,0 +1,23 @@
+#include "backend/list_object.hpp"
+#include "backend/operations.hpp"
+
+namespace TwoPy::Backend {
+    std::string ListPyObject::stringify() {
+        if (m_printing) {
+            return "[...]";
+        }
+        m_printing = true;
+
+        std::string result = "[";
+        for (std::size_t i = 0; i < m_items.size(); i++) {
+            if (i > 0) {
+                result += ", ";
+            }
+            result += repr(m_items[i]);
+        }
+        result += ']';
+
+        m_printing = false;
+        return result;
+    }
+}
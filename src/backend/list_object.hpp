@@ -0,0 +1,95 @@
+#ifndef TWOPY_LIST_OBJECT_HPP
+#define TWOPY_LIST_OBJECT_HPP
+
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "backend/gc.hpp"
+#include "backend/value.hpp"
+
+/*
+list: one contiguous array of Values that grows geometrically, so append is amortized O(1) and
+indexing is a bounds check plus a load. Lists can hold themselves, so they're GC tracked; every
+store into an existing list goes through the heap's write barrier.
+*/
+namespace TwoPy::Backend {
+    class ListPyObject final : public GcObject {
+        private:
+            std::vector<Value> m_items;
+            bool m_printing {};     // set while stringify() runs, a list inside itself prints as [...]
+
+        public:
+            explicit ListPyObject(std::vector<Value> items = {}) noexcept
+                : GcObject(ObjectTag::LIST), m_items(std::move(items)) {}
+
+            [[nodiscard]] std::size_t size() const noexcept {
+                return m_items.size();
+            }
+
+            [[nodiscard]] std::span<const Value> items() const noexcept {
+                return m_items;
+            }
+
+            /* Python index (negative counts from the end) to a position, nullopt when out of range */
+            [[nodiscard]] std::optional<std::size_t> position(long index) const noexcept {
+                auto size = static_cast<long>(m_items.size());
+                if (index < 0) {
+                    index += size;
+                }
+                if (index < 0 || index >= size) {
+                    return std::nullopt;
+                }
+                return static_cast<std::size_t>(index);
+            }
+
+            /* Only with a position from position() */
+            [[nodiscard]] const Value& operator[](std::size_t pos) const noexcept {
+                return m_items[pos];
+            }
+
+            void store(Heap& heap, std::size_t pos, Value val) {
+                heap.write_barrier(this, val);
+                m_items[pos] = std::move(val);
+            }
+
+            void append(Heap& heap, Value val) {
+                heap.write_barrier(this, val);
+                m_items.push_back(std::move(val));
+            }
+
+            /* Removes and returns the last item, the caller checks for empty */
+            [[nodiscard]] Value pop_back() {
+                Value last = std::move(m_items.back());
+                m_items.pop_back();
+                return last;
+            }
+
+            /* Removes and returns the item at `pos`, shifting the rest down */
+            [[nodiscard]] Value erase(std::size_t pos) {
+                Value item = std::move(m_items[pos]);
+                m_items.erase(m_items.begin() + static_cast<std::ptrdiff_t>(pos));
+                return item;
+            }
+
+            void trace(GcVisitor& visitor) const override {
+                visitor.visit(std::span<const Value>(m_items));
+            }
+
+            void clear_references() override {
+                // Moved out first, destroying the items may reach back into this list
+                std::vector<Value> items = std::exchange(m_items, {});
+            }
+
+            std::string stringify() override;
+
+            bool is_truthy() const noexcept override {
+                return !m_items.empty();
+            }
+    };
+}
+
+#endif
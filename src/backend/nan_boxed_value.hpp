@@ -0,0 +1,234 @@
+#ifndef TWOPY_NAN_BOXED_VALUE_HPP
+#define TWOPY_NAN_BOXED_VALUE_HPP
+
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <variant>
+
+#include "backend/objects.hpp"
+
+/*
+8-byte Value for `-DTWOPY_NAN_BOXING=ON`, only meant to be included through value.hpp.
+
+Doubles are stored as themselves. Every other type lives in the payload of a quiet NaN:
+
+    0111 1111 1111 1ttt  pppp ... pppp
+    |  exponent  |q|tag| 48-bit payload
+
+Tag 0 is the one canonical NaN every real NaN gets folded into, so it stays a double.
+Ints are 48-bit two's complement in this mode, arithmetic that leaves that range moves on to a
+BigIntPyObject the same way `long` overflow does in the variant Value. Objects are raw pointers, which fit in 48 bits on x86-64 and AArch64.
+*/
+namespace TwoPy::Backend {
+    class Value {
+    public:
+        using py_object_ptr = ObjectRef<ObjectBase>;
+
+        static constexpr long int_min = -(1L << 47);
+        static constexpr long int_max = (1L << 47) - 1;
+
+    private:
+        static constexpr std::uint64_t quiet_nan = 0x7FF8'0000'0000'0000;
+        static constexpr int tag_shift = 48;
+        static constexpr std::uint64_t tag_mask = quiet_nan | (0x7ULL << tag_shift);
+        static constexpr std::uint64_t payload_mask = (1ULL << tag_shift) - 1;
+
+        enum BoxTag : std::uint64_t {
+            BOX_FLOAT,  // canonical NaN
+            BOX_NONE,
+            BOX_BOOL,
+            BOX_INT,
+            BOX_REF,
+            BOX_OBJ,
+        };
+
+        std::uint64_t m_bits;
+
+        static constexpr std::uint64_t box(BoxTag tag, std::uint64_t payload) noexcept {
+            return quiet_nan | (static_cast<std::uint64_t>(tag) << tag_shift) | (payload & payload_mask);
+        }
+
+        [[nodiscard]] constexpr bool has_box(BoxTag tag) const noexcept {
+            return (m_bits & tag_mask) == box(tag, 0);
+        }
+
+        [[nodiscard]] constexpr std::uint64_t payload() const noexcept {
+            return m_bits & payload_mask;
+        }
+
+        /* Immediates copy as a plain 8-byte move, only objects touch their refcount */
+        void retain() const noexcept {
+            if (is_obj()) {
+                as_object()->incref();
+            }
+        }
+
+        void release() noexcept {
+            if (is_obj()) {
+                as_object()->decref();
+            }
+        }
+
+    public:
+        constexpr Value() noexcept
+        : m_bits {box(BOX_NONE, 0)} {}
+
+        constexpr Value(std::monostate) noexcept
+        : Value() {}
+
+        constexpr Value(bool b) noexcept
+        : m_bits {box(BOX_BOOL, b ? 1 : 0)} {}
+
+        constexpr Value(long i) noexcept
+        : m_bits {box(BOX_INT, static_cast<std::uint64_t>(i))} {}
+
+        constexpr Value(double d) noexcept
+        : m_bits {d != d ? quiet_nan : std::bit_cast<std::uint64_t>(d)} {}
+
+        Value(Reference ref) noexcept
+        : m_bits {box(BOX_REF, reinterpret_cast<std::uintptr_t>(ref))} {}
+
+        /* The handle's reference moves into the box, the count doesn't change */
+        explicit Value(py_object_ptr obj_ptr) noexcept
+        : m_bits {box(BOX_NONE, 0)} {
+            if (obj_ptr) {
+                m_bits = box(BOX_OBJ, reinterpret_cast<std::uintptr_t>(obj_ptr.detach()));
+            }
+        }
+
+        Value(const Value& other) noexcept
+        : m_bits {other.m_bits} {
+            retain();
+        }
+
+        Value(Value&& other) noexcept
+        : m_bits {std::exchange(other.m_bits, box(BOX_NONE, 0))} {}
+
+        Value& operator=(const Value& other) noexcept {
+            other.retain();
+            release();
+            m_bits = other.m_bits;
+            return *this;
+        }
+
+        Value& operator=(Value&& other) noexcept {
+            if (this != &other) {
+                release();
+                m_bits = std::exchange(other.m_bits, box(BOX_NONE, 0));
+            }
+            return *this;
+        }
+
+        ~Value() {
+            release();
+        }
+
+        [[nodiscard]] constexpr ValueTag tag() const noexcept {
+            if ((m_bits & quiet_nan) != quiet_nan) {
+                return ValueTag::FLOAT;
+            }
+
+            switch (static_cast<BoxTag>((m_bits >> tag_shift) & 0x7)) {
+                case BOX_NONE: return ValueTag::NONE;
+                case BOX_BOOL: return ValueTag::BOOL;
+                case BOX_INT: return ValueTag::INT;
+                case BOX_REF: return ValueTag::REF;
+                case BOX_OBJ: return ValueTag::OBJ;
+                default: return ValueTag::FLOAT;
+            }
+        }
+
+        [[nodiscard]] constexpr bool is_none() const noexcept { return has_box(BOX_NONE); }
+        [[nodiscard]] constexpr bool is_bool() const noexcept { return has_box(BOX_BOOL); }
+        [[nodiscard]] constexpr bool is_int() const noexcept { return has_box(BOX_INT); }
+        [[nodiscard]] constexpr bool is_obj() const noexcept { return has_box(BOX_OBJ); }
+        [[nodiscard]] constexpr bool is_float() const noexcept {
+            return (m_bits & quiet_nan) != quiet_nan || m_bits == quiet_nan;
+        }
+
+        [[nodiscard]] constexpr bool as_bool() const noexcept { return payload() != 0; }
+        [[nodiscard]] constexpr double as_float() const noexcept { return std::bit_cast<double>(m_bits); }
+        [[nodiscard]] constexpr long as_int() const noexcept {
+            // Sign-extend the 48-bit payload
+            return static_cast<long>(static_cast<std::int64_t>(m_bits << (64 - tag_shift)) >> (64 - tag_shift));
+        }
+
+        [[nodiscard]] ObjectBase* as_object() const noexcept {
+            return is_obj() ? reinterpret_cast<ObjectBase*>(payload()) : nullptr;
+        }
+
+        [[nodiscard]] Reference ref() const noexcept {
+            return has_box(BOX_REF) ? reinterpret_cast<Reference>(payload()) : nullptr;
+        }
+
+        [[nodiscard]] py_object_ptr obj_ref() const noexcept {
+            return py_object_ptr(as_object());
+        }
+
+        /* The encoding, for the JIT's inline paths. The top 16 bits of a boxed value are its tag */
+        [[nodiscard]] constexpr std::uint64_t bits() const noexcept { return m_bits; }
+        [[nodiscard]] static constexpr std::uint64_t payload_bits() noexcept { return payload_mask; }
+        [[nodiscard]] static constexpr std::uint64_t int_bits(long i) noexcept { return box(BOX_INT, static_cast<std::uint64_t>(i)); }
+        [[nodiscard]] static constexpr std::uint64_t bool_bits(bool b) noexcept { return box(BOX_BOOL, b ? 1 : 0); }
+        [[nodiscard]] static constexpr std::uint64_t obj_bits() noexcept { return box(BOX_OBJ, 0); }
+
+        /* Identity for objects, equality for immediates */
+        [[nodiscard]] friend bool operator==(const Value& lhs, const Value& rhs) noexcept {
+            if (lhs.is_float() && rhs.is_float()) {
+                return lhs.as_float() == rhs.as_float();
+            }
+            return lhs.m_bits == rhs.m_bits;
+        }
+
+        [[nodiscard]] constexpr bool is_truthy() const noexcept {
+            switch (tag()) {
+                case ValueTag::BOOL: return as_bool();
+                case ValueTag::INT: return as_int() != 0L;
+                case ValueTag::FLOAT: return as_float() != 0.0;
+                case ValueTag::REF: return payload() != 0;
+                // Empty containers and strings are false, the object knows
+                case ValueTag::OBJ: return as_object() != nullptr && as_object()->is_truthy();
+                default: return false;
+            }
+        }
+
+        [[nodiscard]] long to_long() const noexcept {
+            switch (tag()) {
+                case ValueTag::BOOL: return as_bool() ? 1L : 0L;
+                case ValueTag::INT: return as_int();
+                case ValueTag::FLOAT: return static_cast<long>(as_float());
+                case ValueTag::REF: return ref()->to_long();
+                default: return 0L;
+            }
+        }
+
+        [[nodiscard]] double to_double() const noexcept {
+            switch (tag()) {
+                case ValueTag::BOOL: return as_bool() ? 1.0 : 0.0;
+                case ValueTag::INT: return static_cast<double>(as_int());
+                case ValueTag::FLOAT: return as_float();
+                case ValueTag::REF: return ref()->to_double();
+                default: return 0.0;
+            }
+        }
+
+        [[nodiscard]] std::string to_string() const {
+            switch (tag()) {
+                case ValueTag::NONE: return "None";
+                case ValueTag::BOOL: return as_bool() ? "True" : "False";
+                case ValueTag::INT: return std::to_string(as_int());
+                case ValueTag::FLOAT: return std::to_string(as_float());
+                case ValueTag::REF: return ref()->to_string();
+                case ValueTag::OBJ: return as_object()->stringify();
+                default: return "";
+            }
+        }
+    };
+
+    static_assert(sizeof(Value) == 8);
+}
+
+#endif
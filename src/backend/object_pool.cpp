@@ -0,0 +1,21 @@
+#include "backend/object_pool.hpp"
+
+namespace TwoPy::Backend {
+    void ObjectPool::refill(std::size_t index) {
+        const std::size_t block_size = class_size(index);
+        const std::size_t count = slab_bytes / block_size;
+        auto* slab = static_cast<std::byte*>(::operator new(slab_bytes));
+
+        // Threaded back to front so the list hands blocks out in address order
+        FreeBlock* head = m_free[index];
+        for (std::size_t i = count; i > 0; i--) {
+            auto* block = reinterpret_cast<FreeBlock*>(slab + (i - 1) * block_size);
+            block->next = head;
+            head = block;
+        }
+
+        m_free[index] = head;
+        m_stats[index].capacity += count;
+        m_slabs++;
+    }
+}
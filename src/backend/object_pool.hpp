@@ -0,0 +1,123 @@
+#ifndef TWOPY_OBJECT_POOL_HPP
+#define TWOPY_OBJECT_POOL_HPP
+
+#include <array>
+#include <cstddef>
+#include <new>
+
+/*
+Size-class allocator behind ObjectBase's operator new. Requests are rounded up to a multiple of
+16 bytes and every size class keeps its own free list, carved out of 64 KiB slabs. Allocating is
+popping the head of that list and freeing is pushing onto it. Anything over 256 bytes goes to the
+global operator new.
+
+The pool is per thread, the same way objects belong to the thread that made them. It isn't owned
+by a VM: constant pools and the builtins table are built before any VM exists and outlive it.
+Slabs are never handed back. A freed block only ever gets reused for the same size class.
+*/
+namespace TwoPy::Backend {
+    struct PoolClassStats {
+        std::size_t allocations {};
+        std::size_t frees {};
+        std::size_t capacity {};    // blocks carved out of slabs so far
+        std::size_t requested {};   // bytes asked for by the live blocks, before rounding up
+
+        [[nodiscard]] std::size_t live() const noexcept {
+            return allocations - frees;
+        }
+    };
+
+    class ObjectPool {
+        public:
+            static constexpr std::size_t granularity = 16;
+            static constexpr std::size_t max_pooled = 256;
+            static constexpr std::size_t class_count = max_pooled / granularity;
+            static constexpr std::size_t slab_bytes = 64 * 1024;
+
+            static_assert(granularity >= alignof(std::max_align_t));
+
+        private:
+            struct FreeBlock {
+                FreeBlock* next;
+            };
+
+            std::array<FreeBlock*, class_count> m_free {};
+            std::array<PoolClassStats, class_count> m_stats {};
+            std::size_t m_slabs {};
+            std::size_t m_large_allocations {};
+            std::size_t m_large_frees {};
+
+            [[nodiscard]] static constexpr std::size_t class_of(std::size_t size) noexcept {
+                return (size + granularity - 1) / granularity - 1;
+            }
+
+            /* Slow path: carves a fresh slab into blocks of class `index` */
+            void refill(std::size_t index);
+
+        public:
+            /* Trivially destructible on purpose: objects freed during static destruction still find their pool */
+            static ObjectPool& local() noexcept {
+                static thread_local constinit ObjectPool pool {};
+                return pool;
+            }
+
+            [[nodiscard]] static constexpr std::size_t class_size(std::size_t index) noexcept {
+                return (index + 1) * granularity;
+            }
+
+            [[nodiscard]] void* allocate(std::size_t size) {
+                if (size > max_pooled) {
+                    m_large_allocations++;
+                    return ::operator new(size);
+                }
+
+                std::size_t index = class_of(size);
+                if (m_free[index] == nullptr) {
+                    refill(index);
+                }
+
+                FreeBlock* block = m_free[index];
+                m_free[index] = block->next;
+
+                auto& stats = m_stats[index];
+                stats.allocations++;
+                stats.requested += size;
+                return block;
+            }
+
+            void deallocate(void* ptr, std::size_t size) noexcept {
+                if (size > max_pooled) {
+                    m_large_frees++;
+                    ::operator delete(ptr, size);
+                    return;
+                }
+
+                std::size_t index = class_of(size);
+                auto* block = static_cast<FreeBlock*>(ptr);
+                block->next = m_free[index];
+                m_free[index] = block;
+
+                auto& stats = m_stats[index];
+                stats.frees++;
+                stats.requested -= size;
+            }
+
+            [[nodiscard]] const std::array<PoolClassStats, class_count>& class_stats() const noexcept {
+                return m_stats;
+            }
+
+            [[nodiscard]] std::size_t slabs() const noexcept {
+                return m_slabs;
+            }
+
+            [[nodiscard]] std::size_t large_allocations() const noexcept {
+                return m_large_allocations;
+            }
+
+            [[nodiscard]] std::size_t large_live() const noexcept {
+                return m_large_allocations - m_large_frees;
+            }
+    };
+}
+
+#endif
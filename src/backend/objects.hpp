@@ -1,16 +1,22 @@
 #ifndef TWOPY_OBJECTS_HPP
 #define TWOPY_OBJECTS_HPP
 
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <thread>
 #include <vector>
 #include <memory>
 #include <type_traits>
+#include <utility>
 
 #include <fmt/core.h>
+#include "backend/object_pool.hpp"
 
 /* Each of these would be local bytecode scope */
 namespace TwoPy::Backend {
-    //class Value;
+    class Value;
 
     /* These would be polymorphic heap object and wouldn't be primitives such as floats, bools, and ints */
 
@@ -18,18 +24,87 @@ namespace TwoPy::Backend {
 
     enum class ObjectTag : uint8_t {
         NONE,       // non-object
-        // LIST,
-        // DICT,
+        LIST,
+        DICT,
         // CLASS,
         FUNCTION,   // callable object
+        NATIVE_FUNCTION,    // builtin implemented in C++
         STRING,
+        RANGE,
+        BIGINT,     // int that doesn't fit in an immediate
     };
 
+    template <typename T>
+    class ObjectRef;
+
+    class GcObject;
+    class Heap;
+
     /* Insprided by Derkt's ObjectBase class which allows for Polymophric virutal representation */
     struct ObjectBase {
         virtual ~ObjectBase() = default;
 
-        virtual ObjectTag tag() const noexcept = 0;
+    private:
+        template <typename T>
+        friend class ObjectRef;
+        friend class Value;
+        friend class Heap;
+
+        /* Intrusive refcount: the count lives in the object itself, so creating one is a single
+           allocation and copying a reference is a plain increment. Not atomic, the VM is single
+           threaded and debug builds check that nobody else touches it. */
+        std::uint32_t m_refcount {};
+        // Fills the padding after the refcount, so type checks are a load instead of a virtual call
+        ObjectTag m_tag;
+#ifndef NDEBUG
+        std::thread::id m_owner_thread {std::this_thread::get_id()};
+#endif
+
+        void assert_owner_thread() const noexcept {
+#ifndef NDEBUG
+            assert(m_owner_thread == std::this_thread::get_id() && "TwoPy objects are not thread safe");
+#endif
+        }
+
+        void incref() noexcept {
+            assert_owner_thread();
+            m_refcount++;
+        }
+
+        void decref() noexcept {
+            assert_owner_thread();
+            if (--m_refcount == 0) {
+                delete this;
+            }
+        }
+
+    protected:
+        explicit ObjectBase(ObjectTag tag) noexcept
+            : m_tag(tag) {}
+
+    public:
+        /* Every object comes out of the thread's size-class pool. The virtual destructor makes
+           sized delete see the dynamic type's size, so the block goes back on the right list. */
+        static void* operator new(std::size_t size) {
+            return ObjectPool::local().allocate(size);
+        }
+
+        static void operator delete(void* ptr, std::size_t size) noexcept {
+            ObjectPool::local().deallocate(ptr, size);
+        }
+
+        [[nodiscard]] std::uint32_t refcount() const noexcept {
+            return m_refcount;
+        }
+
+        [[nodiscard]] ObjectTag tag() const noexcept {
+            return m_tag;
+        }
+
+        /* Non-null for containers the cycle collector tracks (see gc.hpp) */
+        virtual GcObject* gc_object() noexcept {
+            return nullptr;
+        }
 
         /* Indexing */
         /// NOTE: immutable accessor for impl. of __get__
@@ -48,6 +123,88 @@ namespace TwoPy::Backend {
         virtual bool is_truthy() const noexcept = 0;
     };
 
+    /* Owning handle to a heap object, what a Value holds instead of a shared_ptr */
+    template <typename T = ObjectBase>
+    class ObjectRef {
+        private:
+            template <typename U>
+            friend class ObjectRef;
+
+            T* m_ptr {};
+
+            static void retain(T* ptr) noexcept {
+                if (ptr != nullptr) {
+                    static_cast<ObjectBase*>(ptr)->incref();
+                }
+            }
+
+            static void release(T* ptr) noexcept {
+                if (ptr != nullptr) {
+                    static_cast<ObjectBase*>(ptr)->decref();
+                }
+            }
+
+        public:
+            constexpr ObjectRef() noexcept = default;
+            constexpr ObjectRef(std::nullptr_t) noexcept {}
+
+            /* Takes a new reference to `ptr` */
+            explicit ObjectRef(T* ptr) noexcept
+                : m_ptr(ptr) {
+                retain(m_ptr);
+            }
+
+            ObjectRef(const ObjectRef& other) noexcept
+                : ObjectRef(other.m_ptr) {}
+
+            ObjectRef(ObjectRef&& other) noexcept
+                : m_ptr(std::exchange(other.m_ptr, nullptr)) {}
+
+            template <typename U> requires std::is_convertible_v<U*, T*>
+            ObjectRef(const ObjectRef<U>& other) noexcept
+                : ObjectRef(static_cast<T*>(other.m_ptr)) {}
+
+            template <typename U> requires std::is_convertible_v<U*, T*>
+            ObjectRef(ObjectRef<U>&& other) noexcept
+                : m_ptr(std::exchange(other.m_ptr, nullptr)) {}
+
+            ObjectRef& operator=(ObjectRef other) noexcept {
+                std::swap(m_ptr, other.m_ptr);
+                return *this;
+            }
+
+            ~ObjectRef() {
+                release(m_ptr);
+            }
+
+            /* Gives up ownership without touching the count, the caller now owns that reference */
+            [[nodiscard]] T* detach() noexcept {
+                return std::exchange(m_ptr, nullptr);
+            }
+
+            [[nodiscard]] T* get() const noexcept { return m_ptr; }
+            T* operator->() const noexcept { return m_ptr; }
+            T& operator*() const noexcept { return *m_ptr; }
+
+            explicit operator bool() const noexcept {
+                return m_ptr != nullptr;
+            }
+
+            [[nodiscard]] friend bool operator==(const ObjectRef& lhs, const ObjectRef& rhs) noexcept {
+                return lhs.m_ptr == rhs.m_ptr;
+            }
+
+            [[nodiscard]] friend bool operator==(const ObjectRef& lhs, std::nullptr_t) noexcept {
+                return lhs.m_ptr == nullptr;
+            }
+    };
+
+    /* One allocation for the object and its refcount, the make_shared of ObjectRef */
+    template <typename T, typename... Args>
+    [[nodiscard]] ObjectRef<T> make_object(Args&&... args) {
+        return ObjectRef<T>(new T(std::forward<Args>(args)...));
+    }
+
     class FunctionPyObject : public ObjectBase {
         private:
             std::string m_name;
@@ -56,11 +213,7 @@ namespace TwoPy::Backend {
 
         public:
             explicit FunctionPyObject(std::string name, std::vector<std::string> params, std::uint8_t chunk_index)
-                : m_name(std::move(name)), m_params(std::move(params)), m_chunk_index(chunk_index) {}
-
-            ObjectTag tag() const noexcept override {
-                return ObjectTag::FUNCTION;
-            }
+                : ObjectBase(ObjectTag::FUNCTION), m_name(std::move(name)), m_params(std::move(params)), m_chunk_index(chunk_index) {}
 
             [[nodiscard]] const std::string& name() const noexcept {
                 return m_name;
@@ -86,33 +239,51 @@ namespace TwoPy::Backend {
             }
     };
 
-    class StringPyObject : public ObjectBase {
+    /* What range() returns. Only knows its bounds, nothing is materialized */
+    class RangePyObject : public ObjectBase {
         private:
-            std::string m_data {};
+            long m_start {};
+            long m_stop {};
+            long m_step {1};
 
         public:
-            explicit StringPyObject(std::string data) : m_data(std::move(data)) {}
+            RangePyObject(long start, long stop, long step)
+                : ObjectBase(ObjectTag::RANGE), m_start(start), m_stop(stop), m_step(step) {}
+
+            [[nodiscard]] long start() const noexcept { return m_start; }
+            [[nodiscard]] long stop() const noexcept { return m_stop; }
+            [[nodiscard]] long step() const noexcept { return m_step; }
 
-            ObjectTag tag() const noexcept override {
-                return ObjectTag::STRING;
+            [[nodiscard]] long length() const noexcept {
+                // Unsigned so ranges spanning most of `long` don't overflow on the way
+                using ulong = unsigned long;
+                if (m_step > 0 && m_start < m_stop) {
+                    return static_cast<long>((ulong(m_stop) - ulong(m_start) - 1) / ulong(m_step) + 1);
+                } else if (m_step < 0 && m_start > m_stop) {
+                    return static_cast<long>((ulong(m_start) - ulong(m_stop) - 1) / (0 - ulong(m_step)) + 1);
+                }
+                return 0;
             }
 
-            // const Value& operator[](const Value&) const override {
-                
-            // }
+            /* Whether counting up (or down) to `value` hasn't reached stop yet */
+            [[nodiscard]] bool before_stop(long value) const noexcept {
+                return m_step > 0 ? value < m_stop : value > m_stop;
+            }
 
-            /* [[nodiscard]] bool call([[maybe_unused]] void* vm_state, [[maybe_unused]] uint8_t arg_count) override {
-                return false;
-            }*/
+            // Only valid when length() > 0
+            [[nodiscard]] long last() const noexcept {
+                return m_start + (length() - 1) * m_step;
+            }
 
-            /* Gets called when the printer calls it */
             std::string stringify() override {
-                return m_data;
+                if (m_step == 1) {
+                    return fmt::format("range({}, {})", m_start, m_stop);
+                }
+                return fmt::format("range({}, {}, {})", m_start, m_stop, m_step);
             }
 
-            // Empty strings are falsy, non-empty strings are truthy (Python behavior)
             bool is_truthy() const noexcept override {
-                return !m_data.empty();
+                return length() != 0;
             }
     };
 }
@@ -0,0 +1,516 @@
+#ifndef TWOPY_OPERATIONS_HPP
+#define TWOPY_OPERATIONS_HPP
+
+#include <charconv>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <fmt/core.h>
+
+#include "backend/value.hpp"
+#include "backend/bigint.hpp"
+#include "backend/list_object.hpp"
+#include "backend/dict_object.hpp"
+#include "backend/string_object.hpp"
+#include "backend/bytecode.hpp"
+
+/* Python operator semantics shared by the stack VM and the register VM */
+namespace TwoPy::Backend {
+    inline bool both_ints(const Value& lhs, const Value& rhs) noexcept {
+        return lhs.is_int() && rhs.is_int();
+    }
+
+    inline bool both_floats(const Value& lhs, const Value& rhs) noexcept {
+        return lhs.is_float() && rhs.is_float();
+    }
+
+    inline const StringPyObject* as_string(const Value& val) noexcept {
+        auto obj = val.as_object();
+        return obj != nullptr && obj->tag() == ObjectTag::STRING ? static_cast<const StringPyObject*>(obj) : nullptr;
+    }
+
+    inline bool is_string(const Value& val) noexcept {
+        return as_string(val) != nullptr;
+    }
+
+    inline ListPyObject* as_list(const Value& val) noexcept {
+        auto obj = val.as_object();
+        return obj != nullptr && obj->tag() == ObjectTag::LIST ? static_cast<ListPyObject*>(obj) : nullptr;
+    }
+
+    inline const RangePyObject* as_range(const Value& val) noexcept {
+        auto obj = val.as_object();
+        return obj != nullptr && obj->tag() == ObjectTag::RANGE ? static_cast<const RangePyObject*>(obj) : nullptr;
+    }
+
+    inline DictPyObject* as_dict(const Value& val) noexcept {
+        auto obj = val.as_object();
+        return obj != nullptr && obj->tag() == ObjectTag::DICT ? static_cast<DictPyObject*>(obj) : nullptr;
+    }
+
+    /* What Python calls the type in error messages */
+    inline std::string_view type_name(const Value& val) noexcept {
+        switch (val.tag()) {
+            case ValueTag::NONE: return "NoneType";
+            case ValueTag::BOOL: return "bool";
+            case ValueTag::INT: return "int";
+            case ValueTag::FLOAT: return "float";
+            case ValueTag::REF: return "reference";
+            case ValueTag::OBJ: break;
+        }
+
+        switch (val.as_object()->tag()) {
+            case ObjectTag::LIST: return "list";
+            case ObjectTag::DICT: return "dict";
+            case ObjectTag::FUNCTION: return "function";
+            case ObjectTag::NATIVE_FUNCTION: return "builtin_function_or_method";
+            case ObjectTag::STRING: return "str";
+            case ObjectTag::RANGE: return "range";
+            case ObjectTag::BIGINT: return "int";
+            case ObjectTag::NONE: break;
+        }
+        return "object";
+    }
+
+    inline bool both_strings(const Value& lhs, const Value& rhs) noexcept {
+        return is_string(lhs) && is_string(rhs);
+    }
+
+    inline Value concat_strings(const Value& lhs, const Value& rhs) {
+        return Value(StringPyObject::concat(*as_string(lhs), *as_string(rhs)));
+    }
+
+    inline const BigIntPyObject* as_bigint(const Value& val) noexcept {
+        auto obj = val.as_object();
+        return obj != nullptr && obj->tag() == ObjectTag::BIGINT ? static_cast<const BigIntPyObject*>(obj) : nullptr;
+    }
+
+    /* Python ints: immediates, bools and bigints */
+    inline bool is_integer(const Value& val) noexcept {
+        return val.is_int() || val.is_bool() || as_bigint(val) != nullptr;
+    }
+
+    inline bool is_number(const Value& val) noexcept {
+        return is_integer(val) || val.is_float();
+    }
+
+    /*
+    Overflow-checked arithmetic on immediates, false when the result leaves the immediate range.
+    In the variant Value that range is all of `long` and the range check folds away.
+    */
+    inline bool small_add(long lhs, long rhs, long& result) noexcept {
+        return !__builtin_add_overflow(lhs, rhs, &result) && result >= Value::int_min && result <= Value::int_max;
+    }
+
+    inline bool small_sub(long lhs, long rhs, long& result) noexcept {
+        return !__builtin_sub_overflow(lhs, rhs, &result) && result >= Value::int_min && result <= Value::int_max;
+    }
+
+    inline bool small_mul(long lhs, long rhs, long& result) noexcept {
+        return !__builtin_mul_overflow(lhs, rhs, &result) && result >= Value::int_min && result <= Value::int_max;
+    }
+
+    /* An immediate if `big` fits in one, so equal ints always have the same representation */
+    inline Value make_int(BigInt big) {
+        if (auto small = big.to_long(Value::int_min, Value::int_max)) {
+            return Value(long {*small});
+        }
+        return Value(make_object<BigIntPyObject>(std::move(big)));
+    }
+
+    inline Value make_int(long val) {
+        if (val < Value::int_min || val > Value::int_max) {
+            return make_int(BigInt(val));
+        }
+        return Value(long {val});
+    }
+
+    /* Only for integers (is_integer) */
+    inline BigInt to_bigint(const Value& val) {
+        if (auto big = as_bigint(val)) {
+            return big->value();
+        }
+        return BigInt(val.to_long());
+    }
+
+    inline double to_double(const Value& val) noexcept {
+        if (auto big = as_bigint(val)) {
+            return big->value().to_double();
+        }
+        return val.to_double();
+    }
+
+    /* Slow paths, out of line so the immediate fast paths stay small wherever they're inlined */
+    [[gnu::cold, gnu::noinline]] inline Value bigint_add(const Value& lhs, const Value& rhs) {
+        return make_int(to_bigint(lhs) + to_bigint(rhs));
+    }
+
+    [[gnu::cold, gnu::noinline]] inline Value bigint_sub(const Value& lhs, const Value& rhs) {
+        return make_int(to_bigint(lhs) - to_bigint(rhs));
+    }
+
+    [[gnu::cold, gnu::noinline]] inline Value bigint_mul(const Value& lhs, const Value& rhs) {
+        return make_int(to_bigint(lhs) * to_bigint(rhs));
+    }
+
+    /* The TypeError for an operator Python has no meaning for on these operands */
+    [[noreturn, gnu::cold]] inline void unsupported_operands(std::string_view op, const Value& lhs, const Value& rhs) {
+        throw std::runtime_error(fmt::format("TypeError: unsupported operand type(s) for {}: '{}' and '{}'", op, type_name(lhs), type_name(rhs)));
+    }
+
+    /* Decimal int literal or int() argument of any length */
+    inline std::optional<Value> parse_int(std::string_view text) {
+        long small {};
+        auto [end, err] = std::from_chars(text.data(), text.data() + text.size(), small);
+        if (err == std::errc {} && end == text.data() + text.size()) {
+            return make_int(small);
+        }
+
+        if (auto big = BigInt::from_string(text)) {
+            return make_int(std::move(*big));
+        }
+        return std::nullopt;
+    }
+
+    inline Value binary_add(const Value& lhs, const Value& rhs) {
+        if (both_ints(lhs, rhs)) {
+            long result {};
+            if (small_add(lhs.as_int(), rhs.as_int(), result)) {
+                return Value(long {result});
+            }
+            return bigint_add(lhs, rhs);
+        }
+
+        if (both_strings(lhs, rhs)) {
+            return concat_strings(lhs, rhs);
+        }
+
+        if (is_integer(lhs) && is_integer(rhs)) {
+            return bigint_add(lhs, rhs);
+        }
+
+        if (!is_number(lhs) || !is_number(rhs)) {
+            unsupported_operands("+", lhs, rhs);
+        }
+        return Value(to_double(lhs) + to_double(rhs));
+    }
+
+    inline Value binary_sub(const Value& lhs, const Value& rhs) {
+        if (both_ints(lhs, rhs)) {
+            long result {};
+            if (small_sub(lhs.as_int(), rhs.as_int(), result)) {
+                return Value(long {result});
+            }
+            return bigint_sub(lhs, rhs);
+        }
+
+        if (is_integer(lhs) && is_integer(rhs)) {
+            return bigint_sub(lhs, rhs);
+        }
+
+        if (!is_number(lhs) || !is_number(rhs)) {
+            unsupported_operands("-", lhs, rhs);
+        }
+        return Value(to_double(lhs) - to_double(rhs));
+    }
+
+    inline Value binary_mul(const Value& lhs, const Value& rhs) {
+        if (both_ints(lhs, rhs)) {
+            long result {};
+            if (small_mul(lhs.as_int(), rhs.as_int(), result)) {
+                return Value(long {result});
+            }
+            return bigint_mul(lhs, rhs);
+        }
+
+        if (is_integer(lhs) && is_integer(rhs)) {
+            return bigint_mul(lhs, rhs);
+        }
+
+        if (!is_number(lhs) || !is_number(rhs)) {
+            unsupported_operands("*", lhs, rhs);
+        }
+        return Value(to_double(lhs) * to_double(rhs));
+    }
+
+    inline Value binary_div(const Value& lhs, const Value& rhs) {
+        if (!is_number(lhs) || !is_number(rhs)) {
+            unsupported_operands("/", lhs, rhs);
+        }
+        double divisor = to_double(rhs);
+        if (divisor == 0.0) {
+            throw std::runtime_error("ZeroDivisionError: division by zero");
+        }
+        return Value(to_double(lhs) / divisor);
+    }
+
+    /*
+    % and // round the quotient toward negative infinity, so the remainder takes the divisor's sign.
+    On immediates that's C++'s truncating division moved over by one where the signs differ. False
+    for the one quotient that overflows a long, LONG_MIN // -1
+    */
+    inline bool small_floor_divmod(long lhs, long rhs, long& quotient, long& remainder) noexcept {
+        if (rhs == -1 && lhs == std::numeric_limits<long>::min()) {
+            return false;
+        }
+        quotient = lhs / rhs;
+        remainder = lhs % rhs;
+        if (remainder != 0 && (remainder < 0) != (rhs < 0)) {
+            quotient--;
+            remainder += rhs;
+        }
+        return true;
+    }
+
+    /* CPython's float divmod, down to the sign of a zero */
+    inline std::pair<double, double> float_floor_divmod(double lhs, double rhs) noexcept {
+        double remainder = std::fmod(lhs, rhs);
+        double quotient = (lhs - remainder) / rhs;
+        if (remainder != 0.0) {
+            if ((rhs < 0.0) != (remainder < 0.0)) {
+                remainder += rhs;
+                quotient -= 1.0;
+            }
+        } else {
+            remainder = std::copysign(0.0, rhs);
+        }
+
+        if (quotient == 0.0) {
+            return {std::copysign(0.0, lhs / rhs), remainder};
+        }
+        double floored = std::floor(quotient);
+        if (quotient - floored > 0.5) {
+            floored += 1.0;
+        }
+        return {floored, remainder};
+    }
+
+    /* Everything but two immediates: bigints, floats and the errors. `op` is "%" or "//" */
+    [[gnu::cold, gnu::noinline]] inline std::pair<Value, Value> floor_divmod(std::string_view op, const Value& lhs, const Value& rhs) {
+        if (!is_number(lhs) || !is_number(rhs)) {
+            unsupported_operands(op, lhs, rhs);
+        }
+
+        if (lhs.is_float() || rhs.is_float()) {
+            double divisor = to_double(rhs);
+            if (divisor == 0.0) {
+                throw std::runtime_error(op == "%" ? "ZeroDivisionError: float modulo" : "ZeroDivisionError: float floor division by zero");
+            }
+            auto [quotient, remainder] = float_floor_divmod(to_double(lhs), divisor);
+            return {Value(double {quotient}), Value(double {remainder})};
+        }
+
+        BigInt divisor = to_bigint(rhs);
+        if (divisor.is_zero()) {
+            throw std::runtime_error(op == "%" ? "ZeroDivisionError: integer modulo by zero" : "ZeroDivisionError: integer division or modulo by zero");
+        }
+        auto [quotient, remainder] = BigInt::floor_divmod(to_bigint(lhs), divisor);
+        return {make_int(std::move(quotient)), make_int(std::move(remainder))};
+    }
+
+    inline Value binary_mod(const Value& lhs, const Value& rhs) {
+        if (both_ints(lhs, rhs) && rhs.as_int() != 0) {
+            long quotient {};
+            long remainder {};
+            if (small_floor_divmod(lhs.as_int(), rhs.as_int(), quotient, remainder)) {
+                return Value(long {remainder});
+            }
+        }
+        return floor_divmod("%", lhs, rhs).second;
+    }
+
+    inline Value binary_floor_div(const Value& lhs, const Value& rhs) {
+        if (both_ints(lhs, rhs) && rhs.as_int() != 0) {
+            long quotient {};
+            long remainder {};
+            if (small_floor_divmod(lhs.as_int(), rhs.as_int(), quotient, remainder)) {
+                return make_int(quotient);
+            }
+        }
+        return floor_divmod("//", lhs, rhs).first;
+    }
+
+    template <typename T>
+    bool compare_ordered(CompareOp op, const T& lhs, const T& rhs) noexcept {
+        switch (op) {
+            case CompareOp::LT: return lhs < rhs;
+            case CompareOp::LE: return lhs <= rhs;
+            case CompareOp::EQ: return lhs == rhs;
+            case CompareOp::NE: return lhs != rhs;
+            case CompareOp::GT: return lhs > rhs;
+            case CompareOp::GE: return lhs >= rhs;
+        }
+
+        return false;
+    }
+
+    /* nullopt when the operands can't be ordered against each other (Python raises a TypeError) */
+    inline std::optional<bool> compare_values(CompareOp op, const Value& lhs, const Value& rhs) {
+        if (both_ints(lhs, rhs)) {
+            return compare_ordered(op, lhs.as_int(), rhs.as_int());
+        }
+
+        if (is_number(lhs) && is_number(rhs)) {
+            if (lhs.is_float() || rhs.is_float()) {
+                return compare_ordered(op, to_double(lhs), to_double(rhs));
+            }
+            if (as_bigint(lhs) != nullptr || as_bigint(rhs) != nullptr) {
+                return compare_ordered(op, to_bigint(lhs), to_bigint(rhs));
+            }
+            return compare_ordered(op, lhs.to_long(), rhs.to_long());
+        }
+
+        if (both_strings(lhs, rhs)) {
+            const StringPyObject& lhs_str = *as_string(lhs);
+            const StringPyObject& rhs_str = *as_string(rhs);
+            if (op == CompareOp::EQ || op == CompareOp::NE) {
+                return (lhs_str == rhs_str) == (op == CompareOp::EQ);
+            }
+            return compare_ordered(op, lhs_str.view(), rhs_str.view());
+        }
+
+        if (op == CompareOp::EQ || op == CompareOp::NE) {
+            bool same = lhs == rhs;
+            return op == CompareOp::EQ ? same : !same;
+        }
+
+        return std::nullopt;
+    }
+
+    /* A subscript as a C++ index. Throws the Python error for anything that isn't an int */
+    inline long subscript_index(const Value& index) {
+        if (index.is_int() || index.is_bool()) {
+            return index.to_long();
+        }
+        if (as_bigint(index) != nullptr) {
+            throw std::runtime_error("IndexError: cannot fit 'int' into an index-sized integer");
+        }
+        throw std::runtime_error(fmt::format("TypeError: indices must be integers, not {}", type_name(index)));
+    }
+
+    /* repr() as far as containers need it: strings get their quotes, the rest print as str() does */
+    inline std::string repr(const Value& val) {
+        if (auto str = as_string(val)) {
+            return fmt::format("'{}'", str->view());
+        }
+        return val.to_string();
+    }
+
+    /* container[index], the VM inlines list[int] and dict[str] and comes here for everything else */
+    inline Value subscript(const Value& container, const Value& index) {
+        if (auto dict = as_dict(container)) {
+            if (const Value* found = dict->find(index)) {
+                return *found;
+            }
+            throw std::runtime_error(fmt::format("KeyError: {}", repr(index)));
+        }
+        if (auto list = as_list(container)) {
+            auto pos = list->position(subscript_index(index));
+            if (!pos) {
+                throw std::runtime_error("IndexError: list index out of range");
+            }
+            return (*list)[*pos];
+        }
+        throw std::runtime_error(fmt::format("TypeError: '{}' object is not subscriptable", type_name(container)));
+    }
+
+    /*
+    Iteration without iterator objects: GET_ITER leaves the iterable and a position next to it on
+    the stack, and FOR_ITER advances the position in place. A range's position is the next value
+    itself, a list's or str's is an index, a dict's is its next entry.
+    */
+    inline long iteration_start(const Value& iterable) {
+        if (auto range = as_range(iterable)) {
+            return range->start();
+        }
+        if (as_list(iterable) != nullptr || as_dict(iterable) != nullptr || as_string(iterable) != nullptr) {
+            return 0;
+        }
+        throw std::runtime_error(fmt::format("TypeError: '{}' object is not iterable", type_name(iterable)));
+    }
+
+    /* FOR_ITER_RANGE's step on the int in the position slot: the item, or nullopt once it reached stop */
+    inline std::optional<long> range_step(const RangePyObject& range, Value& position) noexcept {
+        long current = position.as_int();
+        if (!range.before_stop(current)) {
+            return std::nullopt;
+        }
+
+        // Stepping past the immediate range can only mean stepping past stop
+        long next {};
+        position = Value(long {small_add(current, range.step(), next) ? next : range.stop()});
+        return current;
+    }
+
+    /* The item at `position`, moving `position` past it. nullopt once `iterable` is exhausted */
+    inline std::optional<Value> iteration_next(const Value& iterable, long& position) {
+        if (auto range = as_range(iterable)) {
+            if (!range->before_stop(position)) {
+                return std::nullopt;
+            }
+            long item = position;
+            // Stepping past the immediate range can only mean stepping past stop
+            if (!small_add(position, range->step(), position)) {
+                position = range->stop();
+            }
+            return Value(long {item});
+        }
+
+        auto pos = static_cast<std::size_t>(position);
+        if (auto list = as_list(iterable)) {
+            if (pos >= list->size()) {
+                return std::nullopt;
+            }
+            position++;
+            return (*list)[pos];
+        }
+
+        if (auto dict = as_dict(iterable)) {
+            auto entries = dict->entries();
+            while (pos < entries.size() && !entries[pos].live()) {
+                pos++;
+            }
+            if (pos >= entries.size()) {
+                return std::nullopt;
+            }
+            position = static_cast<long>(pos + 1);
+            return entries[pos].key;
+        }
+
+        // str: one code point at a time, the position is a byte offset
+        std::string_view text = as_string(iterable)->view();
+        if (pos >= text.size()) {
+            return std::nullopt;
+        }
+        std::size_t width = 1;
+        while (pos + width < text.size() && (static_cast<unsigned char>(text[pos + width]) & 0xC0) == 0x80) {
+            width++;
+        }
+        position = static_cast<long>(pos + width);
+        return Value(StringPyObject::make(text.substr(pos, width)));
+    }
+
+    /* container[index] = val */
+    inline void store_subscript(Heap& heap, const Value& container, const Value& index, Value val) {
+        if (auto dict = as_dict(container)) {
+            dict->store(heap, index, std::move(val));
+            return;
+        }
+        if (auto list = as_list(container)) {
+            auto pos = list->position(subscript_index(index));
+            if (!pos) {
+                throw std::runtime_error("IndexError: list assignment index out of range");
+            }
+            list->store(heap, *pos, std::move(val));
+            return;
+        }
+        throw std::runtime_error(fmt::format("TypeError: '{}' object does not support item assignment", type_name(container)));
+    }
+}
+
+#endif
@@ -0,0 +1,44 @@
+#include "backend/output_buffer.hpp"
+
+#include <cerrno>
+#include <unistd.h>
+
+namespace TwoPy::Backend {
+    OutputBuffer::OutputBuffer(int fd, bool unbuffered)
+        : m_fd(fd),
+          m_policy(unbuffered ? FlushPolicy::UNBUFFERED : isatty(fd) ? FlushPolicy::LINE : FlushPolicy::FULL) {
+        m_buffer.reserve(capacity);
+    }
+
+    OutputBuffer::~OutputBuffer() {
+        flush();
+    }
+
+    void OutputBuffer::flush() {
+        if (m_buffer.size() == 0) {
+            return;
+        }
+
+        write_out(m_buffer.data(), m_buffer.size());
+        m_buffer.clear();
+    }
+
+    void OutputBuffer::write_out(const char* data, std::size_t size) {
+        // write(2) may take less than it's given (pipes, signals), keep going until it's all out
+        while (size > 0) {
+            ssize_t written = ::write(m_fd, data, size);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                // Nowhere left to report the error (stdout is gone), so the rest is dropped
+                return;
+            }
+
+            m_writes++;
+            m_bytes += static_cast<std::size_t>(written);
+            data += written;
+            size -= static_cast<std::size_t>(written);
+        }
+    }
+}
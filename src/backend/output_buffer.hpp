@@ -0,0 +1,85 @@
+#ifndef TWOPY_OUTPUT_BUFFER_HPP
+#define TWOPY_OUTPUT_BUFFER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+#include <utility>
+
+#include <fmt/format.h>
+
+namespace TwoPy::Backend {
+    /*
+    Where print() writes. Output collects in one memory buffer and goes out with a single write(2)
+    when the buffer fills up, when a line ends on a terminal, or when the VM finishes, instead of
+    one stdio call per argument. `--unbuffered` flushes after every line no matter where stdout goes.
+    */
+    class OutputBuffer {
+        public:
+            enum class FlushPolicy : std::uint8_t {
+                FULL,           // redirected output: only when the buffer is full
+                LINE,           // a terminal: every completed line
+                UNBUFFERED,     // `--unbuffered`: every completed line, even when redirected
+            };
+
+            static constexpr std::size_t capacity = 64 * 1024;
+
+        private:
+            fmt::memory_buffer m_buffer {};
+            int m_fd;
+            FlushPolicy m_policy;
+
+            std::size_t m_lines {};
+            std::size_t m_bytes {};
+            std::size_t m_writes {};
+
+            void write_out(const char* data, std::size_t size);
+
+        public:
+            /* Picks LINE or FULL depending on whether `fd` is a terminal */
+            explicit OutputBuffer(int fd, bool unbuffered = false);
+            ~OutputBuffer();
+
+            OutputBuffer(const OutputBuffer&) = delete;
+            OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+            void write(std::string_view text) {
+                m_buffer.append(text.data(), text.data() + text.size());
+            }
+
+            template <typename... Args>
+            void format(fmt::format_string<Args...> fmt_str, Args&&... args) {
+                fmt::format_to(std::back_inserter(m_buffer), fmt_str, std::forward<Args>(args)...);
+            }
+
+            void end_line() {
+                m_buffer.push_back('\n');
+                m_lines++;
+
+                if (m_policy != FlushPolicy::FULL || m_buffer.size() >= capacity) {
+                    flush();
+                }
+            }
+
+            void flush();
+
+            [[nodiscard]] FlushPolicy policy() const noexcept {
+                return m_policy;
+            }
+
+            [[nodiscard]] std::size_t lines() const noexcept {
+                return m_lines;
+            }
+
+            [[nodiscard]] std::size_t bytes() const noexcept {
+                return m_bytes;
+            }
+
+            [[nodiscard]] std::size_t writes() const noexcept {
+                return m_writes;
+            }
+    };
+}
+
+#endif
@@ -0,0 +1,303 @@
+#include "backend/register_bytecode.hpp"
+#include "backend/bytecode.hpp"
+#include "backend/builtins.hpp"
+#include "backend/string_object.hpp"
+
+#include <stdexcept>
+#include <fmt/core.h>
+
+namespace TwoPy::Backend {
+    std::uint8_t TempAllocator::alloc() {
+        if (m_next > UINT8_MAX) {
+            throw std::runtime_error("Expression needs more than 256 registers");
+        }
+
+        auto reg = static_cast<std::uint8_t>(m_next++);
+        m_high_water = std::max(m_high_water, m_next);
+        return reg;
+    }
+
+    register_compiler::register_compiler(const TwoPy::Frontend::Program& program)
+        : m_program(program) {}
+
+    RegisterChunk register_compiler::compile_program() {
+        // Module variables get the bottom registers for the whole run, temporaries live above them
+        for (const auto& ptr : m_program.statements) {
+            collect_variables(*ptr);
+        }
+        m_temps.reset(m_variables.size());
+
+        for (const auto& ptr : m_program.statements) {
+            compile_instruction(ptr);
+        }
+
+        emit(RegOpCode::RETURN);
+        m_chunk.register_count = m_temps.high_water();
+        return m_chunk;
+    }
+
+    void register_compiler::collect_variables(const TwoPy::Frontend::StmtNode& stmt) {
+        if (auto* expr_stmt = std::get_if<TwoPy::Frontend::ExpressionStmt>(&stmt.node)) {
+            auto* ops = std::get_if<TwoPy::Frontend::OperatorsType>(&expr_stmt->expression->node);
+            auto* assign = ops ? std::get_if<TwoPy::Frontend::AssignmentOp>(ops) : nullptr;
+            if (assign == nullptr || !assign->target) {
+                return;
+            }
+
+            if (auto* ident = std::get_if<TwoPy::Frontend::Identifier>(&assign->target->node)) {
+                if (!m_variables.contains(ident->token.value)) {
+                    m_variables.insert({ident->token.value, static_cast<std::uint8_t>(m_chunk.variables.size())});
+                    m_chunk.variables.push_back(ident->token.value);
+                }
+            }
+            return;
+        }
+
+        if (auto* if_stmt = std::get_if<TwoPy::Frontend::IfStmt>(&stmt.node)) {
+            collect_variables(if_stmt->body);
+            for (const auto& elif : if_stmt->elifs) {
+                collect_variables(elif.body);
+            }
+            if (if_stmt->else_branch != nullptr) {
+                collect_variables(if_stmt->else_branch->body);
+            }
+        }
+    }
+
+    void register_compiler::collect_variables(const TwoPy::Frontend::Block& blk) {
+        for (const auto& s : blk.statements) {
+            collect_variables(*s);
+        }
+    }
+
+    std::uint8_t register_compiler::add_constant(Value val) {
+        return intern_constant(m_chunk.consts_pool, std::move(val));
+    }
+
+    void register_compiler::compile_instruction(const TwoPy::Frontend::StmtPtr& stmt) {
+        try {
+            compile_stmt(*stmt);
+        } catch (const std::exception& e) {
+            fmt::print("Error: {}\n", e.what());
+        }
+    }
+
+    void register_compiler::compile_stmt(const TwoPy::Frontend::StmtNode& stmt) {
+        auto base = m_temps.mark();
+
+        if (auto* expr_stmt = std::get_if<TwoPy::Frontend::ExpressionStmt>(&stmt.node)) {
+            if (!expr_stmt->expression) {
+                throw std::runtime_error("Something went wrong");
+            }
+            // No POP here, an unused result just sits in a temporary until the next statement reuses it
+            compile_expr(*expr_stmt->expression);
+        } else if (auto* if_stmt = std::get_if<TwoPy::Frontend::IfStmt>(&stmt.node)) {
+            compile_if_stmt(*if_stmt);
+        } else if (std::holds_alternative<TwoPy::Frontend::FunctionDef>(stmt.node)) {
+            throw std::runtime_error("The register backend doesn't support functions yet");
+        } else if (std::holds_alternative<TwoPy::Frontend::ForStmt>(stmt.node)) {
+            throw std::runtime_error("The register backend doesn't support loops yet");
+        }
+
+        m_temps.release_to(base);
+    }
+
+    void register_compiler::compile_block(const TwoPy::Frontend::Block& blk) {
+        for (const auto& s : blk.statements) {
+            compile_instruction(s);
+        }
+    }
+
+    void register_compiler::compile_if_stmt(const TwoPy::Frontend::IfStmt& stmt) {
+        std::vector<std::size_t> end_jumps {};
+
+        auto compile_arm = [&](const TwoPy::Frontend::ExprNode& condition, const TwoPy::Frontend::Block& body, bool needs_end_jump) {
+            auto base = m_temps.mark();
+            std::uint8_t cond = compile_expr(condition);
+            m_temps.release_to(base);
+
+            auto false_jump = emit_jump(RegOpCode::JUMP_IF_FALSE, cond);
+            compile_block(body);
+
+            if (needs_end_jump) {
+                end_jumps.push_back(emit_jump(RegOpCode::JUMP));
+            }
+            patch_jump(false_jump);
+        };
+
+        const bool has_else = stmt.else_branch != nullptr;
+        compile_arm(*stmt.condition, stmt.body, !stmt.elifs.empty() || has_else);
+
+        for (std::size_t i = 0; i < stmt.elifs.size(); i++) {
+            compile_arm(*stmt.elifs[i].condition, stmt.elifs[i].body, i + 1 < stmt.elifs.size() || has_else);
+        }
+
+        if (has_else) {
+            compile_block(stmt.else_branch->body);
+        }
+
+        for (auto ej : end_jumps) {
+            patch_jump(ej);
+        }
+    }
+
+    std::uint8_t register_compiler::compile_expr(const TwoPy::Frontend::ExprNode& expr, std::optional<std::uint8_t> dst) {
+        if (auto* ident = std::get_if<TwoPy::Frontend::Identifier>(&expr.node)) {
+            if (auto it = m_variables.find(ident->token.value); it != m_variables.end()) {
+                // Reading a variable is free unless the result has to land somewhere else
+                if (dst && *dst != it->second) {
+                    emit(RegOpCode::MOVE, *dst, it->second);
+                    return *dst;
+                }
+                return it->second;
+            }
+
+            // Every module variable has a register, so any other name has to be a builtin
+            auto index = find_builtin(ident->token.value);
+            if (!index) {
+                throw std::runtime_error(fmt::format("NameError: name '{}' is not defined", ident->token.value));
+            }
+
+            std::uint8_t reg = target_register(dst);
+            emit(RegOpCode::LOAD_BUILTIN, reg, *index);
+            return reg;
+        }
+
+        if (auto* lits = std::get_if<TwoPy::Frontend::Literals>(&expr.node)) {
+            return compile_literal(*lits, dst);
+        }
+
+        if (auto* ops = std::get_if<TwoPy::Frontend::OperatorsType>(&expr.node)) {
+            return compile_operators(*ops, dst);
+        }
+
+        if (auto* call = std::get_if<TwoPy::Frontend::CallExpr>(&expr.node)) {
+            return compile_call(*call, dst);
+        }
+
+        throw std::runtime_error("The register backend doesn't support this expression yet");
+    }
+
+    std::uint8_t register_compiler::compile_literal(const TwoPy::Frontend::Literals& lits, std::optional<std::uint8_t> dst) {
+        std::uint8_t const_index {};
+
+        if (auto* int_lit = std::get_if<TwoPy::Frontend::IntegerLiteral>(&lits)) {
+            const_index = add_constant(int_literal(int_lit->token.value));
+        } else if (auto* float_lit = std::get_if<TwoPy::Frontend::FloatLiteral>(&lits)) {
+            const_index = add_constant(Value(std::stod(float_lit->token.value)));
+        } else if (auto* string_lit = std::get_if<TwoPy::Frontend::StringLiteral>(&lits)) {
+            const_index = add_constant(Value(StringPyObject::literal(string_lit->token.value)));
+        } else if (auto* bool_lit = std::get_if<TwoPy::Frontend::BoolLiteral>(&lits)) {
+            const_index = add_constant(Value(bool_lit->token.value == "True"));
+        }
+
+        std::uint8_t reg = target_register(dst);
+        emit(RegOpCode::LOAD_CONSTANT, reg, const_index);
+        return reg;
+    }
+
+    std::uint8_t register_compiler::compile_operators(const TwoPy::Frontend::OperatorsType& ops, std::optional<std::uint8_t> dst) {
+        if (auto* assign = std::get_if<TwoPy::Frontend::AssignmentOp>(&ops)) {
+            auto* ident = std::get_if<TwoPy::Frontend::Identifier>(&assign->target->node);
+            if (ident == nullptr) {
+                throw std::runtime_error("The register backend only assigns to names");
+            }
+
+            // The value is computed straight into the variable's register
+            return compile_expr(*assign->value, m_variables.at(ident->token.value));
+        }
+
+        if (auto* term = std::get_if<TwoPy::Frontend::TermOp>(&ops)) {
+            RegOpCode op = term->op.value == "+" ? RegOpCode::ADD : RegOpCode::SUB;
+            return compile_binary(op, *term->left, *term->right, dst);
+        }
+
+        if (auto* factor = std::get_if<TwoPy::Frontend::FactorOp>(&ops)) {
+            const std::string& op = factor->op.value;
+            if (op == "*") {
+                return compile_binary(RegOpCode::MUL, *factor->left, *factor->right, dst);
+            } else if (op == "/") {
+                return compile_binary(RegOpCode::DIV, *factor->left, *factor->right, dst);
+            }
+            throw std::runtime_error(fmt::format("The register backend doesn't support '{}' yet", op));
+        }
+
+        if (auto* compare = std::get_if<TwoPy::Frontend::EqualityOp>(&ops)) {
+            RegOpCode op = compare->op.value == "==" ? RegOpCode::COMPARE_EQ : RegOpCode::COMPARE_NE;
+            return compile_binary(op, *compare->left, *compare->right, dst);
+        }
+
+        if (auto* compare = std::get_if<TwoPy::Frontend::ComparisonOp>(&ops)) {
+            const std::string& op = compare->op.value;
+            RegOpCode cmp = RegOpCode::COMPARE_LT;
+            if (op == "<=") {
+                cmp = RegOpCode::COMPARE_LE;
+            } else if (op == ">") {
+                cmp = RegOpCode::COMPARE_GT;
+            } else if (op == ">=") {
+                cmp = RegOpCode::COMPARE_GE;
+            }
+            return compile_binary(cmp, *compare->left, *compare->right, dst);
+        }
+
+        if (auto* _and = std::get_if<TwoPy::Frontend::AndOp>(&ops)) {
+            return compile_logical(RegOpCode::JUMP_IF_FALSE, *_and->left, *_and->right, dst);
+        }
+
+        if (auto* _or = std::get_if<TwoPy::Frontend::OrOp>(&ops)) {
+            return compile_logical(RegOpCode::JUMP_IF_TRUE, *_or->left, *_or->right, dst);
+        }
+
+        throw std::runtime_error("The register backend doesn't support this operator yet");
+    }
+
+    std::uint8_t register_compiler::compile_binary(RegOpCode op, const TwoPy::Frontend::ExprNode& left, const TwoPy::Frontend::ExprNode& right, std::optional<std::uint8_t> dst) {
+        auto base = m_temps.mark();
+        std::uint8_t lhs = compile_expr(left);
+        std::uint8_t rhs = compile_expr(right);
+        m_temps.release_to(base);
+
+        // Operands are read before the destination is written, so reusing lhs's temporary is safe
+        std::uint8_t reg = target_register(dst);
+        emit(op, reg, lhs, rhs);
+        return reg;
+    }
+
+    std::uint8_t register_compiler::compile_logical(RegOpCode jump, const TwoPy::Frontend::ExprNode& left, const TwoPy::Frontend::ExprNode& right, std::optional<std::uint8_t> dst) {
+        // Always goes through a fresh temporary: `x = y or x` must still read the old x on the right
+        std::uint8_t result = m_temps.alloc();
+        auto base = m_temps.mark();
+
+        compile_expr(left, result);
+        auto short_circuit = emit_jump(jump, result);
+        compile_expr(right, result);
+        patch_jump(short_circuit);
+
+        m_temps.release_to(base);
+
+        if (dst) {
+            emit(RegOpCode::MOVE, *dst, result);
+            return *dst;
+        }
+        return result;
+    }
+
+    std::uint8_t register_compiler::compile_call(const TwoPy::Frontend::CallExpr& call, std::optional<std::uint8_t> dst) {
+        // The callee and its arguments sit in consecutive registers
+        std::uint8_t func = m_temps.alloc();
+        compile_expr(*call.callee, func);
+
+        for (const auto& arg : call.arguments) {
+            std::uint8_t arg_reg = m_temps.alloc();
+            auto base = m_temps.mark();
+            compile_expr(*arg, arg_reg);
+            m_temps.release_to(base);
+        }
+
+        m_temps.release_to(func + 1);
+
+        std::uint8_t reg = dst ? *dst : func;
+        emit(RegOpCode::CALL, reg, func, static_cast<std::uint8_t>(call.arguments.size()));
+        return reg;
+    }
+}
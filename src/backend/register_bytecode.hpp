@@ -0,0 +1,141 @@
+#ifndef TWOPY_REGISTER_BYTECODE_HPP
+#define TWOPY_REGISTER_BYTECODE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "backend/value.hpp"
+#include "frontend/ast.hpp"
+
+/*
+Three-address alternative to the stack bytecode (`--register`).
+Every operand names a slot of the frame's register file instead of the top of a stack,
+so `z = x + y` is a single `ADD r2, r0, r1` instead of LOAD/LOAD/ADD/STORE.
+*/
+namespace TwoPy::Backend {
+    enum class RegOpCode : std::uint8_t {
+        LOAD_CONSTANT,  // a = consts[b]
+        LOAD_BUILTIN,   // a = builtins[b]
+        MOVE,           // a = b
+
+        ADD,            // a = b + c
+        SUB,            // a = b - c
+        MUL,            // a = b * c
+        DIV,            // a = b / c
+
+        COMPARE_LT,     // a = b < c, the six compares follow CompareOp's order
+        COMPARE_LE,
+        COMPARE_EQ,
+        COMPARE_NE,
+        COMPARE_GT,
+        COMPARE_GE,
+
+        JUMP,           // ip = b | c << 8
+        JUMP_IF_FALSE,  // if not a: ip = b | c << 8
+        JUMP_IF_TRUE,   // if a: ip = b | c << 8
+
+        CALL,           // a = b(b + 1, ..., b + c)
+        RETURN,
+    };
+
+    struct RegInstruction {
+        RegOpCode opcode;
+        std::uint8_t a {};
+        std::uint8_t b {};
+        std::uint8_t c {};
+    };
+
+    struct RegisterChunk {
+        std::vector<RegInstruction> code;
+        std::vector<Value> consts_pool;
+        std::vector<std::string> variables;     // names of the first `variables.size()` registers
+        std::size_t register_count {};
+    };
+
+    /*
+    Temporaries are handed out by a linear scan over the expression in evaluation order.
+    An expression tree's live ranges are strictly nested, so a temporary is dead as soon as
+    its parent consumes it and the scan reduces to bumping and rewinding a watermark.
+    */
+    class TempAllocator {
+    private:
+        std::size_t m_next {};
+        std::size_t m_high_water {};
+
+    public:
+        void reset(std::size_t first_temp) noexcept {
+            m_next = m_high_water = first_temp;
+        }
+
+        [[nodiscard]] std::uint8_t alloc();
+
+        [[nodiscard]] std::size_t mark() const noexcept {
+            return m_next;
+        }
+
+        void release_to(std::size_t mark) noexcept {
+            m_next = mark;
+        }
+
+        [[nodiscard]] std::size_t high_water() const noexcept {
+            return m_high_water;
+        }
+    };
+
+    class register_compiler {
+    private:
+        const TwoPy::Frontend::Program& m_program;
+        RegisterChunk m_chunk {};
+        TempAllocator m_temps {};
+
+        std::map<std::string, std::uint8_t> m_variables {};
+
+        void emit(RegOpCode op, std::uint8_t a = 0, std::uint8_t b = 0, std::uint8_t c = 0) {
+            m_chunk.code.push_back({.opcode=op, .a=a, .b=b, .c=c});
+        }
+
+        [[nodiscard]] std::size_t emit_jump(RegOpCode op, std::uint8_t cond = 0) {
+            emit(op, cond);
+            return m_chunk.code.size() - 1;
+        }
+
+        void patch_jump(std::size_t at) {
+            std::size_t target = m_chunk.code.size();
+            m_chunk.code[at].b = static_cast<std::uint8_t>(target & 0xFF);
+            m_chunk.code[at].c = static_cast<std::uint8_t>(target >> 8);
+        }
+
+        [[nodiscard]] std::uint8_t add_constant(Value val);
+
+        void collect_variables(const TwoPy::Frontend::StmtNode& stmt);
+        void collect_variables(const TwoPy::Frontend::Block& blk);
+
+        void compile_instruction(const TwoPy::Frontend::StmtPtr& stmt);
+        void compile_stmt(const TwoPy::Frontend::StmtNode& stmt);
+        void compile_block(const TwoPy::Frontend::Block& blk);
+        void compile_if_stmt(const TwoPy::Frontend::IfStmt& stmt);
+
+        /* Returns the register holding the result. `dst` asks for the result in a specific register. */
+        std::uint8_t compile_expr(const TwoPy::Frontend::ExprNode& expr, std::optional<std::uint8_t> dst = std::nullopt);
+        std::uint8_t compile_literal(const TwoPy::Frontend::Literals& lits, std::optional<std::uint8_t> dst);
+        std::uint8_t compile_operators(const TwoPy::Frontend::OperatorsType& ops, std::optional<std::uint8_t> dst);
+        std::uint8_t compile_binary(RegOpCode op, const TwoPy::Frontend::ExprNode& left, const TwoPy::Frontend::ExprNode& right, std::optional<std::uint8_t> dst);
+        std::uint8_t compile_logical(RegOpCode jump, const TwoPy::Frontend::ExprNode& left, const TwoPy::Frontend::ExprNode& right, std::optional<std::uint8_t> dst);
+        std::uint8_t compile_call(const TwoPy::Frontend::CallExpr& call, std::optional<std::uint8_t> dst);
+
+        std::uint8_t target_register(std::optional<std::uint8_t> dst) {
+            return dst ? *dst : m_temps.alloc();
+        }
+
+    public:
+        register_compiler(const TwoPy::Frontend::Program& program);
+
+        RegisterChunk compile_program();
+    };
+}
+
+#endif
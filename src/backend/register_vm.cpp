@@ -0,0 +1,124 @@
+#include "backend/register_vm.hpp"
+#include "backend/operations.hpp"
+#include "backend/builtins.hpp"
+
+#include <fmt/core.h>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace TwoPy::Backend {
+    RegisterVM::RegisterVM(const RegisterChunk& chunk, bool unbuffered_output)
+        : m_chunk(chunk), m_registers(chunk.register_count), m_output(STDOUT_FILENO, unbuffered_output) {}
+
+    RegisterVM::Result RegisterVM::run() {
+        // The arithmetic ops throw their TypeError or ZeroDivisionError
+        Result result {};
+        try {
+            result = execute();
+        } catch (const std::runtime_error& e) {
+            fmt::print(stderr, "{}\n", e.what());
+            result = Result::RUNTIME_ERROR;
+        }
+        m_output.flush();
+        return result;
+    }
+
+    RegisterVM::Result RegisterVM::execute() {
+        const auto& code = m_chunk.code;
+        auto& regs = m_registers;
+
+        while (m_ip < code.size()) {
+            const RegInstruction& instr = code[m_ip];
+            m_ip++;
+
+            if (m_profiling) {
+                m_dispatches++;
+            }
+
+            switch (instr.opcode) {
+                case RegOpCode::LOAD_CONSTANT:
+                    regs[instr.a] = m_chunk.consts_pool[instr.b];
+                    break;
+
+                case RegOpCode::LOAD_BUILTIN:
+                    regs[instr.a] = builtin(instr.b);
+                    break;
+
+                case RegOpCode::MOVE:
+                    regs[instr.a] = regs[instr.b];
+                    break;
+
+                case RegOpCode::ADD:
+                    regs[instr.a] = binary_add(regs[instr.b], regs[instr.c]);
+                    break;
+
+                case RegOpCode::SUB:
+                    regs[instr.a] = binary_sub(regs[instr.b], regs[instr.c]);
+                    break;
+
+                case RegOpCode::MUL:
+                    regs[instr.a] = binary_mul(regs[instr.b], regs[instr.c]);
+                    break;
+
+                case RegOpCode::DIV:
+                    regs[instr.a] = binary_div(regs[instr.b], regs[instr.c]);
+                    break;
+
+                case RegOpCode::COMPARE_LT:
+                case RegOpCode::COMPARE_LE:
+                case RegOpCode::COMPARE_EQ:
+                case RegOpCode::COMPARE_NE:
+                case RegOpCode::COMPARE_GT:
+                case RegOpCode::COMPARE_GE: {
+                    auto op = static_cast<CompareOp>(static_cast<std::uint8_t>(instr.opcode) - static_cast<std::uint8_t>(RegOpCode::COMPARE_LT));
+                    auto result = compare_values(op, regs[instr.b], regs[instr.c]);
+                    if (!result) {
+                        return Result::RUNTIME_ERROR;
+                    }
+                    regs[instr.a] = Value(bool {*result});
+                    break;
+                }
+
+                case RegOpCode::JUMP:
+                    m_ip = jump_target(instr);
+                    break;
+
+                case RegOpCode::JUMP_IF_FALSE:
+                    if (!regs[instr.a].is_truthy()) {
+                        m_ip = jump_target(instr);
+                    }
+                    break;
+
+                case RegOpCode::JUMP_IF_TRUE:
+                    if (regs[instr.a].is_truthy()) {
+                        m_ip = jump_target(instr);
+                    }
+                    break;
+
+                case RegOpCode::CALL: {
+                    // Only builtins can be called here, the register backend doesn't compile functions
+                    ObjectBase* callee = regs[instr.b].as_object();
+                    if (callee == nullptr || callee->tag() != ObjectTag::NATIVE_FUNCTION) {
+                        return Result::RUNTIME_ERROR;
+                    }
+
+                    try {
+                        NativeContext ctx {.out = m_output, .heap = m_heap};
+                        std::span<const Value> args {regs.data() + instr.b + 1, instr.c};
+                        regs[instr.a] = static_cast<NativeFunctionPyObject*>(callee)->call(ctx, args);
+                    } catch (const std::runtime_error& e) {
+                        fmt::print(stderr, "{}\n", e.what());
+                        return Result::RUNTIME_ERROR;
+                    }
+                    maybe_collect();
+                    break;
+                }
+
+                case RegOpCode::RETURN:
+                    return Result::OK;
+            }
+        }
+
+        return Result::OK;
+    }
+}
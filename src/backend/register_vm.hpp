@@ -0,0 +1,74 @@
+#ifndef TWOPY_REGISTER_VM_HPP
+#define TWOPY_REGISTER_VM_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include "backend/value.hpp"
+#include "backend/register_bytecode.hpp"
+#include "backend/gc.hpp"
+#include "backend/output_buffer.hpp"
+
+namespace TwoPy::Backend {
+    /* Executes a RegisterChunk over a flat register file, nothing is ever pushed or popped */
+    class RegisterVM {
+        public:
+            enum class Result : std::uint8_t {
+                OK,
+                RUNTIME_ERROR,
+            };
+
+        private:
+            const RegisterChunk& m_chunk;
+
+            Heap m_heap {};
+
+            std::vector<Value> m_registers {};
+            OutputBuffer m_output;
+
+            // Also called program counters
+            std::size_t m_ip {};
+
+            bool m_profiling {};
+            std::size_t m_dispatches {};
+
+            [[nodiscard]] std::size_t jump_target(const RegInstruction& instr) const noexcept {
+                return static_cast<std::size_t>(instr.b) | (static_cast<std::size_t>(instr.c) << 8);
+            }
+
+            Result execute();
+
+            /* GC roots: the register file and the constant pool */
+            void maybe_collect() {
+                if (m_heap.collect_pending()) {
+                    m_heap.collect([this](GcVisitor& visitor) {
+                        visitor.visit(m_registers);
+                        visitor.visit(m_chunk.consts_pool);
+                    });
+                }
+            }
+
+        public:
+            RegisterVM(const RegisterChunk& chunk, bool unbuffered_output = false);
+
+            void enable_profiling() noexcept {
+                m_profiling = true;
+            }
+
+            [[nodiscard]] std::size_t dispatches() const noexcept {
+                return m_dispatches;
+            }
+
+            [[nodiscard]] const GcStats& gc_stats() const noexcept {
+                return m_heap.stats();
+            }
+
+            [[nodiscard]] const OutputBuffer& output() const noexcept {
+                return m_output;
+            }
+
+            Result run();
+    };
+}
+
+#endif
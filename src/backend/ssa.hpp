@@ -0,0 +1,125 @@
+#ifndef TWOPY_SSA_HPP
+#define TWOPY_SSA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "backend/bytecode.hpp"
+#include "backend/value.hpp"
+#include "frontend/ast.hpp"
+
+/*
+Mid-level IR between the AST and bytecode, taken with `--ssa`. Each function becomes a control-flow
+graph of basic blocks over values in SSA form: every value is defined once, a local variable is
+just whichever value was last assigned to it, and where paths with different values meet a PHI
+picks one by the edge taken. Globals, subscripts and calls stay operations, other chunks can see
+them. Every value also carries the type it's known to have, inferred from constants and operators.
+
+build_ssa() builds the graph straight from the Program, the way the Braun et al. construction does
+it: a variable read looks back through the predecessors for its definition and leaves a PHI where
+they meet. optimize_ssa() then runs copy propagation, sparse conditional constant propagation,
+dominator-based common subexpression elimination and dead code elimination. lower_ssa() gives
+every value that outlives its block a fast slot, keeps the rest on the operand stack and emits
+ordinary bytecode the VM, the superinstruction pass and the JIT take like any other.
+*/
+namespace TwoPy::Backend {
+    using SsaValue = std::uint32_t;     // index into SsaFunction::values
+    using SsaBlockId = std::uint32_t;   // index into SsaFunction::blocks
+
+    enum class SsaType : std::uint8_t {
+        ANY,
+        NONE,
+        BOOL,
+        INT,        // small or big
+        FLOAT,
+        STR,
+        LIST,
+        DICT,
+        FUNCTION,
+        ITERATION,  // GET_ITER's iterable and position, they never leave the stack
+        METHOD,     // LOAD_METHOD's method and receiver, likewise
+    };
+
+    enum class SsaOp : std::uint8_t {
+        CONSTANT,       // `constant`
+        PARAM,          // `arg` is the parameter's index, which is also its slot
+        LOAD_GLOBAL,    // `arg` is the global slot
+        LOAD_BUILTIN,   // `arg` is the builtins table index, for a name nothing ever binds
+        STORE_GLOBAL,   // operands: the value
+        BINARY,         // `arg` is the generic OpCode: ADD, SUB, MUL, DIV, BINARY_MODULO or BINARY_FLOOR_DIVIDE
+        COMPARE,        // `arg` is the CompareOp
+        CALL,           // operands: the callee, then the arguments
+        LOAD_METHOD,    // operands: the receiver. `constant` is the method's interned name
+        CALL_METHOD,    // operands: the LOAD_METHOD, then the arguments
+        BUILD_LIST,     // operands: the items
+        BUILD_MAP,      // operands: key, value, key, value...
+        SUBSCR,         // operands: container, index
+        STORE_SUBSCR,   // operands: value, container, index
+        MAKE_FUNCTION,  // `constant` is the FunctionPyObject
+        GET_ITER,       // operands: the iterable
+        DROP_ITER,      // operands: the GET_ITER, on a break's way out of its loop
+        COPY,           // operands: the value a variable is assigned, copy propagation folds it away
+        PHI,            // operands: one per predecessor of the block, in the same order
+
+        // Terminators, always last in their block
+        JUMP,           // successors: the target
+        BRANCH,         // operands: the condition. successors: if truthy, if not
+        FOR_ITER,       // operands: the GET_ITER. The value is the next item. successors: the body, the exit once exhausted
+        RETURN,         // operands: the result
+    };
+
+    struct SsaInstr {
+        SsaOp op {};
+        SsaType type {SsaType::ANY};
+        std::uint32_t arg {};
+        Value constant {};
+        std::vector<SsaValue> operands {};
+        SsaBlockId block {};
+        std::string variable {};    // the local it was assigned to, only for the dump
+        bool dead {};               // removed by a pass, the numbering of the others stays
+    };
+
+    struct SsaBlock {
+        std::vector<SsaValue> instrs {};            // PHIs first, a terminator last
+        std::vector<SsaBlockId> predecessors {};
+        std::vector<SsaBlockId> successors {};
+        bool dead {};
+    };
+
+    /* A function's graph, blocks[0] is the entry. Chunk i of the program is functions[i] */
+    struct SsaFunction {
+        std::string name;
+        std::vector<std::string> params {};
+        std::vector<SsaInstr> values {};
+        std::vector<SsaBlock> blocks {};
+    };
+
+    struct SsaProgram {
+        std::vector<SsaFunction> functions {};
+        std::vector<std::string> global_names {};
+    };
+
+    [[nodiscard]] bool is_terminator(SsaOp op) noexcept;
+
+    /* Anything a pass can't drop even when nothing uses its value: it writes somewhere, calls out or can raise */
+    [[nodiscard]] bool has_side_effects(const SsaInstr& instr, const SsaFunction& function) noexcept;
+
+    [[nodiscard]] SsaProgram build_ssa(const TwoPy::Frontend::Program& program);
+
+    /* The passes optimize_ssa() runs, each leaves the function in SSA form with its types up to date */
+    void infer_types(SsaFunction& function);
+    void propagate_copies(SsaFunction& function);
+    void propagate_constants(SsaFunction& function);
+    void eliminate_common_subexpressions(SsaFunction& function);
+    void eliminate_dead_code(SsaFunction& function);
+    void optimize_ssa(SsaProgram& program);
+
+    /* Blocks in reverse postorder from the entry, every block before its successors but for back-edges */
+    [[nodiscard]] std::vector<SsaBlockId> reverse_postorder(const SsaFunction& function);
+
+    [[nodiscard]] ByteCodeProgram lower_ssa(const SsaProgram& program);
+}
+
+#endif
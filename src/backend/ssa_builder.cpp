@@ -0,0 +1,721 @@
+#include "backend/ssa.hpp"
+#include "backend/builtins.hpp"
+#include "backend/string_object.hpp"
+
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <utility>
+#include <fmt/core.h>
+
+namespace TwoPy::Backend {
+    namespace {
+        class ProgramBuilder;
+
+        /*
+        Builds one function's graph. Names are scoped the way the bytecode compiler scopes them: at the
+        top level everything is a global, inside a function a name is local once it's a parameter or has
+        been assigned further up the source, anything else is a global or builtin.
+        */
+        class FunctionBuilder {
+            private:
+                /* The loops around the statement being built, innermost last */
+                struct LoopContext {
+                    SsaBlockId header;                  // continue goes back here
+                    SsaBlockId exit;                    // break goes here
+                    std::optional<SsaValue> iteration;  // a for loop's, a break drops it
+                };
+
+                ProgramBuilder& m_program;
+                SsaFunction m_function {};
+                const bool m_is_module;
+                SsaBlockId m_block {};
+
+                std::set<std::string> m_locals {};
+                std::vector<std::map<std::string, SsaValue>> m_definitions {};     // per block, what each local holds at its end
+                std::vector<std::vector<std::pair<std::string, SsaValue>>> m_incomplete_phis {};
+                std::vector<bool> m_sealed {};
+                std::optional<SsaValue> m_undefined {};
+                std::vector<LoopContext> m_loops {};
+
+                [[nodiscard]] SsaBlockId new_block();
+                void start_block(SsaBlockId block, bool seal = true);
+                void seal_block(SsaBlockId block);
+                void add_edge(SsaBlockId from, SsaBlockId to);
+
+                SsaValue emit(SsaOp op, std::vector<SsaValue> operands = {}, std::uint32_t arg = 0, Value constant = {});
+                void jump(SsaBlockId target);
+                void branch(SsaValue condition, SsaBlockId if_true, SsaBlockId if_false);
+                // After a return, break or continue: whatever follows in the source goes to a block nothing reaches
+                void start_unreachable();
+
+                /* SSA construction, a variable read looks back through the predecessors for its value */
+                void write_variable(const std::string& name, SsaBlockId block, SsaValue value);
+                [[nodiscard]] SsaValue read_variable(const std::string& name, SsaBlockId block);
+                [[nodiscard]] SsaValue new_phi(const std::string& name, SsaBlockId block);
+                void add_phi_operands(const std::string& name, SsaValue phi);
+                // A local read before anything was assigned to it, its slot would still hold None
+                [[nodiscard]] SsaValue undefined();
+
+                void build_block(const TwoPy::Frontend::Block& blk);
+                void build_stmt(const TwoPy::Frontend::StmtNode& stmt);
+                void build_function_def(const TwoPy::Frontend::FunctionDef& function);
+                void build_if_stmt(const TwoPy::Frontend::IfStmt& stmt);
+                void build_for_stmt(const TwoPy::Frontend::ForStmt& stmt);
+                void build_while_stmt(const TwoPy::Frontend::WhileStmt& stmt);
+                void build_break_stmt();
+                void build_continue_stmt();
+
+                // Branches to `if_true` or `if_false` on the condition, and/or short-circuit into blocks of their own
+                void build_condition(const TwoPy::Frontend::ExprNode& condition, SsaBlockId if_true, SsaBlockId if_false);
+                [[nodiscard]] SsaValue build_expr(const TwoPy::Frontend::ExprNode& expr);
+                [[nodiscard]] SsaValue build_literal(const TwoPy::Frontend::Literals& lits);
+                [[nodiscard]] SsaValue build_operators(const TwoPy::Frontend::OperatorsType& ops);
+                [[nodiscard]] SsaValue build_assignment(const TwoPy::Frontend::AssignmentOp& assign);
+                [[nodiscard]] SsaValue build_short_circuit(const TwoPy::Frontend::ExprNode& left, const TwoPy::Frontend::ExprNode& right, bool is_and);
+                [[nodiscard]] SsaValue build_call(const TwoPy::Frontend::CallExpr& call);
+                [[nodiscard]] SsaValue build_identifier(const TwoPy::Frontend::Identifier& iden);
+                void assign_identifier(const TwoPy::Frontend::Identifier& iden, SsaValue value);
+
+            public:
+                FunctionBuilder(ProgramBuilder& program, std::string name, std::vector<std::string> params, bool is_module);
+
+                [[nodiscard]] SsaFunction build(const std::vector<TwoPy::Frontend::StmtPtr>& statements);
+        };
+
+        class ProgramBuilder {
+            private:
+                SsaProgram m_program {};
+
+            public:
+                /* Globals are numbered once for the whole program, like the bytecode compiler numbers them */
+                [[nodiscard]] std::uint32_t global_slot(const std::string& name) {
+                    auto& names = m_program.global_names;
+                    auto it = std::ranges::find(names, name);
+                    if (it != names.end()) {
+                        return static_cast<std::uint32_t>(std::distance(names.begin(), it));
+                    }
+
+                    if (names.size() > UINT8_MAX) {
+                        throw std::runtime_error("Too many global names");
+                    }
+                    names.push_back(name);
+                    return static_cast<std::uint32_t>(names.size() - 1);
+                }
+
+                /* The chunk index a function gets, claimed before its body is built so nested defs come after it */
+                [[nodiscard]] std::size_t reserve_function() {
+                    if (m_program.functions.size() > UINT8_MAX) {
+                        throw std::runtime_error("Too many functions");
+                    }
+                    m_program.functions.emplace_back();
+                    return m_program.functions.size() - 1;
+                }
+
+                void define_function(std::size_t index, SsaFunction function) {
+                    m_program.functions[index] = std::move(function);
+                }
+
+                // After the whole program is built, since a later def or assignment can still shadow a builtin
+                void resolve_builtins() {
+                    std::vector<bool> stored(m_program.global_names.size());
+                    for (const auto& function : m_program.functions) {
+                        for (const auto& instr : function.values) {
+                            if (instr.op == SsaOp::STORE_GLOBAL) {
+                                stored[instr.arg] = true;
+                            }
+                        }
+                    }
+
+                    for (auto& function : m_program.functions) {
+                        for (auto& instr : function.values) {
+                            if (instr.op != SsaOp::LOAD_GLOBAL || stored[instr.arg]) {
+                                continue;
+                            }
+
+                            if (auto index = find_builtin(m_program.global_names[instr.arg])) {
+                                instr.op = SsaOp::LOAD_BUILTIN;
+                                instr.arg = *index;
+                            }
+                        }
+                    }
+                }
+
+                [[nodiscard]] SsaProgram take() {
+                    return std::move(m_program);
+                }
+        };
+
+        FunctionBuilder::FunctionBuilder(ProgramBuilder& program, std::string name, std::vector<std::string> params, bool is_module)
+            : m_program(program), m_is_module(is_module) {
+            m_function.name = std::move(name);
+            m_function.params = std::move(params);
+        }
+
+        SsaFunction FunctionBuilder::build(const std::vector<TwoPy::Frontend::StmtPtr>& statements) {
+            start_block(new_block());
+
+            // Arguments arrive in the first slots, in parameter order
+            for (std::size_t i = 0; i < m_function.params.size(); i++) {
+                const std::string& param = m_function.params[i];
+                SsaValue value = emit(SsaOp::PARAM, {}, static_cast<std::uint32_t>(i));
+                m_function.values[value].variable = param;
+                m_locals.insert(param);
+                write_variable(param, m_block, value);
+            }
+
+            for (const auto& stmt : statements) {
+                build_stmt(*stmt);
+            }
+
+            // Falling off the end returns None
+            emit(SsaOp::RETURN, {emit(SsaOp::CONSTANT)});
+            return std::move(m_function);
+        }
+
+        SsaBlockId FunctionBuilder::new_block() {
+            m_function.blocks.emplace_back();
+            m_definitions.emplace_back();
+            m_incomplete_phis.emplace_back();
+            m_sealed.push_back(false);
+            return static_cast<SsaBlockId>(m_function.blocks.size() - 1);
+        }
+
+        void FunctionBuilder::start_block(SsaBlockId block, bool seal) {
+            m_block = block;
+            if (seal) {
+                seal_block(block);
+            }
+        }
+
+        void FunctionBuilder::seal_block(SsaBlockId block) {
+            for (const auto& [name, phi] : std::exchange(m_incomplete_phis[block], {})) {
+                add_phi_operands(name, phi);
+            }
+            m_sealed[block] = true;
+        }
+
+        void FunctionBuilder::add_edge(SsaBlockId from, SsaBlockId to) {
+            m_function.blocks[from].successors.push_back(to);
+            m_function.blocks[to].predecessors.push_back(from);
+        }
+
+        SsaValue FunctionBuilder::emit(SsaOp op, std::vector<SsaValue> operands, std::uint32_t arg, Value constant) {
+            auto value = static_cast<SsaValue>(m_function.values.size());
+            m_function.values.push_back({.op = op, .arg = arg, .constant = std::move(constant), .operands = std::move(operands), .block = m_block});
+            m_function.blocks[m_block].instrs.push_back(value);
+            return value;
+        }
+
+        void FunctionBuilder::jump(SsaBlockId target) {
+            emit(SsaOp::JUMP);
+            add_edge(m_block, target);
+        }
+
+        void FunctionBuilder::branch(SsaValue condition, SsaBlockId if_true, SsaBlockId if_false) {
+            emit(SsaOp::BRANCH, {condition});
+            add_edge(m_block, if_true);
+            add_edge(m_block, if_false);
+        }
+
+        void FunctionBuilder::start_unreachable() {
+            start_block(new_block());
+        }
+
+        void FunctionBuilder::write_variable(const std::string& name, SsaBlockId block, SsaValue value) {
+            m_definitions[block][name] = value;
+        }
+
+        SsaValue FunctionBuilder::read_variable(const std::string& name, SsaBlockId block) {
+            if (auto it = m_definitions[block].find(name); it != m_definitions[block].end()) {
+                return it->second;
+            }
+
+            SsaValue value {};
+            const auto& predecessors = m_function.blocks[block].predecessors;
+            if (!m_sealed[block]) {
+                // More predecessors are still to come (a loop header before its back-edges), they fill it in once sealed
+                value = new_phi(name, block);
+                m_incomplete_phis[block].emplace_back(name, value);
+            } else if (predecessors.empty()) {
+                value = undefined();
+            } else if (predecessors.size() == 1) {
+                value = read_variable(name, predecessors.front());
+            } else {
+                // Written before its operands are looked up, a loop around back to here finds the PHI itself
+                value = new_phi(name, block);
+                write_variable(name, block, value);
+                add_phi_operands(name, value);
+            }
+
+            write_variable(name, block, value);
+            return value;
+        }
+
+        SsaValue FunctionBuilder::new_phi(const std::string& name, SsaBlockId block) {
+            auto value = static_cast<SsaValue>(m_function.values.size());
+            m_function.values.push_back({.op = SsaOp::PHI, .block = block, .variable = name});
+
+            auto& instrs = m_function.blocks[block].instrs;
+            auto after_phis = std::ranges::find_if(instrs, [&](SsaValue instr) { return m_function.values[instr].op != SsaOp::PHI; });
+            instrs.insert(after_phis, value);
+            return value;
+        }
+
+        void FunctionBuilder::add_phi_operands(const std::string& name, SsaValue phi) {
+            SsaBlockId block = m_function.values[phi].block;
+            for (SsaBlockId predecessor : m_function.blocks[block].predecessors) {
+                SsaValue operand = read_variable(name, predecessor);
+                m_function.values[phi].operands.push_back(operand);
+            }
+        }
+
+        SsaValue FunctionBuilder::undefined() {
+            if (!m_undefined) {
+                // At the very start of the entry block, so it's defined before anything that could read it
+                auto value = static_cast<SsaValue>(m_function.values.size());
+                m_function.values.push_back({.op = SsaOp::CONSTANT, .block = 0});
+                auto& entry = m_function.blocks.front().instrs;
+                entry.insert(entry.begin(), value);
+                m_undefined = value;
+            }
+            return *m_undefined;
+        }
+
+        void FunctionBuilder::build_block(const TwoPy::Frontend::Block& blk) {
+            for (const auto& s : blk.statements) {
+                build_stmt(*s);
+            }
+        }
+
+        void FunctionBuilder::build_stmt(const TwoPy::Frontend::StmtNode& stmt) {
+            if (auto* expr_stmt = std::get_if<TwoPy::Frontend::ExpressionStmt>(&stmt.node)) {
+                if (!expr_stmt->expression) {
+                    throw std::runtime_error("Something went wrong");
+                }
+                // Nothing uses the value, so lowering pops it
+                (void)build_expr(*expr_stmt->expression);
+            }
+
+            if (auto* func_def = std::get_if<TwoPy::Frontend::FunctionDef>(&stmt.node)) {
+                build_function_def(*func_def);
+            }
+
+            if (auto* if_stmt = std::get_if<TwoPy::Frontend::IfStmt>(&stmt.node)) {
+                build_if_stmt(*if_stmt);
+            }
+
+            if (auto* for_stmt = std::get_if<TwoPy::Frontend::ForStmt>(&stmt.node)) {
+                build_for_stmt(*for_stmt);
+            }
+
+            if (auto* while_stmt = std::get_if<TwoPy::Frontend::WhileStmt>(&stmt.node)) {
+                build_while_stmt(*while_stmt);
+            }
+
+            if (std::holds_alternative<TwoPy::Frontend::BreakStmt>(stmt.node)) {
+                build_break_stmt();
+            }
+
+            if (std::holds_alternative<TwoPy::Frontend::ContinueStmt>(stmt.node)) {
+                build_continue_stmt();
+            }
+
+            if (auto* return_stmt = std::get_if<TwoPy::Frontend::ReturnStmt>(&stmt.node)) {
+                SsaValue result = return_stmt->value ? build_expr(*return_stmt->value) : emit(SsaOp::CONSTANT);
+                emit(SsaOp::RETURN, {result});
+                start_unreachable();
+            }
+        }
+
+        void FunctionBuilder::build_function_def(const TwoPy::Frontend::FunctionDef& function) {
+            std::size_t index = m_program.reserve_function();
+
+            std::vector<std::string> param_names;
+            for (const auto& param : function.params.params) {
+                param_names.push_back(param.token.value);
+            }
+
+            FunctionBuilder body(m_program, function.token.value, param_names, false);
+            m_program.define_function(index, body.build(function.body.statements));
+
+            auto func_obj = make_object<FunctionPyObject>(
+                function.token.value, std::move(param_names), static_cast<std::uint8_t>(index)
+            );
+
+            // A def binds a global even inside a function, like the bytecode compiler does
+            SsaValue func = emit(SsaOp::MAKE_FUNCTION, {}, 0, Value(std::move(func_obj)));
+            emit(SsaOp::STORE_GLOBAL, {func}, m_program.global_slot(function.token.value));
+        }
+
+        void FunctionBuilder::build_if_stmt(const TwoPy::Frontend::IfStmt& stmt) {
+            SsaBlockId join = new_block();
+
+            auto build_arm = [&](const TwoPy::Frontend::ExprNode& condition, const TwoPy::Frontend::Block& body) {
+                SsaBlockId then_block = new_block();
+                SsaBlockId next = new_block();
+                build_condition(condition, then_block, next);
+
+                start_block(then_block);
+                build_block(body);
+                jump(join);
+
+                start_block(next);
+            };
+
+            build_arm(*stmt.condition, stmt.body);
+            for (const auto& elif : stmt.elifs) {
+                build_arm(*elif.condition, elif.body);
+            }
+
+            if (stmt.else_branch != nullptr) {
+                build_block(stmt.else_branch->body);
+            }
+            jump(join);
+
+            start_block(join);
+        }
+
+        void FunctionBuilder::build_for_stmt(const TwoPy::Frontend::ForStmt& stmt) {
+            if (!stmt.iterable || !*stmt.iterable) {
+                throw std::runtime_error("for loop without an iterable");
+            }
+
+            SsaValue iteration = emit(SsaOp::GET_ITER, {build_expr(**stmt.iterable)});
+
+            // FOR_ITER ends the header, every pass starts there and it leaves for the exit once the iterable runs dry
+            SsaBlockId header = new_block();
+            SsaBlockId body = new_block();
+            SsaBlockId exit = new_block();
+            jump(header);
+
+            start_block(header, false);
+            SsaValue item = emit(SsaOp::FOR_ITER, {iteration});
+            add_edge(header, body);
+            add_edge(header, exit);
+
+            start_block(body);
+            assign_identifier(stmt.variable, item);
+
+            m_loops.push_back({.header = header, .exit = exit, .iteration = iteration});
+            build_block(stmt.body);
+            jump(header);
+            m_loops.pop_back();
+
+            seal_block(header);
+            start_block(exit);
+        }
+
+        void FunctionBuilder::build_while_stmt(const TwoPy::Frontend::WhileStmt& stmt) {
+            // The condition is the loop header, every pass runs it again
+            SsaBlockId header = new_block();
+            SsaBlockId body = new_block();
+            SsaBlockId exit = new_block();
+            jump(header);
+
+            start_block(header, false);
+            build_condition(*stmt.condition, body, exit);
+
+            start_block(body);
+            m_loops.push_back({.header = header, .exit = exit, .iteration = std::nullopt});
+            build_block(stmt.body);
+            jump(header);
+            m_loops.pop_back();
+
+            seal_block(header);
+            start_block(exit);
+        }
+
+        void FunctionBuilder::build_break_stmt() {
+            if (m_loops.empty()) {
+                throw std::runtime_error("'break' outside loop");
+            }
+
+            // A for loop's exit edge drops the iterable and its position, a break has to do the same on its way out
+            if (auto iteration = m_loops.back().iteration) {
+                emit(SsaOp::DROP_ITER, {*iteration});
+            }
+            jump(m_loops.back().exit);
+            start_unreachable();
+        }
+
+        void FunctionBuilder::build_continue_stmt() {
+            if (m_loops.empty()) {
+                throw std::runtime_error("'continue' not properly in loop");
+            }
+            jump(m_loops.back().header);
+            start_unreachable();
+        }
+
+        void FunctionBuilder::build_condition(const TwoPy::Frontend::ExprNode& condition, SsaBlockId if_true, SsaBlockId if_false) {
+            if (auto* ops = std::get_if<TwoPy::Frontend::OperatorsType>(&condition.node)) {
+                if (auto* p_and = std::get_if<TwoPy::Frontend::AndOp>(ops)) {
+                    SsaBlockId right = new_block();
+                    build_condition(*p_and->left, right, if_false);
+                    start_block(right);
+                    build_condition(*p_and->right, if_true, if_false);
+                    return;
+                }
+
+                if (auto* p_or = std::get_if<TwoPy::Frontend::OrOp>(ops)) {
+                    SsaBlockId right = new_block();
+                    build_condition(*p_or->left, if_true, right);
+                    start_block(right);
+                    build_condition(*p_or->right, if_true, if_false);
+                    return;
+                }
+            }
+
+            branch(build_expr(condition), if_true, if_false);
+        }
+
+        SsaValue FunctionBuilder::build_expr(const TwoPy::Frontend::ExprNode& expr) {
+            if (auto* call = std::get_if<TwoPy::Frontend::CallExpr>(&expr.node)) {
+                return build_call(*call);
+            }
+
+            if (auto* lits = std::get_if<TwoPy::Frontend::Literals>(&expr.node)) {
+                return build_literal(*lits);
+            }
+
+            if (auto* ops = std::get_if<TwoPy::Frontend::OperatorsType>(&expr.node)) {
+                return build_operators(*ops);
+            }
+
+            if (auto* ident = std::get_if<TwoPy::Frontend::Identifier>(&expr.node)) {
+                return build_identifier(*ident);
+            }
+
+            if (auto* list = std::get_if<TwoPy::Frontend::ListExpr>(&expr.node)) {
+                if (list->elements.size() > UINT8_MAX) {
+                    throw std::runtime_error("Too many items in one list display");
+                }
+
+                std::vector<SsaValue> items;
+                for (const auto& element : list->elements) {
+                    items.push_back(build_expr(*element));
+                }
+                return emit(SsaOp::BUILD_LIST, std::move(items));
+            }
+
+            if (auto* dict = std::get_if<TwoPy::Frontend::DictExpr>(&expr.node)) {
+                if (dict->entries.size() > UINT8_MAX) {
+                    throw std::runtime_error("Too many entries in one dict display");
+                }
+
+                std::vector<SsaValue> entries;
+                for (const auto& [key, value] : dict->entries) {
+                    entries.push_back(build_expr(*key));
+                    entries.push_back(build_expr(*value));
+                }
+                return emit(SsaOp::BUILD_MAP, std::move(entries));
+            }
+
+            if (auto* subscript = std::get_if<TwoPy::Frontend::ListIndexExpr>(&expr.node)) {
+                SsaValue container = build_expr(*subscript->list_name);
+                SsaValue index = build_expr(*subscript->index);
+                return emit(SsaOp::SUBSCR, {container, index});
+            }
+
+            if (std::holds_alternative<TwoPy::Frontend::AttributeExpr>(expr.node)) {
+                throw std::runtime_error("Attributes can only be called as methods");
+            }
+
+            throw std::runtime_error("Expression not supported by the SSA compiler");
+        }
+
+        SsaValue FunctionBuilder::build_literal(const TwoPy::Frontend::Literals& lits) {
+            if (auto* int_lit = std::get_if<TwoPy::Frontend::IntegerLiteral>(&lits)) {
+                return emit(SsaOp::CONSTANT, {}, 0, int_literal(int_lit->token.value));
+            }
+
+            if (auto* float_lit = std::get_if<TwoPy::Frontend::FloatLiteral>(&lits)) {
+                return emit(SsaOp::CONSTANT, {}, 0, Value(std::stod(float_lit->token.value)));
+            }
+
+            if (auto* string_lit = std::get_if<TwoPy::Frontend::StringLiteral>(&lits)) {
+                return emit(SsaOp::CONSTANT, {}, 0, Value(StringPyObject::literal(string_lit->token.value)));
+            }
+
+            auto& bool_lit = std::get<TwoPy::Frontend::BoolLiteral>(lits);
+            return emit(SsaOp::CONSTANT, {}, 0, Value(bool {bool_lit.token.value == "True"}));
+        }
+
+        SsaValue FunctionBuilder::build_operators(const TwoPy::Frontend::OperatorsType& ops) {
+            if (auto* assign = std::get_if<TwoPy::Frontend::AssignmentOp>(&ops)) {
+                return build_assignment(*assign);
+            }
+
+            if (auto* term = std::get_if<TwoPy::Frontend::TermOp>(&ops)) {
+                SsaValue left = build_expr(*term->left);
+                SsaValue right = build_expr(*term->right);
+
+                const std::string& op = term->op.value;
+                if (op == "+") {
+                    return emit(SsaOp::BINARY, {left, right}, static_cast<std::uint32_t>(OpCode::ADD));
+                }
+                if (op == "-") {
+                    return emit(SsaOp::BINARY, {left, right}, static_cast<std::uint32_t>(OpCode::SUB));
+                }
+                throw std::runtime_error(fmt::format("Unknown operator '{}'", op));
+            }
+
+            if (auto* factor = std::get_if<TwoPy::Frontend::FactorOp>(&ops)) {
+                SsaValue left = build_expr(*factor->left);
+                SsaValue right = build_expr(*factor->right);
+
+                const std::string& op = factor->op.value;
+                OpCode opcode = OpCode::MUL;
+                if (op == "/") {
+                    opcode = OpCode::DIV;
+                } else if (op == "%") {
+                    opcode = OpCode::BINARY_MODULO;
+                } else if (op == "//") {
+                    opcode = OpCode::BINARY_FLOOR_DIVIDE;
+                } else if (op != "*") {
+                    throw std::runtime_error(fmt::format("Unknown operator '{}'", op));
+                }
+                return emit(SsaOp::BINARY, {left, right}, static_cast<std::uint32_t>(opcode));
+            }
+
+            if (auto* compare = std::get_if<TwoPy::Frontend::EqualityOp>(&ops)) {
+                CompareOp op = compare->op.value == "==" ? CompareOp::EQ : CompareOp::NE;
+                SsaValue left = build_expr(*compare->left);
+                SsaValue right = build_expr(*compare->right);
+                return emit(SsaOp::COMPARE, {left, right}, static_cast<std::uint32_t>(op));
+            }
+
+            if (auto* compare = std::get_if<TwoPy::Frontend::ComparisonOp>(&ops)) {
+                const std::string& op = compare->op.value;
+                CompareOp cmp = CompareOp::LT;
+                if (op == "<=") {
+                    cmp = CompareOp::LE;
+                } else if (op == ">") {
+                    cmp = CompareOp::GT;
+                } else if (op == ">=") {
+                    cmp = CompareOp::GE;
+                }
+
+                SsaValue left = build_expr(*compare->left);
+                SsaValue right = build_expr(*compare->right);
+                return emit(SsaOp::COMPARE, {left, right}, static_cast<std::uint32_t>(cmp));
+            }
+
+            if (auto* p_and = std::get_if<TwoPy::Frontend::AndOp>(&ops)) {
+                return build_short_circuit(*p_and->left, *p_and->right, true);
+            }
+
+            if (auto* p_or = std::get_if<TwoPy::Frontend::OrOp>(&ops)) {
+                return build_short_circuit(*p_or->left, *p_or->right, false);
+            }
+
+            throw std::runtime_error("Operator not supported by the SSA compiler");
+        }
+
+        SsaValue FunctionBuilder::build_assignment(const TwoPy::Frontend::AssignmentOp& assign) {
+            if (!assign.value || !assign.target) {
+                throw std::runtime_error("Something went wrong");
+            }
+
+            SsaValue value = build_expr(*assign.value);
+
+            if (auto* ident = std::get_if<TwoPy::Frontend::Identifier>(&assign.target->node)) {
+                assign_identifier(*ident, value);
+            } else if (auto* subscript = std::get_if<TwoPy::Frontend::ListIndexExpr>(&assign.target->node)) {
+                SsaValue container = build_expr(*subscript->list_name);
+                SsaValue index = build_expr(*subscript->index);
+                emit(SsaOp::STORE_SUBSCR, {value, container, index});
+            } else {
+                throw std::runtime_error("Cannot assign to this target");
+            }
+            return value;
+        }
+
+        SsaValue FunctionBuilder::build_short_circuit(const TwoPy::Frontend::ExprNode& left, const TwoPy::Frontend::ExprNode& right, bool is_and) {
+            // `a and b` is a when a is falsy and b otherwise, `a or b` the other way round
+            SsaValue lhs = build_expr(left);
+            SsaBlockId rhs_block = new_block();
+            SsaBlockId join = new_block();
+            if (is_and) {
+                branch(lhs, rhs_block, join);
+            } else {
+                branch(lhs, join, rhs_block);
+            }
+
+            start_block(rhs_block);
+            SsaValue rhs = build_expr(right);
+            jump(join);
+
+            // The edge from the left operand's block went in first, so its value is the first operand
+            start_block(join);
+            auto value = static_cast<SsaValue>(m_function.values.size());
+            m_function.values.push_back({.op = SsaOp::PHI, .operands = {lhs, rhs}, .block = join});
+            m_function.blocks[join].instrs.push_back(value);
+            return value;
+        }
+
+        SsaValue FunctionBuilder::build_call(const TwoPy::Frontend::CallExpr& call) {
+            if (call.arguments.size() > UINT8_MAX) {
+                throw std::runtime_error("Too many arguments in one call");
+            }
+
+            // obj.name(args): LOAD_METHOD/CALL_METHOD, no bound method object gets built
+            if (auto* method = std::get_if<TwoPy::Frontend::AttributeExpr>(&call.callee->node)) {
+                SsaValue receiver = build_identifier(method->constructor);
+                // Interned, so the VM's method lookup compares names by pointer
+                SsaValue pair = emit(SsaOp::LOAD_METHOD, {receiver}, 0, Value(StringPyObject::intern(method->attribute.token.value)));
+
+                std::vector<SsaValue> operands {pair};
+                for (const auto& arg : call.arguments) {
+                    operands.push_back(build_expr(*arg));
+                }
+                return emit(SsaOp::CALL_METHOD, std::move(operands), static_cast<std::uint32_t>(call.arguments.size()));
+            }
+
+            std::vector<SsaValue> operands {build_expr(*call.callee)};
+            for (const auto& arg : call.arguments) {
+                operands.push_back(build_expr(*arg));
+            }
+            return emit(SsaOp::CALL, std::move(operands), static_cast<std::uint32_t>(call.arguments.size()));
+        }
+
+        SsaValue FunctionBuilder::build_identifier(const TwoPy::Frontend::Identifier& iden) {
+            // Inside a function only its parameters and assigned names are locals, anything else is a global or builtin
+            if (!m_is_module && m_locals.contains(iden.token.value)) {
+                return read_variable(iden.token.value, m_block);
+            }
+            return emit(SsaOp::LOAD_GLOBAL, {}, m_program.global_slot(iden.token.value));
+        }
+
+        void FunctionBuilder::assign_identifier(const TwoPy::Frontend::Identifier& iden, SsaValue value) {
+            const std::string& name = iden.token.value;
+            if (m_is_module) {
+                emit(SsaOp::STORE_GLOBAL, {value}, m_program.global_slot(name));
+                return;
+            }
+
+            // The local just takes the value, the copy only marks the assignment until copy propagation folds it
+            SsaValue copy = emit(SsaOp::COPY, {value});
+            m_function.values[copy].variable = name;
+            m_locals.insert(name);
+            write_variable(name, m_block, copy);
+        }
+    }
+
+    SsaProgram build_ssa(const TwoPy::Frontend::Program& program) {
+        ProgramBuilder builder;
+        std::size_t module_index = builder.reserve_function();
+
+        FunctionBuilder module(builder, "<module>", {}, true);
+        builder.define_function(module_index, module.build(program.statements));
+
+        builder.resolve_builtins();
+        SsaProgram result = builder.take();
+        for (auto& function : result.functions) {
+            infer_types(function);
+        }
+        return result;
+    }
+}
@@ -0,0 +1,877 @@
+#include "backend/ssa.hpp"
+#include "backend/string_object.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <utility>
+#include <fmt/core.h>
+
+namespace TwoPy::Backend {
+    namespace {
+        /* How a value gets from its instruction to the ones that use it */
+        enum class Placement : std::uint8_t {
+            NONE,           // nothing uses it: popped, or never pushed in the first place
+            STACK,          // left on the operand stack for its only user, later in the same block
+            SLOT,           // stored to a fast slot, every use loads it
+            REMATERIALIZE,  // a constant, every use loads it with LOAD_CONSTANT
+            PINNED,         // an iteration or a method pair, it never leaves the stack
+        };
+
+        [[nodiscard]] bool has_result(SsaOp op) noexcept {
+            switch (op) {
+                case SsaOp::STORE_GLOBAL:
+                case SsaOp::STORE_SUBSCR:
+                case SsaOp::DROP_ITER:
+                case SsaOp::JUMP:
+                case SsaOp::BRANCH:
+                case SsaOp::RETURN: return false;
+                default: return true;
+            }
+        }
+
+        /* With both operand types known, the quickened opcode the VM would have settled on anyway */
+        [[nodiscard]] OpCode arithmetic_opcode(OpCode generic, SsaType lhs, SsaType rhs) noexcept {
+            if (lhs != rhs) {
+                return generic;
+            }
+
+            switch (generic) {
+                case OpCode::ADD:
+                    if (lhs == SsaType::INT) return OpCode::ADD_INT;
+                    if (lhs == SsaType::FLOAT) return OpCode::ADD_FLOAT;
+                    if (lhs == SsaType::STR) return OpCode::ADD_STR;
+                    return generic;
+                case OpCode::SUB:
+                    if (lhs == SsaType::INT) return OpCode::SUB_INT;
+                    if (lhs == SsaType::FLOAT) return OpCode::SUB_FLOAT;
+                    return generic;
+                case OpCode::MUL:
+                    if (lhs == SsaType::INT) return OpCode::MUL_INT;
+                    if (lhs == SsaType::FLOAT) return OpCode::MUL_FLOAT;
+                    return generic;
+                default:
+                    return generic;
+            }
+        }
+
+        /* One block's code on its own, jumps still name the block they go to */
+        struct EmittedBlock {
+            std::vector<Instruction> code {};
+            std::vector<std::pair<std::size_t, SsaBlockId>> jumps {};   // index in `code`, target
+        };
+
+        class FunctionLowering {
+            private:
+                SsaFunction m_function;
+                std::shared_ptr<Chunk> m_chunk {std::make_shared<Chunk>()};
+                std::vector<SsaBlockId> m_order {};
+                std::vector<std::vector<SsaValue>> m_users {};
+                std::vector<Placement> m_placement {};
+                std::vector<std::uint32_t> m_slots {};
+                std::vector<EmittedBlock> m_blocks {};
+                std::vector<std::vector<SsaValue>> m_early_loads {};  // per instruction, loaded right before it for a later user
+
+                [[nodiscard]] const SsaInstr& instr(SsaValue value) const {
+                    return m_function.values[value];
+                }
+
+                // An iteration sits under everything the block pushes, its instructions find it there on their own
+                [[nodiscard]] std::vector<SsaValue> stack_operands(const SsaInstr& user) const {
+                    std::vector<SsaValue> operands;
+                    for (SsaValue operand : user.operands) {
+                        if (instr(operand).op != SsaOp::GET_ITER) {
+                            operands.push_back(operand);
+                        }
+                    }
+                    return operands;
+                }
+
+                [[nodiscard]] bool on_stack(SsaValue value) const {
+                    return m_placement[value] == Placement::STACK || m_placement[value] == Placement::PINNED;
+                }
+
+                // The operands a user loads itself, the ones in front of its last operand on the stack were loaded early
+                [[nodiscard]] std::size_t first_own_load(const std::vector<SsaValue>& operands) const {
+                    std::size_t first = 0;
+                    for (std::size_t i = 0; i < operands.size(); i++) {
+                        if (on_stack(operands[i])) {
+                            first = i + 1;
+                        }
+                    }
+                    return first;
+                }
+
+                // Whether `value` is already in its slot (or a constant) at instruction `index` of `block`
+                [[nodiscard]] bool defined_before(SsaValue value, SsaBlockId block, std::size_t index) const {
+                    const auto& def = instr(value);
+                    if (m_placement[value] == Placement::REMATERIALIZE || def.block != block || def.op == SsaOp::PHI || def.op == SsaOp::PARAM) {
+                        return true;
+                    }
+                    const auto& instrs = m_function.blocks[block].instrs;
+                    return std::distance(instrs.begin(), std::ranges::find(instrs, value)) < static_cast<std::ptrdiff_t>(index);
+                }
+
+                // False for what can't leave the stack
+                bool demote(SsaValue value) {
+                    switch (m_placement[value]) {
+                        case Placement::STACK:
+                            m_placement[value] = instr(value).op == SsaOp::CONSTANT ? Placement::REMATERIALIZE : Placement::SLOT;
+                            return true;
+                        default:
+                            return false;
+                    }
+                }
+
+                [[nodiscard]] std::optional<SsaBlockId> predecessor_index(SsaBlockId from, SsaBlockId to) const {
+                    const auto& predecessors = m_function.blocks[to].predecessors;
+                    auto it = std::ranges::find(predecessors, from);
+                    if (it == predecessors.end()) {
+                        return std::nullopt;
+                    }
+                    return static_cast<SsaBlockId>(std::distance(predecessors.begin(), it));
+                }
+
+                void split_critical_edges();
+                void collect_users();
+                void place_values();
+                [[nodiscard]] std::vector<SsaValue> entry_stack(SsaBlockId block, const std::vector<std::optional<std::vector<SsaValue>>>& exit_stacks) const;
+                [[nodiscard]] bool stackify_once();
+                void allocate_slots();
+
+                void emit_block(SsaBlockId block);
+                void load(EmittedBlock& out, SsaValue value);
+                void emit_phi_copies(EmittedBlock& out, SsaBlockId from, SsaBlockId to);
+                void finish_result(EmittedBlock& out, SsaValue value);
+                void link();
+
+                [[nodiscard]] std::uint8_t constant(Value value) {
+                    return intern_constant(m_chunk->consts_pool, std::move(value));
+                }
+
+            public:
+                explicit FunctionLowering(SsaFunction function)
+                    : m_function(std::move(function)) {}
+
+                [[nodiscard]] std::shared_ptr<Chunk> lower();
+        };
+
+        std::shared_ptr<Chunk> FunctionLowering::lower() {
+            m_chunk->name = m_function.name;
+
+            split_critical_edges();
+            m_order = reverse_postorder(m_function);
+            collect_users();
+            place_values();
+            m_early_loads.resize(m_function.values.size());
+
+            // Every demotion only ever takes a value off the stack, so this settles
+            while (stackify_once()) {}
+
+            allocate_slots();
+
+            m_blocks.resize(m_function.blocks.size());
+            for (SsaBlockId block : m_order) {
+                emit_block(block);
+            }
+            link();
+
+            m_chunk->max_stack = max_stack_depth(*m_chunk);
+            return m_chunk;
+        }
+
+        void FunctionLowering::split_critical_edges() {
+            /* Copies into a PHI go at the end of the predecessor. A block with more than one successor
+               can't hold them, they'd run on the way to the other one too, so the edge gets a block of its own */
+            const std::size_t original = m_function.blocks.size();
+            for (SsaBlockId from = 0; from < original; from++) {
+                if (m_function.blocks[from].dead || m_function.blocks[from].successors.size() < 2) {
+                    continue;
+                }
+
+                for (std::size_t i = 0; i < m_function.blocks[from].successors.size(); i++) {
+                    SsaBlockId to = m_function.blocks[from].successors[i];
+                    const auto& target = m_function.blocks[to];
+                    bool has_phis = std::ranges::any_of(target.instrs, [&](SsaValue value) { return instr(value).op == SsaOp::PHI; });
+                    if (!has_phis) {
+                        continue;
+                    }
+
+                    auto edge = static_cast<SsaBlockId>(m_function.blocks.size());
+                    auto jump = static_cast<SsaValue>(m_function.values.size());
+                    m_function.values.push_back({.op = SsaOp::JUMP, .block = edge});
+                    m_function.blocks.push_back({.instrs = {jump}, .predecessors = {from}, .successors = {to}});
+
+                    m_function.blocks[from].successors[i] = edge;
+                    auto& predecessors = m_function.blocks[to].predecessors;
+                    *std::ranges::find(predecessors, from) = edge;
+                }
+            }
+        }
+
+        void FunctionLowering::collect_users() {
+            m_users.resize(m_function.values.size());
+            for (SsaBlockId block : m_order) {
+                for (SsaValue value : m_function.blocks[block].instrs) {
+                    for (SsaValue operand : instr(value).operands) {
+                        m_users[operand].push_back(value);
+                    }
+                }
+            }
+        }
+
+        void FunctionLowering::place_values() {
+            m_placement.resize(m_function.values.size(), Placement::NONE);
+
+            for (SsaBlockId block : m_order) {
+                for (SsaValue value : m_function.blocks[block].instrs) {
+                    const auto& def = instr(value);
+                    const auto& users = m_users[value];
+
+                    if (!has_result(def.op) || users.empty()) {
+                        m_placement[value] = Placement::NONE;
+                        continue;
+                    }
+                    if (def.op == SsaOp::GET_ITER || def.op == SsaOp::LOAD_METHOD) {
+                        m_placement[value] = Placement::PINNED;
+                        continue;
+                    }
+                    if (def.op == SsaOp::PARAM || def.op == SsaOp::PHI) {
+                        m_placement[value] = Placement::SLOT;
+                        continue;
+                    }
+
+                    // A FOR_ITER's item is pushed on the way into the loop body
+                    SsaBlockId pushed_into = def.op == SsaOp::FOR_ITER ? m_function.blocks[block].successors[0] : block;
+                    const auto& user = instr(users.front());
+                    bool single_local_use = users.size() == 1 && user.block == pushed_into && user.op != SsaOp::PHI;
+
+                    if (single_local_use) {
+                        m_placement[value] = Placement::STACK;
+                    } else {
+                        m_placement[value] = def.op == SsaOp::CONSTANT ? Placement::REMATERIALIZE : Placement::SLOT;
+                    }
+                }
+            }
+        }
+
+        std::vector<SsaValue> FunctionLowering::entry_stack(SsaBlockId block, const std::vector<std::optional<std::vector<SsaValue>>>& exit_stacks) const {
+            for (SsaBlockId predecessor : m_function.blocks[block].predecessors) {
+                const auto& terminator = instr(m_function.blocks[predecessor].instrs.back());
+                if (terminator.op == SsaOp::FOR_ITER && m_function.blocks[predecessor].successors[0] == block) {
+                    SsaValue item = m_function.blocks[predecessor].instrs.back();
+                    if (m_placement[item] == Placement::STACK) {
+                        return {item};
+                    }
+                    return {};
+                }
+            }
+
+            // Only a method pair outlives a block (its call's arguments had an and/or), every way in leaves the same
+            for (SsaBlockId predecessor : m_function.blocks[block].predecessors) {
+                if (exit_stacks[predecessor]) {
+                    return *exit_stacks[predecessor];
+                }
+            }
+            return {};
+        }
+
+        bool FunctionLowering::stackify_once() {
+            /* Walks every block with the values it has left on the stack. A value can only stay there
+               if its user's operands that are also on the stack sit right on top, in order. An operand
+               loaded in front of one of them is loaded before that one's expression starts instead, so
+               it ends up underneath. What's in the way goes to a slot. */
+            constexpr std::size_t carried_in = 0;   // starts are 1 + the index of the first instruction, this is before them all
+            std::vector<std::optional<std::vector<SsaValue>>> exit_stacks(m_function.blocks.size());
+            std::ranges::fill(m_early_loads, std::vector<SsaValue> {});
+
+            for (SsaBlockId block : m_order) {
+                const auto& instrs = m_function.blocks[block].instrs;
+                std::vector<SsaValue> stack = entry_stack(block, exit_stacks);
+                std::vector<std::size_t> starts(stack.size(), carried_in);   // where each entry's expression starts
+
+                for (std::size_t index = 0; index < instrs.size(); index++) {
+                    SsaValue value = instrs[index];
+                    const auto& user = instr(value);
+                    if (user.op == SsaOp::PHI) {
+                        continue;
+                    }
+
+                    auto operands = stack_operands(user);
+                    std::vector<SsaValue> resident {};
+                    std::ranges::copy_if(operands, std::back_inserter(resident), [&](SsaValue operand) { return on_stack(operand); });
+
+                    bool demoted = false;
+                    bool in_order = resident.size() <= stack.size() && std::equal(resident.begin(), resident.end(), stack.end() - static_cast<std::ptrdiff_t>(resident.size()));
+                    if (!in_order) {
+                        std::size_t deepest = stack.size();
+                        for (SsaValue operand : resident) {
+                            auto it = std::ranges::find(stack, operand);
+                            if (it == stack.end()) {
+                                demoted |= demote(operand);
+                            } else {
+                                deepest = std::min(deepest, static_cast<std::size_t>(std::distance(stack.begin(), it)));
+                            }
+                        }
+                        for (std::size_t i = deepest; i < stack.size(); i++) {
+                            if (std::ranges::find(resident, stack[i]) == resident.end()) {
+                                demoted |= demote(stack[i]);
+                            }
+                        }
+                        // Nothing in the way, so they're out of order themselves
+                        if (!demoted) {
+                            for (SsaValue operand : resident) {
+                                demoted |= demote(operand);
+                            }
+                        }
+                        if (!demoted) {
+                            throw std::runtime_error(fmt::format("Can't lower {}: stack operands out of order", m_function.name));
+                        }
+                        return true;
+                    }
+
+                    std::size_t start = index + 1;
+                    std::size_t entry = stack.size() - resident.size();
+                    std::vector<std::pair<std::size_t, std::vector<SsaValue>>> early {};
+                    std::vector<SsaValue> pending {};
+                    for (SsaValue operand : operands) {
+                        if (!on_stack(operand)) {
+                            pending.push_back(operand);
+                            continue;
+                        }
+
+                        std::size_t operand_start = starts[entry++];
+                        start = std::min(start, operand_start);
+                        if (pending.empty()) {
+                            continue;
+                        }
+                        bool loadable = operand_start != carried_in && std::ranges::all_of(pending, [&](SsaValue load) { return defined_before(load, block, operand_start - 1); });
+                        if (!loadable) {
+                            if (!demote(operand)) {
+                                throw std::runtime_error(fmt::format("Can't lower {}: no room for operands under v{}", m_function.name, operand));
+                            }
+                            return true;
+                        }
+                        early.emplace_back(operand_start, std::exchange(pending, {}));
+                    }
+                    stack.resize(entry - resident.size());
+                    starts.resize(stack.size());
+
+                    // An iteration goes on, or comes off, the top of the stack, and a block leaves nothing of its own behind
+                    if (is_terminator(user.op) || user.op == SsaOp::GET_ITER || user.op == SsaOp::DROP_ITER) {
+                        for (SsaValue left : stack) {
+                            demoted |= demote(left);
+                        }
+                        if (demoted) {
+                            return true;
+                        }
+                    }
+
+                    // An enclosing expression's early loads go under this one's, it gets here later
+                    for (auto& [at, loads] : early) {
+                        auto& before = m_early_loads[instrs[at - 1]];
+                        before.insert(before.begin(), loads.begin(), loads.end());
+                    }
+
+                    if (user.op != SsaOp::FOR_ITER && user.op != SsaOp::GET_ITER && on_stack(value)) {
+                        stack.push_back(value);
+                        starts.push_back(start);
+                    }
+                }
+
+                exit_stacks[block] = std::move(stack);
+            }
+            return false;
+        }
+
+        void FunctionLowering::allocate_slots() {
+            /* Values in slots are numbered densely, then liveness gives which of them are live at the
+               same time. Each PHI tries to share a slot with its operands so the copies into it vanish,
+               and parameters keep the slots their arguments arrive in. Whatever's left gets the lowest
+               slot none of the values it overlaps with has. */
+            std::vector<std::uint32_t> dense(m_function.values.size(), UINT32_MAX);
+            std::vector<SsaValue> slotted {};
+            for (SsaValue value = 0; value < m_function.values.size(); value++) {
+                if (m_placement[value] == Placement::SLOT) {
+                    dense[value] = static_cast<std::uint32_t>(slotted.size());
+                    slotted.push_back(value);
+                }
+            }
+
+            const std::size_t count = slotted.size();
+            const auto& blocks = m_function.blocks;
+            std::vector<std::vector<bool>> interferes(count, std::vector<bool>(count));
+            std::vector<std::vector<bool>> live_in(blocks.size(), std::vector<bool>(count));
+            std::vector<std::vector<bool>> live_out(blocks.size(), std::vector<bool>(count));
+
+            auto phis = [&](SsaBlockId block) {
+                std::vector<SsaValue> result;
+                for (SsaValue value : blocks[block].instrs) {
+                    if (instr(value).op == SsaOp::PHI && dense[value] != UINT32_MAX) {
+                        result.push_back(value);
+                    }
+                }
+                return result;
+            };
+
+            // Backwards through the block from what's live at its end, returns what's live on the way in
+            auto scan = [&](SsaBlockId block, std::vector<bool> live, bool record) {
+                const auto& instrs = blocks[block].instrs;
+                for (auto it = instrs.rbegin(); it != instrs.rend() && instr(*it).op != SsaOp::PHI; ++it) {
+                    if (std::uint32_t def = dense[*it]; def != UINT32_MAX) {
+                        if (record) {
+                            for (std::size_t other = 0; other < count; other++) {
+                                if (live[other] && other != def) {
+                                    interferes[def][other] = interferes[other][def] = true;
+                                }
+                            }
+                        }
+                        live[def] = false;
+                    }
+                    for (SsaValue operand : instr(*it).operands) {
+                        if (dense[operand] != UINT32_MAX) {
+                            live[dense[operand]] = true;
+                        }
+                    }
+                }
+
+                // PHIs are all defined at once on the way in
+                auto block_phis = phis(block);
+                for (SsaValue phi : block_phis) {
+                    std::uint32_t def = dense[phi];
+                    if (record) {
+                        for (std::size_t other = 0; other < count; other++) {
+                            if (live[other] && other != def) {
+                                interferes[def][other] = interferes[other][def] = true;
+                            }
+                        }
+                        for (SsaValue sibling : block_phis) {
+                            if (sibling != phi) {
+                                interferes[def][dense[sibling]] = interferes[dense[sibling]][def] = true;
+                            }
+                        }
+                    }
+                }
+                for (SsaValue phi : block_phis) {
+                    live[dense[phi]] = false;
+                }
+                return live;
+            };
+
+            auto compute_live_out = [&](SsaBlockId block) {
+                std::vector<bool> live(count);
+                for (SsaBlockId successor : blocks[block].successors) {
+                    for (std::size_t i = 0; i < count; i++) {
+                        if (live_in[successor][i]) {
+                            live[i] = true;
+                        }
+                    }
+
+                    // What flows into the successor's PHIs is read at the end of this block
+                    auto index = predecessor_index(block, successor);
+                    for (SsaValue phi : phis(successor)) {
+                        SsaValue operand = instr(phi).operands[*index];
+                        if (dense[operand] != UINT32_MAX) {
+                            live[dense[operand]] = true;
+                        }
+                    }
+                }
+                return live;
+            };
+
+            for (bool changed = true; changed;) {
+                changed = false;
+                for (auto it = m_order.rbegin(); it != m_order.rend(); ++it) {
+                    auto out = compute_live_out(*it);
+                    auto in = scan(*it, out, false);
+                    if (out != live_out[*it] || in != live_in[*it]) {
+                        live_out[*it] = std::move(out);
+                        live_in[*it] = std::move(in);
+                        changed = true;
+                    }
+                }
+            }
+            for (SsaBlockId block : m_order) {
+                (void)scan(block, live_out[block], true);
+            }
+
+            // Coalescing, one group per slot
+            std::vector<std::uint32_t> group(count);
+            std::iota(group.begin(), group.end(), 0);
+            std::vector<std::vector<std::uint32_t>> members(count);
+            std::vector<std::optional<std::uint32_t>> fixed(count);
+            for (std::uint32_t i = 0; i < count; i++) {
+                members[i] = {i};
+                if (instr(slotted[i]).op == SsaOp::PARAM) {
+                    fixed[i] = instr(slotted[i]).arg;
+                }
+            }
+
+            auto find = [&](std::uint32_t i) {
+                while (group[i] != i) {
+                    group[i] = group[group[i]];
+                    i = group[i];
+                }
+                return i;
+            };
+
+            auto coalesce = [&](SsaValue lhs, SsaValue rhs) {
+                if (dense[lhs] == UINT32_MAX || dense[rhs] == UINT32_MAX) {
+                    return;
+                }
+                std::uint32_t a = find(dense[lhs]);
+                std::uint32_t b = find(dense[rhs]);
+                if (a == b || (fixed[a] && fixed[b])) {
+                    return;
+                }
+                for (std::uint32_t x : members[a]) {
+                    for (std::uint32_t y : members[b]) {
+                        if (interferes[x][y]) {
+                            return;
+                        }
+                    }
+                }
+
+                members[a].insert(members[a].end(), members[b].begin(), members[b].end());
+                members[b].clear();
+                if (!fixed[a]) {
+                    fixed[a] = fixed[b];
+                }
+                group[b] = a;
+            };
+
+            for (SsaValue value : slotted) {
+                const auto& def = instr(value);
+                if (def.op == SsaOp::PHI || def.op == SsaOp::COPY) {
+                    for (SsaValue operand : def.operands) {
+                        coalesce(value, operand);
+                    }
+                }
+            }
+
+            std::vector<std::set<std::uint32_t>> neighbours(count);
+            for (std::uint32_t i = 0; i < count; i++) {
+                for (std::uint32_t j = i + 1; j < count; j++) {
+                    if (interferes[i][j]) {
+                        neighbours[find(i)].insert(find(j));
+                        neighbours[find(j)].insert(find(i));
+                    }
+                }
+            }
+
+            std::vector<std::optional<std::uint32_t>> colors(count);
+            std::uint32_t slot_count = static_cast<std::uint32_t>(m_function.params.size());
+            for (std::uint32_t i = 0; i < count; i++) {
+                if (find(i) == i && fixed[i]) {
+                    colors[i] = fixed[i];
+                }
+            }
+            for (std::uint32_t i = 0; i < count; i++) {
+                if (find(i) != i || colors[i]) {
+                    continue;
+                }
+
+                std::set<std::uint32_t> taken {};
+                for (std::uint32_t neighbour : neighbours[i]) {
+                    if (colors[neighbour]) {
+                        taken.insert(*colors[neighbour]);
+                    }
+                }
+                std::uint32_t color = 0;
+                while (taken.contains(color)) {
+                    color++;
+                }
+                colors[i] = color;
+            }
+
+            m_slots.resize(m_function.values.size(), UINT32_MAX);
+            for (std::uint32_t i = 0; i < count; i++) {
+                std::uint32_t color = *colors[find(i)];
+                m_slots[slotted[i]] = color;
+                slot_count = std::max(slot_count, color + 1);
+            }
+            if (slot_count > UINT8_MAX + 1) {
+                throw std::runtime_error(fmt::format("Too many locals in {}", m_function.name));
+            }
+
+            // Parameters name their slots, anything else takes the name of a local that lives in it
+            auto& names = m_chunk->local_names;
+            names.resize(slot_count);
+            for (std::size_t slot = 0; slot < slot_count; slot++) {
+                names[slot] = slot < m_function.params.size() ? m_function.params[slot] : fmt::format("${}", slot);
+            }
+            for (SsaValue value : slotted) {
+                const auto& name = instr(value).variable;
+                if (m_slots[value] >= m_function.params.size() && !name.empty() && names[m_slots[value]].starts_with('$')) {
+                    names[m_slots[value]] = name;
+                }
+            }
+        }
+
+        void FunctionLowering::load(EmittedBlock& out, SsaValue value) {
+            switch (m_placement[value]) {
+                case Placement::SLOT:
+                    out.code.push_back({.opcode = OpCode::LOAD_FAST, .argument = static_cast<std::uint8_t>(m_slots[value])});
+                    return;
+                case Placement::REMATERIALIZE:
+                    out.code.push_back({.opcode = OpCode::LOAD_CONSTANT, .argument = constant(instr(value).constant)});
+                    return;
+                default:
+                    throw std::runtime_error(fmt::format("Can't lower {}: operand v{} has nowhere to load it from", m_function.name, value));
+            }
+        }
+
+        void FunctionLowering::finish_result(EmittedBlock& out, SsaValue value) {
+            switch (m_placement[value]) {
+                case Placement::SLOT:
+                    out.code.push_back({.opcode = OpCode::STORE_FAST, .argument = static_cast<std::uint8_t>(m_slots[value])});
+                    return;
+                case Placement::NONE:
+                    if (has_result(instr(value).op)) {
+                        out.code.push_back({.opcode = OpCode::POP, .argument = 0});
+                    }
+                    return;
+                default:
+                    return;
+            }
+        }
+
+        void FunctionLowering::emit_phi_copies(EmittedBlock& out, SsaBlockId from, SsaBlockId to) {
+            auto index = predecessor_index(from, to);
+            if (!index) {
+                return;
+            }
+
+            /* All copies into a block's PHIs happen at once. Unless one of them overwrites a slot another
+               still has to read, they go one at a time, otherwise every source is pushed before any store */
+            struct Move {
+                std::uint8_t slot;
+                SsaValue source;
+            };
+            std::vector<Move> moves {};
+            for (SsaValue value : m_function.blocks[to].instrs) {
+                const auto& phi = instr(value);
+                if (phi.op != SsaOp::PHI) {
+                    break;
+                }
+                if (m_placement[value] != Placement::SLOT) {
+                    continue;
+                }
+
+                SsaValue source = phi.operands[*index];
+                if (m_placement[source] == Placement::SLOT && m_slots[source] == m_slots[value]) {
+                    continue;
+                }
+                moves.push_back({.slot = static_cast<std::uint8_t>(m_slots[value]), .source = source});
+            }
+
+            bool overlapping = std::ranges::any_of(moves, [&](const Move& move) {
+                return std::ranges::any_of(moves, [&](const Move& other) {
+                    return m_placement[other.source] == Placement::SLOT && m_slots[other.source] == move.slot;
+                });
+            });
+
+            if (!overlapping) {
+                for (const auto& move : moves) {
+                    load(out, move.source);
+                    out.code.push_back({.opcode = OpCode::STORE_FAST, .argument = move.slot});
+                }
+                return;
+            }
+
+            for (const auto& move : moves) {
+                load(out, move.source);
+            }
+            for (auto it = moves.rbegin(); it != moves.rend(); ++it) {
+                out.code.push_back({.opcode = OpCode::STORE_FAST, .argument = it->slot});
+            }
+        }
+
+        void FunctionLowering::emit_block(SsaBlockId block) {
+            auto& out = m_blocks[block];
+            const auto& successors = m_function.blocks[block].successors;
+
+            for (SsaValue value : m_function.blocks[block].instrs) {
+                const auto& def = instr(value);
+                if (def.op == SsaOp::PHI || def.op == SsaOp::PARAM) {
+                    continue;
+                }
+                if (def.op == SsaOp::CONSTANT && m_placement[value] != Placement::STACK) {
+                    continue;
+                }
+
+                for (SsaValue early : m_early_loads[value]) {
+                    load(out, early);
+                }
+                auto operands = stack_operands(def);
+                for (std::size_t i = first_own_load(operands); i < operands.size(); i++) {
+                    load(out, operands[i]);
+                }
+
+                auto emit = [&](OpCode opcode, std::uint32_t argument = 0) {
+                    out.code.push_back({.opcode = opcode, .argument = static_cast<std::uint8_t>(argument)});
+                };
+                auto emit_jump = [&](OpCode opcode, SsaBlockId target) {
+                    out.jumps.emplace_back(out.code.size(), target);
+                    emit(opcode);
+                };
+
+                switch (def.op) {
+                    case SsaOp::CONSTANT: emit(OpCode::LOAD_CONSTANT, constant(def.constant)); break;
+                    case SsaOp::LOAD_GLOBAL: emit(OpCode::LOAD_NAME, def.arg); break;
+                    case SsaOp::LOAD_BUILTIN: emit(OpCode::LOAD_BUILTIN, def.arg); break;
+                    case SsaOp::STORE_GLOBAL: emit(OpCode::STORE_NAME, def.arg); break;
+                    case SsaOp::BINARY:
+                        emit(arithmetic_opcode(static_cast<OpCode>(def.arg), instr(def.operands[0]).type, instr(def.operands[1]).type));
+                        break;
+                    case SsaOp::COMPARE: emit(OpCode::COMPARE_OP, def.arg); break;
+                    case SsaOp::CALL: emit(OpCode::CALL_FUNCTION, def.arg); break;
+                    case SsaOp::LOAD_METHOD: emit(OpCode::LOAD_METHOD, constant(def.constant)); break;
+                    case SsaOp::CALL_METHOD: emit(OpCode::CALL_METHOD, def.arg); break;
+                    case SsaOp::BUILD_LIST: emit(OpCode::BUILD_LIST, static_cast<std::uint32_t>(def.operands.size())); break;
+                    case SsaOp::BUILD_MAP: emit(OpCode::BUILD_MAP, static_cast<std::uint32_t>(def.operands.size() / 2)); break;
+                    case SsaOp::SUBSCR: emit(OpCode::BINARY_SUBSCR); break;
+                    case SsaOp::STORE_SUBSCR: emit(OpCode::STORE_SUBSCR); break;
+                    case SsaOp::MAKE_FUNCTION: {
+                        // The qualified name goes on top like the bytecode compiler leaves it, MAKE_FUNCTION drops it
+                        auto* function = static_cast<FunctionPyObject*>(def.constant.as_object());
+                        emit(OpCode::LOAD_CONSTANT, constant(def.constant));
+                        emit(OpCode::LOAD_CONSTANT, constant(Value(StringPyObject::intern(function->name()))));
+                        emit(OpCode::MAKE_FUNCTION);
+                        break;
+                    }
+                    case SsaOp::GET_ITER: emit(OpCode::GET_ITER); break;
+                    case SsaOp::DROP_ITER:
+                        emit(OpCode::POP);
+                        emit(OpCode::POP);
+                        break;
+                    case SsaOp::COPY: break;
+                    case SsaOp::JUMP:
+                        emit_phi_copies(out, block, successors[0]);
+                        emit_jump(OpCode::JUMP_FORWARD, successors[0]);
+                        continue;
+                    case SsaOp::BRANCH:
+                        emit_jump(OpCode::POP_JUMP_IF_FALSE, successors[1]);
+                        emit_jump(OpCode::JUMP_FORWARD, successors[0]);
+                        continue;
+                    case SsaOp::FOR_ITER:
+                        emit_jump(OpCode::FOR_ITER, successors[1]);
+                        finish_result(out, value);
+                        emit_jump(OpCode::JUMP_FORWARD, successors[0]);
+                        continue;
+                    case SsaOp::RETURN:
+                        // The call was left on the stack right before, so nothing runs between it and the return
+                        if (instr(def.operands[0]).op == SsaOp::CALL && !out.code.empty() && out.code.back().opcode == OpCode::CALL_FUNCTION
+                            && m_function.name != "<module>") {
+                            out.code.back().opcode = OpCode::TAIL_CALL;
+                        }
+                        emit(OpCode::RETURN);
+                        continue;
+                    default: break;
+                }
+                finish_result(out, value);
+            }
+        }
+
+        void FunctionLowering::link() {
+            /* Lays the blocks out in reverse postorder. A block that's nothing but a jump is skipped and
+               jumps to it go straight on, a jump to the block right after it is dropped, and a branch
+               whose false arm comes next flips to POP_JUMP_IF_TRUE */
+            auto forwards_to = [&](SsaBlockId block) -> std::optional<SsaBlockId> {
+                const auto& emitted = m_blocks[block];
+                if (emitted.code.size() == 1 && emitted.code[0].opcode == OpCode::JUMP_FORWARD) {
+                    return emitted.jumps[0].second;
+                }
+                return std::nullopt;
+            };
+            auto destination = [&](SsaBlockId block) {
+                // An empty infinite loop forwards to itself, it stops after going round once
+                for (std::size_t hops = 0; hops < m_blocks.size(); hops++) {
+                    auto next = forwards_to(block);
+                    if (!next) {
+                        break;
+                    }
+                    block = *next;
+                }
+                return block;
+            };
+
+            std::vector<SsaBlockId> layout {};
+            for (SsaBlockId block : m_order) {
+                if (block == m_order.front() || !forwards_to(block) || destination(block) == block) {
+                    layout.push_back(block);
+                }
+            }
+
+            std::vector<std::size_t> start(m_function.blocks.size());
+            std::vector<std::pair<std::size_t, SsaBlockId>> jumps {};
+            auto& code = m_chunk->code;
+
+            for (std::size_t i = 0; i < layout.size(); i++) {
+                auto emitted = m_blocks[layout[i]];
+                bool last_block = i + 1 == layout.size();
+
+                auto jumps_to_next = [&](std::size_t index) {
+                    auto it = std::ranges::find_if(emitted.jumps, [&](const auto& jump) { return jump.first == index; });
+                    return it != emitted.jumps.end() && !last_block && destination(it->second) == layout[i + 1];
+                };
+
+                if (!emitted.code.empty() && emitted.code.back().opcode == OpCode::JUMP_FORWARD) {
+                    std::size_t last = emitted.code.size() - 1;
+                    if (jumps_to_next(last)) {
+                        emitted.code.pop_back();
+                        std::erase_if(emitted.jumps, [&](const auto& jump) { return jump.first == last; });
+                    } else if (last > 0 && emitted.code[last - 1].opcode == OpCode::POP_JUMP_IF_FALSE && jumps_to_next(last - 1)) {
+                        emitted.code.pop_back();
+                        std::erase_if(emitted.jumps, [&](const auto& jump) { return jump.first == last - 1; });
+                        emitted.code.back().opcode = OpCode::POP_JUMP_IF_TRUE;
+                        for (auto& jump : emitted.jumps) {
+                            if (jump.first == last) {
+                                jump.first = last - 1;
+                            }
+                        }
+                    }
+                }
+
+                start[layout[i]] = code.size();
+                for (const auto& [index, target] : emitted.jumps) {
+                    jumps.emplace_back(code.size() + index, target);
+                }
+                code.insert(code.end(), emitted.code.begin(), emitted.code.end());
+            }
+
+            // Every chunk ends in RETURN, the VM and the JIT never check for running off the end
+            if (code.empty() || code.back().opcode != OpCode::RETURN) {
+                code.push_back({.opcode = OpCode::LOAD_CONSTANT, .argument = constant(Value {})});
+                code.push_back({.opcode = OpCode::RETURN, .argument = 0});
+            }
+
+            std::vector<JumpSite> sites {};
+            for (auto [index, target] : jumps) {
+                std::size_t target_index = start[destination(target)];
+                // A jump back up is a loop's back-edge, the VM counts those
+                if (code[index].opcode == OpCode::JUMP_FORWARD && target_index <= index) {
+                    code[index].opcode = OpCode::JUMP_BACKWARD;
+                }
+                sites.push_back({.index = index, .target = target_index * 2});
+            }
+
+            m_chunk->byte_offset = code.size() * 2;
+            resolve_jump_targets(*m_chunk, sites);
+        }
+    }
+
+    ByteCodeProgram lower_ssa(const SsaProgram& program) {
+        ByteCodeProgram bytecode {};
+        bytecode.name = "<module>";
+        bytecode.global_names = program.global_names;
+
+        for (const auto& function : program.functions) {
+            bytecode.chunks.push_back(FunctionLowering(function).lower());
+        }
+        return bytecode;
+    }
+}
@@ -0,0 +1,800 @@
+#include "backend/ssa.hpp"
+#include "backend/operations.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <map>
+#include <optional>
+#include <tuple>
+#include <utility>
+
+namespace TwoPy::Backend {
+    namespace {
+        [[nodiscard]] bool is_numeric(SsaType type) noexcept {
+            return type == SsaType::INT || type == SsaType::FLOAT || type == SsaType::BOOL;
+        }
+
+        [[nodiscard]] bool is_arithmetic(std::uint32_t opcode) noexcept {
+            switch (static_cast<OpCode>(opcode)) {
+                case OpCode::ADD:
+                case OpCode::SUB:
+                case OpCode::MUL:
+                case OpCode::DIV: return true;
+                default: return false;
+            }
+        }
+
+        [[nodiscard]] SsaType constant_type(const Value& value) noexcept {
+            if (value.is_none()) {
+                return SsaType::NONE;
+            }
+            if (value.is_bool()) {
+                return SsaType::BOOL;
+            }
+            if (value.is_int() || as_bigint(value) != nullptr) {
+                return SsaType::INT;
+            }
+            if (value.is_float()) {
+                return SsaType::FLOAT;
+            }
+            if (is_string(value)) {
+                return SsaType::STR;
+            }
+            if (value.is_obj() && value.as_object() != nullptr && value.as_object()->tag() == ObjectTag::FUNCTION) {
+                return SsaType::FUNCTION;
+            }
+            return SsaType::ANY;
+        }
+
+        /* What binary_add() and friends hand back for operands of these types */
+        [[nodiscard]] SsaType binary_type(std::uint32_t opcode, SsaType lhs, SsaType rhs) noexcept {
+            auto integer = [](SsaType type) { return type == SsaType::INT || type == SsaType::BOOL; };
+
+            switch (static_cast<OpCode>(opcode)) {
+                case OpCode::DIV:
+                    return SsaType::FLOAT;
+                case OpCode::ADD:
+                    if (lhs == SsaType::STR && rhs == SsaType::STR) {
+                        return SsaType::STR;
+                    }
+                    [[fallthrough]];
+                case OpCode::SUB:
+                case OpCode::MUL:
+                    if (integer(lhs) && integer(rhs)) {
+                        return SsaType::INT;
+                    }
+                    if (is_numeric(lhs) && is_numeric(rhs)) {
+                        return SsaType::FLOAT;
+                    }
+                    return SsaType::ANY;
+                default:
+                    return SsaType::ANY;
+            }
+        }
+
+        /* Same immediate down to the bits, objects are never folded so they never compare equal here */
+        [[nodiscard]] bool same_immediate(const Value& lhs, const Value& rhs) noexcept {
+            if (lhs.tag() != rhs.tag()) {
+                return false;
+            }
+
+            switch (lhs.tag()) {
+                case ValueTag::NONE: return true;
+                case ValueTag::BOOL: return lhs.as_bool() == rhs.as_bool();
+                case ValueTag::INT: return lhs.as_int() == rhs.as_int();
+                case ValueTag::FLOAT: return std::bit_cast<std::uint64_t>(lhs.as_float()) == std::bit_cast<std::uint64_t>(rhs.as_float());
+                default: return false;
+            }
+        }
+
+        [[nodiscard]] bool is_immediate(const Value& value) noexcept {
+            return value.is_none() || value.is_bool() || value.is_int() || value.is_float();
+        }
+
+        [[nodiscard]] SsaValue resolve(std::vector<SsaValue>& replacement, SsaValue value) {
+            while (replacement[value] != value) {
+                replacement[value] = replacement[replacement[value]];
+                value = replacement[value];
+            }
+            return value;
+        }
+
+        [[nodiscard]] std::vector<SsaValue> identity(std::size_t count) {
+            std::vector<SsaValue> replacement(count);
+            for (std::size_t i = 0; i < count; i++) {
+                replacement[i] = static_cast<SsaValue>(i);
+            }
+            return replacement;
+        }
+
+        /* Points every use at its replacement and drops the replaced instructions, false if nothing was replaced */
+        bool apply_replacements(SsaFunction& function, std::vector<SsaValue>& replacement) {
+            bool changed = false;
+            for (SsaValue value = 0; value < function.values.size(); value++) {
+                auto& instr = function.values[value];
+                if (instr.dead) {
+                    continue;
+                }
+                if (resolve(replacement, value) != value) {
+                    instr.dead = true;
+                    changed = true;
+                    continue;
+                }
+                for (auto& operand : instr.operands) {
+                    operand = resolve(replacement, operand);
+                }
+            }
+
+            if (changed) {
+                for (auto& block : function.blocks) {
+                    std::erase_if(block.instrs, [&](SsaValue value) { return function.values[value].dead; });
+                }
+            }
+            return changed;
+        }
+
+        /* Takes the edge out of `to`'s predecessors along with the PHI operands that came in over it */
+        void remove_edge(SsaFunction& function, SsaBlockId from, SsaBlockId to) {
+            auto& successors = function.blocks[from].successors;
+            if (auto it = std::ranges::find(successors, to); it != successors.end()) {
+                successors.erase(it);
+            }
+
+            auto& target = function.blocks[to];
+            auto it = std::ranges::find(target.predecessors, from);
+            if (it == target.predecessors.end()) {
+                return;
+            }
+            auto index = static_cast<std::size_t>(std::distance(target.predecessors.begin(), it));
+            target.predecessors.erase(it);
+
+            for (SsaValue value : target.instrs) {
+                auto& instr = function.values[value];
+                if (instr.op == SsaOp::PHI) {
+                    instr.operands.erase(instr.operands.begin() + static_cast<std::ptrdiff_t>(index));
+                }
+            }
+        }
+
+        /* Drops every block the entry no longer reaches, false if there were none */
+        bool remove_unreachable_blocks(SsaFunction& function) {
+            std::vector<bool> reachable(function.blocks.size());
+            for (SsaBlockId block : reverse_postorder(function)) {
+                reachable[block] = true;
+            }
+
+            bool changed = false;
+            for (SsaBlockId block = 0; block < function.blocks.size(); block++) {
+                if (reachable[block] || function.blocks[block].dead) {
+                    continue;
+                }
+
+                for (SsaBlockId successor : std::vector(function.blocks[block].successors)) {
+                    remove_edge(function, block, successor);
+                }
+                for (SsaValue value : function.blocks[block].instrs) {
+                    function.values[value].dead = true;
+                }
+                function.blocks[block] = {.dead = true};
+                changed = true;
+            }
+            return changed;
+        }
+
+        /* Immediate dominators by Cooper, Harvey and Kennedy's iteration over reverse postorder */
+        [[nodiscard]] std::vector<SsaBlockId> immediate_dominators(const SsaFunction& function, const std::vector<SsaBlockId>& order) {
+            constexpr SsaBlockId none = UINT32_MAX;
+            std::vector<std::size_t> position(function.blocks.size());
+            for (std::size_t i = 0; i < order.size(); i++) {
+                position[order[i]] = i;
+            }
+
+            std::vector<SsaBlockId> idom(function.blocks.size(), none);
+            idom[order.front()] = order.front();
+
+            auto intersect = [&](SsaBlockId lhs, SsaBlockId rhs) {
+                while (lhs != rhs) {
+                    while (position[lhs] > position[rhs]) {
+                        lhs = idom[lhs];
+                    }
+                    while (position[rhs] > position[lhs]) {
+                        rhs = idom[rhs];
+                    }
+                }
+                return lhs;
+            };
+
+            for (bool changed = true; changed;) {
+                changed = false;
+                for (std::size_t i = 1; i < order.size(); i++) {
+                    SsaBlockId block = order[i];
+                    SsaBlockId dominator = none;
+                    for (SsaBlockId predecessor : function.blocks[block].predecessors) {
+                        if (idom[predecessor] == none) {
+                            continue;
+                        }
+                        dominator = dominator == none ? predecessor : intersect(predecessor, dominator);
+                    }
+                    if (idom[block] != dominator) {
+                        idom[block] = dominator;
+                        changed = true;
+                    }
+                }
+            }
+            return idom;
+        }
+
+        /*
+        Sparse conditional constant propagation (Wegman and Zadeck). A value starts out unknown, goes to
+        a constant once an executable path gives it one and to overdefined once it could be more than
+        one. Only blocks reached over an edge that can be taken count, so a branch on a folded
+        condition never even looks at the arm it skips.
+        */
+        class ConstantPropagation {
+            private:
+                enum class Lattice : std::uint8_t {
+                    UNKNOWN,
+                    CONSTANT,
+                    OVERDEFINED,
+                };
+
+                struct State {
+                    Lattice lattice {Lattice::UNKNOWN};
+                    Value constant {};
+                };
+
+                SsaFunction& m_function;
+                std::vector<State> m_states;
+                std::vector<std::vector<SsaValue>> m_users;
+                std::vector<bool> m_reached {};
+                std::vector<std::vector<bool>> m_edges {};      // per block, per predecessor: whether that edge can be taken
+                std::vector<std::pair<SsaBlockId, SsaBlockId>> m_flow_worklist {};
+                std::vector<SsaValue> m_value_worklist {};
+
+                void set(SsaValue value, State state) {
+                    auto& current = m_states[value];
+                    if (current.lattice == state.lattice && (state.lattice != Lattice::CONSTANT || same_immediate(current.constant, state.constant))) {
+                        return;
+                    }
+                    current = std::move(state);
+                    m_value_worklist.push_back(value);
+                }
+
+                void overdefine(SsaValue value) {
+                    set(value, {.lattice = Lattice::OVERDEFINED});
+                }
+
+                void take_edge(SsaBlockId from, SsaBlockId to) {
+                    m_flow_worklist.emplace_back(from, to);
+                }
+
+                void visit(SsaValue value);
+                void visit_phi(SsaValue value);
+                [[nodiscard]] State evaluate(const SsaInstr& instr) const;
+
+            public:
+                explicit ConstantPropagation(SsaFunction& function)
+                    : m_function(function), m_states(function.values.size()), m_users(function.values.size()) {
+                    m_reached.resize(function.blocks.size());
+                    for (const auto& block : function.blocks) {
+                        m_edges.emplace_back(block.predecessors.size());
+                    }
+
+                    for (SsaValue value = 0; value < function.values.size(); value++) {
+                        if (function.values[value].dead) {
+                            continue;
+                        }
+                        for (SsaValue operand : function.values[value].operands) {
+                            m_users[operand].push_back(value);
+                        }
+                    }
+                }
+
+                void run();
+                void rewrite();
+        };
+
+        void ConstantPropagation::run() {
+            m_flow_worklist.emplace_back(UINT32_MAX, 0);
+
+            while (!m_flow_worklist.empty() || !m_value_worklist.empty()) {
+                if (!m_flow_worklist.empty()) {
+                    auto [from, to] = m_flow_worklist.back();
+                    m_flow_worklist.pop_back();
+
+                    const auto& predecessors = m_function.blocks[to].predecessors;
+                    if (from != UINT32_MAX) {
+                        auto index = static_cast<std::size_t>(std::distance(predecessors.begin(), std::ranges::find(predecessors, from)));
+                        if (m_edges[to][index]) {
+                            continue;
+                        }
+                        m_edges[to][index] = true;
+                    }
+
+                    // A new edge into a block already reached only changes what its PHIs can see
+                    if (m_reached[to]) {
+                        for (SsaValue value : m_function.blocks[to].instrs) {
+                            if (m_function.values[value].op == SsaOp::PHI) {
+                                visit_phi(value);
+                            }
+                        }
+                        continue;
+                    }
+
+                    m_reached[to] = true;
+                    for (SsaValue value : m_function.blocks[to].instrs) {
+                        visit(value);
+                    }
+                    continue;
+                }
+
+                SsaValue value = m_value_worklist.back();
+                m_value_worklist.pop_back();
+                for (SsaValue user : m_users[value]) {
+                    if (m_reached[m_function.values[user].block]) {
+                        visit(user);
+                    }
+                }
+            }
+        }
+
+        void ConstantPropagation::visit(SsaValue value) {
+            const auto& instr = m_function.values[value];
+            const auto& block = m_function.blocks[instr.block];
+
+            switch (instr.op) {
+                case SsaOp::PHI:
+                    visit_phi(value);
+                    return;
+                case SsaOp::JUMP:
+                    take_edge(instr.block, block.successors[0]);
+                    return;
+                case SsaOp::BRANCH: {
+                    const auto& condition = m_states[instr.operands[0]];
+                    if (condition.lattice == Lattice::CONSTANT) {
+                        take_edge(instr.block, block.successors[condition.constant.is_truthy() ? 0 : 1]);
+                    } else if (condition.lattice == Lattice::OVERDEFINED) {
+                        take_edge(instr.block, block.successors[0]);
+                        take_edge(instr.block, block.successors[1]);
+                    }
+                    return;
+                }
+                case SsaOp::FOR_ITER:
+                    take_edge(instr.block, block.successors[0]);
+                    take_edge(instr.block, block.successors[1]);
+                    overdefine(value);
+                    return;
+                default:
+                    set(value, evaluate(instr));
+                    return;
+            }
+        }
+
+        void ConstantPropagation::visit_phi(SsaValue value) {
+            const auto& instr = m_function.values[value];
+            State merged {};
+            for (std::size_t i = 0; i < instr.operands.size(); i++) {
+                if (!m_edges[instr.block][i]) {
+                    continue;
+                }
+
+                const auto& incoming = m_states[instr.operands[i]];
+                if (incoming.lattice == Lattice::UNKNOWN) {
+                    continue;
+                }
+                if (incoming.lattice == Lattice::OVERDEFINED ||
+                    (merged.lattice == Lattice::CONSTANT && !same_immediate(merged.constant, incoming.constant))) {
+                    merged = {.lattice = Lattice::OVERDEFINED};
+                    break;
+                }
+                merged = incoming;
+            }
+            set(value, std::move(merged));
+        }
+
+        ConstantPropagation::State ConstantPropagation::evaluate(const SsaInstr& instr) const {
+            switch (instr.op) {
+                case SsaOp::CONSTANT:
+                    if (is_immediate(instr.constant)) {
+                        return {.lattice = Lattice::CONSTANT, .constant = instr.constant};
+                    }
+                    return {.lattice = Lattice::OVERDEFINED};
+                case SsaOp::COPY:
+                    return m_states[instr.operands[0]];
+                case SsaOp::BINARY:
+                case SsaOp::COMPARE: {
+                    const auto& lhs = m_states[instr.operands[0]];
+                    const auto& rhs = m_states[instr.operands[1]];
+                    if (lhs.lattice == Lattice::UNKNOWN || rhs.lattice == Lattice::UNKNOWN) {
+                        return {};
+                    }
+                    if (lhs.lattice == Lattice::OVERDEFINED || rhs.lattice == Lattice::OVERDEFINED) {
+                        return {.lattice = Lattice::OVERDEFINED};
+                    }
+
+                    // Only numbers fold, and only to a result that's an immediate again (no bigints)
+                    if (instr.op == SsaOp::COMPARE) {
+                        if (auto result = compare_values(static_cast<CompareOp>(instr.arg), lhs.constant, rhs.constant)) {
+                            return {.lattice = Lattice::CONSTANT, .constant = Value(bool {*result})};
+                        }
+                        return {.lattice = Lattice::OVERDEFINED};
+                    }
+                    if (!is_arithmetic(instr.arg) || !is_number(lhs.constant) || !is_number(rhs.constant)) {
+                        return {.lattice = Lattice::OVERDEFINED};
+                    }
+                    // Division by zero raises when it runs
+                    if (static_cast<OpCode>(instr.arg) == OpCode::DIV && to_double(rhs.constant) == 0.0) {
+                        return {.lattice = Lattice::OVERDEFINED};
+                    }
+
+                    Value result {};
+                    switch (static_cast<OpCode>(instr.arg)) {
+                        case OpCode::ADD: result = binary_add(lhs.constant, rhs.constant); break;
+                        case OpCode::SUB: result = binary_sub(lhs.constant, rhs.constant); break;
+                        case OpCode::MUL: result = binary_mul(lhs.constant, rhs.constant); break;
+                        default: result = binary_div(lhs.constant, rhs.constant); break;
+                    }
+                    if (!is_immediate(result)) {
+                        return {.lattice = Lattice::OVERDEFINED};
+                    }
+                    return {.lattice = Lattice::CONSTANT, .constant = result};
+                }
+                default:
+                    return {.lattice = Lattice::OVERDEFINED};
+            }
+        }
+
+        void ConstantPropagation::rewrite() {
+            // Branches that can only go one way become jumps
+            for (SsaBlockId block = 0; block < m_function.blocks.size(); block++) {
+                if (!m_reached[block] || m_function.blocks[block].dead) {
+                    continue;
+                }
+
+                auto& terminator = m_function.values[m_function.blocks[block].instrs.back()];
+                if (terminator.op != SsaOp::BRANCH || m_states[terminator.operands[0]].lattice != Lattice::CONSTANT) {
+                    continue;
+                }
+
+                bool truthy = m_states[terminator.operands[0]].constant.is_truthy();
+                SsaBlockId skipped = m_function.blocks[block].successors[truthy ? 1 : 0];
+                terminator.op = SsaOp::JUMP;
+                terminator.operands.clear();
+                remove_edge(m_function, block, skipped);
+            }
+
+            // Whatever folded becomes its constant, in place
+            for (SsaValue value = 0; value < m_function.values.size(); value++) {
+                auto& instr = m_function.values[value];
+                if (instr.dead || instr.op == SsaOp::CONSTANT || m_states[value].lattice != Lattice::CONSTANT) {
+                    continue;
+                }
+                instr.op = SsaOp::CONSTANT;
+                instr.arg = 0;
+                instr.constant = m_states[value].constant;
+                instr.operands.clear();
+            }
+
+            // A folded PHI is an ordinary instruction now, it moves below the ones left
+            for (auto& block : m_function.blocks) {
+                std::ranges::stable_partition(block.instrs, [&](SsaValue value) { return m_function.values[value].op == SsaOp::PHI; });
+            }
+
+            remove_unreachable_blocks(m_function);
+        }
+    }
+
+    bool is_terminator(SsaOp op) noexcept {
+        switch (op) {
+            case SsaOp::JUMP:
+            case SsaOp::BRANCH:
+            case SsaOp::FOR_ITER:
+            case SsaOp::RETURN: return true;
+            default: return false;
+        }
+    }
+
+    bool has_side_effects(const SsaInstr& instr, const SsaFunction& function) noexcept {
+        switch (instr.op) {
+            case SsaOp::CONSTANT:
+            case SsaOp::PARAM:
+            case SsaOp::LOAD_BUILTIN:
+            case SsaOp::BUILD_LIST:
+            case SsaOp::MAKE_FUNCTION:
+            case SsaOp::COPY:
+            case SsaOp::PHI:
+                return false;
+            case SsaOp::BINARY: {
+                // Arithmetic raises unless both sides are numbers (or both strings for +), and / on a divisor that may be zero
+                if (!is_arithmetic(instr.arg)) {
+                    return true;
+                }
+                const SsaInstr& lhs = function.values[instr.operands[0]];
+                const SsaInstr& rhs = function.values[instr.operands[1]];
+                auto opcode = static_cast<OpCode>(instr.arg);
+                if (opcode == OpCode::DIV) {
+                    bool nonzero = rhs.op == SsaOp::CONSTANT && is_number(rhs.constant) && to_double(rhs.constant) != 0.0;
+                    return !(is_numeric(lhs.type) && nonzero);
+                }
+                bool strings = opcode == OpCode::ADD && lhs.type == SsaType::STR && rhs.type == SsaType::STR;
+                return !(is_numeric(lhs.type) && is_numeric(rhs.type)) && !strings;
+            }
+            case SsaOp::COMPARE: {
+                // == and != take anything, ordering raises unless both sides are numbers or both strings
+                auto op = static_cast<CompareOp>(instr.arg);
+                if (op == CompareOp::EQ || op == CompareOp::NE) {
+                    return false;
+                }
+                SsaType lhs = function.values[instr.operands[0]].type;
+                SsaType rhs = function.values[instr.operands[1]].type;
+                return !(is_numeric(lhs) && is_numeric(rhs)) && !(lhs == SsaType::STR && rhs == SsaType::STR);
+            }
+            default:
+                // Globals, subscripts and dict displays can raise, calls and stores are what the program does
+                return true;
+        }
+    }
+
+    std::vector<SsaBlockId> reverse_postorder(const SsaFunction& function) {
+        /* Successors are walked last to first, so the first one (a branch's taken arm, a loop's body)
+           ends up right after its block and lowering gets to fall through into it */
+        std::vector<SsaBlockId> postorder;
+        std::vector<bool> visited(function.blocks.size());
+        std::vector<std::pair<SsaBlockId, std::size_t>> stack {{0, function.blocks[0].successors.size()}};
+        visited[0] = true;
+
+        while (!stack.empty()) {
+            auto& [block, remaining] = stack.back();
+            if (remaining == 0) {
+                postorder.push_back(block);
+                stack.pop_back();
+                continue;
+            }
+
+            SsaBlockId successor = function.blocks[block].successors[--remaining];
+            if (!visited[successor]) {
+                visited[successor] = true;
+                stack.emplace_back(successor, function.blocks[successor].successors.size());
+            }
+        }
+
+        std::ranges::reverse(postorder);
+        return postorder;
+    }
+
+    void infer_types(SsaFunction& function) {
+        /* Optimistic: a PHI's type is only what's known of its operands so far, and a loop goes round
+           until nothing changes. Nothing known at all by the end only happens in dead cycles */
+        std::vector<std::optional<SsaType>> types(function.values.size());
+        auto order = reverse_postorder(function);
+
+        auto transfer = [&](const SsaInstr& instr) -> std::optional<SsaType> {
+            auto operand = [&](std::size_t i) { return types[instr.operands[i]]; };
+
+            switch (instr.op) {
+                case SsaOp::CONSTANT: return constant_type(instr.constant);
+                case SsaOp::COMPARE: return SsaType::BOOL;
+                case SsaOp::BUILD_LIST: return SsaType::LIST;
+                case SsaOp::BUILD_MAP: return SsaType::DICT;
+                case SsaOp::MAKE_FUNCTION: return SsaType::FUNCTION;
+                case SsaOp::GET_ITER: return SsaType::ITERATION;
+                case SsaOp::LOAD_METHOD: return SsaType::METHOD;
+                case SsaOp::COPY: return operand(0);
+                case SsaOp::BINARY: {
+                    if (static_cast<OpCode>(instr.arg) == OpCode::DIV) {
+                        return SsaType::FLOAT;
+                    }
+                    if (!operand(0) || !operand(1)) {
+                        return std::nullopt;
+                    }
+                    return binary_type(instr.arg, *operand(0), *operand(1));
+                }
+                case SsaOp::PHI: {
+                    std::optional<SsaType> merged {};
+                    for (std::size_t i = 0; i < instr.operands.size(); i++) {
+                        auto incoming = operand(i);
+                        if (!incoming) {
+                            continue;
+                        }
+                        if (merged && *merged != *incoming) {
+                            return SsaType::ANY;
+                        }
+                        merged = incoming;
+                    }
+                    return merged;
+                }
+                default: return SsaType::ANY;
+            }
+        };
+
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (SsaBlockId block : order) {
+                for (SsaValue value : function.blocks[block].instrs) {
+                    auto type = transfer(function.values[value]);
+                    if (type != types[value]) {
+                        types[value] = type;
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        for (SsaValue value = 0; value < function.values.size(); value++) {
+            function.values[value].type = types[value].value_or(SsaType::ANY);
+        }
+    }
+
+    void propagate_copies(SsaFunction& function) {
+        /* A COPY is its operand, and so is a PHI whose operands are all one value (or itself, around a loop) */
+        for (bool changed = true; changed;) {
+            auto replacement = identity(function.values.size());
+
+            for (SsaValue value = 0; value < function.values.size(); value++) {
+                auto& instr = function.values[value];
+                if (instr.dead) {
+                    continue;
+                }
+
+                std::optional<SsaValue> same {};
+                if (instr.op == SsaOp::COPY) {
+                    same = resolve(replacement, instr.operands[0]);
+                } else if (instr.op == SsaOp::PHI) {
+                    bool trivial = true;
+                    for (SsaValue operand : instr.operands) {
+                        SsaValue source = resolve(replacement, operand);
+                        if (source == value || source == same) {
+                            continue;
+                        }
+                        if (same) {
+                            trivial = false;
+                            break;
+                        }
+                        same = source;
+                    }
+                    if (!trivial) {
+                        same.reset();
+                    }
+                }
+
+                if (same && *same != value) {
+                    // The value keeps the name it was assigned, for the dump
+                    auto& source = function.values[*same];
+                    if (source.variable.empty() && source.op != SsaOp::CONSTANT) {
+                        source.variable = instr.variable;
+                    }
+                    replacement[value] = *same;
+                }
+            }
+
+            changed = apply_replacements(function, replacement);
+        }
+        infer_types(function);
+    }
+
+    void propagate_constants(SsaFunction& function) {
+        ConstantPropagation propagation(function);
+        propagation.run();
+        propagation.rewrite();
+        infer_types(function);
+    }
+
+    void eliminate_common_subexpressions(SsaFunction& function) {
+        /* Walks the dominator tree with a scoped table of the pure expressions seen on the way down,
+           an expression already computed in a dominating block is that earlier value */
+        auto order = reverse_postorder(function);
+        auto idom = immediate_dominators(function, order);
+
+        std::vector<std::vector<SsaBlockId>> children(function.blocks.size());
+        for (SsaBlockId block : order) {
+            if (block != order.front()) {
+                children[idom[block]].push_back(block);
+            }
+        }
+
+        using Key = std::tuple<SsaOp, std::uint32_t, std::vector<SsaValue>>;
+        std::map<Key, SsaValue> available {};
+        auto replacement = identity(function.values.size());
+
+        auto pure = [&](const SsaInstr& instr) {
+            switch (instr.op) {
+                case SsaOp::BINARY: return is_arithmetic(instr.arg);
+                case SsaOp::COMPARE: return true;
+                // LOAD_BUILTIN is as cheap as the LOAD_FAST reusing it would take, and keeps its user's operands on the stack
+                default: return false;
+            }
+        };
+
+        // Explicit stack: the block, and whether its subtree is done and its entries come out of the table
+        std::vector<std::pair<SsaBlockId, bool>> stack {{order.front(), false}};
+        std::vector<std::vector<Key>> added(function.blocks.size());
+        while (!stack.empty()) {
+            auto [block, leaving] = stack.back();
+            stack.pop_back();
+
+            if (leaving) {
+                for (const auto& key : added[block]) {
+                    available.erase(key);
+                }
+                continue;
+            }
+
+            for (SsaValue value : function.blocks[block].instrs) {
+                auto& instr = function.values[value];
+                if (!pure(instr)) {
+                    continue;
+                }
+
+                std::vector<SsaValue> operands;
+                for (SsaValue operand : instr.operands) {
+                    operands.push_back(resolve(replacement, operand));
+                }
+
+                Key key {instr.op, instr.arg, std::move(operands)};
+                if (auto it = available.find(key); it != available.end()) {
+                    replacement[value] = it->second;
+                } else {
+                    available.emplace(key, value);
+                    added[block].push_back(std::move(key));
+                }
+            }
+
+            stack.emplace_back(block, true);
+            for (SsaBlockId child : children[block]) {
+                stack.emplace_back(child, false);
+            }
+        }
+
+        apply_replacements(function, replacement);
+        infer_types(function);
+    }
+
+    void eliminate_dead_code(SsaFunction& function) {
+        remove_unreachable_blocks(function);
+
+        // Mark from what has to run, then sweep whatever nothing needed
+        std::vector<bool> live(function.values.size());
+        std::vector<SsaValue> worklist {};
+        for (const auto& block : function.blocks) {
+            for (SsaValue value : block.instrs) {
+                if (has_side_effects(function.values[value], function)) {
+                    live[value] = true;
+                    worklist.push_back(value);
+                }
+            }
+        }
+
+        while (!worklist.empty()) {
+            SsaValue value = worklist.back();
+            worklist.pop_back();
+            for (SsaValue operand : function.values[value].operands) {
+                if (!live[operand]) {
+                    live[operand] = true;
+                    worklist.push_back(operand);
+                }
+            }
+        }
+
+        for (auto& block : function.blocks) {
+            std::erase_if(block.instrs, [&](SsaValue value) {
+                if (live[value]) {
+                    return false;
+                }
+                function.values[value].dead = true;
+                return true;
+            });
+        }
+        infer_types(function);
+    }
+
+    void optimize_ssa(SsaProgram& program) {
+        for (auto& function : program.functions) {
+            propagate_copies(function);
+            propagate_constants(function);
+            // Folding leaves PHIs with a single operand, or all the same one, behind
+            propagate_copies(function);
+            eliminate_common_subexpressions(function);
+            eliminate_dead_code(function);
+        }
+    }
+}
@@ -0,0 +1,100 @@
+#include "backend/string_object.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+
+namespace TwoPy::Backend {
+    namespace {
+        bool ascii_only(std::string_view text) noexcept {
+            return std::ranges::all_of(text, [](char c) { return static_cast<unsigned char>(c) < 0x80; });
+        }
+
+        bool spelled_like_identifier(std::string_view text) noexcept {
+            auto is_start = [](char c) { return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); };
+            auto is_rest = [&](char c) { return is_start(c) || (c >= '0' && c <= '9'); };
+            return !text.empty() && is_start(text.front()) && std::ranges::all_of(text.substr(1), is_rest);
+        }
+
+        /* Per thread like the objects in it. Keys view the text of the string they map to, which the table keeps alive */
+        std::unordered_map<std::string_view, ObjectRef<StringPyObject>>& intern_table() {
+            static thread_local std::unordered_map<std::string_view, ObjectRef<StringPyObject>> table {};
+            return table;
+        }
+    }
+
+    StringPyObject* StringPyObject::allocate(std::size_t size, bool ascii) {
+        void* block = ObjectPool::local().allocate(allocation_size(size));
+        auto* str = ::new (block) StringPyObject(size, ascii);
+        str->storage()[size] = '\0';
+        return str;
+    }
+
+    void StringPyObject::operator delete(StringPyObject* ptr, std::destroying_delete_t) noexcept {
+        std::size_t bytes = allocation_size(ptr->m_size);
+        ptr->~StringPyObject();
+        ObjectPool::local().deallocate(ptr, bytes);
+    }
+
+    ObjectRef<StringPyObject> StringPyObject::make(std::string_view text) {
+        StringPyObject* str = allocate(text.size(), ascii_only(text));
+        std::memcpy(str->storage(), text.data(), text.size());
+        return ObjectRef<StringPyObject>(str);
+    }
+
+    ObjectRef<StringPyObject> StringPyObject::concat(const StringPyObject& lhs, const StringPyObject& rhs) {
+        StringPyObject* str = allocate(lhs.m_size + rhs.m_size, lhs.m_ascii && rhs.m_ascii);
+        std::memcpy(str->storage(), lhs.data(), lhs.m_size);
+        std::memcpy(str->storage() + lhs.m_size, rhs.data(), rhs.m_size);
+        return ObjectRef<StringPyObject>(str);
+    }
+
+    ObjectRef<StringPyObject> StringPyObject::intern(std::string_view text) {
+        auto& table = intern_table();
+        if (auto it = table.find(text); it != table.end()) {
+            return it->second;
+        }
+
+        ObjectRef<StringPyObject> str = make(text);
+        str->m_interned = true;
+        table.emplace(str->view(), str);
+        return str;
+    }
+
+    ObjectRef<StringPyObject> StringPyObject::literal(std::string_view text) {
+        return spelled_like_identifier(text) ? intern(text) : make(text);
+    }
+
+    std::size_t StringPyObject::length() const noexcept {
+        if (m_ascii) {
+            return m_size;
+        }
+        // Every code point has exactly one byte that isn't a 10xxxxxx continuation byte
+        return static_cast<std::size_t>(std::ranges::count_if(view(), [](char c) {
+            return (static_cast<unsigned char>(c) & 0xC0) != 0x80;
+        }));
+    }
+
+    std::size_t StringPyObject::hash() const noexcept {
+        if (m_hash == 0) {
+            std::size_t computed = std::hash<std::string_view> {}(view());
+            m_hash = computed != 0 ? computed : 1;
+        }
+        return m_hash;
+    }
+
+    bool operator==(const StringPyObject& lhs, const StringPyObject& rhs) noexcept {
+        if (&lhs == &rhs) {
+            return true;
+        }
+        if ((lhs.m_interned && rhs.m_interned) || lhs.m_size != rhs.m_size) {
+            return false;
+        }
+        // Cheap reject when both hashes are already known
+        if (lhs.m_hash != 0 && rhs.m_hash != 0 && lhs.m_hash != rhs.m_hash) {
+            return false;
+        }
+        return std::memcmp(lhs.data(), rhs.data(), lhs.m_size) == 0;
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef TWOPY_STRING_OBJECT_HPP
+#define TWOPY_STRING_OBJECT_HPP
+
+#include <compare>
+#include <cstddef>
+#include <new>
+#include <string>
+#include <string_view>
+
+#include "backend/objects.hpp"
+
+/*
+Immutable str. The bytes (UTF-8, NUL terminated) live right after the header in the same block,
+so a string is one allocation and short ones come out of the object pool like anything else.
+Whether the text is pure ASCII is worked out once on creation, the hash the first time it's
+asked for. Interned strings are unique per text, two of them are equal only if they're the same
+object.
+*/
+namespace TwoPy::Backend {
+    class StringPyObject final : public ObjectBase {
+        private:
+            mutable std::size_t m_hash {};  // 0 until hash() first runs
+            std::size_t m_size;
+            bool m_ascii;
+            bool m_interned {};
+
+            StringPyObject(std::size_t size, bool ascii) noexcept
+                : ObjectBase(ObjectTag::STRING), m_size(size), m_ascii(ascii) {}
+
+            [[nodiscard]] static constexpr std::size_t allocation_size(std::size_t size) noexcept {
+                return sizeof(StringPyObject) + size + 1;
+            }
+
+            /* Header plus room for `size` bytes, the caller fills in the text */
+            [[nodiscard]] static StringPyObject* allocate(std::size_t size, bool ascii);
+
+            [[nodiscard]] char* storage() noexcept {
+                return reinterpret_cast<char*>(this + 1);
+            }
+
+        public:
+            [[nodiscard]] static ObjectRef<StringPyObject> make(std::string_view text);
+
+            /* lhs + rhs written straight into the new string */
+            [[nodiscard]] static ObjectRef<StringPyObject> concat(const StringPyObject& lhs, const StringPyObject& rhs);
+
+            /* The one shared string for `text`, for names and identifiers */
+            [[nodiscard]] static ObjectRef<StringPyObject> intern(std::string_view text);
+
+            /* A string literal's constant: interned when it's spelled like an identifier, same as CPython */
+            [[nodiscard]] static ObjectRef<StringPyObject> literal(std::string_view text);
+
+            /* The block is bigger than sizeof(StringPyObject), so it has to free itself with the real size */
+            void operator delete(StringPyObject* ptr, std::destroying_delete_t) noexcept;
+
+            [[nodiscard]] const char* data() const noexcept {
+                return reinterpret_cast<const char*>(this + 1);
+            }
+
+            [[nodiscard]] std::string_view view() const noexcept {
+                return {data(), m_size};
+            }
+
+            /* In bytes */
+            [[nodiscard]] std::size_t size() const noexcept {
+                return m_size;
+            }
+
+            /* In code points, what len() reports */
+            [[nodiscard]] std::size_t length() const noexcept;
+
+            [[nodiscard]] bool is_ascii() const noexcept {
+                return m_ascii;
+            }
+
+            [[nodiscard]] bool is_interned() const noexcept {
+                return m_interned;
+            }
+
+            [[nodiscard]] std::size_t hash() const noexcept;
+
+            std::string stringify() override {
+                return std::string(view());
+            }
+
+            // Empty strings are falsy, non-empty strings are truthy (Python behavior)
+            bool is_truthy() const noexcept override {
+                return m_size != 0;
+            }
+
+            friend bool operator==(const StringPyObject& lhs, const StringPyObject& rhs) noexcept;
+
+            friend std::strong_ordering operator<=>(const StringPyObject& lhs, const StringPyObject& rhs) noexcept {
+                return lhs.view() <=> rhs.view();
+            }
+    };
+}
+
+#endif
@@ -0,0 +1,75 @@
+#include "backend/bytecode.hpp"
+
+#include <array>
+#include <span>
+
+/*
+Which sequences get fused came out of `twopy -p` dispatch profiles over test-suite/bench.
+Only the first opcode of a match gets rewritten. The handler in VM::run reads the arguments
+of the instructions that follow and skips over them, so jump offsets never move and a jump
+into the middle of a fused sequence still runs the original instruction.
+*/
+namespace TwoPy::Backend {
+    namespace {
+        struct Superinstruction {
+            std::array<OpCode, 3> sequence;
+            std::size_t length;
+            OpCode fused;
+        };
+
+        // Longest sequences first so a triple wins over the pair it starts with
+        constexpr std::array<Superinstruction, 5> superinstructions {{
+            {{OpCode::LOAD_NAME, OpCode::LOAD_CONSTANT, OpCode::ADD}, 3, OpCode::LOAD_NAME__LOAD_CONSTANT__ADD},
+            {{OpCode::COMPARE_OP, OpCode::POP_JUMP_IF_FALSE}, 2, OpCode::COMPARE_OP__POP_JUMP_IF_FALSE},
+            {{OpCode::LOAD_CONSTANT, OpCode::STORE_NAME}, 2, OpCode::LOAD_CONSTANT__STORE_NAME},
+            {{OpCode::LOAD_NAME, OpCode::LOAD_NAME}, 2, OpCode::LOAD_NAME__LOAD_NAME},
+            {{OpCode::LOAD_NAME, OpCode::LOAD_CONSTANT}, 2, OpCode::LOAD_NAME__LOAD_CONSTANT},
+        }};
+
+        bool matches(std::span<const Instruction> code, std::size_t at, const Superinstruction& super) {
+            if (at + super.length > code.size()) {
+                return false;
+            }
+
+            for (std::size_t i = 0; i < super.length; i++) {
+                if (code[at + i].opcode != super.sequence[i]) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        void fuse_chunk(Chunk& chunk) {
+            std::size_t ip = 0;
+            while (ip < chunk.code.size()) {
+                std::size_t step = 1;
+
+                for (const auto& super : superinstructions) {
+                    if (matches(chunk.code, ip, super)) {
+                        chunk.code[ip].opcode = super.fused;
+                        step = super.length;
+                        break;
+                    }
+                }
+
+                ip += step;
+            }
+        }
+    }
+
+    void fuse_superinstructions(ByteCodeProgram& program) {
+        for (auto& chunk : program.chunks) {
+            fuse_chunk(*chunk);
+        }
+    }
+
+    OpCode unfused_opcode(OpCode op) noexcept {
+        for (const auto& super : superinstructions) {
+            if (super.fused == op) {
+                return super.sequence[0];
+            }
+        }
+        return op;
+    }
+}
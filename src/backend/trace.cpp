@@ -0,0 +1,785 @@
+#include "backend/trace.hpp"
+#include "backend/vm.hpp"
+#include "backend/operations.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <map>
+#include <tuple>
+
+namespace TwoPy::Backend {
+    namespace {
+        [[nodiscard]] std::size_t operand_count(TraceOp op) noexcept {
+            switch (op) {
+                case TraceOp::INT_TO_FLOAT:
+                case TraceOp::GUARD_TRUE:
+                case TraceOp::GUARD_FALSE: return 1;
+                case TraceOp::ADD:
+                case TraceOp::SUB:
+                case TraceOp::MUL:
+                case TraceOp::DIV:
+                case TraceOp::MOD:
+                case TraceOp::FLOOR_DIV:
+                case TraceOp::COMPARE:
+                case TraceOp::PHI: return 2;
+                default: return 0;
+            }
+        }
+
+        [[nodiscard]] bool is_guard(TraceOp op) noexcept {
+            return op == TraceOp::GUARD_TRUE || op == TraceOp::GUARD_FALSE;
+        }
+
+        /* Anything with a snapshot to leave with */
+        [[nodiscard]] bool can_exit(const TraceInstr& instr) noexcept {
+            return is_guard(instr.op) || instr.checked;
+        }
+
+        /* Same operands, same result: a candidate for CSE and hoisting */
+        [[nodiscard]] bool is_pure(TraceOp op) noexcept {
+            return op == TraceOp::CONSTANT || op == TraceOp::INT_TO_FLOAT || (op >= TraceOp::ADD && op <= TraceOp::COMPARE);
+        }
+
+        [[nodiscard]] std::uint32_t resolve(const std::vector<std::uint32_t>& forward, std::uint32_t value) noexcept {
+            while (forward[value] != value) {
+                value = forward[value];
+            }
+            return value;
+        }
+
+        [[nodiscard]] std::vector<std::uint32_t> identity(std::size_t size) {
+            std::vector<std::uint32_t> values(size);
+            for (std::size_t i = 0; i < size; i++) {
+                values[i] = static_cast<std::uint32_t>(i);
+            }
+            return values;
+        }
+
+        /* Renumbers the trace to the values in `order`, a value dropped in favour of another (`forward`) hands its uses over */
+        void rebuild(Trace& trace, const std::vector<std::uint32_t>& order, const std::vector<std::uint32_t>& forward) {
+            std::vector<std::uint32_t> position(trace.code.size(), UINT32_MAX);
+            for (std::size_t i = 0; i < order.size(); i++) {
+                position[order[i]] = static_cast<std::uint32_t>(i);
+            }
+            auto renumber = [&](std::uint32_t value) { return position[resolve(forward, value)]; };
+
+            std::vector<TraceInstr> code;
+            code.reserve(order.size());
+            for (std::uint32_t value : order) {
+                TraceInstr instr = trace.code[value];
+                std::size_t operands = operand_count(instr.op);
+                if (operands >= 1) {
+                    instr.left = renumber(instr.left);
+                }
+                if (operands == 2) {
+                    instr.right = renumber(instr.right);
+                }
+                code.push_back(instr);
+            }
+
+            // A snapshot nothing leaves with any more may now point at dropped values, compact_exits() removes it
+            for (TraceExit& exit : trace.exits) {
+                for (std::uint32_t& value : exit.stack) {
+                    value = renumber(value);
+                }
+                for (auto& [variable, value] : exit.variables) {
+                    value = renumber(value);
+                }
+            }
+            trace.code = std::move(code);
+        }
+
+        [[nodiscard]] std::size_t loop_position(const Trace& trace) noexcept {
+            auto loop = std::ranges::find(trace.code, TraceOp::LOOP, &TraceInstr::op);
+            return static_cast<std::size_t>(loop - trace.code.begin());
+        }
+
+        [[nodiscard]] bool is_int_constant(const TraceInstr& instr, long value) noexcept {
+            return instr.op == TraceOp::CONSTANT && instr.type == TraceType::INT && static_cast<long>(instr.arg) == value;
+        }
+
+        /* A divisor that can't be zero, dividing by it needs no exit */
+        [[nodiscard]] bool is_nonzero_constant(const TraceInstr& instr) noexcept {
+            if (instr.op != TraceOp::CONSTANT) {
+                return false;
+            }
+            return instr.type == TraceType::FLOAT ? std::bit_cast<double>(instr.arg) != 0.0 : instr.arg != 0;
+        }
+
+        /* A division by what may be zero has to run even if nothing uses its result */
+        [[nodiscard]] bool may_raise(const Trace& trace, const TraceInstr& instr) noexcept {
+            bool division = instr.op == TraceOp::DIV || instr.op == TraceOp::MOD || instr.op == TraceOp::FLOOR_DIV;
+            return division && !is_nonzero_constant(trace.code[instr.right]);
+        }
+    }
+
+    /*
+    Runs the loop body on the VM's state the way the interpreter would, recording each instruction
+    on the way. The shadow stack holds the trace value of everything pushed since the header, so an
+    abort anywhere leaves the VM exactly as the interpreter would have at that instruction.
+    */
+    class TraceRecorder {
+        public:
+            [[nodiscard]] static std::unique_ptr<Trace> record(VM& vm, std::size_t chunk_index, std::size_t header) {
+                return TraceRecorder(vm, chunk_index, header).run();
+            }
+
+        private:
+            static constexpr std::size_t max_length = 256;          // body instructions before the loop counts as too big
+            static constexpr std::uint32_t load_bit = 1U << 31;     // loads are numbered apart until they're placed before LOOP
+
+            VM& m_vm;
+            std::size_t m_chunk_index;
+            std::size_t m_header;
+            std::vector<TraceInstr> m_loads {};
+            std::vector<TraceInstr> m_body {};
+            std::vector<TraceExit> m_exits {1};                     // exits[0] is filled in once the loop is closed
+            std::vector<std::uint32_t> m_stack {};
+            std::map<TraceVariable, std::uint32_t> m_current {};    // each variable's value as of the instruction being recorded
+            std::map<TraceVariable, std::uint32_t> m_loaded {};
+            std::vector<TraceVariable> m_assigned {};
+
+            TraceRecorder(VM& vm, std::size_t chunk_index, std::size_t header)
+                : m_vm(vm), m_chunk_index(chunk_index), m_header(header) {}
+
+            [[nodiscard]] const TraceInstr& instr(std::uint32_t value) const noexcept {
+                return (value & load_bit) != 0 ? m_loads[value & ~load_bit] : m_body[value];
+            }
+
+            std::uint32_t emit(const TraceInstr& instr) {
+                m_body.push_back(instr);
+                return static_cast<std::uint32_t>(m_body.size() - 1);
+            }
+
+            std::uint32_t constant(TraceType type, std::uint64_t bits) {
+                return emit({.op = TraceOp::CONSTANT, .type = type, .arg = bits});
+            }
+
+            /* The state at `ip` for a guard to leave with, the variables not assigned yet are added once they're all known */
+            std::uint32_t snapshot(std::size_t ip) {
+                TraceExit exit {.ip = ip, .stack = m_stack, .variables = {}};
+                for (const TraceVariable& variable : m_assigned) {
+                    exit.variables.emplace_back(variable, m_current.at(variable));
+                }
+                m_exits.push_back(std::move(exit));
+                return static_cast<std::uint32_t>(m_exits.size() - 1);
+            }
+
+            /* A variable's first read in the iteration is its value from the header, loaded on entry */
+            [[nodiscard]] bool push_variable(TraceVariable variable, const Value& value) {
+                if (auto current = m_current.find(variable); current != m_current.end()) {
+                    m_stack.push_back(current->second);
+                    return true;
+                }
+                std::optional<TraceType> type = trace_type(value);
+                if (!type) {
+                    return false;
+                }
+                m_loads.push_back({.op = variable.global ? TraceOp::LOAD_NAME : TraceOp::LOAD_FAST, .type = *type, .arg = variable.slot});
+                auto load = static_cast<std::uint32_t>(m_loads.size() - 1) | load_bit;
+                m_loaded[variable] = load;
+                m_current[variable] = load;
+                m_stack.push_back(load);
+                return true;
+            }
+
+            void assign(TraceVariable variable) {
+                if (std::ranges::find(m_assigned, variable) == m_assigned.end()) {
+                    m_assigned.push_back(variable);
+                }
+                m_current[variable] = m_stack.back();
+                m_stack.pop_back();
+            }
+
+            std::uint32_t to_float(std::uint32_t value) {
+                if (instr(value).type == TraceType::FLOAT) {
+                    return value;
+                }
+                return emit({.op = TraceOp::INT_TO_FLOAT, .type = TraceType::FLOAT, .left = value});
+            }
+
+            /*
+            Ints stay ints unless it's a division or the result became a bigint, any float makes both floats.
+            % and // are only recorded on ints. A division leaves on a zero divisor, the interpreter
+            raises the ZeroDivisionError
+            */
+            [[nodiscard]] bool binary(std::size_t ip, TraceOp op, Value (*operation)(const Value&, const Value&)) {
+                if (m_stack.size() < 2) {
+                    return false;
+                }
+                std::uint32_t lhs = m_stack[m_stack.size() - 2];
+                std::uint32_t rhs = m_stack.back();
+                if (instr(lhs).type == TraceType::BOOL || instr(rhs).type == TraceType::BOOL) {
+                    return false;
+                }
+                if ((op == TraceOp::MOD || op == TraceOp::FLOOR_DIV) && (instr(lhs).type != TraceType::INT || instr(rhs).type != TraceType::INT)) {
+                    return false;
+                }
+                bool ints = op != TraceOp::DIV && instr(lhs).type == TraceType::INT && instr(rhs).type == TraceType::INT;
+                bool checked = ints || (op == TraceOp::DIV && !is_nonzero_constant(instr(rhs)));
+                std::uint32_t exit = checked ? snapshot(ip) : 0;
+
+                Value& result = m_vm.vm_stack.peek(1);
+                result = operation(result, m_vm.vm_stack.top());
+                m_vm.vm_stack.drop();
+                m_vm.m_ip = ip + 1;
+                if (ints && !result.is_int()) {
+                    return false;
+                }
+
+                m_stack.resize(m_stack.size() - 2);
+                if (ints) {
+                    m_stack.push_back(emit({.op = op, .type = TraceType::INT, .checked = true, .left = lhs, .right = rhs, .exit = exit}));
+                } else {
+                    std::uint32_t left = to_float(lhs);
+                    m_stack.push_back(emit({.op = op, .type = TraceType::FLOAT, .checked = checked, .left = left, .right = to_float(rhs), .exit = exit}));
+                }
+                return true;
+            }
+
+            [[nodiscard]] bool compare(std::size_t ip, CompareOp op) {
+                if (m_stack.size() < 2) {
+                    return false;
+                }
+                std::uint32_t lhs = m_stack[m_stack.size() - 2];
+                std::uint32_t rhs = m_stack.back();
+                if (instr(lhs).type == TraceType::BOOL || instr(rhs).type == TraceType::BOOL) {
+                    return false;
+                }
+
+                Value& result = m_vm.vm_stack.peek(1);
+                result = Value(bool {*compare_values(op, result, m_vm.vm_stack.top())});
+                m_vm.vm_stack.drop();
+                m_vm.m_ip = ip + 1;
+
+                m_stack.resize(m_stack.size() - 2);
+                if (instr(lhs).type != instr(rhs).type) {
+                    lhs = to_float(lhs);
+                    rhs = to_float(rhs);
+                }
+                m_stack.push_back(emit({.op = TraceOp::COMPARE, .type = TraceType::BOOL, .left = lhs, .right = rhs, .arg = static_cast<std::uint64_t>(op)}));
+                return true;
+            }
+
+            /* The guard's exit goes where the branch didn't go while recording, with the condition already popped */
+            [[nodiscard]] bool branch(std::size_t ip, bool jump_if) {
+                if (m_stack.empty()) {
+                    return false;
+                }
+                std::uint32_t condition = m_stack.back();
+                m_stack.pop_back();
+
+                bool truthy = m_vm.vm_stack.top().is_truthy();
+                m_vm.vm_stack.drop();
+                std::size_t target = jump_target(m_vm.m_instrutions, ip);
+                bool jumps = truthy == jump_if;
+                m_vm.m_ip = jumps ? target : ip + 1;
+
+                if (TraceType type = instr(condition).type; type != TraceType::BOOL) {
+                    std::uint32_t zero = constant(type, 0);
+                    condition = emit({.op = TraceOp::COMPARE, .type = TraceType::BOOL, .left = condition, .right = zero, .arg = static_cast<std::uint64_t>(CompareOp::NE)});
+                }
+                std::uint32_t exit = snapshot(jumps ? ip + 1 : target);
+                emit({.op = truthy ? TraceOp::GUARD_TRUE : TraceOp::GUARD_FALSE, .type = TraceType::BOOL, .left = condition, .exit = exit});
+                return true;
+            }
+
+            /* One step of the iteration, false to stop recording with the VM at m_ip */
+            [[nodiscard]] bool step() {
+                VM& vm = m_vm;
+                std::size_t ip = vm.m_ip;
+                const Instruction& instruction = vm.m_instrutions[ip];
+                std::uint32_t arg = instruction.argument;
+
+                // A superinstruction records as the first instruction it replaced, the others follow on their own
+                switch (unfused_opcode(instruction.opcode)) {
+                    case OpCode::LOAD_FAST:
+                        if (!push_variable({.global = false, .slot = arg}, vm.m_slots[arg])) {
+                            return false;
+                        }
+                        vm.vm_stack.push(vm.m_slots[arg]);
+                        break;
+
+                    // Builtins aren't numbers, only a bound global can be one
+                    case OpCode::LOAD_NAME:
+                        if (!vm.m_globals.is_bound(arg) || !push_variable({.global = true, .slot = arg}, vm.m_globals[arg])) {
+                            return false;
+                        }
+                        vm.vm_stack.push(vm.m_globals[arg]);
+                        break;
+
+                    case OpCode::LOAD_CONSTANT: {
+                        const Value& value = vm.m_bp->consts_pool[arg];
+                        std::optional<TraceType> type = trace_type(value);
+                        if (!type) {
+                            return false;
+                        }
+                        m_stack.push_back(constant(*type, unbox(value, *type)));
+                        vm.vm_stack.push(value);
+                        break;
+                    }
+
+                    case OpCode::STORE_FAST:
+                        if (m_stack.empty()) {
+                            return false;
+                        }
+                        assign({.global = false, .slot = arg});
+                        vm.m_slots[arg] = vm.vm_stack.pop();
+                        break;
+
+                    case OpCode::STORE_NAME:
+                        if (m_stack.empty()) {
+                            return false;
+                        }
+                        assign({.global = true, .slot = arg});
+                        vm.m_globals.store(arg, vm.vm_stack.pop());
+                        break;
+
+                    case OpCode::ADD:
+                    case OpCode::ADD_INT:
+                    case OpCode::ADD_FLOAT: return binary(ip, TraceOp::ADD, &binary_add);
+                    case OpCode::SUB:
+                    case OpCode::SUB_INT:
+                    case OpCode::SUB_FLOAT: return binary(ip, TraceOp::SUB, &binary_sub);
+                    case OpCode::MUL:
+                    case OpCode::MUL_INT:
+                    case OpCode::MUL_FLOAT: return binary(ip, TraceOp::MUL, &binary_mul);
+                    case OpCode::DIV: return binary(ip, TraceOp::DIV, &binary_div);
+                    case OpCode::BINARY_MODULO: return binary(ip, TraceOp::MOD, &binary_mod);
+                    case OpCode::BINARY_FLOOR_DIVIDE: return binary(ip, TraceOp::FLOOR_DIV, &binary_floor_div);
+
+                    case OpCode::COMPARE_OP: return compare(ip, static_cast<CompareOp>(arg));
+                    case OpCode::POP_JUMP_IF_FALSE: return branch(ip, false);
+                    case OpCode::POP_JUMP_IF_TRUE: return branch(ip, true);
+
+                    case OpCode::JUMP_FORWARD:
+                        vm.m_ip = jump_target(vm.m_instrutions, ip);
+                        return true;
+
+                    // Only read by the jump after it
+                    case OpCode::EXTENDED_ARG: break;
+
+                    default: return false;
+                }
+                vm.m_ip = ip + 1;
+                return true;
+            }
+
+            [[nodiscard]] std::unique_ptr<Trace> run() {
+                VM& vm = m_vm;
+                for (;;) {
+                    if (m_body.size() > max_length) {
+                        return nullptr;
+                    }
+
+                    // The loop closes on a back-edge to its own header, any other belongs to a loop inside it
+                    const Instruction& instruction = vm.m_instrutions[vm.m_ip];
+                    if (instruction.opcode == OpCode::JUMP_BACKWARD) {
+                        if (jump_target(vm.m_instrutions, vm.m_ip) != m_header || !m_stack.empty()) {
+                            return nullptr;
+                        }
+                        vm.m_ip = m_header;
+                        vm.m_loop_counts[m_header]++;
+                        return finish();
+                    }
+
+                    if (!step()) {
+                        return nullptr;
+                    }
+                }
+            }
+
+            /*
+            Places the loads before LOOP and the body after it, then closes the loop with a PHI per
+            variable assigned. Those are loaded on entry even if the body only writes them: an exit
+            before the assignment has to write back what the variable held. A variable that comes
+            back around with another type than it started with can't stay in one register
+            */
+            [[nodiscard]] std::unique_ptr<Trace> finish() {
+                for (const TraceVariable& variable : m_assigned) {
+                    const TraceInstr& next = instr(m_current.at(variable));
+                    auto loaded = m_loaded.find(variable);
+                    if (loaded == m_loaded.end()) {
+                        m_loads.push_back({.op = variable.global ? TraceOp::LOAD_NAME : TraceOp::LOAD_FAST, .type = next.type, .arg = variable.slot});
+                        m_loaded[variable] = static_cast<std::uint32_t>(m_loads.size() - 1) | load_bit;
+                    } else if (instr(loaded->second).type != next.type) {
+                        return nullptr;
+                    }
+                }
+
+                auto place = [&](std::uint32_t value) {
+                    return (value & load_bit) != 0 ? value & ~load_bit : static_cast<std::uint32_t>(m_loads.size() + 1 + value);
+                };
+
+                auto trace = std::make_unique<Trace>();
+                trace->chunk_index = m_chunk_index;
+                trace->header = m_header;
+                trace->code = m_loads;
+                trace->code.push_back({.op = TraceOp::LOOP});
+                for (TraceInstr body : m_body) {
+                    std::size_t operands = operand_count(body.op);
+                    if (operands >= 1) {
+                        body.left = place(body.left);
+                    }
+                    if (operands == 2) {
+                        body.right = place(body.right);
+                    }
+                    trace->code.push_back(body);
+                }
+                for (const TraceVariable& variable : m_assigned) {
+                    std::uint32_t load = place(m_loaded.at(variable));
+                    trace->code.push_back({.op = TraceOp::PHI, .type = trace->code[load].type, .left = load, .right = place(m_current.at(variable))});
+                }
+
+                m_exits[0].ip = m_header;
+                for (TraceExit& exit : m_exits) {
+                    for (std::uint32_t& value : exit.stack) {
+                        value = place(value);
+                    }
+                    std::vector<std::pair<TraceVariable, std::uint32_t>> variables;
+                    for (const TraceVariable& variable : m_assigned) {
+                        auto assigned = std::ranges::find(exit.variables, variable, &std::pair<TraceVariable, std::uint32_t>::first);
+                        variables.emplace_back(variable, place(assigned != exit.variables.end() ? assigned->second : m_loaded.at(variable)));
+                    }
+                    exit.variables = std::move(variables);
+                }
+                trace->exits = std::move(m_exits);
+                return trace;
+            }
+    };
+
+    /* The passes, in the order optimize_trace() runs them. Each one keeps the code linear: operands before uses, LOOP once, PHIs last */
+    class TraceOptimizer {
+        public:
+            static void optimize(Trace& trace) {
+                fold(trace);
+                hoist(trace);
+                eliminate_overflow_guards(trace);
+                eliminate_dead_code(trace);
+                compact_exits(trace);
+                allocate_registers(trace);
+            }
+
+        private:
+            using ValueKey = std::tuple<TraceOp, TraceType, bool, std::uint32_t, std::uint32_t, std::uint64_t>;
+
+            /* The result of an instruction whose operands are all constants, nullopt where it would leave or isn't worth it */
+            [[nodiscard]] static std::optional<std::uint64_t> evaluate(const Trace& trace, const TraceInstr& instr) {
+                const TraceInstr& left = trace.code[instr.left];
+                const TraceInstr& right = trace.code[instr.right];
+                if (left.op != TraceOp::CONSTANT || (operand_count(instr.op) == 2 && right.op != TraceOp::CONSTANT)) {
+                    return std::nullopt;
+                }
+
+                if (instr.op == TraceOp::INT_TO_FLOAT) {
+                    return std::bit_cast<std::uint64_t>(static_cast<double>(static_cast<long>(left.arg)));
+                }
+                if (instr.op == TraceOp::COMPARE) {
+                    bool result = left.type == TraceType::INT
+                        ? compare_ordered(static_cast<CompareOp>(instr.arg), static_cast<long>(left.arg), static_cast<long>(right.arg))
+                        : compare_ordered(static_cast<CompareOp>(instr.arg), std::bit_cast<double>(left.arg), std::bit_cast<double>(right.arg));
+                    return result ? 1 : 0;
+                }
+
+                if (instr.type == TraceType::FLOAT) {
+                    double lhs = std::bit_cast<double>(left.arg);
+                    double rhs = std::bit_cast<double>(right.arg);
+                    switch (instr.op) {
+                        case TraceOp::ADD: return std::bit_cast<std::uint64_t>(lhs + rhs);
+                        case TraceOp::SUB: return std::bit_cast<std::uint64_t>(lhs - rhs);
+                        case TraceOp::MUL: return std::bit_cast<std::uint64_t>(lhs * rhs);
+                        case TraceOp::DIV:
+                            if (rhs == 0.0) {
+                                return std::nullopt;
+                            }
+                            return std::bit_cast<std::uint64_t>(lhs / rhs);
+                        default: return std::nullopt;
+                    }
+                }
+
+                long lhs = static_cast<long>(left.arg);
+                long rhs = static_cast<long>(right.arg);
+                long result {};
+                bool overflow {};
+                if (instr.op == TraceOp::MOD || instr.op == TraceOp::FLOOR_DIV) {
+                    long quotient {};
+                    long remainder {};
+                    overflow = rhs == 0 || !small_floor_divmod(lhs, rhs, quotient, remainder);
+                    result = instr.op == TraceOp::MOD ? remainder : quotient;
+                } else {
+                    overflow = instr.op == TraceOp::ADD ? __builtin_add_overflow(lhs, rhs, &result)
+                        : instr.op == TraceOp::SUB ? __builtin_sub_overflow(lhs, rhs, &result)
+                        : __builtin_mul_overflow(lhs, rhs, &result);
+                }
+                if (overflow || result < Value::int_min || result > Value::int_max) {
+                    return std::nullopt;
+                }
+                return static_cast<std::uint64_t>(result);
+            }
+
+            /* x + 0, x - 0, x * 1 and x // 1 are x */
+            [[nodiscard]] static std::optional<std::uint32_t> identity_operand(const Trace& trace, const TraceInstr& instr) {
+                if (instr.type != TraceType::INT || operand_count(instr.op) != 2 || instr.op == TraceOp::COMPARE || instr.op == TraceOp::MOD) {
+                    return std::nullopt;
+                }
+                long neutral = instr.op == TraceOp::MUL || instr.op == TraceOp::FLOOR_DIV ? 1 : 0;
+                if (instr.op != TraceOp::DIV && is_int_constant(trace.code[instr.right], neutral)) {
+                    return instr.left;
+                }
+                if ((instr.op == TraceOp::ADD || instr.op == TraceOp::MUL) && is_int_constant(trace.code[instr.left], neutral)) {
+                    return instr.right;
+                }
+                return std::nullopt;
+            }
+
+            /*
+            Constant folding and CSE in one pass down the code. Everything before an instruction
+            has run by the time it does, so an earlier copy of a value or a guard covers a later
+            one, and a guard on a constant that holds goes away. A PHI whose variable comes back
+            unchanged is dropped, the load is then loop-invariant
+            */
+            static void fold(Trace& trace) {
+                std::vector<std::uint32_t> forward = identity(trace.code.size());
+                std::vector<std::uint32_t> order;
+                std::map<ValueKey, std::uint32_t> values;
+
+                for (std::uint32_t value = 0; value < trace.code.size(); value++) {
+                    TraceInstr& instr = trace.code[value];
+                    std::size_t operands = operand_count(instr.op);
+                    if (operands >= 1) {
+                        instr.left = resolve(forward, instr.left);
+                    }
+                    if (operands == 2) {
+                        instr.right = resolve(forward, instr.right);
+                    }
+
+                    if (instr.op == TraceOp::PHI && instr.left == instr.right) {
+                        continue;
+                    }
+                    if (is_guard(instr.op) && trace.code[instr.left].op == TraceOp::CONSTANT
+                        && (trace.code[instr.left].arg != 0) == (instr.op == TraceOp::GUARD_TRUE)) {
+                        continue;
+                    }
+
+                    if (is_pure(instr.op) && instr.op != TraceOp::CONSTANT) {
+                        if (std::optional<std::uint32_t> same = identity_operand(trace, instr)) {
+                            forward[value] = *same;
+                            continue;
+                        }
+                        if (std::optional<std::uint64_t> result = evaluate(trace, instr)) {
+                            instr = {.op = TraceOp::CONSTANT, .type = instr.type, .arg = *result};
+                        }
+                    }
+
+                    if (is_pure(instr.op) || is_guard(instr.op)) {
+                        ValueKey key {instr.op, instr.type, instr.checked, instr.left, operands == 2 ? instr.right : 0, instr.arg};
+                        if (auto [earlier, inserted] = values.try_emplace(key, value); !inserted) {
+                            forward[value] = earlier->second;
+                            continue;
+                        }
+                    }
+                    order.push_back(value);
+                }
+                rebuild(trace, order, forward);
+            }
+
+            /*
+            Loop-invariant code motion: a load whose variable has no PHI, a constant, and anything
+            computed only from those gives the same result in every iteration, so it moves in front
+            of LOOP and runs once per entry. A guard on such a value moves too and leaves through
+            exits[0]: if it would fail in some iteration it fails in the first, and handing the whole
+            loop back to the interpreter from its header is as good an exit as any
+            */
+            static void hoist(Trace& trace) {
+                std::size_t loop = loop_position(trace);
+                std::vector<bool> invariant(trace.code.size());
+                for (std::size_t value = 0; value < loop; value++) {
+                    invariant[value] = true;
+                }
+                for (const TraceInstr& instr : trace.code) {
+                    if (instr.op == TraceOp::PHI) {
+                        invariant[instr.left] = false;
+                    }
+                }
+
+                std::vector<std::uint32_t> before;
+                std::vector<std::uint32_t> after;
+                for (std::uint32_t value = 0; value < trace.code.size(); value++) {
+                    TraceInstr& instr = trace.code[value];
+                    if (value < loop) {
+                        before.push_back(value);
+                        continue;
+                    }
+
+                    std::size_t operands = operand_count(instr.op);
+                    bool movable = (is_pure(instr.op) || is_guard(instr.op))
+                        && (operands < 1 || invariant[instr.left]) && (operands < 2 || invariant[instr.right]);
+                    if (movable) {
+                        invariant[value] = true;
+                        if (can_exit(instr)) {
+                            instr.exit = 0;
+                        }
+                        before.push_back(value);
+                    } else {
+                        after.push_back(value);
+                    }
+                }
+
+                before.insert(before.end(), after.begin(), after.end());
+                rebuild(trace, before, identity(trace.code.size()));
+            }
+
+            /*
+            `i + 1` can't overflow once a guard made sure `i < n` for some int n, and `i - 1` can't
+            once `i > n`: the bound itself is at most the largest (at least the smallest) small int.
+            Only a guard earlier in the same pass down the code counts, it's the one that ran
+            */
+            static void eliminate_overflow_guards(Trace& trace) {
+                std::vector<bool> below_some_int(trace.code.size());
+                std::vector<bool> above_some_int(trace.code.size());
+
+                for (TraceInstr& instr : trace.code) {
+                    if (is_guard(instr.op)) {
+                        const TraceInstr& condition = trace.code[instr.left];
+                        if (condition.op != TraceOp::COMPARE || trace.code[condition.left].type != TraceType::INT) {
+                            continue;
+                        }
+                        // What held, as `smaller < larger`
+                        auto op = static_cast<CompareOp>(condition.arg);
+                        bool holds = instr.op == TraceOp::GUARD_TRUE;
+                        if ((op == CompareOp::LT && holds) || (op == CompareOp::GE && !holds)) {
+                            below_some_int[condition.left] = true;
+                            above_some_int[condition.right] = true;
+                        } else if ((op == CompareOp::GT && holds) || (op == CompareOp::LE && !holds)) {
+                            below_some_int[condition.right] = true;
+                            above_some_int[condition.left] = true;
+                        }
+                        continue;
+                    }
+
+                    if (!instr.checked) {
+                        continue;
+                    }
+                    if (instr.op == TraceOp::ADD && ((below_some_int[instr.left] && is_int_constant(trace.code[instr.right], 1))
+                        || (below_some_int[instr.right] && is_int_constant(trace.code[instr.left], 1)))) {
+                        instr.checked = false;
+                    } else if (instr.op == TraceOp::SUB && above_some_int[instr.left] && is_int_constant(trace.code[instr.right], 1)) {
+                        instr.checked = false;
+                    }
+                }
+            }
+
+            /* Guards, PHIs, LOOP and divisions that may raise stay, the rest only if something (an exit included) still uses it */
+            static void eliminate_dead_code(Trace& trace) {
+                std::vector<bool> live(trace.code.size());
+                for (std::size_t value = trace.code.size(); value-- > 0;) {
+                    const TraceInstr& instr = trace.code[value];
+                    if (is_guard(instr.op) || instr.op == TraceOp::PHI || instr.op == TraceOp::LOOP || may_raise(trace, instr)) {
+                        live[value] = true;
+                    }
+                    if (!live[value]) {
+                        continue;
+                    }
+
+                    std::size_t operands = operand_count(instr.op);
+                    if (operands >= 1) {
+                        live[instr.left] = true;
+                    }
+                    if (operands == 2) {
+                        live[instr.right] = true;
+                    }
+                    if (can_exit(instr)) {
+                        const TraceExit& exit = trace.exits[instr.exit];
+                        for (std::uint32_t used : exit.stack) {
+                            live[used] = true;
+                        }
+                        for (const auto& [variable, used] : exit.variables) {
+                            live[used] = true;
+                        }
+                    }
+                }
+
+                std::vector<std::uint32_t> order;
+                for (std::uint32_t value = 0; value < trace.code.size(); value++) {
+                    if (live[value]) {
+                        order.push_back(value);
+                    }
+                }
+                rebuild(trace, order, identity(trace.code.size()));
+            }
+
+            /* Drops the snapshots nothing leaves with any more, exits[0] stays first */
+            static void compact_exits(Trace& trace) {
+                std::vector<std::uint32_t> renumbered(trace.exits.size(), UINT32_MAX);
+                std::vector<TraceExit> exits;
+                renumbered[0] = 0;
+                exits.push_back(std::move(trace.exits[0]));
+
+                for (TraceInstr& instr : trace.code) {
+                    if (!can_exit(instr)) {
+                        continue;
+                    }
+                    if (renumbered[instr.exit] == UINT32_MAX) {
+                        renumbered[instr.exit] = static_cast<std::uint32_t>(exits.size());
+                        exits.push_back(std::move(trace.exits[instr.exit]));
+                    }
+                    instr.exit = renumbered[instr.exit];
+                }
+                trace.exits = std::move(exits);
+            }
+
+            /*
+            Every value gets its own register, except that a variable's next value is computed
+            straight into the register of its load when nothing reads the load any more after that
+            point (not even an exit): `i = i + 1` then needs no move at the end of the iteration
+            */
+            static void allocate_registers(Trace& trace) {
+                std::size_t size = trace.code.size();
+                std::size_t loop = loop_position(trace);
+                trace.registers = identity(size);
+                trace.register_count = size;
+
+                // A PHI writes its load rather than reading it
+                std::vector<std::size_t> last_use(size);
+                for (std::size_t value = 0; value < size; value++) {
+                    const TraceInstr& instr = trace.code[value];
+                    std::size_t operands = operand_count(instr.op);
+                    if (operands >= 1 && instr.op != TraceOp::PHI) {
+                        last_use[instr.left] = value;
+                    }
+                    if (operands == 2) {
+                        last_use[instr.right] = value;
+                    }
+                    if (can_exit(instr)) {
+                        for (std::uint32_t used : trace.exits[instr.exit].stack) {
+                            last_use[used] = std::max(last_use[used], value);
+                        }
+                        for (const auto& [variable, used] : trace.exits[instr.exit].variables) {
+                            last_use[used] = std::max(last_use[used], value);
+                        }
+                    }
+                }
+
+                for (const TraceInstr& phi : trace.code) {
+                    if (phi.op != TraceOp::PHI) {
+                        continue;
+                    }
+                    std::uint32_t next = phi.right;
+                    const TraceInstr& computed = trace.code[next];
+                    bool in_body = next > loop && computed.op != TraceOp::PHI;
+                    if (in_body && trace.registers[next] == next && last_use[phi.left] <= next) {
+                        trace.registers[next] = trace.registers[phi.left];
+                    }
+                }
+            }
+    };
+
+    std::unique_ptr<Trace> record_trace(VM& vm, std::size_t chunk_index, std::size_t header) {
+        return TraceRecorder::record(vm, chunk_index, header);
+    }
+
+    void optimize_trace(Trace& trace) {
+        TraceOptimizer::optimize(trace);
+    }
+}
@@ -0,0 +1,142 @@
+#ifndef TWOPY_TRACE_HPP
+#define TWOPY_TRACE_HPP
+
+#include <bit>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "backend/jit.hpp"
+#include "backend/value.hpp"
+
+/*
+Tracing JIT for hot loops. Once a loop's back-edge has been taken VM::trace_loop_threshold times,
+record_trace() runs one iteration of it itself, instruction by instruction on the VM's real state,
+and writes down what each one did with the types it saw: a linear SSA trace of the path taken.
+Only ints, floats and bools are followed. Anything else (a call, an object, a bigint, an inner loop)
+aborts the recording, and the interpreter simply carries on from the instruction it stopped at.
+
+Every local or global the loop touches is read once when the trace is entered, guarded to the type
+it had while recording and unboxed into a register. From there on every value is a raw long, double
+or bool whose type is known, so the only guards left inside the loop are:
+- branches, that they go the way they went while recording
+- int arithmetic, that the result is still a small int
+The loop's variables go around the back-edge in registers (the PHIs at the end) and are only boxed
+again when the trace is left. Each guard has a snapshot of where the interpreter picks up, what it
+finds on its stack and what every variable the loop assigns holds at that point.
+
+optimize_trace() folds constants, merges common subexpressions and repeated guards, hoists whatever
+doesn't change between iterations in front of the loop, drops the overflow guard of a step that a
+branch guard already bounds, removes dead code and lets a variable's next value share its register.
+jit_compile_trace() pastes the result together from the trace stencils in jit_stencils.cpp.
+*/
+namespace TwoPy::Backend {
+    enum class TraceType : std::uint8_t {
+        INT,
+        FLOAT,
+        BOOL,
+    };
+
+    enum class TraceOp : std::uint8_t {
+        LOAD_FAST,      // a local on entry, guarded to `type` and unboxed, `arg` is its slot. Only before LOOP
+        LOAD_NAME,      // a global on entry, likewise
+        CONSTANT,       // `arg` is the unboxed bits
+        INT_TO_FLOAT,
+        ADD,            // int or float by `type`. An int one that's `checked` leaves when the result isn't a small int
+        SUB,
+        MUL,
+        DIV,            // always float, a `checked` one leaves when the divisor is zero
+        MOD,            // Python's % and //, only on ints. Leave when the divisor is zero or the quotient isn't a small int
+        FLOOR_DIV,
+        COMPARE,        // `arg` is the CompareOp, both operands have the same type
+        GUARD_TRUE,     // leaves unless `left` is true
+        GUARD_FALSE,
+        LOOP,           // what's before it runs once per entry, what's after once per iteration
+        PHI,            // only at the end: the load `left` takes the value of `right` for the next iteration
+    };
+
+    /* Values are numbered by their position in Trace::code, `left` and `right` are operands */
+    struct TraceInstr {
+        TraceOp op {};
+        TraceType type {};
+        bool checked {};
+        std::uint32_t left {};
+        std::uint32_t right {};
+        std::uint64_t arg {};
+        std::uint32_t exit {};      // the snapshot a guard (or checked arithmetic) leaves with
+    };
+
+    struct TraceVariable {
+        bool global {};
+        std::uint32_t slot {};
+
+        auto operator<=>(const TraceVariable&) const = default;
+    };
+
+    /* What the interpreter's state would have been at `ip` */
+    struct TraceExit {
+        std::size_t ip {};
+        std::vector<std::uint32_t> stack {};                                // pushed back, bottom first
+        std::vector<std::pair<TraceVariable, std::uint32_t>> variables {};  // everything the loop assigns, and its value here
+    };
+
+    struct Trace {
+        std::size_t chunk_index {};
+        std::size_t header {};
+        std::vector<TraceInstr> code {};
+        std::vector<TraceExit> exits {};            // exits[0] leaves from the header before the first iteration
+        std::vector<std::uint32_t> registers {};    // per value, its register in the file
+        std::size_t register_count {};
+
+        std::unique_ptr<JitCode> machine_code {};
+        std::vector<std::uint64_t> register_file {};
+        std::size_t entries {};                     // tried, including when the entry guards failed
+        std::size_t iterations {};                  // back-edges taken inside it
+    };
+
+    [[nodiscard]] inline std::optional<TraceType> trace_type(const Value& value) noexcept {
+        if (value.is_bool()) {
+            return TraceType::BOOL;
+        }
+        if (value.is_int()) {
+            return TraceType::INT;
+        }
+        if (value.is_float()) {
+            return TraceType::FLOAT;
+        }
+        return std::nullopt;
+    }
+
+    /* A value's register contents, for a value already known to have `type` */
+    [[nodiscard]] inline std::uint64_t unbox(const Value& value, TraceType type) noexcept {
+        switch (type) {
+            case TraceType::INT: return static_cast<std::uint64_t>(value.as_int());
+            case TraceType::FLOAT: return std::bit_cast<std::uint64_t>(value.as_float());
+            case TraceType::BOOL: return value.as_bool() ? 1 : 0;
+        }
+        return 0;
+    }
+
+    [[nodiscard]] inline Value box(std::uint64_t bits, TraceType type) noexcept {
+        switch (type) {
+            case TraceType::INT: return Value(long {static_cast<long>(bits)});
+            case TraceType::FLOAT: return Value(std::bit_cast<double>(bits));
+            case TraceType::BOOL: return Value(bool {bits != 0});
+        }
+        return Value();
+    }
+
+    /* Runs the loop at `header` once on `vm` and records it. nullptr when it couldn't be, the VM carries on from its m_ip either way */
+    [[nodiscard]] std::unique_ptr<Trace> record_trace(VM& vm, std::size_t chunk_index, std::size_t header);
+
+    void optimize_trace(Trace& trace);
+
+    /* Fills in machine_code and register_file, false where the JIT isn't built in */
+    [[nodiscard]] bool jit_compile_trace(VM& vm, Trace& trace);
+}
+
+#endif
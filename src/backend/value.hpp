@@ -1,6 +1,7 @@
 #ifndef TWOPY_VALUE_HPP
 #define TWOPY_VALUE_HPP
 
+#include <limits>
 #include <type_traits>
 #include <utility>
 #include <variant>
@@ -25,12 +26,21 @@ namespace TwoPy::Backend {
     class Value;
 
     using Reference = Value*;
+}
 
+#ifdef TWOPY_NAN_BOXING
+#include "backend/nan_boxed_value.hpp"
+#else
+namespace TwoPy::Backend {
     class Value {
     public:
-        using py_object_ptr = std::shared_ptr<ObjectBase>;
+        using py_object_ptr = ObjectRef<ObjectBase>;
         // craftinginterpreters suggests a tagged union
         using hidden_data = std::variant<std::monostate, bool, long, double, Reference, py_object_ptr>;
+
+        /* Range of an immediate int, anything outside it is a BigIntPyObject */
+        static constexpr long int_min = std::numeric_limits<long>::min();
+        static constexpr long int_max = std::numeric_limits<long>::max();
     private:
         template <typename NativeType>
         struct native_type_tag {
@@ -54,10 +64,38 @@ namespace TwoPy::Backend {
         noexcept (std::is_nothrow_constructible_v<hidden_data, NativeT>)
         : m_data (std::forward<NativeT>(native_value)) {}
 
-        /* Specific for ObjectBase where there might be a shared_ptr */
+        /* Specific for ObjectBase, the Value shares ownership through the object's refcount */
         explicit constexpr Value(py_object_ptr obj_ptr) noexcept
         : m_data(obj_ptr) {}
 
+        /* Type checks and unchecked accessors, the same API as the NaN-boxed Value */
+        [[nodiscard]] constexpr ValueTag tag() const noexcept {
+            return static_cast<ValueTag>(m_data.index());
+        }
+
+        [[nodiscard]] constexpr bool is_none() const noexcept { return std::holds_alternative<std::monostate>(m_data); }
+        [[nodiscard]] constexpr bool is_bool() const noexcept { return std::holds_alternative<bool>(m_data); }
+        [[nodiscard]] constexpr bool is_int() const noexcept { return std::holds_alternative<long>(m_data); }
+        [[nodiscard]] constexpr bool is_float() const noexcept { return std::holds_alternative<double>(m_data); }
+        [[nodiscard]] constexpr bool is_obj() const noexcept { return std::holds_alternative<py_object_ptr>(m_data); }
+
+        [[nodiscard]] constexpr bool as_bool() const noexcept { return *std::get_if<bool>(&m_data); }
+        [[nodiscard]] constexpr long as_int() const noexcept { return *std::get_if<long>(&m_data); }
+        [[nodiscard]] constexpr double as_float() const noexcept { return *std::get_if<double>(&m_data); }
+
+        /* Borrowed pointer, no refcount traffic */
+        [[nodiscard]] ObjectBase* as_object() const noexcept {
+            if (auto py_object_p = std::get_if<py_object_ptr>(&m_data); py_object_p) {
+                return py_object_p->get();
+            }
+            return nullptr;
+        }
+
+        /* Identity for objects, equality for immediates */
+        [[nodiscard]] friend bool operator==(const Value& lhs, const Value& rhs) noexcept {
+            return lhs.m_data == rhs.m_data;
+        }
+
         [[nodiscard]] constexpr bool is_truthy() const noexcept {
             if (std::holds_alternative<long>(m_data)) {
                 return std::get<long>(m_data) != 0L;
@@ -66,7 +104,9 @@ namespace TwoPy::Backend {
             } else if (std::holds_alternative<Reference>(m_data)) {
                 return std::get<Reference>(m_data) != nullptr;
             } else if (std::holds_alternative<py_object_ptr>(m_data)) {
-                return std::get<py_object_ptr>(m_data) != nullptr;
+                // Empty containers and strings are false, the object knows
+                const py_object_ptr& obj = std::get<py_object_ptr>(m_data);
+                return obj != nullptr && obj->is_truthy();
             } else if (std::holds_alternative<bool>(m_data)) {
                 return std::get<bool>(m_data) != false;
             }
@@ -78,6 +118,8 @@ namespace TwoPy::Backend {
                 return std::get<long>(self.m_data);
             } else if (std::holds_alternative<double>(self.m_data)) {
                 return std::get<double>(self.m_data);
+            } else if (std::holds_alternative<bool>(self.m_data)) {
+                return std::get<bool>(self.m_data) ? 1L : 0L;
             } else if (std::holds_alternative<Reference>(self.m_data)) {
                 return std::get<Reference>(self.m_data)->to_long();
             }
@@ -90,6 +132,8 @@ namespace TwoPy::Backend {
                 return std::get<long>(self.m_data);
             } else if (std::holds_alternative<double>(self.m_data)) {
                 return std::get<double>(self.m_data);
+            } else if (std::holds_alternative<bool>(self.m_data)) {
+                return std::get<bool>(self.m_data) ? 1.0 : 0.0;
             } else if (std::holds_alternative<Reference>(self.m_data)) {
                 return std::get<Reference>(self.m_data)->to_double();
             }
@@ -100,6 +144,8 @@ namespace TwoPy::Backend {
         [[nodiscard]] std::string to_string(this auto&& self) {
             if (std::holds_alternative<std::monostate>(self.m_data)) {
                 return "None";
+            } else if (std::holds_alternative<bool>(self.m_data)) {
+                return std::get<bool>(self.m_data) ? "True" : "False";
             } else if (std::holds_alternative<long>(self.m_data)) {
                 return std::to_string(std::get<long>(self.m_data));
             } else if (std::holds_alternative<double>(self.m_data)) {
@@ -107,7 +153,7 @@ namespace TwoPy::Backend {
             } else if (std::holds_alternative<Reference>(self.m_data)) {
                 return std::get<Reference>(self.m_data)->to_string();
             } else if (std::holds_alternative<py_object_ptr>(self.m_data)) {
-                auto obj = std::get<py_object_ptr>(self.m_data);
+                const auto& obj = std::get<py_object_ptr>(self.m_data);
                 if (obj) {
                     return obj->stringify();
                 }
@@ -169,5 +215,6 @@ namespace TwoPy::Backend {
         /// TODO: add  %, *, and / overloads with div_int()...
     };
 }
+#endif
 
-#endif
\ No newline at end of file
+#endif
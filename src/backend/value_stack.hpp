@@ -0,0 +1,103 @@
+#ifndef TWOPY_VALUE_STACK_HPP
+#define TWOPY_VALUE_STACK_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <utility>
+
+#include "backend/value.hpp"
+
+namespace TwoPy::Backend {
+    /*
+    Operand stack shared by every frame: one allocation when the VM starts, a raw stack pointer after that.
+    push() doesn't check for overflow. A frame asks has_room() for its chunk's max_stack once on
+    entry, so nothing inside it can run past the end.
+
+    Only the slots below the stack pointer hold constructed Values. The rest is raw memory,
+    so startup doesn't pay for building and destroying the whole capacity.
+    */
+    class ValueStack {
+    private:
+        std::allocator<Value> m_alloc {};
+        Value* m_base;
+        Value* m_sp;
+        Value* m_end;
+
+    public:
+        explicit ValueStack(std::size_t capacity)
+        : m_base(m_alloc.allocate(capacity)), m_sp(m_base), m_end(m_base + capacity) {}
+
+        ValueStack(const ValueStack&) = delete;
+        ValueStack& operator=(const ValueStack&) = delete;
+
+        ~ValueStack() {
+            truncate(m_base);
+            m_alloc.deallocate(m_base, static_cast<std::size_t>(m_end - m_base));
+        }
+
+        [[nodiscard]] bool has_room(std::size_t count) const noexcept {
+            return static_cast<std::size_t>(m_end - m_sp) >= count;
+        }
+
+        void push(Value val) noexcept {
+            assert(m_sp < m_end);
+            std::construct_at(m_sp++, std::move(val));
+        }
+
+        [[nodiscard]] Value pop() noexcept {
+            assert(m_sp > m_base);
+            Value val = std::move(*--m_sp);
+            std::destroy_at(m_sp);
+            return val;
+        }
+
+        /* pop() without handing the value back */
+        void drop() noexcept {
+            assert(m_sp > m_base);
+            std::destroy_at(--m_sp);
+        }
+
+        [[nodiscard]] Value& top() noexcept {
+            return m_sp[-1];
+        }
+
+        // distance 0 is the top
+        [[nodiscard]] Value& peek(std::size_t distance) noexcept {
+            return m_sp[-1 - static_cast<std::ptrdiff_t>(distance)];
+        }
+
+        /* The top `count` values, bottom first. Valid until the next push or pop. */
+        [[nodiscard]] std::span<Value> top_n(std::size_t count) noexcept {
+            return {m_sp - count, count};
+        }
+
+        /* Every constructed slot, bottom first */
+        [[nodiscard]] std::span<const Value> live() const noexcept {
+            return {m_base, size()};
+        }
+
+        [[nodiscard]] Value* sp() const noexcept {
+            return m_sp;
+        }
+
+        /* Where the stack pointer itself lives, for JIT code that pushes and pops without a call */
+        [[nodiscard]] Value** sp_address() noexcept {
+            return &m_sp;
+        }
+
+        /* Pops everything at and above `new_sp` */
+        void truncate(Value* new_sp) noexcept {
+            while (m_sp > new_sp) {
+                std::destroy_at(--m_sp);
+            }
+        }
+
+        [[nodiscard]] std::size_t size() const noexcept {
+            return static_cast<std::size_t>(m_sp - m_base);
+        }
+    };
+}
+
+#endif
@@ -1,149 +1,1218 @@
 #include "backend/vm.hpp"
+#include "backend/operations.hpp"
+#include "backend/builtins.hpp"
 
 #include <fmt/core.h>
 #include <stdexcept>
+#include <algorithm>
+#include <iterator>
+#include <optional>
+#include <utility>
+#include <unistd.h>
+
+#if defined(TWOPY_COMPUTED_GOTO) && (defined(__GNUC__) || defined(__clang__))
+    #define TWOPY_USE_COMPUTED_GOTO 1
+#else
+    #define TWOPY_USE_COMPUTED_GOTO 0
+#endif
+
+/* Opcodes with a handler in VM::run, anything else is an internal error */
+#define TWOPY_VM_OPCODES(X) \
+    X(RETURN) X(LOAD_CONSTANT) \
+    X(ADD) X(ADD_INT) X(ADD_FLOAT) X(ADD_STR) \
+    X(SUB) X(SUB_INT) X(SUB_FLOAT) \
+    X(MUL) X(MUL_INT) X(MUL_FLOAT) \
+    X(DIV) X(BINARY_MODULO) X(BINARY_FLOOR_DIVIDE) X(POP) X(STORE_NAME) X(LOAD_NAME) X(COMPARE_OP) \
+    X(LOAD_FAST) X(STORE_FAST) X(MAKE_FUNCTION) X(LOAD_BUILTIN) \
+    X(POP_JUMP_IF_FALSE) X(POP_JUMP_IF_TRUE) X(JUMP_IF_FALSE_OR_POP) X(JUMP_IF_TRUE_OR_POP) X(JUMP_FORWARD) X(JUMP_BACKWARD) X(EXTENDED_ARG) X(CALL_FUNCTION) \
+    X(GET_ITER) X(FOR_ITER) X(FOR_ITER_RANGE) \
+    X(BUILD_LIST) X(BUILD_MAP) X(BINARY_SUBSCR) X(STORE_SUBSCR) X(LOAD_METHOD) X(CALL_METHOD) X(TAIL_CALL) X(JUMP_IF_INLINED) \
+    X(LOAD_NAME__LOAD_NAME) X(LOAD_NAME__LOAD_CONSTANT) X(LOAD_NAME__LOAD_CONSTANT__ADD) \
+    X(LOAD_CONSTANT__STORE_NAME) X(COMPARE_OP__POP_JUMP_IF_FALSE)
+
+/*
+A computed goto leaves the handler's scope without running destructors, so no handler may hold
+an owning Value when it reaches DISPATCH(). They work on the stack slots in place instead:
+binary ops overwrite the left operand's slot and drop the right one.
+*/
+#if TWOPY_USE_COMPUTED_GOTO
+    #define TARGET(op) TARGET_##op:
+    #define DISPATCH()                                                              \
+        do {                                                                        \
+            instr = &m_instrutions[m_ip++];                                         \
+            if (m_profiling) {                                                      \
+                record_dispatch(instr->opcode);                                     \
+            }                                                                       \
+            goto *dispatch_table[static_cast<std::size_t>(instr->opcode)];          \
+        } while (0)
+#else
+    #define TARGET(op) case OpCode::op:
+    #define DISPATCH() continue
+#endif
 
 namespace TwoPy::Backend {
-    VM::VM(const ByteCodeProgram& prgm) : m_prgm(prgm) {
-        m_bp = m_prgm.chunks[0].get();
-        m_instrutions = m_bp->code;
-        m_frame_count = prgm.chunks.size();
+    VM::VM(const ByteCodeProgram& prgm, bool unbuffered_output)
+        : m_prgm(prgm), m_globals(prgm.global_names), m_output(STDOUT_FILENO, unbuffered_output) {
+        for (const auto& chunk : m_prgm.chunks) {
+            m_chunk_code.push_back(chunk->code);
+            m_chunk_counters.emplace_back(chunk->code.size(), warmup_executions);
+            m_chunk_caches.emplace_back(chunk->code.size());
+            m_chunk_loop_counts.emplace_back(chunk->code.size());
+            m_chunk_traces.emplace_back(chunk->code.size());
+        }
+        m_chunk_jit.resize(m_prgm.chunks.size());
+        m_chunk_calls.resize(m_prgm.chunks.size());
+
+        // Enough for ordinary call depths, deep recursion grows it
+        m_frames.reserve(64);
+        enter_chunk(0);
     }
 
-    VM::Result VM::run() {
-        while (m_ip < m_instrutions.size()) {
-            Instruction instr = m_instrutions[m_ip];
-            m_ip++;
-            switch (instr.opcode) {
-                case OpCode::RETURN: {
+    void VM::scan_roots(GcVisitor& visitor) const {
+        visitor.visit(vm_stack.live());
+        visitor.visit(m_globals.values());
+        for (const auto& chunk : m_prgm.chunks) {
+            visitor.visit(chunk->consts_pool);
+        }
+    }
+
+    void VM::enter_chunk(std::size_t chunk_index) {
+        m_bp = m_prgm.chunks[chunk_index].get();
+        m_instrutions = m_chunk_code[chunk_index].data();
+        m_site_counters = m_chunk_counters[chunk_index].data();
+        m_global_caches = m_chunk_caches[chunk_index].data();
+        m_loop_counts = m_chunk_loop_counts[chunk_index].data();
+        m_traces = m_chunk_traces[chunk_index].data();
+        m_jit = m_chunk_jit[chunk_index].get();
+    }
+
+    void VM::compile_chunk(std::size_t chunk_index) {
+        if (m_chunk_jit[chunk_index] != nullptr) {
+            return;
+        }
+
+        // A chunk the JIT can't take stays interpreted, the thresholds are only ever hit once
+        m_chunk_jit[chunk_index] = jit_compile(*this, chunk_index);
+        if (const JitCode* code = m_chunk_jit[chunk_index].get()) {
+            m_jit_stats.compiled++;
+            m_jit_stats.code_bytes += code->size();
+        }
+    }
+
+    std::optional<VM::Result> VM::run_compiled() {
+        while (m_jit != nullptr) {
+            m_jit_stats.entries++;
+            switch (m_jit->run(*this, m_ip)) {
+                case JitExit::ERROR:
+                    if (m_jit_exception) {
+                        std::rethrow_exception(std::exchange(m_jit_exception, nullptr));
+                    }
+                    return Result::RUNTIME_ERROR;
+                case JitExit::DONE:
                     return Result::OK;
+                default:
+                    // The frame changed, the new one may be compiled too
+                    break;
+            }
+        }
+        return std::nullopt;
+    }
+
+    std::optional<VM::Result> VM::hot_loop() {
+        std::size_t chunk_index = m_frames.back().chunk_index;
+        std::size_t header = m_ip;
+
+        if (m_loop_counts[header] == trace_loop_threshold) {
+            // Recording runs an iteration itself, an abort leaves the interpreter wherever it stopped
+            std::unique_ptr<Trace> trace = record_trace(*this, chunk_index, header);
+            if (trace != nullptr) {
+                optimize_trace(*trace);
+            }
+            if (trace != nullptr && jit_compile_trace(*this, *trace)) {
+                m_jit_stats.traces++;
+                m_traces[header] = std::move(trace);
+            } else {
+                m_jit_stats.trace_aborts++;
+            }
+            if (m_ip != header) {
+                return std::nullopt;
+            }
+        }
+
+        bool traced = m_traces[header] != nullptr;
+        if (traced) {
+            (void)enter_trace(header);
+            if (m_traces[header] != nullptr) {
+                return std::nullopt;
+            }
+        }
+
+        // Hot loop without a trace (any more): the rest of this call runs compiled, from wherever it is now
+        if (traced || m_loop_counts[header] == jit_loop_threshold) {
+            compile_chunk(chunk_index);
+            m_jit = m_chunk_jit[chunk_index].get();
+            return run_compiled();
+        }
+        return std::nullopt;
+    }
+
+    bool VM::enter_trace(std::size_t header) {
+        std::unique_ptr<Trace>& trace = m_traces[header];
+        if (trace == nullptr) {
+            return false;
+        }
+
+        bool entered = run_trace(*trace);
+        if (trace->entries >= trace_probation && trace->iterations < 2 * trace->entries) {
+            m_jit_stats.traces_discarded++;
+            trace.reset();
+        }
+        return entered;
+    }
+
+    bool VM::run_trace(Trace& trace) {
+        trace.entries++;
+        std::uint64_t* registers = trace.register_file.data();
+
+        // The entry guards: every variable the loop reads still has the type it was recorded with
+        for (std::size_t value = 0; trace.code[value].op != TraceOp::LOOP; value++) {
+            const TraceInstr& load = trace.code[value];
+            if (load.op == TraceOp::LOAD_NAME && !m_globals.is_bound(load.arg)) {
+                return false;
+            }
+            if (load.op == TraceOp::LOAD_FAST || load.op == TraceOp::LOAD_NAME) {
+                const Value& variable = load.op == TraceOp::LOAD_FAST ? m_slots[load.arg] : m_globals[load.arg];
+                if (trace_type(variable) != load.type) {
+                    return false;
                 }
+                registers[trace.registers[value]] = unbox(variable, load.type);
+            }
+        }
 
-                /* Pushes to stack */
-                case OpCode::LOAD_CONSTANT: {
-                    vm_stack.push(m_bp->consts_pool[instr.argument]);
-                    break;
+        std::uint64_t& loop_count = m_chunk_loop_counts[trace.chunk_index][trace.header];
+        std::uint64_t before = loop_count;
+        const TraceExit& exit = trace.exits[trace.machine_code->run_trace(registers)];
+        trace.iterations += loop_count - before;
+        m_jit_stats.trace_entries++;
+        m_jit_stats.trace_iterations += loop_count - before;
+
+        // Boxed again, the interpreter's state at the exit
+        auto boxed = [&](std::uint32_t value) { return box(registers[trace.registers[value]], trace.code[value].type); };
+        for (const auto& [variable, value] : exit.variables) {
+            if (variable.global) {
+                m_globals.store(variable.slot, boxed(value));
+            } else {
+                m_slots[variable.slot] = boxed(value);
+            }
+        }
+        for (std::uint32_t value : exit.stack) {
+            vm_stack.push(boxed(value));
+        }
+        m_ip = exit.ip;
+        return true;
+    }
+
+    bool VM::push_frame(const FunctionPyObject& func, std::uint8_t arg_count) {
+        if (func.get_params().size() != arg_count) {
+            fmt::print(stderr, "TypeError: {}() takes {} arguments but {} were given\n", func.name(), func.get_params().size(), arg_count);
+            return false;
+        }
+
+        if (m_frames.size() >= max_frames) {
+            fmt::print(stderr, "RecursionError: maximum recursion depth exceeded\n");
+            return false;
+        }
+
+        std::size_t chunk_index = func.get_chunk_index();
+        Chunk* callee = m_prgm.chunks[chunk_index].get();
+
+        if (m_jit_enabled && ++m_chunk_calls[chunk_index] == jit_call_threshold) {
+            compile_chunk(chunk_index);
+        }
+
+        // The only overflow check the callee gets, its pushes are unchecked after this
+        std::size_t extra_locals = callee->local_names.size() - arg_count;
+        if (!vm_stack.has_room(extra_locals + callee->max_stack)) {
+            fmt::print(stderr, "RecursionError: value stack overflow\n");
+            return false;
+        }
+
+        // The arguments already sit on the stack in parameter order and become the callee's first slots
+        Value* slots = vm_stack.sp() - arg_count;
+        for (std::size_t i = 0; i < extra_locals; i++) {
+            vm_stack.push(Value {});
+        }
+
+        m_frames.back().ip = m_ip;
+        m_frames.push_back({.chunk = callee, .chunk_index = chunk_index, .ip = 0, .slots = slots});
+
+        enter_chunk(chunk_index);
+        m_ip = 0;
+        m_slots = slots;
+
+        if (m_profiling) {
+            m_profile.calls++;
+            m_profile.max_frame_depth = std::max(m_profile.max_frame_depth, m_frames.size());
+        }
+        return true;
+    }
+
+    bool VM::replace_frame(const FunctionPyObject& func, std::uint8_t arg_count) {
+        if (func.get_params().size() != arg_count) {
+            fmt::print(stderr, "TypeError: {}() takes {} arguments but {} were given\n", func.name(), func.get_params().size(), arg_count);
+            return false;
+        }
+
+        std::size_t chunk_index = func.get_chunk_index();
+        Chunk* callee = m_prgm.chunks[chunk_index].get();
+
+        if (m_jit_enabled && ++m_chunk_calls[chunk_index] == jit_call_threshold) {
+            compile_chunk(chunk_index);
+        }
+
+        // The arguments move down over the old locals, whatever else the frame left on the stack goes
+        Value* args = vm_stack.sp() - arg_count;
+        std::move(args, args + arg_count, m_slots);
+        vm_stack.truncate(m_slots + arg_count);
+
+        std::size_t extra_locals = callee->local_names.size() - arg_count;
+        if (!vm_stack.has_room(extra_locals + callee->max_stack)) {
+            fmt::print(stderr, "RecursionError: value stack overflow\n");
+            return false;
+        }
+        for (std::size_t i = 0; i < extra_locals; i++) {
+            vm_stack.push(Value {});
+        }
+
+        // The callable under the slots is still the first call's, the result goes there all the same
+        m_frames.back() = {.chunk = callee, .chunk_index = chunk_index, .ip = 0, .slots = m_slots};
+        enter_chunk(chunk_index);
+        m_ip = 0;
+
+        if (m_profiling) {
+            m_profile.calls++;
+            m_profile.tail_calls++;
+        }
+        return true;
+    }
+
+    void VM::specialize_binary(std::size_t site, OpCode generic, const Value& lhs, const Value& rhs) {
+        OpCode specialized = generic;
+
+        if (both_ints(lhs, rhs)) {
+            specialized = generic == OpCode::ADD ? OpCode::ADD_INT : generic == OpCode::SUB ? OpCode::SUB_INT : OpCode::MUL_INT;
+        } else if (both_floats(lhs, rhs)) {
+            specialized = generic == OpCode::ADD ? OpCode::ADD_FLOAT : generic == OpCode::SUB ? OpCode::SUB_FLOAT : OpCode::MUL_FLOAT;
+        } else if (generic == OpCode::ADD && both_strings(lhs, rhs)) {
+            specialized = OpCode::ADD_STR;
+        }
+
+        if (specialized == generic) {
+            m_site_counters[site] = deopt_backoff;
+            return;
+        }
+
+        m_instrutions[site].opcode = specialized;
+        if (m_profiling) {
+            m_specialization.specializations[static_cast<std::size_t>(specialized)]++;
+        }
+    }
+
+    void VM::specialize_for_iter(std::size_t site, const Value& iterable) {
+        if (as_range(iterable) == nullptr) {
+            m_site_counters[site] = deopt_backoff;
+            return;
+        }
+
+        m_instrutions[site].opcode = OpCode::FOR_ITER_RANGE;
+        if (m_profiling) {
+            m_specialization.specializations[static_cast<std::size_t>(OpCode::FOR_ITER_RANGE)]++;
+        }
+    }
+
+    void VM::deoptimize(std::size_t site, OpCode generic) {
+        if (m_profiling) {
+            m_specialization.deopts[static_cast<std::size_t>(m_instrutions[site].opcode)]++;
+        }
+
+        m_instrutions[site].opcode = generic;
+        m_site_counters[site] = deopt_backoff;
+    }
+
+    void VM::record_dispatch(OpCode op) {
+        m_profile.dispatches++;
+        m_profile.opcodes[static_cast<std::size_t>(op)]++;
+
+        if (m_history >= 1) {
+            m_profile.pairs[{m_last_ops[1], op}]++;
+        }
+        if (m_history >= 2) {
+            m_profile.triples[{m_last_ops[0], m_last_ops[1], op}]++;
+        }
+
+        m_last_ops[0] = m_last_ops[1];
+        m_last_ops[1] = op;
+        m_history++;
+    }
+
+    bool VM::load_name(std::size_t site, std::uint8_t slot) {
+        GlobalCache& cache = m_global_caches[site];
+
+        if (cache.version == m_globals.version()) {
+            if (m_profiling) {
+                m_profile.global_cache_hits++;
+            }
+            vm_stack.push(*cache.value);
+            return true;
+        }
+
+        if (m_profiling) {
+            m_profile.global_cache_misses++;
+        }
+
+        // Slow path: the globals changed shape since this site last ran, resolve the name again
+        if (m_globals.is_bound(slot)) {
+            cache.value = &m_globals[slot];
+        } else if (auto index = find_builtin(m_globals.name(slot))) {
+            cache.value = &builtin(*index);
+        } else {
+            fmt::print(stderr, "NameError: name '{}' is not defined\n", m_globals.name(slot));
+            return false;
+        }
+
+        cache.version = m_globals.version();
+        vm_stack.push(*cache.value);
+        return true;
+    }
+
+    bool VM::pop_frame() {
+        CallFrame finished = m_frames.back();
+        m_frames.pop_back();
+        if (m_frames.empty()) {
+            vm_stack.drop();
+            return false;
+        }
+
+        // The result takes the callable's slot, the callee's slots above it go away
+        finished.slots[-1] = std::move(vm_stack.top());
+        vm_stack.truncate(finished.slots);
+
+        const CallFrame& caller = m_frames.back();
+        enter_chunk(caller.chunk_index);
+        m_ip = caller.ip;
+        m_slots = caller.slots;
+        return true;
+    }
+
+    VM::CallResult VM::call_function(std::uint8_t arg_count) {
+        ObjectBase* callee = vm_stack.peek(arg_count).as_object();
+        if (callee == nullptr) {
+            fmt::print(stderr, "TypeError: object is not callable\n");
+            return CallResult::FAILED;
+        }
+
+        switch (callee->tag()) {
+            case ObjectTag::NATIVE_FUNCTION: {
+                // Arguments are read in place off the stack top
+                Value result {};
+                NativeContext ctx {.out = m_output, .heap = m_heap};
+                try {
+                    result = static_cast<NativeFunctionPyObject*>(callee)->call(ctx, vm_stack.top_n(arg_count));
+                } catch (const std::runtime_error& e) {
+                    fmt::print(stderr, "{}\n", e.what());
+                    return CallResult::FAILED;
                 }
 
-                case OpCode::ADD: {
-                    Value rhs = vm_stack.top();
-                    vm_stack.pop();
+                vm_stack.truncate(vm_stack.sp() - arg_count - 1);
+                vm_stack.push(std::move(result));
+                maybe_collect();
+                return CallResult::RETURNED;
+            }
 
-                    Value lhs = vm_stack.top();
-                    vm_stack.pop();
+            case ObjectTag::FUNCTION:
+                if (!push_frame(*static_cast<FunctionPyObject*>(callee), arg_count)) {
+                    return CallResult::FAILED;
+                }
+                return CallResult::ENTERED;
 
-                    if (std::holds_alternative<long>(lhs.data()) && std::holds_alternative<long>(rhs.data())) {
-                        vm_stack.push(Value(lhs.to_long() + rhs.to_long()));
-                    } else {
-                        vm_stack.push(Value(lhs.to_double() + rhs.to_double()));
-                    }
-                    break;
+            default:
+                fmt::print(stderr, "TypeError: '{}' object is not callable\n", callee->stringify());
+                return CallResult::FAILED;
+        }
+    }
+
+    VM::CallResult VM::tail_call(std::uint8_t arg_count) {
+        ObjectBase* callee = vm_stack.peek(arg_count).as_object();
+        if (callee == nullptr || callee->tag() != ObjectTag::FUNCTION) {
+            return call_function(arg_count);
+        }
+        return replace_frame(*static_cast<FunctionPyObject*>(callee), arg_count) ? CallResult::ENTERED : CallResult::FAILED;
+    }
+
+    /* The function inlined at the site is on top, the callee under it. Only a match drops both */
+    bool VM::still_inlined() noexcept {
+        bool same = vm_stack.peek(1).as_object() == vm_stack.top().as_object();
+        vm_stack.drop();
+        if (same) {
+            vm_stack.drop();
+        }
+        return same;
+    }
+
+    /* The iterable stays on the stack with its position above it, no iterator object gets made */
+    bool VM::get_iter() {
+        long start {};
+        try {
+            start = iteration_start(vm_stack.top());
+        } catch (const std::runtime_error& e) {
+            fmt::print(stderr, "{}\n", e.what());
+            return false;
+        }
+
+        vm_stack.push(Value(long {start}));
+        return true;
+    }
+
+    bool VM::for_iter_step() {
+        long position = vm_stack.top().as_int();
+        std::optional<Value> item = iteration_next(vm_stack.peek(1), position);
+        if (!item) {
+            vm_stack.truncate(vm_stack.sp() - 2);
+            return false;
+        }
+
+        vm_stack.top() = Value(long {position});
+        vm_stack.push(std::move(*item));
+        return true;
+    }
+
+    void VM::build_list(std::uint8_t count) {
+        {
+            // The items move straight off the stack into the list's storage
+            auto items = vm_stack.top_n(count);
+            Value list(m_heap.make<ListPyObject>(std::vector<Value>(std::make_move_iterator(items.begin()), std::make_move_iterator(items.end()))));
+            vm_stack.truncate(vm_stack.sp() - count);
+            vm_stack.push(std::move(list));
+        }
+        maybe_collect();
+    }
+
+    bool VM::build_map(std::uint8_t count) {
+        {
+            Value dict(m_heap.make<DictPyObject>());
+            auto* target = static_cast<DictPyObject*>(dict.as_object());
+            auto items = vm_stack.top_n(2 * count);
+            try {
+                for (std::size_t i = 0; i < items.size(); i += 2) {
+                    target->store(m_heap, std::move(items[i]), std::move(items[i + 1]));
                 }
+            } catch (const std::runtime_error& e) {
+                fmt::print(stderr, "{}\n", e.what());
+                return false;
+            }
+            vm_stack.truncate(vm_stack.sp() - items.size());
+            vm_stack.push(std::move(dict));
+        }
+        maybe_collect();
+        return true;
+    }
+
+    /* list[int] and dict[str] are answered here, anything else goes through subscript() */
+    bool VM::binary_subscr() {
+        Value& index = vm_stack.top();
+        Value& container = vm_stack.peek(1);
+
+        std::optional<std::size_t> pos {};
+        ListPyObject* list = as_list(container);
+        DictPyObject* dict = list == nullptr ? as_dict(container) : nullptr;
+        const StringPyObject* key = dict != nullptr ? as_string(index) : nullptr;
+        const Value* found = key != nullptr ? dict->find_string(*key) : nullptr;
+
+        if (list != nullptr && index.is_int() && (pos = list->position(index.as_int()))) {
+            // Copied out before the slot lets go of what may be the list's last reference
+            Value item = (*list)[*pos];
+            container = std::move(item);
+        } else if (found != nullptr) {
+            Value item = *found;
+            container = std::move(item);
+        } else {
+            try {
+                container = subscript(container, index);
+            } catch (const std::runtime_error& e) {
+                fmt::print(stderr, "{}\n", e.what());
+                return false;
+            }
+        }
+        vm_stack.drop();
+        return true;
+    }
+
+    /* Stack is value, container, index */
+    bool VM::store_subscr() {
+        Value& index = vm_stack.top();
+        Value& container = vm_stack.peek(1);
+        Value& stored = vm_stack.peek(2);
+
+        std::optional<std::size_t> pos {};
+        ListPyObject* list = as_list(container);
+        if (list != nullptr && index.is_int() && (pos = list->position(index.as_int()))) {
+            list->store(m_heap, *pos, std::move(stored));
+        } else {
+            try {
+                store_subscript(m_heap, container, index, std::move(stored));
+            } catch (const std::runtime_error& e) {
+                fmt::print(stderr, "{}\n", e.what());
+                return false;
+            }
+        }
+        vm_stack.truncate(vm_stack.sp() - 3);
+        return true;
+    }
+
+    /* Leaves the method's native under self, so CALL_METHOD passes self as the first argument */
+    bool VM::load_method(std::uint8_t name_const) {
+        const Value& receiver = vm_stack.top();
+        const auto& name = *static_cast<const StringPyObject*>(m_bp->consts_pool[name_const].as_object());
+
+        ObjectBase* obj = receiver.as_object();
+        const Value* method = obj != nullptr ? find_method(obj->tag(), name) : nullptr;
+        if (method == nullptr) {
+            fmt::print(stderr, "AttributeError: '{}' object has no attribute '{}'\n", type_name(receiver), name.view());
+            return false;
+        }
+
+        vm_stack.push(*method);
+        std::swap(vm_stack.top(), vm_stack.peek(1));
+        return true;
+    }
+
+    bool VM::call_method(std::uint8_t arg_count) {
+        const auto* method = static_cast<const NativeFunctionPyObject*>(vm_stack.peek(arg_count + 1).as_object());
+
+        {
+            Value result {};
+            NativeContext ctx {.out = m_output, .heap = m_heap};
+            try {
+                result = method->call(ctx, vm_stack.top_n(arg_count + 1));
+            } catch (const std::runtime_error& e) {
+                fmt::print(stderr, "{}\n", e.what());
+                return false;
+            }
+
+            vm_stack.truncate(vm_stack.sp() - arg_count - 2);
+            vm_stack.push(std::move(result));
+        }
+        maybe_collect();
+        return true;
+    }
+
+    VM::Result VM::run() {
+        // An operator's TypeError or ZeroDivisionError unwinds from wherever it ran: a handler, a JIT helper or the trace recorder
+        Result result {};
+        try {
+            result = execute();
+        } catch (const std::runtime_error& e) {
+            fmt::print(stderr, "{}\n", e.what());
+            result = Result::RUNTIME_ERROR;
+        }
+
+        // Whatever print() left in the buffer goes out before anyone else writes to stdout
+        m_output.flush();
+        return result;
+    }
+
+    VM::Result VM::execute() {
+        // Every chunk ends in RETURN, so dispatch never checks m_ip against the end of the code
+        const Instruction* instr {};
+
+        // The module only has fast slots when it was lowered from SSA, values that outlive a block go there
+        std::size_t module_locals = m_bp->local_names.size();
+        if (!vm_stack.has_room(module_locals + m_bp->max_stack)) {
+            return Result::RUNTIME_ERROR;
+        }
+        m_frames.push_back({.chunk = m_bp, .chunk_index = 0, .ip = 0, .slots = vm_stack.sp()});
+        m_slots = vm_stack.sp();
+        for (std::size_t i = 0; i < module_locals; i++) {
+            vm_stack.push(Value {});
+        }
 
-                case OpCode::SUB: {
-                    Value rhs = vm_stack.top();
-                    vm_stack.pop();
+#if TWOPY_USE_COMPUTED_GOTO
+        /* One indirect jump at the end of every handler instead of a single shared switch jump,
+           which gives the branch predictor a separate history per opcode */
+        void* dispatch_table[256];
+        std::ranges::fill(dispatch_table, &&TARGET_UNKNOWN);
+        #define TWOPY_SET_TARGET(op) dispatch_table[static_cast<std::size_t>(OpCode::op)] = &&TARGET_##op;
+        TWOPY_VM_OPCODES(TWOPY_SET_TARGET)
+        #undef TWOPY_SET_TARGET
 
-                    Value lhs = vm_stack.top();
-                    vm_stack.pop();
+        DISPATCH();
+#else
+        for (;;) {
+            instr = &m_instrutions[m_ip++];
 
-                    if (std::holds_alternative<long>(lhs.data()) && std::holds_alternative<long>(rhs.data())) {
-                        vm_stack.push(Value(lhs.to_long() - rhs.to_long()));
-                    } else {
-                        vm_stack.push(Value(lhs.to_double() - rhs.to_double()));
+            if (m_profiling) {
+                record_dispatch(instr->opcode);
+            }
+
+            switch (instr->opcode) {
+#endif
+            TARGET(RETURN) {
+                if (!pop_frame()) {
+                    return Result::OK;
+                }
+                // The caller may have been compiled since it made the call
+                if (m_jit != nullptr) {
+                    if (auto result = run_compiled()) {
+                        return *result;
                     }
-                    break;
                 }
+                DISPATCH();
+            }
 
-                case OpCode::MUL: {
-                    Value rhs = vm_stack.top();
-                    vm_stack.pop();
+            /* Pushes to stack */
+            TARGET(LOAD_CONSTANT) {
+                vm_stack.push(m_bp->consts_pool[instr->argument]);
+                DISPATCH();
+            }
 
-                    Value lhs = vm_stack.top();
-                    vm_stack.pop();
+            TARGET(ADD) {
+                Value& rhs = vm_stack.top();
+                Value& lhs = vm_stack.peek(1);
 
-                    if (std::holds_alternative<long>(lhs.data()) && std::holds_alternative<long>(rhs.data())) {
-                        vm_stack.push(Value(lhs.to_long() * rhs.to_long()));
-                    } else {
-                        vm_stack.push(Value(lhs.to_double() * rhs.to_double()));
-                    }
-                    break;
+                if (--m_site_counters[m_ip - 1] == 0) {
+                    specialize_binary(m_ip - 1, OpCode::ADD, lhs, rhs);
+                }
+                if (m_profiling) {
+                    m_specialization.generic[static_cast<std::size_t>(OpCode::ADD)]++;
                 }
 
-                case OpCode::DIV: {
-                    Value rhs = vm_stack.top();
-                    vm_stack.pop();
+                lhs = binary_add(lhs, rhs);
+                vm_stack.drop();
+                DISPATCH();
+            }
 
-                    Value lhs = vm_stack.top();
-                    vm_stack.pop();
+            TARGET(ADD_INT) {
+                Value& rhs = vm_stack.top();
+                Value& lhs = vm_stack.peek(1);
 
-                    vm_stack.push(Value(lhs.to_double() / rhs.to_double()));
-                    break;
+                if (!both_ints(lhs, rhs)) {
+                    deoptimize(m_ip - 1, OpCode::ADD);
+                    lhs = binary_add(lhs, rhs);
+                    vm_stack.drop();
+                    DISPATCH();
+                }
+                if (m_profiling) {
+                    m_specialization.hits[static_cast<std::size_t>(OpCode::ADD_INT)]++;
                 }
 
-                /* gets rid of None Value */
-                case OpCode::POP: {
-                    vm_stack.pop();
-                    break;
+                // Overflow leaves the fast path for a bigint, the site stays specialized
+                if (long result {}; small_add(lhs.as_int(), rhs.as_int(), result)) {
+                    lhs = Value(long {result});
+                } else {
+                    lhs = bigint_add(lhs, rhs);
                 }
+                vm_stack.drop();
+                DISPATCH();
+            }
 
-                 /* Pops from stack */
-                case OpCode::STORE_NAME: {
-                    auto name = vm_stack.top();
-                    vm_stack.pop();
+            TARGET(ADD_FLOAT) {
+                Value& rhs = vm_stack.top();
+                Value& lhs = vm_stack.peek(1);
 
-                    std::string key = m_bp->names_pool[instr.argument];
-                    global_vars.insert_or_assign(key, name);
-                    break;
+                if (!both_floats(lhs, rhs)) {
+                    deoptimize(m_ip - 1, OpCode::ADD);
+                    lhs = binary_add(lhs, rhs);
+                    vm_stack.drop();
+                    DISPATCH();
+                }
+                if (m_profiling) {
+                    m_specialization.hits[static_cast<std::size_t>(OpCode::ADD_FLOAT)]++;
                 }
 
-                /* Pushes to stack */
-                case OpCode::LOAD_NAME: {
-                    std::string var_name = m_bp->names_pool[instr.argument];
-                    
-                    auto it = global_vars.find(var_name);
-                    if (it != global_vars.end()) {
-                        vm_stack.push(it->second);
-                    } else if (var_name == "print") {
-                        auto builtin = std::make_shared<FunctionPyObject>("print", std::vector<std::string>{}, 0);
-                        vm_stack.push(Value(builtin));
-                    } else {
-                        return Result::RUNTIME_ERROR;
-                    }
+                lhs = Value(lhs.as_float() + rhs.as_float());
+                vm_stack.drop();
+                DISPATCH();
+            }
 
-                    break;
-                } 
+            TARGET(ADD_STR) {
+                Value& rhs = vm_stack.top();
+                Value& lhs = vm_stack.peek(1);
+
+                if (!both_strings(lhs, rhs)) {
+                    deoptimize(m_ip - 1, OpCode::ADD);
+                    lhs = binary_add(lhs, rhs);
+                    vm_stack.drop();
+                    DISPATCH();
+                }
+                if (m_profiling) {
+                    m_specialization.hits[static_cast<std::size_t>(OpCode::ADD_STR)]++;
+                }
+
+                lhs = concat_strings(lhs, rhs);
+                vm_stack.drop();
+                DISPATCH();
+            }
+
+            TARGET(SUB) {
+                Value& rhs = vm_stack.top();
+                Value& lhs = vm_stack.peek(1);
+
+                if (--m_site_counters[m_ip - 1] == 0) {
+                    specialize_binary(m_ip - 1, OpCode::SUB, lhs, rhs);
+                }
+                if (m_profiling) {
+                    m_specialization.generic[static_cast<std::size_t>(OpCode::SUB)]++;
+                }
+
+                lhs = binary_sub(lhs, rhs);
+                vm_stack.drop();
+                DISPATCH();
+            }
+
+            TARGET(SUB_INT) {
+                Value& rhs = vm_stack.top();
+                Value& lhs = vm_stack.peek(1);
+
+                if (!both_ints(lhs, rhs)) {
+                    deoptimize(m_ip - 1, OpCode::SUB);
+                    lhs = binary_sub(lhs, rhs);
+                    vm_stack.drop();
+                    DISPATCH();
+                }
+                if (m_profiling) {
+                    m_specialization.hits[static_cast<std::size_t>(OpCode::SUB_INT)]++;
+                }
+
+                // Overflow leaves the fast path for a bigint, the site stays specialized
+                if (long result {}; small_sub(lhs.as_int(), rhs.as_int(), result)) {
+                    lhs = Value(long {result});
+                } else {
+                    lhs = bigint_sub(lhs, rhs);
+                }
+                vm_stack.drop();
+                DISPATCH();
+            }
+
+            TARGET(SUB_FLOAT) {
+                Value& rhs = vm_stack.top();
+                Value& lhs = vm_stack.peek(1);
+
+                if (!both_floats(lhs, rhs)) {
+                    deoptimize(m_ip - 1, OpCode::SUB);
+                    lhs = binary_sub(lhs, rhs);
+                    vm_stack.drop();
+                    DISPATCH();
+                }
+                if (m_profiling) {
+                    m_specialization.hits[static_cast<std::size_t>(OpCode::SUB_FLOAT)]++;
+                }
+
+                lhs = Value(lhs.as_float() - rhs.as_float());
+                vm_stack.drop();
+                DISPATCH();
+            }
+
+            TARGET(MUL) {
+                Value& rhs = vm_stack.top();
+                Value& lhs = vm_stack.peek(1);
+
+                if (--m_site_counters[m_ip - 1] == 0) {
+                    specialize_binary(m_ip - 1, OpCode::MUL, lhs, rhs);
+                }
+                if (m_profiling) {
+                    m_specialization.generic[static_cast<std::size_t>(OpCode::MUL)]++;
+                }
+
+                lhs = binary_mul(lhs, rhs);
+                vm_stack.drop();
+                DISPATCH();
+            }
+
+            TARGET(MUL_INT) {
+                Value& rhs = vm_stack.top();
+                Value& lhs = vm_stack.peek(1);
+
+                if (!both_ints(lhs, rhs)) {
+                    deoptimize(m_ip - 1, OpCode::MUL);
+                    lhs = binary_mul(lhs, rhs);
+                    vm_stack.drop();
+                    DISPATCH();
+                }
+                if (m_profiling) {
+                    m_specialization.hits[static_cast<std::size_t>(OpCode::MUL_INT)]++;
+                }
+
+                // Overflow leaves the fast path for a bigint, the site stays specialized
+                if (long result {}; small_mul(lhs.as_int(), rhs.as_int(), result)) {
+                    lhs = Value(long {result});
+                } else {
+                    lhs = bigint_mul(lhs, rhs);
+                }
+                vm_stack.drop();
+                DISPATCH();
+            }
+
+            TARGET(MUL_FLOAT) {
+                Value& rhs = vm_stack.top();
+                Value& lhs = vm_stack.peek(1);
+
+                if (!both_floats(lhs, rhs)) {
+                    deoptimize(m_ip - 1, OpCode::MUL);
+                    lhs = binary_mul(lhs, rhs);
+                    vm_stack.drop();
+                    DISPATCH();
+                }
+                if (m_profiling) {
+                    m_specialization.hits[static_cast<std::size_t>(OpCode::MUL_FLOAT)]++;
+                }
+
+                lhs = Value(lhs.as_float() * rhs.as_float());
+                vm_stack.drop();
+                DISPATCH();
+            }
+
+            TARGET(DIV) {
+                Value& rhs = vm_stack.top();
+                Value& lhs = vm_stack.peek(1);
+
+                lhs = binary_div(lhs, rhs);
+                vm_stack.drop();
+                DISPATCH();
+            }
+
+            TARGET(BINARY_MODULO) {
+                Value& rhs = vm_stack.top();
+                Value& lhs = vm_stack.peek(1);
+
+                lhs = binary_mod(lhs, rhs);
+                vm_stack.drop();
+                DISPATCH();
+            }
+
+            TARGET(BINARY_FLOOR_DIVIDE) {
+                Value& rhs = vm_stack.top();
+                Value& lhs = vm_stack.peek(1);
+
+                lhs = binary_floor_div(lhs, rhs);
+                vm_stack.drop();
+                DISPATCH();
+            }
+
+            /* gets rid of None Value */
+            TARGET(POP) {
+                vm_stack.drop();
+                DISPATCH();
+            }
+
+             /* Pops from stack */
+            TARGET(STORE_NAME) {
+                m_globals.store(instr->argument, vm_stack.pop());
+                DISPATCH();
+            }
+
+            TARGET(LOAD_BUILTIN) {
+                vm_stack.push(builtin(instr->argument));
+                DISPATCH();
+            }
+
+            TARGET(LOAD_FAST) {
+                vm_stack.push(m_slots[instr->argument]);
+                DISPATCH();
+            }
+
+            TARGET(STORE_FAST) {
+                m_slots[instr->argument] = vm_stack.pop();
+                DISPATCH();
+            }
+
+            /* The code object already is the function, only the qualified name under it gets dropped */
+            TARGET(MAKE_FUNCTION) {
+                vm_stack.drop();
+                DISPATCH();
+            }
+
+            /* Pushes to stack */
+            TARGET(LOAD_NAME) {
+                if (!load_name(m_ip - 1, instr->argument)) {
+                    return Result::RUNTIME_ERROR;
+                }
+                DISPATCH();
+            }
+
+            TARGET(COMPARE_OP) {
+                Value& rhs = vm_stack.top();
+                Value& lhs = vm_stack.peek(1);
 
-                case OpCode::CALL_FUNCTION: {
-                    std::uint8_t arg_count = instr.argument;
+                auto result = compare_values(static_cast<CompareOp>(instr->argument), lhs, rhs);
+                if (!result) {
+                    return Result::RUNTIME_ERROR;
+                }
+
+                lhs = Value(bool {*result});
+                vm_stack.drop();
+                DISPATCH();
+            }
+
+            /* Jump arguments are absolute byte offsets, see jump_target() */
+            TARGET(POP_JUMP_IF_FALSE) {
+                bool truthy = vm_stack.top().is_truthy();
+                vm_stack.drop();
+
+                if (!truthy) {
+                    m_ip = jump_target(m_instrutions, m_ip - 1);
+                }
+                DISPATCH();
+            }
+
+            TARGET(POP_JUMP_IF_TRUE) {
+                bool truthy = vm_stack.top().is_truthy();
+                vm_stack.drop();
+
+                if (truthy) {
+                    m_ip = jump_target(m_instrutions, m_ip - 1);
+                }
+                DISPATCH();
+            }
 
-                    std::vector<Value> args(arg_count);
-                    for (int i = arg_count - 1; i >= 0; i--) {
-                        args[i] = vm_stack.top();
-                        vm_stack.pop();
+            /* and/or as a value: the operand that decides it stays as the result */
+            TARGET(JUMP_IF_FALSE_OR_POP) {
+                if (vm_stack.top().is_truthy()) {
+                    vm_stack.drop();
+                } else {
+                    m_ip = jump_target(m_instrutions, m_ip - 1);
+                }
+                DISPATCH();
+            }
+
+            TARGET(JUMP_IF_TRUE_OR_POP) {
+                if (vm_stack.top().is_truthy()) {
+                    m_ip = jump_target(m_instrutions, m_ip - 1);
+                } else {
+                    vm_stack.drop();
+                }
+                DISPATCH();
+            }
+
+            TARGET(JUMP_IF_INLINED) {
+                if (still_inlined()) {
+                    m_ip = jump_target(m_instrutions, m_ip - 1);
+                }
+                DISPATCH();
+            }
+
+            TARGET(JUMP_FORWARD) {
+                m_ip = jump_target(m_instrutions, m_ip - 1);
+                DISPATCH();
+            }
+
+            /* Every back-edge bumps its loop header's counter, so it's known which loops are hot */
+            TARGET(JUMP_BACKWARD) {
+                m_ip = jump_target(m_instrutions, m_ip - 1);
+                if (++m_loop_counts[m_ip] >= trace_loop_threshold && m_jit_enabled) {
+                    if (auto result = hot_loop()) {
+                        return *result;
                     }
+                }
+                DISPATCH();
+            }
+
+            /* Only read by the jump after it */
+            TARGET(EXTENDED_ARG) {
+                DISPATCH();
+            }
+
+            TARGET(GET_ITER) {
+                if (!get_iter()) {
+                    return Result::RUNTIME_ERROR;
+                }
+                DISPATCH();
+            }
+
+            TARGET(FOR_ITER) {
+                if (--m_site_counters[m_ip - 1] == 0) {
+                    specialize_for_iter(m_ip - 1, vm_stack.peek(1));
+                }
+                if (m_profiling) {
+                    m_specialization.generic[static_cast<std::size_t>(OpCode::FOR_ITER)]++;
+                }
+
+                if (!for_iter_step()) {
+                    m_ip = jump_target(m_instrutions, m_ip - 1);
+                }
+                DISPATCH();
+            }
+
+            /* The store that follows is done here so the item skips the stack */
+            TARGET(FOR_ITER_RANGE) {
+                const RangePyObject* range = as_range(vm_stack.peek(1));
+                if (range == nullptr) {
+                    deoptimize(m_ip - 1, OpCode::FOR_ITER);
+                    m_ip--;
+                    DISPATCH();
+                }
+                if (m_profiling) {
+                    m_specialization.hits[static_cast<std::size_t>(OpCode::FOR_ITER_RANGE)]++;
+                }
 
-                    Value callable = vm_stack.top();
-                    vm_stack.pop();
+                std::optional<long> current = range_step(*range, vm_stack.top());
+                if (!current) {
+                    vm_stack.truncate(vm_stack.sp() - 2);
+                    m_ip = jump_target(m_instrutions, m_ip - 1);
+                    DISPATCH();
+                }
 
-                    auto obj = callable.obj_ref();
-                    if (auto* func = dynamic_cast<FunctionPyObject*>(obj.get())) {
-                        if (func->name() == "print") {
-                            for (std::size_t i = 0; i < args.size(); i++) {
-                                if (i > 0) fmt::print(" ");
-                                fmt::print("{}", args[i].to_string());
+                const Instruction& store = m_instrutions[m_ip];
+                if (store.opcode == OpCode::STORE_FAST) {
+                    m_slots[store.argument] = Value(long {*current});
+                    m_ip++;
+                } else if (store.opcode == OpCode::STORE_NAME) {
+                    m_globals.store(store.argument, Value(long {*current}));
+                    m_ip++;
+                } else {
+                    vm_stack.push(Value(long {*current}));
+                }
+                DISPATCH();
+            }
+
+            TARGET(CALL_FUNCTION) {
+                switch (call_function(instr->argument)) {
+                    case CallResult::FAILED:
+                        return Result::RUNTIME_ERROR;
+                    case CallResult::ENTERED:
+                        if (m_jit != nullptr) {
+                            if (auto result = run_compiled()) {
+                                return *result;
                             }
-                            fmt::print("\n");
-                            vm_stack.push(Value{});
                         }
-                    }
-                    break;
+                        break;
+                    case CallResult::RETURNED:
+                        break;
                 }
+                DISPATCH();
+            }
+
+            // The RETURN after it only runs for a native callee
+            TARGET(TAIL_CALL) {
+                switch (tail_call(instr->argument)) {
+                    case CallResult::FAILED:
+                        return Result::RUNTIME_ERROR;
+                    case CallResult::ENTERED:
+                        if (m_jit != nullptr) {
+                            if (auto result = run_compiled()) {
+                                return *result;
+                            }
+                        }
+                        break;
+                    case CallResult::RETURNED:
+                        break;
+                }
+                DISPATCH();
+            }
+
+            TARGET(BUILD_LIST) {
+                build_list(instr->argument);
+                DISPATCH();
+            }
+
+            TARGET(BUILD_MAP) {
+                if (!build_map(instr->argument)) {
+                    return Result::RUNTIME_ERROR;
+                }
+                DISPATCH();
+            }
+
+            TARGET(BINARY_SUBSCR) {
+                if (!binary_subscr()) {
+                    return Result::RUNTIME_ERROR;
+                }
+                DISPATCH();
+            }
+
+            TARGET(STORE_SUBSCR) {
+                if (!store_subscr()) {
+                    return Result::RUNTIME_ERROR;
+                }
+                DISPATCH();
+            }
+
+            TARGET(LOAD_METHOD) {
+                if (!load_method(instr->argument)) {
+                    return Result::RUNTIME_ERROR;
+                }
+                DISPATCH();
+            }
+
+            TARGET(CALL_METHOD) {
+                if (!call_method(instr->argument)) {
+                    return Result::RUNTIME_ERROR;
+                }
+                DISPATCH();
+            }
+
+            /* Superinstructions: the trailing instructions only carry arguments here */
+            TARGET(LOAD_NAME__LOAD_NAME) {
+                Instruction next = m_instrutions[m_ip++];
+                if (!load_name(m_ip - 2, instr->argument) || !load_name(m_ip - 1, next.argument)) {
+                    return Result::RUNTIME_ERROR;
+                }
+                DISPATCH();
+            }
+
+            TARGET(LOAD_NAME__LOAD_CONSTANT) {
+                Instruction next = m_instrutions[m_ip++];
+                if (!load_name(m_ip - 2, instr->argument)) {
+                    return Result::RUNTIME_ERROR;
+                }
+                vm_stack.push(m_bp->consts_pool[next.argument]);
+                DISPATCH();
+            }
+
+            TARGET(LOAD_NAME__LOAD_CONSTANT__ADD) {
+                Instruction next = m_instrutions[m_ip];
+                m_ip += 2;
+
+                if (!load_name(m_ip - 3, instr->argument)) {
+                    return Result::RUNTIME_ERROR;
+                }
+                Value& lhs = vm_stack.top();
+                lhs = binary_add(lhs, m_bp->consts_pool[next.argument]);
+                DISPATCH();
+            }
+
+            TARGET(LOAD_CONSTANT__STORE_NAME) {
+                Instruction next = m_instrutions[m_ip++];
+                m_globals.store(next.argument, m_bp->consts_pool[instr->argument]);
+                DISPATCH();
+            }
+
+            TARGET(COMPARE_OP__POP_JUMP_IF_FALSE) {
+                m_ip++;
+
+                auto result = compare_values(static_cast<CompareOp>(instr->argument), vm_stack.peek(1), vm_stack.top());
+                if (!result) {
+                    return Result::RUNTIME_ERROR;
+                }
+                vm_stack.truncate(vm_stack.sp() - 2);
 
+                if (!*result) {
+                    m_ip = jump_target(m_instrutions, m_ip - 1);
+                }
+                DISPATCH();
+            }
+
+#if TWOPY_USE_COMPUTED_GOTO
+            TARGET_UNKNOWN:
+                fmt::print(stderr, "SystemError: unknown opcode {}\n", static_cast<int>(instr->opcode));
+                return Result::RUNTIME_ERROR;
+#else
                 default:
-                    break;
+                    fmt::print(stderr, "SystemError: unknown opcode {}\n", static_cast<int>(instr->opcode));
+                    return Result::RUNTIME_ERROR;
             }
         }
-        return Result::OK;
+#endif
     }
-}
\ No newline at end of file
+}
+
+#undef TARGET
+#undef DISPATCH
@@ -1,14 +1,24 @@
 #ifndef VM_HPP
 #define VM_HPP
 
-#include <stack>
 #include <cstddef>
 #include <vector>
 #include <flat_map>
+#include <map>
+#include <array>
 #include <string>
+#include <exception>
+#include <memory>
+#include <optional>
 
 #include "backend/value.hpp"
 #include "backend/bytecode.hpp"
+#include "backend/value_stack.hpp"
+#include "backend/gc.hpp"
+#include "backend/globals.hpp"
+#include "backend/output_buffer.hpp"
+#include "backend/jit.hpp"
+#include "backend/trace.hpp"
 
 /// NOTE: immutable accessor for impl. of __get__
 
@@ -25,6 +35,41 @@
 // Access local variables & arguments
 
 namespace TwoPy::Backend {
+    /* Filled in by `-p`: dynamic opcode, pair and triple frequencies used to pick superinstructions */
+    struct DispatchProfile {
+        std::size_t dispatches {};
+        std::size_t calls {};
+        std::size_t tail_calls {};
+        std::size_t global_cache_hits {};
+        std::size_t global_cache_misses {};
+        std::size_t max_frame_depth {};
+        std::array<std::size_t, 256> opcodes {};
+        std::map<std::array<OpCode, 2>, std::size_t> pairs {};
+        std::map<std::array<OpCode, 3>, std::size_t> triples {};
+    };
+
+    /* Filled in by `-p`: how well each quickened opcode's type guess held up, indexed by OpCode */
+    struct SpecializationStats {
+        std::array<std::size_t, 256> generic {};            // executions of the unspecialized opcode
+        std::array<std::size_t, 256> specializations {};    // sites rewritten to this opcode
+        std::array<std::size_t, 256> hits {};               // executions that passed the guard
+        std::array<std::size_t, 256> deopts {};             // guard failures, the site went back to generic
+    };
+
+    /* A running function. The caller's ip is saved here while a callee runs. */
+    struct CallFrame {
+        Chunk* chunk {};
+        std::size_t chunk_index {};
+        std::size_t ip {};
+        Value* slots {};        // first argument, the callable sits just below it
+    };
+
+    /* Per-LOAD_NAME inline cache: where the name resolved to, valid while the globals keep this version */
+    struct GlobalCache {
+        std::uint32_t version {UINT32_MAX};
+        const Value* value {};
+    };
+
     class VM {
         public:
             enum class Result : std::uint8_t {
@@ -34,16 +79,53 @@ namespace TwoPy::Backend {
             };
             
         private:
+            // Its helpers run opcodes for compiled code, on the same state the interpreter uses
+            friend class StencilJit;
+            friend class JitCode;
+            friend class TraceRecorder;
+            friend class TraceJit;
+
+            /* What CALL_FUNCTION did with its callee */
+            enum class CallResult : std::uint8_t {
+                RETURNED,   // a native ran, its result is on the stack
+                ENTERED,    // a Python frame got pushed and is now running
+                FAILED,     // already reported
+            };
+
             const ByteCodeProgram& m_prgm {};
+
+            // Declared first so it outlives the stack and globals, its destructor sweeps what they left behind
+            Heap m_heap {};
+
+            static constexpr std::size_t stack_capacity = 16 * 1024;
+            static constexpr std::size_t max_frames = 1000;     // Python's default recursion limit
             
-            std::size_t m_frame_count {};
-            
-            std::flat_map<std::string, Value> global_vars {};
-            std::flat_map<std::string, Value> local_vars {};
+            GlobalTable m_globals;
 
             // stores runtime consts/values 
-            std::stack<Value> vm_stack {};
-            std::vector<Instruction> m_instrutions {};
+            ValueStack vm_stack {stack_capacity};
+            std::vector<CallFrame> m_frames {};
+
+            /* Each chunk gets its own copy of the code so quickening can rewrite it.
+               m_instrutions and m_site_counters point at the running chunk's copy. */
+            std::vector<std::vector<Instruction>> m_chunk_code {};
+            std::vector<std::vector<std::uint16_t>> m_chunk_counters {};
+            std::vector<std::vector<GlobalCache>> m_chunk_caches {};
+            Instruction* m_instrutions {};
+            GlobalCache* m_global_caches {};
+
+            /* Back-edges taken per loop header, indexed like the chunk's code. Always counted, not
+               just under `-p`, they're what deciding a loop is hot enough for more work rests on. */
+            std::vector<std::vector<std::uint64_t>> m_chunk_loop_counts {};
+            std::uint64_t* m_loop_counts {};
+
+            /* Quickening: every site starts generic and counts down, at zero it gets
+               specialized to the operand types it just saw. A failed guard (or unspecializable
+               operands) restarts the countdown from the longer backoff. */
+            static constexpr std::uint16_t warmup_executions = 16;
+            static constexpr std::uint16_t deopt_backoff = 64;
+            std::uint16_t* m_site_counters {};
+            SpecializationStats m_specialization {};
 
             // Also called program counters 
             std::size_t m_ip {};
@@ -51,8 +133,137 @@ namespace TwoPy::Backend {
             // Base Pointer (EBP)
             Chunk* m_bp {};
 
+            // Fast locals of the running frame
+            Value* m_slots {};
+
+            OutputBuffer m_output;
+
+            /* Copy-and-patch JIT, see jit.hpp. A chunk gets compiled once it's been called jit_call_threshold
+               times or one of its loops has taken jit_loop_threshold back-edges, late enough that
+               quickening has settled which opcodes the stencils get picked for. */
+            static constexpr std::uint32_t jit_call_threshold = 100;
+            static constexpr std::uint64_t jit_loop_threshold = 200;
+            bool m_jit_enabled {TWOPY_USE_JIT == 1};
+            std::vector<std::unique_ptr<JitCode>> m_chunk_jit {};
+            std::vector<std::uint32_t> m_chunk_calls {};
+            const JitCode* m_jit {};                    // the running chunk's, nullptr while it's interpreted
+            std::exception_ptr m_jit_exception {};      // thrown under a helper, rethrown once out of compiled code
+            JitStats m_jit_stats {};
+
+            /* Tracing JIT, see trace.hpp. A loop is recorded once it has taken trace_loop_threshold
+               back-edges, before the whole chunk would be compiled. A trace that keeps being left
+               within a couple of iterations of entering it is dropped after trace_probation entries,
+               its chunk is compiled instead. Indexed like the loop counts, by header */
+            static constexpr std::uint64_t trace_loop_threshold = 64;
+            static constexpr std::size_t trace_probation = 64;
+            std::vector<std::vector<std::unique_ptr<Trace>>> m_chunk_traces {};
+            std::unique_ptr<Trace>* m_traces {};
+
+            bool m_profiling {};
+            DispatchProfile m_profile {};
+            std::array<OpCode, 2> m_last_ops {};
+            std::size_t m_history {};
+
+            void record_dispatch(OpCode op);
+
+            void specialize_binary(std::size_t site, OpCode generic, const Value& lhs, const Value& rhs);
+            void specialize_for_iter(std::size_t site, const Value& iterable);
+            void deoptimize(std::size_t site, OpCode generic);
+
+            // Pushes a global (or builtin) through the site's inline cache, false if the name isn't bound anywhere
+            [[nodiscard]] bool load_name(std::size_t site, std::uint8_t slot);
+
+            /* Frame entry: checks arity, recursion depth and stack room, then switches to the callee */
+            [[nodiscard]] bool push_frame(const FunctionPyObject& func, std::uint8_t arg_count);
+
+            /* Tail call: the callee takes over the running frame and its slots, the depth stays the same */
+            [[nodiscard]] bool replace_frame(const FunctionPyObject& func, std::uint8_t arg_count);
+            void enter_chunk(std::size_t chunk_index);
+
+            /* RETURN: the result goes to the caller, whose frame takes over. False when it was the module's */
+            [[nodiscard]] bool pop_frame();
+
+            /* Handler bodies the interpreter and the JIT's helpers share. The bool ones return false
+               after reporting an error */
+            [[nodiscard]] CallResult call_function(std::uint8_t arg_count);
+            [[nodiscard]] CallResult tail_call(std::uint8_t arg_count);   // a native callee just returns, as with call_function()
+            [[nodiscard]] bool get_iter();
+            [[nodiscard]] bool for_iter_step();     // false once the iterable is exhausted, not an error
+            [[nodiscard]] bool still_inlined() noexcept;    // JUMP_IF_INLINED, true when the inlined body can run
+            void build_list(std::uint8_t count);
+            [[nodiscard]] bool build_map(std::uint8_t count);
+            [[nodiscard]] bool binary_subscr();
+            [[nodiscard]] bool store_subscr();
+            [[nodiscard]] bool load_method(std::uint8_t name_const);
+            [[nodiscard]] bool call_method(std::uint8_t arg_count);
+
+            void compile_chunk(std::size_t chunk_index);
+
+            /* Runs compiled code for as long as the running frame has some. nullopt hands back to
+               the interpreter at m_ip, anything else is what execute() returns */
+            [[nodiscard]] std::optional<Result> run_compiled();
+
+            /* A back-edge to m_ip past trace_loop_threshold: records, runs or gives up on the loop's
+               trace. Same return as run_compiled() */
+            [[nodiscard]] std::optional<Result> hot_loop();
+
+            /* Runs the running chunk's trace for the loop at `header`, false if there's none or the
+               variables don't have the types it was recorded with. Either way the VM is left at m_ip */
+            [[nodiscard]] bool enter_trace(std::size_t header);
+            [[nodiscard]] bool run_trace(Trace& trace);
+
+            /* GC roots: the stack (every frame's slots live on it), the globals and the constant pools */
+            void scan_roots(GcVisitor& visitor) const;
+
+            // Safe point: only between instructions, when no Value is held anywhere but the roots
+            void maybe_collect() {
+                if (m_heap.collect_pending()) {
+                    m_heap.collect([this](GcVisitor& visitor) { scan_roots(visitor); });
+                }
+            }
+
+            Result execute();
+
         public:
-            VM(const ByteCodeProgram& prgm);        
+            VM(const ByteCodeProgram& prgm, bool unbuffered_output = false);
+
+            void enable_profiling() noexcept {
+                m_profiling = true;
+            }
+
+            void disable_jit() noexcept {
+                m_jit_enabled = false;
+            }
+
+            [[nodiscard]] const DispatchProfile& profile() const noexcept {
+                return m_profile;
+            }
+
+            [[nodiscard]] const SpecializationStats& specialization_stats() const noexcept {
+                return m_specialization;
+            }
+
+            /* Per chunk, indexed by instruction: how many times a back-edge jumped to that loop header */
+            [[nodiscard]] const std::vector<std::vector<std::uint64_t>>& loop_counts() const noexcept {
+                return m_chunk_loop_counts;
+            }
+
+            [[nodiscard]] const JitStats& jit_stats() const noexcept {
+                return m_jit_stats;
+            }
+
+            /* Per chunk, indexed by loop header: the traces still in use */
+            [[nodiscard]] const std::vector<std::vector<std::unique_ptr<Trace>>>& traces() const noexcept {
+                return m_chunk_traces;
+            }
+
+            [[nodiscard]] const GcStats& gc_stats() const noexcept {
+                return m_heap.stats();
+            }
+
+            [[nodiscard]] const OutputBuffer& output() const noexcept {
+                return m_output;
+            }
 
             Result run();
     };
@@ -132,10 +132,20 @@ ExprPtr parser_class::parse_expression_types() {
                 }
             } else if (match(token_type::LBRACKET)) {
                 expr = parse_list_index_call(std::move(id_expr));
+            } else if (match(token_type::DOT)) {
+                expr = parse_attribute_expr();
+                if (match(token_type::LPAREN)) {
+                    expr = parse_call_expr(std::move(expr));
+                }
             } else {
                 expr = std::move(id_expr);
             }
 
+            // Calls and subscripts chain onto what came before them: lst[0](x), f(x)(y), grid[i][j]
+            while (match(token_type::LPAREN, token_type::LBRACKET)) {
+                expr = match(token_type::LPAREN) ? parse_call_expr(std::move(expr)) : parse_list_index_call(std::move(expr));
+            }
+
             break;
         }
 
@@ -538,7 +548,7 @@ StmtPtr parser_class::parse_return_stmt() {
 
     ExprPtr value;
     if (!is_at_end() && !match(token_type::NEWLINE)) {
-        value = parse_expression_types();
+        value = parse_logical_or();
     }
 
     ReturnStmt ret{.token=token, .value=std::move(value)};
@@ -694,7 +704,7 @@ StmtPtr parser_class::parse_if_stmt() {
         token_class elif_token = current_token();
         consume(token_type::KEYWORD_ELIF);
 
-        auto elif_condition = parse_expression_types();
+        auto elif_condition = parse_logical_or();
 
         consume_newline();
         Block elif_body = parse_block();
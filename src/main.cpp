@@ -1,36 +1,86 @@
 #include <string_view>
 #include <string>
+#include <chrono>
 #include <fmt/core.h>
 
 #include "frontend/lexical.hpp"
 #include "frontend/parser.hpp"
 #include "print/ast_tree.hpp"   
 #include "print/python_byte.hpp"
+#include "print/vm_stats.hpp"
+#include "print/register_byte.hpp"
+#include "print/ssa_ir.hpp"
 #include "backend/bytecode.hpp"
+#include "backend/ssa.hpp"
 #include "backend/vm.hpp"
+#include "backend/register_bytecode.hpp"
+#include "backend/register_vm.hpp"
 
 void show_usage(const char* process_path) {
-    fmt::print(stderr, "Usage: {} [-a | -d | -r] <file.py>\n\t-d: dump bytecode\n", process_path);
+    fmt::print(stderr, "Usage: {} [-a | -d | -r | -p] [options] <file.py>\n\t-d: dump bytecode\n\t-p: run and print a dispatch profile\n", process_path);
+    fmt::print(stderr, "Options:\n\t--no-superinstructions: keep the unfused bytecode\n\t--register: compile for the register VM instead of the stack VM\n");
+    fmt::print(stderr, "\t--repeat <n>: with -p, also time n unprofiled runs\n\t--unbuffered: flush print() output after every line\n");
+    fmt::print(stderr, "\t--loop-stats: after the run, print how often each loop's back-edge was taken\n");
+    fmt::print(stderr, "\t--no-jit: interpret everything, even hot code\n");
+    fmt::print(stderr, "\t--traces: after the run, print the traces the tracing JIT compiled\n");
+    fmt::print(stderr, "\t--ssa: compile through the SSA IR (with -d, dump it before the bytecode)\n");
+    fmt::print(stderr, "\t--no-inline: call small functions instead of compiling their body into the caller\n");
     fmt::print(stderr, "Example: {} test.py\n", process_path);
 }
 
 int main(int argc, char* argv[]) {
-    if (argc < 2 || argc > 3) {
+    if (argc < 3) {
         show_usage(argv[0]);
         return 1;
     }
 
     std::string_view option_str {argv[1]};
-    std::string file_path {argv[2]};
+    std::string file_path {argv[argc - 1]};
     const auto allow_ast_dump = option_str == "-a";
     const auto allow_bytecode_dump = option_str == "-d";
-    const auto allow_run = option_str == "-r";
+    const auto allow_profile = option_str == "-p";
+    const auto allow_run = option_str == "-r" || allow_profile;
 
     if (!allow_ast_dump && !allow_bytecode_dump && !allow_run) {
         show_usage(argv[0]);
         return 1;
     }
 
+    bool allow_superinstructions = true;
+    bool use_register_vm = false;
+    bool unbuffered_output = false;
+    bool loop_stats = false;
+    bool print_traces = false;
+    bool allow_jit = true;
+    bool use_ssa = false;
+    bool inline_calls = true;
+    std::size_t repeat_runs = 0;
+    for (int i = 2; i < argc - 1; i++) {
+        std::string_view flag {argv[i]};
+        if (flag == "--no-superinstructions") {
+            allow_superinstructions = false;
+        } else if (flag == "--register") {
+            use_register_vm = true;
+        } else if (flag == "--repeat" && i + 1 < argc - 1) {
+            repeat_runs = std::stoul(argv[++i]);
+        } else if (flag == "--unbuffered") {
+            unbuffered_output = true;
+        } else if (flag == "--loop-stats") {
+            loop_stats = true;
+        } else if (flag == "--traces") {
+            print_traces = true;
+        } else if (flag == "--no-jit") {
+            allow_jit = false;
+        } else if (flag == "--ssa") {
+            use_ssa = true;
+        } else if (flag == "--no-inline") {
+            inline_calls = false;
+        } else {
+            show_usage(argv[0]);
+            return 1;
+        }
+    }
+
     try {
         const std::string& source_code = TwoPy::Frontend::read_file(file_path);
         TwoPy::Frontend::lexical_class lexer(source_code);
@@ -44,8 +94,65 @@ int main(int argc, char* argv[]) {
             return 0;
         }
 
-        TwoPy::Backend::compiler bytecode_compiler(program);
-        TwoPy::Backend::ByteCodeProgram bytecode_program = bytecode_compiler.disassemble_program();
+        if (use_register_vm) {
+            TwoPy::Backend::register_compiler reg_compiler(program);
+            TwoPy::Backend::RegisterChunk reg_chunk = reg_compiler.compile_program();
+
+            if (allow_bytecode_dump) {
+                fmt::print("\n=== REGISTER BYTECODE ===\n");
+                RegisterPrinter::disassemble_chunk(reg_chunk);
+                return 0;
+            }
+
+            TwoPy::Backend::RegisterVM reg_vm(reg_chunk, unbuffered_output);
+            if (allow_profile) {
+                reg_vm.enable_profiling();
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            auto result = reg_vm.run();
+            auto elapsed = std::chrono::steady_clock::now() - start;
+
+            if (allow_profile) {
+                StatsPrinter::print_register_profile(reg_vm.dispatches(), reg_chunk.code.size(), elapsed);
+                StatsPrinter::print_output_stats(reg_vm.output(), elapsed);
+                StatsPrinter::print_gc_stats(reg_vm.gc_stats());
+                StatsPrinter::print_pool_stats(TwoPy::Backend::ObjectPool::local());
+            }
+
+            if (allow_profile && repeat_runs > 0) {
+                auto timed_start = std::chrono::steady_clock::now();
+                for (std::size_t run = 0; run < repeat_runs; run++) {
+                    TwoPy::Backend::RegisterVM timed_vm(reg_chunk, unbuffered_output);
+                    (void)timed_vm.run();
+                }
+                StatsPrinter::print_timing(repeat_runs, std::chrono::steady_clock::now() - timed_start);
+            }
+
+            if (result == TwoPy::Backend::RegisterVM::Result::RUNTIME_ERROR) {
+                throw std::runtime_error("You need more logic");
+            }
+            return 0;
+        }
+
+        TwoPy::Backend::ByteCodeProgram bytecode_program {};
+        if (use_ssa) {
+            TwoPy::Backend::SsaProgram ssa_program = TwoPy::Backend::build_ssa(program);
+            TwoPy::Backend::optimize_ssa(ssa_program);
+
+            if (allow_bytecode_dump) {
+                fmt::print("\n=== SSA IR ===\n");
+                SsaPrinter::print_program(ssa_program);
+            }
+            bytecode_program = TwoPy::Backend::lower_ssa(ssa_program);
+        } else {
+            TwoPy::Backend::compiler bytecode_compiler(program, inline_calls);
+            bytecode_program = bytecode_compiler.disassemble_program();
+        }
+
+        if (allow_superinstructions) {
+            TwoPy::Backend::fuse_superinstructions(bytecode_program);
+        }
 
         if (allow_bytecode_dump) {
             fmt::print("\n=== BYTECODE ===\n");
@@ -57,8 +164,54 @@ int main(int argc, char* argv[]) {
             return 0;
         }
 
-        TwoPy::Backend::VM py_vm(bytecode_program);
+        auto startup_start = std::chrono::steady_clock::now();
+        TwoPy::Backend::VM py_vm(bytecode_program, unbuffered_output);
+        auto startup = std::chrono::steady_clock::now() - startup_start;
+
+        if (allow_profile) {
+            py_vm.enable_profiling();
+        }
+        if (!allow_jit) {
+            py_vm.disable_jit();
+        }
+
+        auto start = std::chrono::steady_clock::now();
         auto result = py_vm.run();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        if (allow_profile) {
+            std::size_t instruction_count = 0;
+            for (const auto& chunk : bytecode_program.chunks) {
+                instruction_count += chunk->code.size();
+            }
+            StatsPrinter::print_dispatch_profile(py_vm.profile(), instruction_count, elapsed);
+            StatsPrinter::print_startup(startup);
+            StatsPrinter::print_output_stats(py_vm.output(), elapsed);
+            StatsPrinter::print_gc_stats(py_vm.gc_stats());
+            StatsPrinter::print_jit_stats(py_vm.jit_stats());
+            StatsPrinter::print_specialization_stats(py_vm.specialization_stats());
+            StatsPrinter::print_pool_stats(TwoPy::Backend::ObjectPool::local());
+        }
+
+        if (loop_stats) {
+            StatsPrinter::print_loop_stats(bytecode_program, py_vm.loop_counts());
+        }
+        if (print_traces) {
+            StatsPrinter::print_traces(bytecode_program, py_vm.traces());
+        }
+
+        if (allow_profile && repeat_runs > 0) {
+            // Each run gets a fresh VM, so quickening starts cold every time just like a real process
+            auto timed_start = std::chrono::steady_clock::now();
+            for (std::size_t run = 0; run < repeat_runs; run++) {
+                TwoPy::Backend::VM timed_vm(bytecode_program, unbuffered_output);
+                if (!allow_jit) {
+                    timed_vm.disable_jit();
+                }
+                (void)timed_vm.run();
+            }
+            StatsPrinter::print_timing(repeat_runs, std::chrono::steady_clock::now() - timed_start);
+        }
 
         if (result == TwoPy::Backend::VM::Result::RUNTIME_ERROR) {
             throw std::runtime_error("You need more logic");
@@ -11,6 +11,7 @@
 #include "backend/bytecode.hpp"
 #include "backend/objects.hpp"
 #include "backend/value.hpp"
+#include "backend/builtins.hpp"
 
 namespace BytePrinter {
     using namespace TwoPy::Backend;
@@ -29,53 +30,92 @@ namespace BytePrinter {
             case OpCode::PUSH_NULL: return "PUSH_NULL";
             case OpCode::BINARY_POWER: return "BINARY_POWER";
             case OpCode::BINARY_MODULO: return "BINARY_MODULO";
+            case OpCode::BINARY_FLOOR_DIVIDE: return "BINARY_FLOOR_DIVIDE";
             case OpCode::STORE_FAST: return "STORE_FAST";
             case OpCode::STORE_NAME: return "STORE_NAME";
             case OpCode::COMPARE_OP: return "COMPARE_OP";
             case OpCode::POP_JUMP_IF_FALSE: return "POP_JUMP_IF_FALSE";
             case OpCode::POP_JUMP_IF_TRUE: return "POP_JUMP_IF_TRUE";
+            case OpCode::JUMP_IF_FALSE_OR_POP: return "JUMP_IF_FALSE_OR_POP";
+            case OpCode::JUMP_IF_TRUE_OR_POP: return "JUMP_IF_TRUE_OR_POP";
+            case OpCode::JUMP_FORWARD: return "JUMP_FORWARD";
+            case OpCode::JUMP_BACKWARD: return "JUMP_BACKWARD";
+            case OpCode::EXTENDED_ARG: return "EXTENDED_ARG";
+            case OpCode::GET_ITER: return "GET_ITER";
+            case OpCode::FOR_ITER: return "FOR_ITER";
             case OpCode::LOAD_FAST: return "LOAD_FAST";
             case OpCode::LOAD_NAME: return "LOAD_NAME";
             case OpCode::LOAD_CONSTANT: return "LOAD_CONSTANT";
+            case OpCode::LOAD_BUILTIN: return "LOAD_BUILTIN";
+            case OpCode::BUILD_LIST: return "BUILD_LIST";
+            case OpCode::BUILD_MAP: return "BUILD_MAP";
+            case OpCode::BINARY_SUBSCR: return "BINARY_SUBSCR";
+            case OpCode::STORE_SUBSCR: return "STORE_SUBSCR";
+            case OpCode::LOAD_METHOD: return "LOAD_METHOD";
+            case OpCode::CALL_METHOD: return "CALL_METHOD";
+            case OpCode::TAIL_CALL: return "TAIL_CALL";
+            case OpCode::JUMP_IF_INLINED: return "JUMP_IF_INLINED";
+            case OpCode::LOAD_NAME__LOAD_NAME: return "LOAD_NAME__LOAD_NAME";
+            case OpCode::LOAD_NAME__LOAD_CONSTANT: return "LOAD_NAME__LOAD_CONSTANT";
+            case OpCode::LOAD_CONSTANT__STORE_NAME: return "LOAD_CONSTANT__STORE_NAME";
+            case OpCode::COMPARE_OP__POP_JUMP_IF_FALSE: return "COMPARE_OP__POP_JUMP_IF_FALSE";
+            case OpCode::LOAD_NAME__LOAD_CONSTANT__ADD: return "LOAD_NAME__LOAD_CONSTANT__ADD";
+            case OpCode::ADD_INT: return "ADD_INT";
+            case OpCode::ADD_FLOAT: return "ADD_FLOAT";
+            case OpCode::ADD_STR: return "ADD_STR";
+            case OpCode::SUB_INT: return "SUB_INT";
+            case OpCode::SUB_FLOAT: return "SUB_FLOAT";
+            case OpCode::MUL_INT: return "MUL_INT";
+            case OpCode::MUL_FLOAT: return "MUL_FLOAT";
+            case OpCode::FOR_ITER_RANGE: return "FOR_ITER_RANGE";
             default: return "UNKNOWN";
         }
     }
 
+    inline std::string compare_op_to_string(std::uint8_t op) {
+        switch (static_cast<CompareOp>(op)) {
+            case CompareOp::LT: return "<";
+            case CompareOp::LE: return "<=";
+            case CompareOp::EQ: return "==";
+            case CompareOp::NE: return "!=";
+            case CompareOp::GT: return ">";
+            case CompareOp::GE: return ">=";
+            default: return "?";
+        }
+    }
+
     inline std::string value_to_string(const Value& val) {
-        const auto& data = val.data();
-
-        if (std::holds_alternative<std::monostate>(data)) {
-            return "None";
-        } else if (std::holds_alternative<long>(data)) {
-            return std::to_string(std::get<long>(data));
-        } else if (std::holds_alternative<double>(data)) {
-            return std::to_string(std::get<double>(data));
-        } else if (std::holds_alternative<bool>(data)) {
-            return std::get<bool>(data) ? "True" : "False";
-        } else if (std::holds_alternative<Reference>(data)) {
-            return "<ref>";
-        } else if (std::holds_alternative<Value::py_object_ptr>(data)) {
-            auto obj = std::get<Value::py_object_ptr>(data);
-            if (!obj) {
-                return "<null>";
-            }
-            if (obj->tag() == ObjectTag::STRING) {
-                return "\"" + obj->stringify() + "\"";
+        switch (val.tag()) {
+            case ValueTag::NONE: return "None";
+            case ValueTag::INT: return std::to_string(val.as_int());
+            case ValueTag::FLOAT: return std::to_string(val.as_float());
+            case ValueTag::BOOL: return val.as_bool() ? "True" : "False";
+            case ValueTag::REF: return "<ref>";
+            case ValueTag::OBJ: {
+                auto obj = val.as_object();
+                if (!obj) {
+                    return "<null>";
+                }
+                if (obj->tag() == ObjectTag::STRING) {
+                    return "\"" + obj->stringify() + "\"";
+                }
+                return "<" + obj->stringify() + ">";
             }
-            return "<" + obj->stringify() + ">";
         }
 
         return "<unknown>";
     }
 
     inline void print_instruction(const Instruction& instr, size_t offset,
-                                  const Chunk& chunk) {
+                                  const Chunk& chunk, const std::vector<std::string>& global_names) {
         std::string opname = opcode_to_string(instr.opcode);
 
         fmt::print("{:>6}  {:<20}", offset * 2, opname);
 
         switch (instr.opcode) {
             case OpCode::LOAD_CONSTANT:
+            case OpCode::LOAD_CONSTANT__STORE_NAME:
+            case OpCode::LOAD_METHOD:
                 if (instr.argument < chunk.consts_pool.size()) {
                     fmt::print(" {:>3}  ({})",
                               instr.argument,
@@ -87,29 +127,70 @@ namespace BytePrinter {
 
             case OpCode::STORE_FAST:
             case OpCode::LOAD_FAST:
+                if (instr.argument < chunk.local_names.size()) {
+                    fmt::print(" {:>3}  ({})",
+                              instr.argument,
+                              chunk.local_names[instr.argument]);
+                } else {
+                    fmt::print(" {:>3}  <invalid local slot>", instr.argument);
+                }
+                break;
+
             case OpCode::LOAD_NAME:
             case OpCode::STORE_NAME:
-                if (instr.argument < chunk.names_pool.size()) {
+            case OpCode::LOAD_NAME__LOAD_NAME:
+            case OpCode::LOAD_NAME__LOAD_CONSTANT:
+            case OpCode::LOAD_NAME__LOAD_CONSTANT__ADD:
+                if (instr.argument < global_names.size()) {
                     fmt::print(" {:>3}  ({})",
                               instr.argument,
-                              chunk.names_pool[instr.argument]);
+                              global_names[instr.argument]);
                 } else {
                     fmt::print(" {:>3}  <invalid variable index>", instr.argument);
                 }
                 break;
 
+            case OpCode::LOAD_BUILTIN:
+                fmt::print(" {:>3}  ({})", instr.argument, TwoPy::Backend::builtin_name(instr.argument));
+                break;
+
             case OpCode::POP_JUMP_IF_FALSE:
-                fmt::print(" {:>3}  (to {})", (offset + 1) * 2, instr.argument);
+                fmt::print(" {:>3}  (to {})", (offset + 1) * 2, jump_target(chunk.code.data(), offset) * 2);
                 break;
 
             case OpCode::POP_JUMP_IF_TRUE:
-                fmt::print(" {:>3}  (to {})", instr.argument / 2, instr.argument);
+                fmt::print(" {:>3}  (to {})", instr.argument / 2, jump_target(chunk.code.data(), offset) * 2);
+                break;
+
+            case OpCode::JUMP_FORWARD:
+            case OpCode::JUMP_BACKWARD:
+            case OpCode::JUMP_IF_FALSE_OR_POP:
+            case OpCode::JUMP_IF_TRUE_OR_POP:
+            case OpCode::JUMP_IF_INLINED:
+            case OpCode::FOR_ITER:
+            case OpCode::FOR_ITER_RANGE:
+                fmt::print(" {:>3}  (to {})", instr.argument, jump_target(chunk.code.data(), offset) * 2);
+                break;
+
+            case OpCode::COMPARE_OP:
+            case OpCode::COMPARE_OP__POP_JUMP_IF_FALSE:
+                fmt::print(" {:>3}  ({})", instr.argument, compare_op_to_string(instr.argument));
                 break;
 
             case OpCode::CALL_FUNCTION:
+            case OpCode::CALL_METHOD:
+            case OpCode::TAIL_CALL:
                 fmt::print(" {:>3}  (arg count)", instr.argument);
                 break;
 
+            case OpCode::BUILD_LIST:
+                fmt::print(" {:>3}  (item count)", instr.argument);
+                break;
+
+            case OpCode::BUILD_MAP:
+                fmt::print(" {:>3}  (pair count)", instr.argument);
+                break;
+
             default:
                 if (instr.argument != 0) {
                     fmt::print(" {:>3}", instr.argument);
@@ -120,7 +201,7 @@ namespace BytePrinter {
         fmt::print("\n");
     }
 
-    inline void disassemble_chunk(const Chunk& chunk, const std::string& name = "<chunk>") {
+    inline void disassemble_chunk(const Chunk& chunk, const std::vector<std::string>& global_names, const std::string& name = "<chunk>") {
         fmt::print("Disassembly of {}:\n", name);
         fmt::print("Constants: [");
         for (size_t i = 0; i < chunk.consts_pool.size(); ++i) {
@@ -129,29 +210,50 @@ namespace BytePrinter {
         }
         fmt::print("]\n");
 
-        fmt::print("Variables: [");
-        for (size_t i = 0; i < chunk.names_pool.size(); ++i) {
-            if (i > 0) fmt::print(", ");
-            fmt::print("'{}'", chunk.names_pool[i]);
+        if (!chunk.local_names.empty()) {
+            fmt::print("Locals: [");
+            for (size_t i = 0; i < chunk.local_names.size(); ++i) {
+                if (i > 0) fmt::print(", ");
+                fmt::print("'{}'", chunk.local_names[i]);
+            }
+            fmt::print("]\n");
         }
-        fmt::print("]\n\n");
+        fmt::print("Max stack: {}\n\n", chunk.max_stack);
 
         fmt::print("Offset  Opcode               Arg  Details\n");
         fmt::print("------  -------------------  ---  -------\n");
 
         for (size_t i = 0; i < chunk.code.size(); ++i) {
-            print_instruction(chunk.code[i], i, chunk);
+            print_instruction(chunk.code[i], i, chunk, global_names);
         }
 
         fmt::print("\n");
     }
 
     inline void disassemble_program(const ByteCodeProgram& program) {
-        fmt::print("=== Bytecode Program: {} ===\n\n", program.name);
+        fmt::print("=== Bytecode Program: {} ===\n", program.name);
+
+        fmt::print("Globals: [");
+        for (size_t i = 0; i < program.global_names.size(); ++i) {
+            if (i > 0) fmt::print(", ");
+            fmt::print("'{}'", program.global_names[i]);
+        }
+        fmt::print("]\n");
+
+        if (!program.inlined_calls.empty()) {
+            fmt::print("Inlined: ");
+            bool first = true;
+            for (const auto& [name, sites] : program.inlined_calls) {
+                fmt::print("{}{} ({} call site{})", first ? "" : ", ", name, sites, sites == 1 ? "" : "s");
+                first = false;
+            }
+            fmt::print("\n");
+        }
+        fmt::print("\n");
 
         for (size_t i = 0; i < program.chunks.size(); ++i) {
             std::string chunk_name = (i == 0) ? "<module>" : fmt::format("<chunk {}>", i);
-            disassemble_chunk(*program.chunks[i], chunk_name);
+            disassemble_chunk(*program.chunks[i], program.global_names, chunk_name);
         }
 
         fmt::print("=== End of {} ===\n", program.name);
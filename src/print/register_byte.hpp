@@ -0,0 +1,109 @@
+#ifndef REGISTER_BYTE_HPP
+#define REGISTER_BYTE_HPP
+
+#include <string>
+
+#include <fmt/core.h>
+#include "backend/register_bytecode.hpp"
+#include "backend/builtins.hpp"
+#include "print/python_byte.hpp"
+
+namespace RegisterPrinter {
+    using namespace TwoPy::Backend;
+
+    inline std::string opcode_to_string(RegOpCode op) {
+        switch (op) {
+            case RegOpCode::LOAD_CONSTANT: return "LOAD_CONSTANT";
+            case RegOpCode::LOAD_BUILTIN: return "LOAD_BUILTIN";
+            case RegOpCode::MOVE: return "MOVE";
+            case RegOpCode::ADD: return "ADD";
+            case RegOpCode::SUB: return "SUB";
+            case RegOpCode::MUL: return "MUL";
+            case RegOpCode::DIV: return "DIV";
+            case RegOpCode::COMPARE_LT: return "COMPARE_LT";
+            case RegOpCode::COMPARE_LE: return "COMPARE_LE";
+            case RegOpCode::COMPARE_EQ: return "COMPARE_EQ";
+            case RegOpCode::COMPARE_NE: return "COMPARE_NE";
+            case RegOpCode::COMPARE_GT: return "COMPARE_GT";
+            case RegOpCode::COMPARE_GE: return "COMPARE_GE";
+            case RegOpCode::JUMP: return "JUMP";
+            case RegOpCode::JUMP_IF_FALSE: return "JUMP_IF_FALSE";
+            case RegOpCode::JUMP_IF_TRUE: return "JUMP_IF_TRUE";
+            case RegOpCode::CALL: return "CALL";
+            case RegOpCode::RETURN: return "RETURN";
+            default: return "UNKNOWN";
+        }
+    }
+
+    inline std::string register_name(const RegisterChunk& chunk, std::uint8_t reg) {
+        if (reg < chunk.variables.size()) {
+            return fmt::format("r{}({})", reg, chunk.variables[reg]);
+        }
+        return fmt::format("r{}", reg);
+    }
+
+    inline void print_instruction(const RegInstruction& instr, std::size_t offset, const RegisterChunk& chunk) {
+        fmt::print("{:>6}  {:<20}", offset, opcode_to_string(instr.opcode));
+
+        const std::size_t target = static_cast<std::size_t>(instr.b) | (static_cast<std::size_t>(instr.c) << 8);
+
+        switch (instr.opcode) {
+            case RegOpCode::LOAD_CONSTANT:
+                fmt::print(" {}, {}", register_name(chunk, instr.a), BytePrinter::value_to_string(chunk.consts_pool[instr.b]));
+                break;
+
+            case RegOpCode::LOAD_BUILTIN:
+                fmt::print(" {}, {}", register_name(chunk, instr.a), TwoPy::Backend::builtin_name(instr.b));
+                break;
+
+            case RegOpCode::MOVE:
+                fmt::print(" {}, {}", register_name(chunk, instr.a), register_name(chunk, instr.b));
+                break;
+
+            case RegOpCode::JUMP:
+                fmt::print(" (to {})", target);
+                break;
+
+            case RegOpCode::JUMP_IF_FALSE:
+            case RegOpCode::JUMP_IF_TRUE:
+                fmt::print(" {} (to {})", register_name(chunk, instr.a), target);
+                break;
+
+            case RegOpCode::CALL:
+                fmt::print(" {}, {} ({} args)", register_name(chunk, instr.a), register_name(chunk, instr.b), instr.c);
+                break;
+
+            case RegOpCode::RETURN:
+                break;
+
+            default:
+                fmt::print(" {}, {}, {}", register_name(chunk, instr.a), register_name(chunk, instr.b), register_name(chunk, instr.c));
+                break;
+        }
+
+        fmt::print("\n");
+    }
+
+    inline void disassemble_chunk(const RegisterChunk& chunk) {
+        fmt::print("=== Register Program: <module> ===\n\n");
+        fmt::print("Registers: {} ({} variables)\n", chunk.register_count, chunk.variables.size());
+
+        fmt::print("Constants: [");
+        for (std::size_t i = 0; i < chunk.consts_pool.size(); ++i) {
+            if (i > 0) fmt::print(", ");
+            fmt::print("{}", BytePrinter::value_to_string(chunk.consts_pool[i]));
+        }
+        fmt::print("]\n\n");
+
+        fmt::print("Index   Opcode               Operands\n");
+        fmt::print("------  -------------------  --------\n");
+
+        for (std::size_t i = 0; i < chunk.code.size(); ++i) {
+            print_instruction(chunk.code[i], i, chunk);
+        }
+
+        fmt::print("\n=== End of <module> ===\n");
+    }
+}
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef SSA_IR_HPP
+#define SSA_IR_HPP
+
+#include <string>
+
+#include <fmt/core.h>
+#include "backend/ssa.hpp"
+#include "print/python_byte.hpp"
+
+namespace SsaPrinter {
+    using namespace TwoPy::Backend;
+
+    inline std::string type_to_string(SsaType type) {
+        switch (type) {
+            case SsaType::ANY: return "any";
+            case SsaType::NONE: return "none";
+            case SsaType::BOOL: return "bool";
+            case SsaType::INT: return "int";
+            case SsaType::FLOAT: return "float";
+            case SsaType::STR: return "str";
+            case SsaType::LIST: return "list";
+            case SsaType::DICT: return "dict";
+            case SsaType::FUNCTION: return "function";
+            case SsaType::ITERATION: return "iteration";
+            case SsaType::METHOD: return "method";
+        }
+        return "?";
+    }
+
+    inline std::string op_to_string(const SsaInstr& instr) {
+        switch (instr.op) {
+            case SsaOp::CONSTANT: return "const";
+            case SsaOp::PARAM: return "param";
+            case SsaOp::LOAD_GLOBAL: return "load_global";
+            case SsaOp::LOAD_BUILTIN: return "load_builtin";
+            case SsaOp::STORE_GLOBAL: return "store_global";
+            case SsaOp::BINARY:
+                switch (static_cast<OpCode>(instr.arg)) {
+                    case OpCode::ADD: return "add";
+                    case OpCode::SUB: return "sub";
+                    case OpCode::MUL: return "mul";
+                    case OpCode::DIV: return "div";
+                    case OpCode::BINARY_MODULO: return "mod";
+                    case OpCode::BINARY_FLOOR_DIVIDE: return "floordiv";
+                    default: return BytePrinter::opcode_to_string(static_cast<OpCode>(instr.arg));
+                }
+            case SsaOp::COMPARE: return "cmp " + BytePrinter::compare_op_to_string(static_cast<std::uint8_t>(instr.arg));
+            case SsaOp::CALL: return "call";
+            case SsaOp::LOAD_METHOD: return "load_method";
+            case SsaOp::CALL_METHOD: return "call_method";
+            case SsaOp::BUILD_LIST: return "build_list";
+            case SsaOp::BUILD_MAP: return "build_map";
+            case SsaOp::SUBSCR: return "subscr";
+            case SsaOp::STORE_SUBSCR: return "store_subscr";
+            case SsaOp::MAKE_FUNCTION: return "make_function";
+            case SsaOp::GET_ITER: return "get_iter";
+            case SsaOp::DROP_ITER: return "drop_iter";
+            case SsaOp::COPY: return "copy";
+            case SsaOp::PHI: return "phi";
+            case SsaOp::JUMP: return "jump";
+            case SsaOp::BRANCH: return "branch";
+            case SsaOp::FOR_ITER: return "for_iter";
+            case SsaOp::RETURN: return "return";
+        }
+        return "?";
+    }
+
+    inline void print_instr(const SsaFunction& function, SsaValue value, const std::vector<std::string>& global_names) {
+        const auto& instr = function.values[value];
+        const auto& block = function.blocks[instr.block];
+
+        if (instr.op == SsaOp::JUMP || instr.op == SsaOp::BRANCH || instr.op == SsaOp::RETURN || instr.op == SsaOp::STORE_GLOBAL
+            || instr.op == SsaOp::STORE_SUBSCR || instr.op == SsaOp::DROP_ITER) {
+            fmt::print("    ");
+        } else {
+            fmt::print("    v{}{} = ", value, instr.variable.empty() ? "" : " " + instr.variable);
+        }
+        fmt::print("{}", op_to_string(instr));
+
+        switch (instr.op) {
+            case SsaOp::CONSTANT:
+            case SsaOp::LOAD_METHOD:
+            case SsaOp::MAKE_FUNCTION:
+                fmt::print(" {}", BytePrinter::value_to_string(instr.constant));
+                break;
+            case SsaOp::PARAM:
+                fmt::print(" {}", instr.arg);
+                break;
+            case SsaOp::LOAD_GLOBAL:
+            case SsaOp::STORE_GLOBAL:
+                fmt::print(" {}", global_names[instr.arg]);
+                break;
+            case SsaOp::LOAD_BUILTIN:
+                fmt::print(" #{}", instr.arg);
+                break;
+            default:
+                break;
+        }
+
+        if (instr.op == SsaOp::PHI) {
+            for (std::size_t i = 0; i < instr.operands.size(); i++) {
+                fmt::print(" [b{}: v{}]", block.predecessors[i], instr.operands[i]);
+            }
+        } else {
+            for (std::size_t i = 0; i < instr.operands.size(); i++) {
+                fmt::print("{} v{}", i == 0 ? "" : ",", instr.operands[i]);
+            }
+        }
+
+        switch (instr.op) {
+            case SsaOp::JUMP:
+                fmt::print(" b{}", block.successors[0]);
+                break;
+            case SsaOp::BRANCH:
+            case SsaOp::FOR_ITER:
+                fmt::print(" ? b{} : b{}", block.successors[0], block.successors[1]);
+                break;
+            default:
+                break;
+        }
+
+        if (instr.op != SsaOp::JUMP && instr.op != SsaOp::BRANCH && instr.op != SsaOp::RETURN && instr.op != SsaOp::STORE_GLOBAL
+            && instr.op != SsaOp::STORE_SUBSCR && instr.op != SsaOp::DROP_ITER) {
+            fmt::print(" : {}", type_to_string(instr.type));
+        }
+        fmt::print("\n");
+    }
+
+    inline void print_function(const SsaFunction& function, const std::vector<std::string>& global_names) {
+        fmt::print("function {}(", function.name);
+        for (std::size_t i = 0; i < function.params.size(); i++) {
+            fmt::print("{}{}", i == 0 ? "" : ", ", function.params[i]);
+        }
+        fmt::print("):\n");
+
+        for (SsaBlockId id : reverse_postorder(function)) {
+            const auto& block = function.blocks[id];
+            fmt::print("  b{}:", id);
+            if (!block.predecessors.empty()) {
+                fmt::print(" <-");
+                for (std::size_t i = 0; i < block.predecessors.size(); i++) {
+                    fmt::print("{} b{}", i == 0 ? "" : ",", block.predecessors[i]);
+                }
+            }
+            fmt::print("\n");
+
+            for (SsaValue value : block.instrs) {
+                print_instr(function, value, global_names);
+            }
+        }
+        fmt::print("\n");
+    }
+
+    inline void print_program(const SsaProgram& program) {
+        for (const auto& function : program.functions) {
+            print_function(function, program.global_names);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,297 @@
+#ifndef VM_STATS_HPP
+#define VM_STATS_HPP
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+#include "backend/vm.hpp"
+#include "print/python_byte.hpp"
+
+/* Reports for the `-p` run mode, printed to stderr so the program's own output stays clean */
+namespace StatsPrinter {
+    using namespace TwoPy::Backend;
+
+    inline constexpr std::size_t top_n = 10;
+
+    template <typename Key>
+    std::vector<std::pair<Key, std::size_t>> most_frequent(const std::map<Key, std::size_t>& counts) {
+        std::vector<std::pair<Key, std::size_t>> sorted(counts.begin(), counts.end());
+        std::ranges::sort(sorted, [](const auto& a, const auto& b) { return a.second > b.second; });
+
+        if (sorted.size() > top_n) {
+            sorted.resize(top_n);
+        }
+        return sorted;
+    }
+
+    template <std::size_t N>
+    std::string sequence_to_string(const std::array<OpCode, N>& ops) {
+        std::string out;
+        for (std::size_t i = 0; i < N; i++) {
+            if (i > 0) out += "; ";
+            out += BytePrinter::opcode_to_string(ops[i]);
+        }
+        return out;
+    }
+
+#ifdef TWOPY_NAN_BOXING
+    inline constexpr const char* value_repr = "nan-boxed";
+#else
+    inline constexpr const char* value_repr = "variant";
+#endif
+
+    inline void print_dispatch_profile(const DispatchProfile& profile, std::size_t instruction_count, std::chrono::duration<double, std::milli> wall_time) {
+        fmt::print(stderr, "\n=== DISPATCH PROFILE (stack) ===\n");
+        fmt::print(stderr, "Value:        {} bytes ({})\n", sizeof(Value), value_repr);
+        fmt::print(stderr, "Instructions: {}\n", instruction_count);
+        fmt::print(stderr, "Dispatches:   {}\n", profile.dispatches);
+        fmt::print(stderr, "Calls:        {} (max depth {}, {} tail calls)\n", profile.calls, profile.max_frame_depth, profile.tail_calls);
+        fmt::print(stderr, "Global cache: {} hits, {} misses\n", profile.global_cache_hits, profile.global_cache_misses);
+        fmt::print(stderr, "Wall time:    {:.3f} ms\n\n", wall_time.count());
+
+        std::map<std::array<OpCode, 1>, std::size_t> singles;
+        for (std::size_t op = 0; op < profile.opcodes.size(); op++) {
+            if (profile.opcodes[op] != 0) {
+                singles[{static_cast<OpCode>(op)}] = profile.opcodes[op];
+            }
+        }
+
+        fmt::print(stderr, "Opcodes:\n");
+        for (const auto& [ops, count] : most_frequent(singles)) {
+            fmt::print(stderr, "{:>12}  {}\n", count, sequence_to_string(ops));
+        }
+
+        fmt::print(stderr, "\nPairs:\n");
+        for (const auto& [ops, count] : most_frequent(profile.pairs)) {
+            fmt::print(stderr, "{:>12}  {}\n", count, sequence_to_string(ops));
+        }
+
+        fmt::print(stderr, "\nTriples:\n");
+        for (const auto& [ops, count] : most_frequent(profile.triples)) {
+            fmt::print(stderr, "{:>12}  {}\n", count, sequence_to_string(ops));
+        }
+    }
+
+    inline void print_specialization_stats(const SpecializationStats& stats) {
+        // {generic, specialized}, grouped by generic opcode
+        constexpr std::array<std::pair<OpCode, OpCode>, 8> specialized_ops {{
+            {OpCode::ADD, OpCode::ADD_INT}, {OpCode::ADD, OpCode::ADD_FLOAT}, {OpCode::ADD, OpCode::ADD_STR},
+            {OpCode::SUB, OpCode::SUB_INT}, {OpCode::SUB, OpCode::SUB_FLOAT},
+            {OpCode::MUL, OpCode::MUL_INT}, {OpCode::MUL, OpCode::MUL_FLOAT},
+            {OpCode::FOR_ITER, OpCode::FOR_ITER_RANGE},
+        }};
+
+        fmt::print(stderr, "\nSpecialization:\n");
+        fmt::print(stderr, "{:<16}{:>12}{:>12}{:>12}{:>12}{:>10}\n", "opcode", "generic", "sites", "hits", "deopts", "hit rate");
+
+        std::optional<OpCode> current_generic {};
+        for (const auto& [generic, op] : specialized_ops) {
+            if (current_generic != generic) {
+                current_generic = generic;
+                fmt::print(stderr, "{:<16}{:>12}\n", BytePrinter::opcode_to_string(generic), stats.generic[static_cast<std::size_t>(generic)]);
+            }
+
+            auto index = static_cast<std::size_t>(op);
+            std::size_t executions = stats.hits[index] + stats.deopts[index];
+            double hit_rate = executions == 0 ? 0.0 : 100.0 * static_cast<double>(stats.hits[index]) / static_cast<double>(executions);
+
+            fmt::print(stderr, "  {:<14}{:>12}{:>12}{:>12}{:>12}{:>9.1f}%\n", BytePrinter::opcode_to_string(op), "",
+                       stats.specializations[index], stats.hits[index], stats.deopts[index], hit_rate);
+        }
+    }
+
+    /* `--loop-stats`: back-edges per loop header, every loop the program compiled to, hottest first */
+    inline void print_loop_stats(const ByteCodeProgram& program, const std::vector<std::vector<std::uint64_t>>& counts) {
+        struct LoopRow {
+            const Chunk* chunk;
+            std::size_t header;
+            std::uint64_t back_edges;
+        };
+
+        std::vector<LoopRow> rows;
+        for (std::size_t c = 0; c < program.chunks.size(); c++) {
+            const Chunk& chunk = *program.chunks[c];
+            std::vector<bool> seen(chunk.code.size());
+            for (std::size_t i = 0; i < chunk.code.size(); i++) {
+                if (chunk.code[i].opcode != OpCode::JUMP_BACKWARD) {
+                    continue;
+                }
+                // continue jumps back to the same header as the end of the body, it's still one loop
+                std::size_t header = jump_target(chunk.code.data(), i);
+                if (!seen[header]) {
+                    seen[header] = true;
+                    rows.push_back({.chunk = &chunk, .header = header, .back_edges = counts[c][header]});
+                }
+            }
+        }
+        std::ranges::stable_sort(rows, [](const LoopRow& a, const LoopRow& b) { return a.back_edges > b.back_edges; });
+
+        fmt::print(stderr, "\nLoops:\n");
+        fmt::print(stderr, "{:<20}{:>8}{:>8}{:>16}\n", "chunk", "header", "kind", "back-edges");
+        for (const auto& row : rows) {
+            // A for loop's header is its FOR_ITER, possibly behind the EXTENDED_ARG of its exit jump
+            std::size_t first = row.header;
+            while (row.chunk->code[first].opcode == OpCode::EXTENDED_ARG) {
+                first++;
+            }
+            const char* kind = row.chunk->code[first].opcode == OpCode::FOR_ITER ? "for" : "while";
+
+            fmt::print(stderr, "{:<20}{:>8}{:>8}{:>16}\n", row.chunk->name, row.header * 2, kind, row.back_edges);
+        }
+    }
+
+    /* VM construction: the operand stack allocation and the per-chunk code copies */
+    inline void print_startup(std::chrono::duration<double, std::milli> startup) {
+        fmt::print(stderr, "Startup:      {:.3f} ms\n", startup.count());
+    }
+
+    /* print() traffic: redirect stdout to compare the buffered and `--unbuffered` write(2) counts */
+    inline void print_output_stats(const OutputBuffer& output, std::chrono::duration<double, std::milli> wall_time) {
+        constexpr std::array<const char*, 3> policy_names {"full", "line", "unbuffered"};
+        double seconds = wall_time.count() / 1000.0;
+        double lines_per_second = seconds > 0.0 ? static_cast<double>(output.lines()) / seconds : 0.0;
+
+        fmt::print(stderr, "Output:       {} lines, {} bytes in {} writes (flush: {}, {:.0f} lines/s)\n",
+                   output.lines(), output.bytes(), output.writes(), policy_names[static_cast<std::size_t>(output.policy())], lines_per_second);
+    }
+
+    /* Cycle collector: only containers are tracked, acyclic garbage never gets this far */
+    inline void print_gc_stats(const GcStats& stats) {
+        using ms = std::chrono::duration<double, std::milli>;
+        const std::size_t young = static_cast<std::size_t>(Generation::YOUNG);
+        const std::size_t old = static_cast<std::size_t>(Generation::OLD);
+
+        fmt::print(stderr, "GC:           {} young + {} full collections, {:.3f} ms paused (max {:.3f} ms)\n",
+                   stats.collections[young], stats.collections[old], ms(stats.total_pause).count(), ms(stats.max_pause).count());
+        fmt::print(stderr, "GC heap:      {} containers allocated, {} collected, {} promoted, {} young + {} old live\n",
+                   stats.allocated, stats.collected, stats.promoted, stats.tracked[young], stats.tracked[old]);
+    }
+
+    /* Baseline JIT: what got compiled, and how often a frame was handed over to compiled code */
+    inline void print_jit_stats(const JitStats& stats) {
+        fmt::print(stderr, "JIT:          {} chunks compiled, {} bytes of code, {} entries\n", stats.compiled, stats.code_bytes, stats.entries);
+        fmt::print(stderr, "Traces:       {} compiled, {} aborted, {} discarded, {} entries, {} iterations\n",
+                   stats.traces, stats.trace_aborts, stats.traces_discarded, stats.trace_entries, stats.trace_iterations);
+    }
+
+    inline std::string trace_op_to_string(const TraceInstr& instr) {
+        switch (instr.op) {
+            case TraceOp::LOAD_FAST: return "load_fast";
+            case TraceOp::LOAD_NAME: return "load_name";
+            case TraceOp::CONSTANT: return "const";
+            case TraceOp::INT_TO_FLOAT: return "int_to_float";
+            case TraceOp::ADD: return instr.checked ? "add.checked" : "add";
+            case TraceOp::SUB: return instr.checked ? "sub.checked" : "sub";
+            case TraceOp::MUL: return instr.checked ? "mul.checked" : "mul";
+            case TraceOp::DIV: return instr.checked ? "div.checked" : "div";
+            case TraceOp::MOD: return "mod.checked";
+            case TraceOp::FLOOR_DIV: return "floordiv.checked";
+            case TraceOp::COMPARE: return BytePrinter::compare_op_to_string(static_cast<std::uint8_t>(instr.arg));
+            case TraceOp::GUARD_TRUE: return "guard_true";
+            case TraceOp::GUARD_FALSE: return "guard_false";
+            case TraceOp::LOOP: return "loop";
+            case TraceOp::PHI: return "phi";
+        }
+        return "?";
+    }
+
+    inline std::string trace_operands_to_string(const TraceInstr& instr) {
+        constexpr std::array<const char*, 3> type_names {"int", "float", "bool"};
+        const char* type = type_names[static_cast<std::size_t>(instr.type)];
+        switch (instr.op) {
+            case TraceOp::LOAD_FAST:
+            case TraceOp::LOAD_NAME: return fmt::format("{} : {}", instr.arg, type);
+            case TraceOp::CONSTANT:
+                return instr.type == TraceType::FLOAT ? fmt::format("{} : float", std::bit_cast<double>(instr.arg)) : fmt::format("{} : {}", static_cast<long>(instr.arg), type);
+            case TraceOp::INT_TO_FLOAT: return fmt::format("v{}", instr.left);
+            case TraceOp::GUARD_TRUE:
+            case TraceOp::GUARD_FALSE: return fmt::format("v{} else exit {}", instr.left, instr.exit);
+            case TraceOp::LOOP: return "";
+            default: break;
+        }
+        std::string operands = fmt::format("v{}, v{} : {}", instr.left, instr.right, type);
+        return instr.checked ? fmt::format("{} else exit {}", operands, instr.exit) : operands;
+    }
+
+    /* `--traces`: every trace still in use after the run, optimized, with the registers its values got and its exits */
+    inline void print_traces(const ByteCodeProgram& program, const std::vector<std::vector<std::unique_ptr<Trace>>>& traces) {
+        for (std::size_t c = 0; c < traces.size(); c++) {
+            for (const auto& trace : traces[c]) {
+                if (trace == nullptr) {
+                    continue;
+                }
+                fmt::print(stderr, "\n=== TRACE {} @ {} ({} entries, {} iterations) ===\n",
+                           program.chunks[c]->name, trace->header * 2, trace->entries, trace->iterations);
+                for (std::size_t value = 0; value < trace->code.size(); value++) {
+                    const TraceInstr& instr = trace->code[value];
+                    fmt::print(stderr, "{:>6}  r{:<4}{:<18}{}\n", fmt::format("v{}", value), trace->registers[value], trace_op_to_string(instr), trace_operands_to_string(instr));
+                }
+                for (std::size_t e = 0; e < trace->exits.size(); e++) {
+                    const TraceExit& exit = trace->exits[e];
+                    std::string state;
+                    for (std::uint32_t value : exit.stack) {
+                        state += fmt::format(" push v{}", value);
+                    }
+                    for (const auto& [variable, value] : exit.variables) {
+                        state += fmt::format(" {}{}=v{}", variable.global ? "global" : "local", variable.slot, value);
+                    }
+                    fmt::print(stderr, "  exit {} -> {}:{}\n", e, exit.ip * 2, state);
+                }
+            }
+        }
+    }
+
+    /* Object allocator: per size class, how much of what was carved out is in use and how much rounding wastes */
+    inline void print_pool_stats(const ObjectPool& pool) {
+        std::size_t live_bytes = 0;
+        std::size_t allocations = pool.large_allocations();
+
+        fmt::print(stderr, "\nObject pool:\n");
+        fmt::print(stderr, "{:>8}{:>12}{:>10}{:>10}{:>11}{:>10}\n", "class", "allocs", "live", "blocks", "occupancy", "rounding");
+        for (std::size_t index = 0; index < ObjectPool::class_count; index++) {
+            const auto& stats = pool.class_stats()[index];
+            if (stats.capacity == 0) {
+                continue;
+            }
+
+            const std::size_t size = ObjectPool::class_size(index);
+            const std::size_t live = stats.live();
+            double occupancy = 100.0 * static_cast<double>(live) / static_cast<double>(stats.capacity);
+            double rounding = live == 0 ? 0.0 : 100.0 * (1.0 - static_cast<double>(stats.requested) / static_cast<double>(live * size));
+
+            fmt::print(stderr, "{:>8}{:>12}{:>10}{:>10}{:>10.1f}%{:>9.1f}%\n", size, stats.allocations, live, stats.capacity, occupancy, rounding);
+            live_bytes += live * size;
+            allocations += stats.allocations;
+        }
+
+        const std::size_t reserved = pool.slabs() * ObjectPool::slab_bytes;
+        double fragmentation = reserved == 0 ? 0.0 : 100.0 * (1.0 - static_cast<double>(live_bytes) / static_cast<double>(reserved));
+        fmt::print(stderr, "Allocations:  {} ({} over {} bytes went to operator new, {} still live)\n",
+                   allocations, pool.large_allocations(), ObjectPool::max_pooled, pool.large_live());
+        fmt::print(stderr, "Slabs:        {} x {} KiB, {} bytes live, {:.1f}% free or fragmented\n",
+                   pool.slabs(), ObjectPool::slab_bytes / 1024, live_bytes, fragmentation);
+    }
+
+    /* `--repeat N` reruns the program without profiling so the dispatch counters don't skew the clock */
+    inline void print_timing(std::size_t runs, std::chrono::duration<double, std::milli> total) {
+        fmt::print(stderr, "\nTimed runs:   {}\n", runs);
+        fmt::print(stderr, "Total time:   {:.3f} ms\n", total.count());
+        fmt::print(stderr, "Per run:      {:.3f} ms\n", total.count() / static_cast<double>(runs));
+    }
+
+    /* Same headline numbers for `--register`, to compare the two backends head to head */
+    inline void print_register_profile(std::size_t dispatches, std::size_t instruction_count, std::chrono::duration<double, std::milli> wall_time) {
+        fmt::print(stderr, "\n=== DISPATCH PROFILE (register) ===\n");
+        fmt::print(stderr, "Instructions: {}\n", instruction_count);
+        fmt::print(stderr, "Dispatches:   {}\n", dispatches);
+        fmt::print(stderr, "Wall time:    {:.3f} ms\n", wall_time.count());
+    }
+}
+
+#endif
@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <elf.h>
+#include <fmt/core.h>
+
+#include "backend/jit_stencil.hpp"
+
+/*
+Build step of the copy-and-patch JIT: reads the relocatable object jit_stencils.cpp compiled to
+and writes a header with each `twopy_stencil_*` function's bytes and holes, which jit.cpp
+includes. The relocations are the holes, so anything the compiler referred to that isn't one of
+the `_JIT_*` symbols is an error here rather than a crash at runtime.
+
+    extract_stencils <jit_stencils.o> <jit_stencils.hpp>
+*/
+using namespace TwoPy::Backend;
+
+namespace {
+    constexpr std::string_view stencil_prefix = "twopy_stencil_";
+    constexpr std::string_view symbol_prefix = "_JIT_";      // a hole's symbol is its HoleKind's name with this in front
+
+    struct ExtractedStencil {
+        std::string name;
+        std::vector<std::uint8_t> code;
+        std::vector<Hole> holes;
+        std::size_t fallthrough_size;
+    };
+
+    class ObjectFile {
+        public:
+            explicit ObjectFile(const std::string& path) {
+                std::ifstream file(path, std::ios::binary);
+                if (!file) {
+                    throw std::runtime_error(fmt::format("can't open {}", path));
+                }
+                m_bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+                const auto& header = at<Elf64_Ehdr>(0);
+                if (std::memcmp(header.e_ident, ELFMAG, SELFMAG) != 0 || header.e_ident[EI_CLASS] != ELFCLASS64
+                    || header.e_type != ET_REL || header.e_machine != EM_X86_64) {
+                    throw std::runtime_error(fmt::format("{} isn't an x86-64 ELF object file", path));
+                }
+                for (std::size_t i = 0; i < header.e_shnum; i++) {
+                    m_sections.push_back(at<Elf64_Shdr>(header.e_shoff + i * header.e_shentsize));
+                }
+                m_section_names = &m_sections.at(header.e_shstrndx);
+            }
+
+            [[nodiscard]] std::vector<ExtractedStencil> stencils() const {
+                const Elf64_Shdr* symtab = find_section(SHT_SYMTAB);
+                if (symtab == nullptr) {
+                    throw std::runtime_error("the object file has no symbol table");
+                }
+
+                std::vector<ExtractedStencil> result;
+                for (std::size_t i = 0; i < symtab->sh_size / sizeof(Elf64_Sym); i++) {
+                    const auto& symbol = at<Elf64_Sym>(symtab->sh_offset + i * sizeof(Elf64_Sym));
+                    std::string_view name = string_at(m_sections.at(symtab->sh_link), symbol.st_name);
+                    if (ELF64_ST_TYPE(symbol.st_info) == STT_FUNC && name.starts_with(stencil_prefix)) {
+                        result.push_back(extract(*symtab, symbol, name.substr(stencil_prefix.size())));
+                    }
+                }
+
+                std::ranges::sort(result, {}, &ExtractedStencil::name);
+                return result;
+            }
+
+        private:
+            std::vector<char> m_bytes {};
+            std::vector<Elf64_Shdr> m_sections {};
+            const Elf64_Shdr* m_section_names {};
+
+            template <typename T>
+            [[nodiscard]] const T& at(std::size_t offset) const {
+                if (offset + sizeof(T) > m_bytes.size()) {
+                    throw std::runtime_error("the object file is truncated");
+                }
+                return *reinterpret_cast<const T*>(m_bytes.data() + offset);
+            }
+
+            [[nodiscard]] std::string_view string_at(const Elf64_Shdr& table, std::size_t index) const {
+                return {m_bytes.data() + table.sh_offset + index};
+            }
+
+            [[nodiscard]] const Elf64_Shdr* find_section(std::uint32_t type) const {
+                auto found = std::ranges::find(m_sections, type, &Elf64_Shdr::sh_type);
+                return found == m_sections.end() ? nullptr : &*found;
+            }
+
+            [[nodiscard]] ExtractedStencil extract(const Elf64_Shdr& symtab, const Elf64_Sym& symbol, std::string_view name) const {
+                // -ffunction-sections gives every stencil a section of its own, so its relocations are only its own
+                const Elf64_Shdr& section = m_sections.at(symbol.st_shndx);
+                if (symbol.st_value != 0) {
+                    throw std::runtime_error(fmt::format("{} shares its section, compile the stencils with -ffunction-sections", name));
+                }
+
+                ExtractedStencil stencil {.name = std::string(name), .code = {}, .holes = {}, .fallthrough_size = 0};
+                auto start = m_bytes.begin() + static_cast<std::ptrdiff_t>(section.sh_offset);
+                stencil.code.assign(start, start + static_cast<std::ptrdiff_t>(symbol.st_size));
+
+                for (const auto& relocations : m_sections) {
+                    if (relocations.sh_type == SHT_REL) {
+                        throw std::runtime_error("the object file uses REL relocations, x86-64 stencils should only have RELA");
+                    }
+                    if (relocations.sh_type != SHT_RELA || &m_sections.at(relocations.sh_info) != &section) {
+                        continue;
+                    }
+                    for (std::size_t i = 0; i < relocations.sh_size / sizeof(Elf64_Rela); i++) {
+                        stencil.holes.push_back(hole(symtab, at<Elf64_Rela>(relocations.sh_offset + i * sizeof(Elf64_Rela)), name));
+                    }
+                }
+
+                std::ranges::sort(stencil.holes, {}, &Hole::offset);
+                check_tail_calls(stencil);
+                stencil.fallthrough_size = fallthrough_size(stencil);
+                return stencil;
+            }
+
+            [[nodiscard]] Hole hole(const Elf64_Shdr& symtab, const Elf64_Rela& relocation, std::string_view stencil) const {
+                const auto& target = at<Elf64_Sym>(symtab.sh_offset + ELF64_R_SYM(relocation.r_info) * sizeof(Elf64_Sym));
+                std::string_view name = ELF64_ST_TYPE(target.st_info) == STT_SECTION
+                    ? string_at(*m_section_names, m_sections.at(target.st_shndx).sh_name)
+                    : string_at(m_sections.at(symtab.sh_link), target.st_name);
+
+                auto kind = std::ranges::find(hole_symbols, name);
+                if (kind == hole_symbols.end()) {
+                    throw std::runtime_error(fmt::format("{} refers to {}, stencils can only refer to the _JIT_ symbols", stencil, name));
+                }
+
+                Hole result {
+                    .offset = static_cast<std::uint32_t>(relocation.r_offset),
+                    .kind = static_cast<HoleKind>(kind - hole_symbols.begin()),
+                    .width = 8,
+                    .relative = false,
+                    .addend = relocation.r_addend,
+                };
+                switch (ELF64_R_TYPE(relocation.r_info)) {
+                    case R_X86_64_64: break;
+                    case R_X86_64_32:
+                    case R_X86_64_32S: result.width = 4; break;
+                    case R_X86_64_PC32:
+                    case R_X86_64_PLT32:
+                        result.width = 4;
+                        result.relative = true;
+                        break;
+                    default:
+                        throw std::runtime_error(fmt::format("{} has a relocation of type {} for {}, compile the stencils with -mcmodel=medium -fno-pic",
+                            stencil, ELF64_R_TYPE(relocation.r_info), name));
+                }
+
+                // Only other templates are close enough for a displacement, and everything but OPARG, SITE and the register offsets needs all 64 bits
+                bool is_template = result.kind == HoleKind::CONTINUE || result.kind == HoleKind::JUMP_TARGET || result.kind == HoleKind::SLOW;
+                bool is_small = result.kind == HoleKind::OPARG || result.kind == HoleKind::SITE || result.kind == HoleKind::RESULT
+                    || result.kind == HoleKind::LEFT || result.kind == HoleKind::RIGHT;
+                if (result.relative != is_template || (!is_template && !is_small && result.width != 8)) {
+                    throw std::runtime_error(fmt::format("{} refers to {} the wrong way, compile the stencils with -mcmodel=medium -fno-pic", stencil, name));
+                }
+                return result;
+            }
+
+            /* A template that called its continuation instead of jumping to it would grow the native stack on every instruction */
+            static void check_tail_calls(const ExtractedStencil& stencil) {
+                const auto& code = stencil.code;
+                for (const auto& hole : stencil.holes) {
+                    if (!hole.relative) {
+                        continue;
+                    }
+                    bool jmp = hole.offset >= 1 && code[hole.offset - 1] == 0xE9;
+                    bool jcc = hole.offset >= 2 && code[hole.offset - 2] == 0x0F && (code[hole.offset - 1] & 0xF0) == 0x80;
+                    if (!jmp && !jcc) {
+                        throw std::runtime_error(fmt::format("{} calls {} instead of jumping to it, compile the stencils with -O2",
+                            stencil.name, hole_symbols[static_cast<std::size_t>(hole.kind)]));
+                    }
+                }
+            }
+
+            /* A stencil ending in `jmp _JIT_CONTINUE` can drop it when its continuation is pasted right after, anything jumping to it lands there anyway */
+            static std::size_t fallthrough_size(const ExtractedStencil& stencil) {
+                std::size_t size = stencil.code.size();
+                if (stencil.holes.empty() || size < 5) {
+                    return size;
+                }
+                const Hole& last = stencil.holes.back();
+                if (last.kind == HoleKind::CONTINUE && last.relative && last.offset == size - 4 && stencil.code[size - 5] == 0xE9) {
+                    return size - 5;
+                }
+                return size;
+            }
+    };
+
+    [[nodiscard]] std::string header(const std::vector<ExtractedStencil>& stencils) {
+        std::string out = "// Generated by extract_stencils from jit_stencils.cpp, don't edit\n"
+            "#ifndef TWOPY_JIT_STENCILS_HPP\n#define TWOPY_JIT_STENCILS_HPP\n\n"
+            "#include <array>\n#include <cstdint>\n\n#include \"backend/jit_stencil.hpp\"\n\n"
+            "namespace TwoPy::Backend::Stencils {\n";
+
+        for (const auto& stencil : stencils) {
+            out += fmt::format("    inline constexpr std::array<std::uint8_t, {}> {}_code {{", stencil.code.size(), stencil.name);
+            for (std::size_t i = 0; i < stencil.code.size(); i++) {
+                out += fmt::format("{}0x{:02x},", i % 16 == 0 ? "\n        " : " ", stencil.code[i]);
+            }
+            out += "\n    };\n";
+
+            out += fmt::format("    inline constexpr std::array<Hole, {}> {}_holes {{{{\n", stencil.holes.size(), stencil.name);
+            for (const auto& hole : stencil.holes) {
+                out += fmt::format("        {{{}, HoleKind::{}, {}, {}, {}}},\n", hole.offset, hole_symbols[static_cast<std::size_t>(hole.kind)].substr(symbol_prefix.size()),
+                    hole.width, hole.relative, hole.addend);
+            }
+            out += "    }};\n";
+
+            out += fmt::format("    inline constexpr Stencil {0} {{{0}_code, {0}_holes, {1}}};\n\n", stencil.name, stencil.fallthrough_size);
+        }
+
+        out += "}\n\n#endif\n";
+        return out;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        fmt::print(stderr, "Usage: {} <jit_stencils.o> <jit_stencils.hpp>\n", argv[0]);
+        return 1;
+    }
+
+    try {
+        std::vector<ExtractedStencil> stencils = ObjectFile(argv[1]).stencils();
+        if (stencils.empty()) {
+            throw std::runtime_error(fmt::format("{} has no twopy_stencil_ functions", argv[1]));
+        }
+
+        std::ofstream out(argv[2], std::ios::binary | std::ios::trunc);
+        out << header(stencils);
+        if (!out) {
+            throw std::runtime_error(fmt::format("can't write {}", argv[2]));
+        }
+    } catch (const std::exception& error) {
+        fmt::print(stderr, "extract_stencils: {}\n", error.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,19 @@
+x = 3
+y = 4
+if x < 5:
+    print(x)
+else:
+    print(2)
+if x > 5:
+    print(100)
+else:
+    print(200)
+if x == 4:
+    print(1)
+z = x + 1
+if x < y and y < 10:
+    print(z)
+if x > y or y > 3:
+    print(y)
+print(x + y)
+print("done")
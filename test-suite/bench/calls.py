@@ -0,0 +1,7 @@
+def inc(n):
+    m = n + 1
+    return m
+
+x = 0
+for i in range(200):
+    x = inc(x)
@@ -0,0 +1,4 @@
+x = 0
+for i in range(300):
+    x = x + 1
+print(x)
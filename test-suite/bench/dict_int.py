@@ -0,0 +1,44 @@
+def fill(d, base, n):
+    if n == 0:
+        return 0
+    k = base + n
+    d[k] = n
+    r = fill(d, base, n - 1)
+    return r
+
+def read(d, base, n):
+    if n == 0:
+        return 0
+    k = base + n
+    x = d[k]
+    r = read(d, base, n - 1)
+    return r
+
+def drop(d, base, n):
+    if n == 0:
+        return 0
+    k = base + n
+    x = d.pop(k)
+    r = drop(d, base, n - 1)
+    return r
+
+def middle(d, base, n, leaf):
+    if n == 0:
+        return 0
+    r = leaf(d, base + n * 100, 100)
+    r = middle(d, base, n - 1, leaf)
+    return r
+
+def outer(d, n, leaf):
+    if n == 0:
+        return 0
+    r = middle(d, n * 10000, 100, leaf)
+    r = outer(d, n - 1, leaf)
+    return r
+
+d = {}
+r = outer(d, 100, fill)
+print(len(d))
+r = outer(d, 100, read)
+r = outer(d, 100, drop)
+print(len(d))
@@ -0,0 +1,24 @@
+def read(d, n, acc):
+    if n == 0:
+        return acc
+    d["count"] = d["count"] + 1
+    r = read(d, n - 1, acc + d["width"] * d["height"])
+    return r
+
+def middle(d, n, acc):
+    if n == 0:
+        return acc
+    r = read(d, 200, acc)
+    r = middle(d, n - 1, r)
+    return r
+
+def outer(d, n, acc):
+    if n == 0:
+        return acc
+    r = middle(d, 200, acc)
+    r = outer(d, n - 1, r)
+    return r
+
+d = {"width": 3, "height": 4, "count": 0, "name": "box"}
+print(outer(d, 50, 0))
+print(d["count"])
@@ -0,0 +1,9 @@
+a = 1
+b = 2
+c = 3.5
+d = 0.5
+for i in range(60):
+    a = a + b
+    b = b - a
+    c = c * d
+    d = d + c
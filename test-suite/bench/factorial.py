@@ -0,0 +1,9 @@
+def prod(n, lo):
+    if n == lo:
+        return n
+    r = n * prod(n - 1, lo)
+    return r
+
+x = prod(1000, 501) * prod(500, 1)
+s = str(x)
+print(len(s))
@@ -0,0 +1,8 @@
+def total(n):
+    s = 0
+    for i in range(n):
+        s = s + i
+    return s
+
+for k in range(10):
+    print(total(10000000))
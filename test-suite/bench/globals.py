@@ -0,0 +1,9 @@
+k = 3
+j = 2
+def step(n):
+    m = n + k - j
+    return m
+
+x = 0
+for i in range(200):
+    x = step(x)
@@ -0,0 +1,21 @@
+def square(x):
+    return x * x
+
+def lerp(a, b, t):
+    return a + (b - a) * t
+
+def below(a, limit):
+    return a < limit
+
+def energy(rows, cols):
+    total = 0
+    r = 0
+    while below(r, rows):
+        c = 0
+        while below(c, cols):
+            total = total + square(c) - lerp(c, 3, 2)
+            c = c + 1
+        r = r + 1
+    return total
+
+print(energy(1000, 1000))
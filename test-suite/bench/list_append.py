@@ -0,0 +1,24 @@
+def fill(l, n):
+    if n == 0:
+        return 0
+    l.append(n)
+    r = fill(l, n - 1)
+    return r
+
+def middle(l, n):
+    if n == 0:
+        return 0
+    r = fill(l, 216)
+    r = middle(l, n - 1)
+    return r
+
+def outer(l, n):
+    if n == 0:
+        return 0
+    r = middle(l, 216)
+    r = outer(l, n - 1)
+    return r
+
+l = []
+r = outer(l, 216)
+print(len(l))
@@ -0,0 +1,24 @@
+def read(l, n, acc):
+    if n == 0:
+        return acc
+    x = l[n]
+    l[n] = x
+    r = read(l, n - 1, acc + x)
+    return r
+
+def middle(l, n, acc):
+    if n == 0:
+        return acc
+    r = read(l, 216, acc)
+    r = middle(l, n - 1, r)
+    return r
+
+def outer(l, n, acc):
+    if n == 0:
+        return acc
+    r = middle(l, 216, acc)
+    r = outer(l, n - 1, r)
+    return r
+
+l = list(range(217))
+print(outer(l, 216, 0))
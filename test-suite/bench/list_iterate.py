@@ -0,0 +1,23 @@
+def walk(l, base, n, acc):
+    if n == 0:
+        return acc
+    i = base + n
+    r = walk(l, base, n - 1, acc + l[i])
+    return r
+
+def middle(l, base, n, acc):
+    if n == 0:
+        return acc
+    r = walk(l, base + n * 216, 216, acc)
+    r = middle(l, base, n - 1, r)
+    return r
+
+def outer(l, n, acc):
+    if n == 0:
+        return acc
+    r = middle(l, n * 46656, 216, acc)
+    r = outer(l, n - 1, r)
+    return r
+
+l = list(range(10125000))
+print(outer(l, 216, 0))
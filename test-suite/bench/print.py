@@ -0,0 +1,6 @@
+a = 1
+b = 2.5
+c = "line"
+for i in range(125):
+    print(a, a, a)
+    print(c, a, b)
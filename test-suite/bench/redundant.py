@@ -0,0 +1,15 @@
+def scaled(n):
+    seconds = 60 * 60 * 24
+    debug = 0
+    total = 0
+    i = 0
+    while i < n:
+        if debug > 0:
+            print(i)
+        x = i * 3 + 1
+        y = i * 3 + 1
+        total = total + x - y + seconds
+        i = i + 1
+    return total
+
+print(scaled(2000000))
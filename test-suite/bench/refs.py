@@ -0,0 +1,6 @@
+s = "ab"
+f = len
+for i in range(80):
+    t = s
+    u = t
+    n = f(u)
@@ -0,0 +1,11 @@
+def walk(n, acc):
+    if n == 0:
+        return acc
+    r = walk(n - 1, acc + n * 3 - 1)
+    return r
+
+x = walk(900, 1)
+x = walk(900, x)
+x = walk(900, x)
+x = walk(900, x)
+print(x)
@@ -0,0 +1,8 @@
+a = "the quick brown fox jumps over the lazy dog"
+b = "the quick brown fox jumps over the lazy cat"
+n = "name"
+for i in range(100):
+    x = a == b
+    y = a < b
+    z = n == "name"
+    print(a)
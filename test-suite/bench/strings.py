@@ -0,0 +1,4 @@
+s = "ab"
+for i in range(120):
+    t = s + s
+    u = t + s
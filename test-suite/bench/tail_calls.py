@@ -0,0 +1,6 @@
+def total(n, acc):
+    if n == 0:
+        return acc
+    return total(n - 1, acc + n)
+
+print(total(1000000, 0))
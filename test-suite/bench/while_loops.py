@@ -0,0 +1,28 @@
+def int_sum(n):
+    i = 0
+    total = 0
+    while i < n:
+        total = total + i * 3
+        i = i + 1
+    return total
+
+def float_sum(n):
+    i = 1
+    x = 0.0
+    while i < n:
+        x = x + 1.0 / i
+        i = i + 1
+    return x
+
+def countdown(n):
+    i = n
+    even = 0
+    while i > 0:
+        if i < 1000:
+            even = even + 1
+        i = i - 1
+    return even
+
+print(int_sum(3000000))
+print(float_sum(3000000))
+print(countdown(3000000))
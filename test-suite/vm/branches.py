@@ -0,0 +1,63 @@
+def grade(score):
+    if score >= 90:
+        return "A"
+    elif score >= 80:
+        return "B"
+    elif score >= 70:
+        return "C"
+    else:
+        return "F"
+
+def sign(n):
+    if n < 0:
+        return "negative"
+    elif n == 0:
+        return "zero"
+    return "positive"
+
+def fizzbuzz(n):
+    if n % 15 == 0:
+        return "FizzBuzz"
+    elif n % 3 == 0:
+        return "Fizz"
+    elif n % 5 == 0:
+        return "Buzz"
+    else:
+        return str(n)
+
+print(grade(95))
+print(grade(85))
+print(grade(75))
+print(grade(10))
+print(sign(0 - 4))
+print(sign(0))
+print(sign(4))
+
+for i in range(1, 16):
+    print(fizzbuzz(i))
+
+x = 7
+if x < 5:
+    print("small")
+elif x < 10 and x % 2 == 1:
+    print("odd and medium")
+elif x < 10:
+    print("medium")
+
+counts = [0, 0, 0]
+for i in range(3000):
+    if i % 3 == 0:
+        counts[0] = counts[0] + 1
+    elif i % 3 == 1 or i > 100000:
+        counts[1] = counts[1] + 1
+    else:
+        counts[2] = counts[2] + 1
+print(counts)
+
+empty = ""
+if empty:
+    print("never")
+elif {}:
+    print("never either")
+else:
+    print("both falsy")
@@ -0,0 +1,50 @@
+def fill(n):
+    items = []
+    for i in range(n):
+        items.append(i * i)
+    return items
+
+squares = fill(6)
+print(squares)
+print(len(squares))
+print(squares[4])
+squares[0] = 100
+print(squares[0])
+print(squares.pop())
+print(squares.pop(0))
+print(squares)
+print(sum(squares))
+print(min(squares))
+print(max(squares))
+
+grid = [[1, 2], [3, 4]]
+grid[1][0] = 30
+print(grid[1][0] + grid[0][1])
+
+ages = {"ann": 31, "bob": 27}
+ages["cy"] = 40
+ages["bob"] = ages["bob"] + 1
+print(ages["bob"])
+print(len(ages))
+print(ages.get("ann"))
+print(ages.get("dan"))
+print(ages.get("dan", 0))
+print(ages.pop("cy"))
+print(ages.pop("cy", 7))
+print(len(ages))
+
+counts = {}
+for word in ["a", "b", "a", "c", "a"]:
+    counts[word] = counts.get(word, 0) + 1
+print(counts["a"])
+print(counts["c"])
+
+total = 0
+for k in ages:
+    total = total + ages[k]
+print(total)
+
+copied = list(range(3))
+copied.append("x")
+print(copied)
+print(dict(ages))
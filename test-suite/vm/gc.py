@@ -0,0 +1,60 @@
+def make_cycle(n):
+    node = {"n": n}
+    node["self"] = node
+    pair = [n]
+    pair.append(pair)
+    node["pair"] = pair
+    return node
+
+def churn(count):
+    for i in range(count):
+        garbage = [i]
+        garbage.append(garbage)
+        loop = {"i": i}
+        loop["loop"] = loop
+
+registry = []
+slots = [0, 0, 0, 0, 0, 0, 0, 0, 0, 0]
+table = {"first": 0}
+kept = []
+churn(3000)
+
+for i in range(20000):
+    following = i + 1
+    inner = [following]
+    entry = [i, inner]
+    registry.append(entry)
+    k = i % 10
+    slots[k] = {"value": i}
+    table["first"] = [i]
+    key = str(i % 50)
+    table[key] = [i, i]
+    if i % 100 == 0:
+        kept.append(make_cycle(i))
+    garbage = [i]
+    garbage.append(garbage)
+
+total = 0
+for entry in registry:
+    total = total + entry[0] + entry[1][0]
+print(len(registry))
+print(total)
+print(registry[12345][1][0])
+
+slot_sum = 0
+for slot in slots:
+    slot_sum = slot_sum + slot["value"]
+print(slot_sum)
+print(table["first"][0])
+print(table["7"][1])
+print(len(table))
+
+cycle_sum = 0
+for node in kept:
+    cycle_sum = cycle_sum + node["self"]["self"]["n"] + node["pair"][1][1][0]
+print(len(kept))
+print(cycle_sum)
+
+churn(5000)
+print(registry[19999][1][0])
+print(kept[199]["self"]["pair"][0])
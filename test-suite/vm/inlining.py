@@ -0,0 +1,35 @@
+def square(x):
+    return x * x
+
+def cube(x):
+    return x * x * x
+
+def scale(a, b):
+    return a * 10 + b
+
+def add(a, b):
+    return a + b
+
+def sum_squares(n):
+    total = 0
+    for i in range(n):
+        total = total + square(i)
+    return total
+
+print(sum_squares(5000))
+print(scale(4, 2))
+
+square = cube
+print(sum_squares(5000))
+
+def square(x):
+    return x + 1
+
+print(sum_squares(5000))
+
+results = []
+for i in range(4):
+    if i == 2:
+        scale = add
+    results.append(scale(i, 1))
+print(results)
@@ -0,0 +1,71 @@
+def power(base, exp):
+    result = 1
+    for i in range(exp):
+        result = result * base
+    return result
+
+def factorial(n):
+    result = 1
+    for i in range(2, n + 1):
+        result = result * i
+    return result
+
+big = 9223372036854775807
+print(big + 1)
+print(big + 1 - 1)
+print(big * 2 // 2)
+small = 0 - big - 1
+print(small)
+print(small - 1)
+print(small - 1 + 1)
+print(big * big)
+print(big * big // big)
+
+two_64 = power(2, 64)
+print(two_64)
+print(two_64 - two_64 + 5)
+print(power(3, 100))
+print(power(7, 77) - power(7, 77))
+
+f = factorial(300)
+g = factorial(280)
+print(f // g)
+print(f % 1000000007)
+print(f * g % 998244353)
+print(factorial(500) // factorial(499))
+huge = power(10, 400) + 12345
+other = power(10, 350) + 678
+product = huge * other
+print(product % power(10, 30))
+print(product // power(10, 720))
+same = product == huge * other
+print(same)
+same = product // huge == other
+print(same)
+
+n7 = 0 - 7
+n2 = 0 - 2
+print(7 % 2, 7 // 2)
+print(n7 % 2, n7 // 2)
+print(7 % n2, 7 // n2)
+print(n7 % n2, n7 // n2)
+print(0 % 5, 0 // n2)
+print(small % n7, small // n7)
+print(small // 1, small % 1)
+
+n25 = 0 - 2.5
+same = 7.5 % 2 == 1.5 and 7.5 // 2 == 3.0
+print(same)
+same = n7 % 2.5 == 0.5 and n7 // 2.5 == 0 - 3.0
+print(same)
+same = 7 % n25 == n25 + 2 and 7 // n25 == 0 - 3.0
+print(same)
+same = 5.0 % 5 == 0.0 and 0.0 // 3 == 0.0 and n7 // 2.0 == 0 - 4.0
+print(same)
+
+negbig = 0 - power(10, 30) - 7
+print(negbig % 10, negbig // 10)
+print(negbig % n7, negbig // n7)
+print(power(10, 30) % n7, power(10, 30) // n7)
+print(negbig // power(10, 25), negbig % power(10, 25))
+print(17 // power(10, 30), n7 // power(10, 30), n7 % power(10, 30))
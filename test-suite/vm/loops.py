@@ -0,0 +1,105 @@
+def first_over(items, limit):
+    for x in items:
+        if x > limit:
+            return x
+    return 0
+
+total = 0
+for i in range(10):
+    if i == 3:
+        continue
+    if i == 7:
+        break
+    total = total + i
+print(total)
+
+n = 0
+odd = 0
+while n < 20:
+    n = n + 1
+    if n % 2 == 0:
+        continue
+    if n > 15:
+        break
+    odd = odd + n
+print(odd)
+print(n)
+
+pairs = 0
+for a in range(5):
+    for b in range(5):
+        if b > a:
+            break
+        pairs = pairs + 1
+print(pairs)
+
+print(first_over([3, 8, 1, 12, 20], 10))
+print(first_over([1, 2], 10))
+
+empty = 0
+for x in []:
+    empty = empty + 1
+print(empty)
+
+a = 0
+b = 0
+c = 0
+i = 0
+while i < 50:
+    i = i + 1
+    if i == 5:
+        continue
+    a = a + b % 7 + i
+    b = b + c % 7 + i
+    c = c + a % 7 + i
+    a = a + b % 7 + i
+    b = b + c % 7 + i
+    c = c + a % 7 + i
+    a = a + b % 7 + i
+    b = b + c % 7 + i
+    c = c + a % 7 + i
+    a = a + b % 7 + i
+    b = b + c % 7 + i
+    c = c + a % 7 + i
+    a = a + b % 7 + i
+    b = b + c % 7 + i
+    c = c + a % 7 + i
+    a = a + b % 7 + i
+    b = b + c % 7 + i
+    c = c + a % 7 + i
+    a = a + b % 7 + i
+    b = b + c % 7 + i
+    c = c + a % 7 + i
+    a = a + b % 7 + i
+    b = b + c % 7 + i
+    c = c + a % 7 + i
+    a = a + b % 7 + i
+    b = b + c % 7 + i
+    c = c + a % 7 + i
+    a = a + b % 7 + i
+    b = b + c % 7 + i
+    c = c + a % 7 + i
+    a = a + b % 7 + i
+    b = b + c % 7 + i
+    c = c + a % 7 + i
+    a = a + b % 7 + i
+    b = b + c % 7 + i
+    c = c + a % 7 + i
+    a = a + b % 7 + i
+    b = b + c % 7 + i
+    c = c + a % 7 + i
+    a = a + b % 7 + i
+    b = b + c % 7 + i
+    c = c + a % 7 + i
+    a = a + b % 7 + i
+    b = b + c % 7 + i
+    c = c + a % 7 + i
+    a = a + b % 7 + i
+    b = b + c % 7 + i
+    c = c + a % 7 + i
+    if i == 40:
+        break
+print(a)
+print(b)
+print(c)
+print(i)
@@ -0,0 +1,65 @@
+def either(a, b):
+    return a or b
+
+def both(a, b):
+    return a and b
+
+def pick(a, b, c):
+    return a and b or c
+
+def check(a, b, c):
+    if a or b and c:
+        return "taken"
+    return "skipped"
+
+def guard(a, b, c):
+    while a and b or c:
+        return "looped"
+    return "done"
+
+print(either(3, 4))
+print(either(0, 4))
+print(either("x", "y"))
+print(either("", "y"))
+print(both(3, 4))
+print(both(0, 4))
+print(both([], 4))
+print(pick(1, 2, 3))
+print(pick(0, 2, 3))
+print(pick(1, 0, 3))
+print(check(1, 0, 0))
+print(check(0, 1, 1))
+print(check(0, 1, 0))
+print(check(0, 0, 1))
+print(guard(1, 1, 0))
+print(guard(1, 0, 0))
+print(guard(0, 0, 1))
+
+picked = "x" or "y"
+print(picked)
+picked = "" and "y"
+print(picked)
+picked = 0 or "" or [] or "last"
+print(picked)
+picked = 1 and 2 and 3
+print(picked)
+
+total = 0
+i = 0
+while i < 1000:
+    total = total + (i % 3 and i % 5 or 1)
+    i = i + 1
+print(total)
+
+n = 0
+for k in range(500):
+    if k % 2 == 0 and k % 3 == 0 or k == 7:
+        n = n + 1
+print(n)
+
+items = {"x": 1}
+drained = 0
+while items:
+    items.pop("x", 0)
+    drained = drained + 1
+print(drained)
@@ -0,0 +1,39 @@
+def total(n, acc):
+    if n == 0:
+        return acc
+    return total(n - 1, acc + n)
+
+def count_down(n):
+    if n > 0:
+        return count_down(n - 1)
+    else:
+        return "landed"
+
+def is_even(n):
+    if n == 0:
+        return True
+    return is_odd(n - 1)
+
+def is_odd(n):
+    if n == 0:
+        return False
+    return is_even(n - 1)
+
+def gcd(a, b):
+    if b == 0:
+        return a
+    return gcd(b, a % b)
+
+def collect(n, items):
+    if n == 0:
+        return items
+    items.append(n)
+    return collect(n - 1, items)
+
+print(total(1000000, 0))
+print(total(0, 5))
+print(count_down(2000000))
+print(is_even(1000001))
+print(is_odd(1000001))
+print(gcd(1071, 462))
+print(len(collect(500000, [])))
@@ -0,0 +1,49 @@
+def truth(x):
+    if x:
+        return "yes"
+    else:
+        return "no"
+
+def nothing():
+    x = 0
+
+print(truth({}))
+print(truth({"k": 0}))
+print(truth(""))
+print(truth("0"))
+print(truth([]))
+print(truth([0]))
+print(truth(0))
+print(truth(3))
+print(truth(0.0))
+print(truth(nothing()))
+print(truth(False))
+
+d = {}
+d["a"] = 1
+d.pop("a")
+print(truth(d))
+
+s = ""
+picked = s or "fallback"
+print(picked)
+picked = {} or "empty dict"
+print(picked)
+picked = "text" and {}
+print(picked)
+picked = "x" or "y"
+print(picked)
+picked = {"k": 0} or "unused"
+print(picked)
+picked = "" and "unused"
+print(picked)
+picked = {} and "unused"
+print(picked)
+
+items = {"x": 1, "y": 2}
+drained = 0
+while items:
+    items.pop("x", 0)
+    items.pop("y", 0)
+    drained = drained + 1
+print(drained)